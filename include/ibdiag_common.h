@@ -42,9 +42,22 @@
 #include <endian.h>
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include <infiniband/mad.h>
+#define IBMAD_FAST_FIELDS
+#include <infiniband/mad_fields.h>
 #include <infiniband/iba/ib_types.h>
 #include <infiniband/ibnetdisc.h>
+#include <complib/cl_nodenamemap.h>
+
+/* --format: how tools which support it write their per-port records */
+enum ibdiag_format {
+	IBDIAG_FORMAT_TEXT,
+	IBDIAG_FORMAT_NDJSON,
+	IBDIAG_FORMAT_CSV,
+	IBDIAG_FORMAT_BINARY,
+};
 
 extern int ibverbose;
 extern char *ibd_ca;
@@ -57,6 +70,11 @@ extern uint64_t ibd_mkey;
 extern uint64_t ibd_sakey;
 extern int show_keys;
 extern char *ibd_nd_format;
+extern int ibd_format_supported;
+extern enum ibdiag_format ibd_format;
+extern char *ibd_resolve_cache;
+extern int ibd_daemon_supported;
+extern char *ibd_daemon;
 
 /*========================================================*/
 /*                External interface                      */
@@ -162,6 +180,133 @@ int vsnprint_field(char *buf, size_t n, enum MAD_FIELDS f, int spacing,
 int snprint_field(char *buf, size_t n, enum MAD_FIELDS f, int spacing,
 		  const char *format, ...);
 void dump_portinfo(void *pi, int tabs);
+ibnd_fabric_t *ibdiag_discover_fabric(char *ca_name, int ca_port,
+				      struct ibnd_config *cfg,
+				      const char *hint_file);
+void ibdiag_print_changes(FILE * f, ibnd_change_t * changes);
+
+/**
+ * Buffered output for the large fabric dumps: text is collected in one
+ * large buffer, which is written to the stream whenever it fills, and
+ * numbers are formatted without going through printf.  Other output to
+ * the same stream must be preceded by ibdiag_out_flush().
+ */
+#define IBDIAG_OUT_BUFSZ (1 << 20)
+
+struct ibdiag_out {
+	FILE *f;
+	char *buf;
+	size_t len;
+	size_t size;
+	int err;
+};
+
+void ibdiag_out_init(struct ibdiag_out *o, FILE *f);
+int ibdiag_out_flush(struct ibdiag_out *o);
+int ibdiag_out_close(struct ibdiag_out *o);
+void ibdiag_out_mem(struct ibdiag_out *o, const char *s, size_t n);
+/* as %*s, %*u, %*d and %0*x */
+void ibdiag_out_pad(struct ibdiag_out *o, const char *s, int width);
+void ibdiag_out_uint(struct ibdiag_out *o, uint64_t val, int width);
+void ibdiag_out_int(struct ibdiag_out *o, int64_t val, int width);
+void ibdiag_out_hex(struct ibdiag_out *o, uint64_t val, int width);
+void ibdiag_out_printf(struct ibdiag_out *o, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static inline void ibdiag_out_str(struct ibdiag_out *o, const char *s)
+{
+	ibdiag_out_mem(o, s, strlen(s));
+}
+
+static inline void ibdiag_out_char(struct ibdiag_out *o, char c)
+{
+	if (o->len < o->size)
+		o->buf[o->len++] = c;
+	else
+		ibdiag_out_mem(o, &c, 1);
+}
+
+/**
+ * Records for --format: one per port, written through a struct ibdiag_out
+ * with the raw values and no padding.  The fields of a record are given
+ * once, as an array ended by a NULL name, and their values are then added
+ * in that order.
+ *
+ * ndjson  one JSON object per line; GUIDs are "0x..." strings
+ * csv     a header line with the field names, then one line per record
+ * binary  "IBDR", u8 version 1, u8 0, le16 field count and, per field,
+ *         u8 type (IBDIAG_FIELD_*), u8 name length and the name; then per
+ *         record a le32 length and the values: le64 for numbers, le16
+ *         length and the bytes for strings
+ */
+enum ibdiag_field_type {
+	IBDIAG_FIELD_UINT = 1,
+	IBDIAG_FIELD_GUID = 2,
+	IBDIAG_FIELD_STR = 3,
+};
+
+struct ibdiag_field {
+	const char *name;
+	enum ibdiag_field_type type;
+};
+
+#define IBDIAG_REC_MAX 4096
+
+struct ibdiag_rec {
+	struct ibdiag_out *out;
+	enum ibdiag_format format;
+	const struct ibdiag_field *fields;
+	unsigned nfields;
+	unsigned field;		/* next field of the current record */
+	int header_done;
+	size_t len;		/* binary: the record is built in buf */
+	uint8_t buf[IBDIAG_REC_MAX];
+};
+
+void ibdiag_rec_init(struct ibdiag_rec *r, struct ibdiag_out *o,
+		     const struct ibdiag_field *fields);
+void ibdiag_rec_begin(struct ibdiag_rec *r);
+void ibdiag_rec_uint(struct ibdiag_rec *r, uint64_t val);
+void ibdiag_rec_str(struct ibdiag_rec *r, const char *s);
+void ibdiag_rec_end(struct ibdiag_rec *r);
+
+/* the port counters as 64 bit values: the error counters from pce if
+ * ext_errors is set, else from pc, and the data counters from pce if
+ * present, else from pc.  Counters which were not read are 0. */
+#define IBDIAG_COUNTER_FIELDS \
+	{"symbol_errors", IBDIAG_FIELD_UINT}, \
+	{"link_recovers", IBDIAG_FIELD_UINT}, \
+	{"link_downed", IBDIAG_FIELD_UINT}, \
+	{"rcv_errors", IBDIAG_FIELD_UINT}, \
+	{"rcv_remote_phys_errors", IBDIAG_FIELD_UINT}, \
+	{"rcv_switch_relay_errors", IBDIAG_FIELD_UINT}, \
+	{"xmt_discards", IBDIAG_FIELD_UINT}, \
+	{"xmt_constraint_errors", IBDIAG_FIELD_UINT}, \
+	{"rcv_constraint_errors", IBDIAG_FIELD_UINT}, \
+	{"link_integrity_errors", IBDIAG_FIELD_UINT}, \
+	{"excessive_buffer_overrun_errors", IBDIAG_FIELD_UINT}, \
+	{"vl15_dropped", IBDIAG_FIELD_UINT}, \
+	{"xmt_wait", IBDIAG_FIELD_UINT}, \
+	{"qp1_dropped", IBDIAG_FIELD_UINT}, \
+	{"xmt_data", IBDIAG_FIELD_UINT}, \
+	{"rcv_data", IBDIAG_FIELD_UINT}, \
+	{"xmt_pkts", IBDIAG_FIELD_UINT}, \
+	{"rcv_pkts", IBDIAG_FIELD_UINT}, \
+	{"xmt_upkts", IBDIAG_FIELD_UINT}, \
+	{"rcv_upkts", IBDIAG_FIELD_UINT}, \
+	{"xmt_mpkts", IBDIAG_FIELD_UINT}, \
+	{"rcv_mpkts", IBDIAG_FIELD_UINT}
+
+void ibdiag_rec_counters(struct ibdiag_rec *r,
+			 const struct ib_perfcounters_decoded *pc,
+			 const struct ib_perfcounters_ext_decoded *pce,
+			 int ext_errors);
+
+/* remap_node_name() with the result kept for the rest of the run; the
+ * returned name must not be freed.  Not thread safe. */
+const char *ibdiag_remap_node_name(nn_map_t * map, uint64_t guid,
+				   const char *nodedesc);
+void ibdiag_free_node_names(void);
 
 /**
  * Some common command line parsing
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#ifndef _IBDIAG_DAEMON_H_
+#define _IBDIAG_DAEMON_H_
+
+#include <stdint.h>
+#include <infiniband/ibnetdisc.h>
+
+/* Protocol spoken between ibdiagd and the tools run with --daemon.
+ *
+ * One request per connection: the client writes a struct ibdiagd_req and
+ * the daemon answers with a struct ibdiagd_reply followed by length bytes
+ * of payload, then closes the socket.  For IBDIAGD_OP_FABRIC the payload
+ * is the fabric as last swept, in the version 2 ibnetdiscover cache
+ * format (ibnd_load_fabric_buf).  Both ends are on the same host, so the
+ * headers are in host byte order.
+ */
+
+#define IBDIAGD_SOCKET "/var/run/ibdiagd.sock"
+#define IBDIAGD_MAGIC 0x49424444	/* "IBDD" */
+#define IBDIAGD_VERSION 1
+
+enum ibdiagd_op {
+	IBDIAGD_OP_FABRIC = 1,
+};
+
+enum ibdiagd_status {
+	IBDIAGD_OK,
+	IBDIAGD_BAD_REQUEST,
+	IBDIAGD_NO_FABRIC,
+};
+
+struct ibdiagd_req {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t op;
+	uint32_t reserved;
+};
+
+struct ibdiagd_reply {
+	uint32_t magic;
+	uint32_t status;
+	uint64_t generation;	/* bumped by every sweep which saw a change */
+	uint64_t sweep_time;	/* end of the last sweep, seconds since epoch */
+	uint32_t reserved;
+	uint32_t length;
+};
+
+int ibdiagd_read_full(int fd, void *buf, size_t length);
+int ibdiagd_write_full(int fd, const void *buf, size_t length);
+
+/* fetch the fabric held by the daemon listening on path; NULL on error */
+ibnd_fabric_t *ibdiagd_fetch_fabric(const char *path,
+				    struct ibdiagd_reply *reply);
+
+#endif /* _IBDIAG_DAEMON_H_ */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#ifndef _IBDIAG_PMA_H_
+#define _IBDIAG_PMA_H_
+
+#include <infiniband/mad.h>
+#include <complib/cl_qmap.h>
+
+/* Asynchronous PerfMgt (PMA) queries.
+ *
+ * Keeps up to "window" GMPs in flight across the fabric, at most
+ * "max_per_lid" of them to any one destination, and matches responses to
+ * requests by TID.  umad completes every send, with ETIMEDOUT if no
+ * response arrived in time; the engine then sends the query again, up to
+ * "retries" times, before failing it.
+ */
+#define DEFAULT_PMA_WINDOW 64
+#define DEFAULT_PMAS_PER_LID 2
+
+struct pma_query;
+
+/* status is 0 on success, ETIMEDOUT or EIO; data is the attribute data
+ * of the response (IB_PC_DATA_SZ bytes) or NULL on error. */
+typedef void (*pma_comp_cb_t) (struct pma_query * q, uint8_t * data,
+			       int status);
+
+struct pma_query {
+	cl_map_item_t on_wire;	/* keep first */
+	struct pma_query *qnext;
+	ib_portid_t portid;
+	ib_rpc_t rpc;
+	uint8_t payload[IB_PC_DATA_SZ];
+	int portnum;
+	unsigned attempts;
+	int redirects;
+	pma_comp_cb_t cb;
+	void *cb_data;
+};
+
+struct pma_engine {
+	struct ibmad_transport *tp;
+	int fd, agent;
+	unsigned window;
+	unsigned max_per_lid;
+	unsigned timeout_ms;
+	unsigned retries;
+	cl_qmap_t on_wire;
+	struct pma_query *queue_head;
+	struct pma_query *queue_tail;
+	uint8_t *lid_load;	/* queries on the wire per destination LID */
+	unsigned total;
+	unsigned failures;
+};
+
+/* NOTE: umad_init must be called prior to pma_engine_open */
+int pma_engine_open(struct pma_engine *engine, char *ca, int ca_port,
+		    unsigned window, unsigned max_per_lid, unsigned timeout_ms);
+void pma_engine_close(struct pma_engine *engine);
+
+/* same attribute layout as pma_query_via() and performance_reset_via() */
+int pma_query_async(struct pma_engine *engine, ib_portid_t * portid,
+		    int portnum, unsigned attr_id, pma_comp_cb_t cb,
+		    void *cb_data);
+int pma_reset_async(struct pma_engine *engine, ib_portid_t * portid,
+		    int portnum, unsigned mask, unsigned attr_id,
+		    pma_comp_cb_t cb, void *cb_data);
+
+/* run until every query issued, including those issued from completion
+ * callbacks, has completed */
+int pma_engine_run(struct pma_engine *engine);
+
+#endif /* _IBDIAG_PMA_H_ */
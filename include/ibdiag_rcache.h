@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#ifndef _IBDIAG_RCACHE_H_
+#define _IBDIAG_RCACHE_H_
+
+#include <stdint.h>
+#include <infiniband/mad.h>
+
+/* Address resolution cache.
+ *
+ * Keeps the LID (and SL) found for a destination GID by the SA in a file
+ * shared by all tools, so that repeated invocations addressing ports by
+ * GUID or GID do not each have to query the SA.  The file is mapped and
+ * holds an open addressed table keyed by GID.  It is only valid for the
+ * local port it was filled from and the SM which assigned the LIDs: when
+ * the port GUID, subnet prefix, local LID/LMC or SM LID/SL reported by
+ * umad differ from those recorded in the file, the table is emptied.
+ * This is checked again on every lookup and store, as a tool on another
+ * port may empty the file meanwhile.  The SM can also move a remote port
+ * without any of these changing, so entries expire after a few minutes.
+ *
+ * The cache is best effort; a file which cannot be opened or mapped only
+ * disables it.
+ */
+
+/* return 0 and fill portid->lid (and portid->sl when want_sl is set) if
+ * gid is in the cache */
+int rcache_lookup(const char *file, char *ca_name, uint8_t ca_port,
+		  ibmad_gid_t gid, ib_portid_t * portid, int want_sl);
+/* sl_valid is 0 when portid->sl is not the SL from the local port */
+void rcache_store(ibmad_gid_t gid, const ib_portid_t * portid, int sl_valid);
+
+#endif /* _IBDIAG_RCACHE_H_ */
@@ -47,9 +47,12 @@
  * the saquery tool and provides it to other utilities.
  */
 struct sa_handle {
+	struct ibmad_transport *tp;
 	int fd, agent;
 	ib_portid_t dport;
 	struct ibmad_port *srcport;
+	void *umad;		/* receive buffer of sa_query_cursor() */
+	int umad_size;
 };
 
 struct sa_query_result {
@@ -67,6 +70,28 @@ int sa_query(struct sa_handle *h, uint8_t method,
 	     void *data, size_t datasz, struct sa_query_result *result);
 void sa_free_result_mad(struct sa_query_result *result);
 void *sa_get_query_rec(void *mad, unsigned i);
+
+/* Records of a response, in the receive buffer of the handle: there is no
+ * copy of the table to free, and the buffer is reused, grown as needed, by
+ * the next query.  The records are valid until then. */
+struct sa_cursor {
+	uint32_t status;
+	unsigned left;		/* records not yet returned */
+	size_t recsz;
+	uint8_t *next;
+};
+
+int sa_query_cursor(struct sa_handle *h, uint8_t method,
+		    uint16_t attr, uint32_t mod, uint64_t comp_mask,
+		    uint64_t sm_key, void *data, size_t datasz,
+		    struct sa_cursor *c);
+void *sa_cursor_next(struct sa_cursor *c);
+#define IB_MLIDS_IN_BLOCK	(IB_SMP_DATA_SIZE/2)
+
+/* where an LFTRecord (or MFTRecord when multicast) goes in a table of
+ * nblocks * chunks SMP blocks from startblock; -1 if outside it */
+int sa_ft_record_index(void *rec, int multicast, unsigned startblock,
+		       unsigned nblocks, unsigned chunks, void **data);
 void sa_report_err(int status);
 
 /* Macros for setting query values and ComponentMasks */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#ifndef _IBDIAG_SIM_H_
+#define _IBDIAG_SIM_H_
+
+#include <stdint.h>
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+/* Simulated fabric.
+ *
+ * Answers SMP, PerfMgt and SA MADs from an in-memory model of a subnet so
+ * that discovery and counter sweeps can be run and timed without
+ * hardware.  The model is described by a spec string of comma separated
+ * key=value pairs:
+ *
+ *   fattree=S:L:H    two level fat tree; S spines, L leaves, H hosts/leaf
+ *   fattree=K        three level K-ary fat tree (K^3/4 hosts)
+ *   dragonfly=G:A:H  G groups of A routers, H hosts/router
+ *   torus=X:Y:Z:H    3D torus of switches, H hosts/switch
+ *   cache=FILE       topology from an ibnetdiscover cache file
+ *   latency=US       MAD round trip time (default 20)
+ *   loss=PCT         percentage of MADs dropped (default 0)
+ *   sma_rate=N       MADs per second each node can answer (default 0, no limit)
+ *   traffic=MBPS     data counter growth per port (default 0)
+ *   errors=PERMILLE  ports reporting error counters (default 0)
+ *   seed=N           seed for loss and error placement (default 1)
+ *
+ * or by "unix=PATH" to use a fabric served by ibdiagsim over a UNIX socket.
+ */
+#define IBDIAG_SIM_ENV "IBDIAG_SIM"
+
+struct sim_fabric;
+
+struct sim_fabric *sim_fabric_create(const char *spec);
+void sim_fabric_destroy(struct sim_fabric *f);
+
+/* each handle is an independent umad port with its own receive queue */
+int sim_open(struct sim_fabric *f);
+void sim_close(struct sim_fabric *f, int h);
+void sim_get_port(struct sim_fabric *f, umad_port_t *port);
+
+/* queue the response (or timeout) to a send; umad's agent_id, timeout_ms
+ * and retries must be filled in */
+int sim_send(struct sim_fabric *f, int h, void *umad, int length);
+
+/* due time (see sim_now) and MAD length of the next queued receive */
+int sim_next(struct sim_fabric *f, int h, uint64_t *due, int *length);
+/* dequeue it into umad, which must hold umad_size() + length bytes */
+int sim_take(struct sim_fabric *f, int h, void *umad);
+
+uint64_t sim_now(void);
+
+/* ibdiagsim socket protocol: a sim_frame header followed by length bytes.
+ * GETPORT is answered with a umad_port_t, SEND carries a umad and MAD,
+ * RECV returns one when it is due. */
+enum {
+	SIM_FRAME_GETPORT = 1,
+	SIM_FRAME_SEND,
+	SIM_FRAME_RECV,
+};
+
+#define SIM_FRAME_MAX (16 << 20)
+
+struct sim_frame {
+	uint32_t type;
+	uint32_t length;
+};
+
+int sim_write_frame(int fd, uint32_t type, const void *buf, uint32_t length);
+int sim_read_frame(int fd, uint32_t *type, void **buf, uint32_t *length);
+
+/* transport for mad_set_transport() */
+struct ibmad_transport *sim_transport_create(const char *spec);
+
+/* install a simulated transport if IBDIAG_SIM is set */
+int ibdiag_sim_setup(void);
+
+#endif /* _IBDIAG_SIM_H_ */
@@ -1406,6 +1406,36 @@ enum MAD_NODE_TYPE {
 	IB_NODE_MAX = NODE_RNIC
 };
 
+/*
+ * MAD transport.  Every umad call made by libibmad and libibnetdisc goes
+ * through one of these; the default passes straight through to libibumad.
+ * Each function takes and returns what its libibumad namesake does, with
+ * the transport itself as an additional first argument.
+ */
+struct umad_port;
+
+struct ibmad_transport {
+	const char *name;
+	void *priv;
+	int (*open_port)(struct ibmad_transport *tp, const char *ca_name,
+			 int portnum);
+	int (*close_port)(struct ibmad_transport *tp, int fd);
+	int (*get_port)(struct ibmad_transport *tp, const char *ca_name,
+			int portnum, struct umad_port *port);
+	int (*release_port)(struct ibmad_transport *tp, struct umad_port *port);
+	int (*register_agent)(struct ibmad_transport *tp, int fd,
+			      int mgmt_class, int mgmt_version,
+			      uint8_t rmpp_version, long method_mask[]);
+	int (*register_oui)(struct ibmad_transport *tp, int fd, int mgmt_class,
+			    uint8_t rmpp_version, uint8_t oui[3],
+			    long method_mask[]);
+	int (*unregister_agent)(struct ibmad_transport *tp, int fd, int agentid);
+	int (*send)(struct ibmad_transport *tp, int fd, int agentid, void *umad,
+		    int length, int timeout_ms, int retries);
+	int (*recv)(struct ibmad_transport *tp, int fd, void *umad,
+		    int *length, int timeout_ms);
+};
+
 /******************************************************************************/
 
 /* portid.c */
@@ -1425,6 +1455,120 @@ static inline int ib_portid_set(ib_portid_t * portid, int lid, int qp, int qkey)
 	return 0;
 }
 
+/*
+ * Whole attributes decoded in one pass, see mad_decode_portinfo() and
+ * friends.  Members are in host order and as wide as the field needs.
+ */
+struct ib_portinfo_decoded {
+	uint64_t mkey;
+	uint64_t gid_prefix;
+	uint16_t lid;
+	uint16_t sm_lid;
+	uint32_t capmask;
+	uint16_t diag_code;
+	uint16_t mkey_lease_period;
+	uint8_t local_port;
+	uint8_t link_width_enabled;
+	uint8_t link_width_supported;
+	uint8_t link_width_active;
+	uint8_t link_speed_supported;
+	uint8_t state;
+	uint8_t phys_state;
+	uint8_t link_down_def_state;
+	uint8_t mkey_prot_bits;
+	uint8_t lmc;
+	uint8_t link_speed_active;
+	uint8_t link_speed_enabled;
+	uint8_t neighbor_mtu;
+	uint8_t smsl;
+	uint8_t vl_cap;
+	uint8_t init_type;
+	uint8_t vl_high_limit;
+	uint8_t vl_arb_high_cap;
+	uint8_t vl_arb_low_cap;
+	uint8_t init_type_reply;
+	uint8_t mtu_cap;
+	uint8_t vl_stall_count;
+	uint8_t hoq_life;
+	uint8_t oper_vls;
+	uint8_t part_enf_inb;
+	uint8_t part_enf_outb;
+	uint8_t filter_raw_inb;
+	uint8_t filter_raw_outb;
+	uint16_t mkey_violations;
+	uint16_t pkey_violations;
+	uint16_t qkey_violations;
+	uint8_t guid_cap;
+	uint8_t client_reregister;
+	uint8_t mcast_pkey_trap_supr;
+	uint8_t subnet_timeout;
+	uint8_t resp_time_val;
+	uint8_t local_phys_err;
+	uint8_t overrun_err;
+	uint16_t max_credit_hint;
+	uint32_t link_round_trip;
+	uint16_t capmask2;
+	uint8_t link_speed_ext_active;
+	uint8_t link_speed_ext_supported;
+	uint8_t link_speed_ext_enabled;
+};
+
+struct ib_perfcounters_decoded {
+	uint8_t port_select;
+	uint16_t counter_select;
+	uint16_t symbol_errors;
+	uint8_t link_recovers;
+	uint8_t link_downed;
+	uint16_t rcv_errors;
+	uint16_t rcv_remote_phys_errors;
+	uint16_t rcv_switch_relay_errors;
+	uint16_t xmt_discards;
+	uint8_t xmt_constraint_errors;
+	uint8_t rcv_constraint_errors;
+	uint8_t counter_select2;
+	uint8_t link_integrity_errors;
+	uint8_t excessive_buffer_overrun_errors;
+	uint16_t vl15_dropped;
+	uint32_t xmt_data;
+	uint32_t rcv_data;
+	uint32_t xmt_pkts;
+	uint32_t rcv_pkts;
+	uint32_t xmt_wait;
+};
+
+/*
+ * The counters from symbol_errors on are only valid when the PMA sets
+ * IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP, the unicast and multicast ones with
+ * IB_PM_EXT_WIDTH_SUPPORTED.
+ */
+struct ib_perfcounters_ext_decoded {
+	uint8_t port_select;
+	uint16_t counter_select;
+	uint32_t counter_select2;
+	uint64_t xmt_data;
+	uint64_t rcv_data;
+	uint64_t xmt_pkts;
+	uint64_t rcv_pkts;
+	uint64_t xmt_upkts;
+	uint64_t rcv_upkts;
+	uint64_t xmt_mpkts;
+	uint64_t rcv_mpkts;
+	uint64_t symbol_errors;
+	uint64_t link_recovers;
+	uint64_t link_downed;
+	uint64_t rcv_errors;
+	uint64_t rcv_remote_phys_errors;
+	uint64_t rcv_switch_relay_errors;
+	uint64_t xmt_discards;
+	uint64_t xmt_constraint_errors;
+	uint64_t rcv_constraint_errors;
+	uint64_t link_integrity_errors;
+	uint64_t excessive_buffer_overrun_errors;
+	uint64_t vl15_dropped;
+	uint64_t xmt_wait;
+	uint64_t qp1_dropped;
+};
+
 /* fields.c */
 MAD_EXPORT uint32_t mad_get_field(void *buf, int base_offs,
 				  enum MAD_FIELDS field);
@@ -1450,6 +1594,14 @@ MAD_EXPORT char *mad_dump_field(enum MAD_FIELDS field, char *buf, int bufsz,
 MAD_EXPORT char *mad_dump_val(enum MAD_FIELDS field, char *buf, int bufsz,
 			      void *val);
 MAD_EXPORT const char *mad_field_name(enum MAD_FIELDS field);
+/* buf is the attribute data, as for mad_decode_field() */
+MAD_EXPORT void mad_decode_portinfo(void *buf,
+				    struct ib_portinfo_decoded *pi);
+MAD_EXPORT void mad_decode_perfcounters(void *buf,
+					struct ib_perfcounters_decoded *pc);
+MAD_EXPORT void mad_decode_perfcounters_ext(void *buf,
+					    struct ib_perfcounters_ext_decoded
+					    *pc);
 
 /* mad.c */
 MAD_EXPORT void *mad_encode(void *buf, ib_rpc_t * rpc, ib_dr_path_t * drpath,
@@ -1503,6 +1655,11 @@ MAD_EXPORT int mad_register_server_via(int mgmt, uint8_t rmpp_version,
 				       struct ibmad_port *srcport);
 MAD_EXPORT int mad_class_agent(int mgmt) DEPRECATED;
 
+/* transport.c */
+MAD_EXPORT struct ibmad_transport *mad_get_transport(void);
+MAD_EXPORT void mad_set_transport(struct ibmad_transport *tp);
+MAD_EXPORT struct ibmad_transport *mad_rpc_transport(struct ibmad_port *srcport);
+
 /* serv.c */
 MAD_EXPORT int mad_send(ib_rpc_t * rpc, ib_portid_t * dport,
 			ib_rmpp_hdr_t * rmpp, void *data) DEPRECATED;
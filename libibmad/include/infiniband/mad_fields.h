@@ -0,0 +1,742 @@
+/*
+ * Generated by gen_fields from the libibmad field table; do not edit.
+ */
+
+#ifndef _MAD_FIELDS_H_
+#define _MAD_FIELDS_H_
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <infiniband/mad.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Each field within one 32 bit word is that big endian word at byte
+ * offset word, shifted right by shift, in bits bits.  Fields with bits 0
+ * (wider, or across words) are left to the library.
+ */
+struct mad_field_layout {
+	uint16_t word;
+	uint8_t shift;
+	uint8_t bits;
+};
+
+static const struct mad_field_layout mad_field_layouts[IB_FIELD_LAST_ + 1] = {
+	{0, 0, 0},	/* 0  */
+	{0, 0, 0},	/* 1 GidPrefix */
+	{0, 0, 0},	/* 2 GidGuid */
+	{0, 0, 7},	/* 3 MadMethod */
+	{0, 7, 1},	/* 4 MadIsResponse */
+	{0, 8, 8},	/* 5 MadClassVersion */
+	{0, 16, 8},	/* 6 MadMgmtClass */
+	{0, 24, 8},	/* 7 MadBaseVersion */
+	{4, 16, 16},	/* 8 MadStatus */
+	{4, 0, 8},	/* 9 DrSmpHopCnt */
+	{4, 8, 8},	/* 10 DrSmpHopPtr */
+	{4, 16, 15},	/* 11 DrSmpStatus */
+	{4, 31, 1},	/* 12 DrSmpDirection */
+	{0, 0, 0},	/* 13 MadTRID */
+	{16, 16, 16},	/* 14 MadAttr */
+	{20, 0, 32},	/* 15 MadModifier */
+	{0, 0, 0},	/* 16 MadMkey */
+	{32, 0, 16},	/* 17 DrSmpDLID */
+	{32, 16, 16},	/* 18 DrSmpSLID */
+	{0, 0, 0},	/* 19 SaSMkey */
+	{44, 16, 16},	/* 20 SaAttrOffs */
+	{0, 0, 0},	/* 21 SaCompMask */
+	{0, 0, 0},	/* 22 SaData */
+	{0, 0, 0},	/* 23  */
+	{0, 0, 0},	/* 24 GsData */
+	{0, 0, 0},	/* 25 DrSmpPath */
+	{0, 0, 0},	/* 26 DrSmpRetPath */
+	{0, 0, 0},	/* 27 Mkey */
+	{0, 0, 0},	/* 28 GidPrefix */
+	{16, 16, 16},	/* 29 Lid */
+	{16, 0, 16},	/* 30 SMLid */
+	{20, 0, 32},	/* 31 CapMask */
+	{24, 16, 16},	/* 32 DiagCode */
+	{24, 0, 16},	/* 33 MkeyLeasePeriod */
+	{28, 24, 8},	/* 34 LocalPort */
+	{28, 16, 8},	/* 35 LinkWidthEnabled */
+	{28, 8, 8},	/* 36 LinkWidthSupported */
+	{28, 0, 8},	/* 37 LinkWidthActive */
+	{32, 28, 4},	/* 38 LinkSpeedSupported */
+	{32, 24, 4},	/* 39 LinkState */
+	{32, 20, 4},	/* 40 PhysLinkState */
+	{32, 16, 4},	/* 41 LinkDownDefState */
+	{32, 14, 2},	/* 42 ProtectBits */
+	{32, 8, 3},	/* 43 LMC */
+	{32, 4, 4},	/* 44 LinkSpeedActive */
+	{32, 0, 4},	/* 45 LinkSpeedEnabled */
+	{36, 28, 4},	/* 46 NeighborMTU */
+	{36, 24, 4},	/* 47 SMSL */
+	{36, 20, 4},	/* 48 VLCap */
+	{36, 16, 4},	/* 49 InitType */
+	{36, 8, 8},	/* 50 VLHighLimit */
+	{36, 0, 8},	/* 51 VLArbHighCap */
+	{40, 24, 8},	/* 52 VLArbLowCap */
+	{40, 20, 4},	/* 53 InitReply */
+	{40, 16, 4},	/* 54 MtuCap */
+	{40, 13, 3},	/* 55 VLStallCount */
+	{40, 8, 5},	/* 56 HoqLife */
+	{40, 4, 4},	/* 57 OperVLs */
+	{40, 3, 1},	/* 58 PartEnforceInb */
+	{40, 2, 1},	/* 59 PartEnforceOutb */
+	{40, 1, 1},	/* 60 FilterRawInb */
+	{40, 0, 1},	/* 61 FilterRawOutb */
+	{44, 16, 16},	/* 62 MkeyViolations */
+	{44, 0, 16},	/* 63 PkeyViolations */
+	{48, 16, 16},	/* 64 QkeyViolations */
+	{48, 8, 8},	/* 65 GuidCap */
+	{48, 7, 1},	/* 66 ClientReregister */
+	{48, 6, 1},	/* 67 McastPkeyTrapSuppressionEnabled */
+	{48, 0, 5},	/* 68 SubnetTimeout */
+	{52, 24, 5},	/* 69 RespTimeVal */
+	{52, 20, 4},	/* 70 LocalPhysErr */
+	{52, 16, 4},	/* 71 OverrunErr */
+	{52, 0, 16},	/* 72 MaxCreditHint */
+	{56, 0, 24},	/* 73 RoundTrip */
+	{0, 0, 0},	/* 74  */
+	{0, 24, 8},	/* 75 BaseVers */
+	{0, 16, 8},	/* 76 ClassVers */
+	{0, 8, 8},	/* 77 NodeType */
+	{0, 0, 8},	/* 78 NumPorts */
+	{0, 0, 0},	/* 79 SystemGuid */
+	{0, 0, 0},	/* 80 Guid */
+	{0, 0, 0},	/* 81 PortGuid */
+	{28, 16, 16},	/* 82 PartCap */
+	{28, 0, 16},	/* 83 DevId */
+	{32, 0, 32},	/* 84 Revision */
+	{36, 24, 8},	/* 85 LocalPort */
+	{36, 0, 24},	/* 86 VendorId */
+	{0, 0, 0},	/* 87  */
+	{0, 16, 16},	/* 88 LinearFdbCap */
+	{0, 0, 16},	/* 89 RandomFdbCap */
+	{4, 16, 16},	/* 90 McastFdbCap */
+	{4, 0, 16},	/* 91 LinearFdbTop */
+	{8, 24, 8},	/* 92 DefPort */
+	{8, 16, 8},	/* 93 DefMcastPrimPort */
+	{8, 8, 8},	/* 94 DefMcastNotPrimPort */
+	{8, 3, 5},	/* 95 LifeTime */
+	{8, 2, 1},	/* 96 StateChange */
+	{8, 0, 2},	/* 97 OptSLtoVLMapping */
+	{12, 16, 16},	/* 98 LidsPerPort */
+	{12, 0, 16},	/* 99 PartEnforceCap */
+	{16, 31, 1},	/* 100 InboundPartEnf */
+	{16, 30, 1},	/* 101 OutboundPartEnf */
+	{16, 29, 1},	/* 102 FilterRawInbound */
+	{16, 28, 1},	/* 103 FilterRawOutbound */
+	{16, 27, 1},	/* 104 EnhancedPort0 */
+	{16, 0, 16},	/* 105 MulticastFDBTop */
+	{0, 0, 0},	/* 106  */
+	{0, 0, 0},	/* 107 LinearForwTbl */
+	{0, 0, 0},	/* 108 MulticastForwTbl */
+	{0, 0, 0},	/* 109 NodeDesc */
+	{0, 31, 1},	/* 110 NoticeIsGeneric */
+	{0, 24, 7},	/* 111 NoticeType */
+	{0, 0, 24},	/* 112 NoticeProducerType */
+	{4, 16, 16},	/* 113 NoticeTrapNumber */
+	{4, 0, 16},	/* 114 NoticeIssuerLID */
+	{8, 31, 1},	/* 115 NoticeToggle */
+	{8, 16, 15},	/* 116 NoticeCount */
+	{0, 0, 0},	/* 117 NoticeDataDetails */
+	{8, 0, 16},	/* 118 NoticeDataLID */
+	{12, 16, 16},	/* 119 NoticeDataTrap144LID */
+	{16, 0, 32},	/* 120 NoticeDataTrap144CapMask */
+	{0, 16, 8},	/* 121 PortSelect */
+	{0, 0, 16},	/* 122 CounterSelect */
+	{4, 16, 16},	/* 123 SymbolErrorCounter */
+	{4, 8, 8},	/* 124 LinkErrorRecoveryCounter */
+	{4, 0, 8},	/* 125 LinkDownedCounter */
+	{8, 16, 16},	/* 126 PortRcvErrors */
+	{8, 0, 16},	/* 127 PortRcvRemotePhysicalErrors */
+	{12, 16, 16},	/* 128 PortRcvSwitchRelayErrors */
+	{12, 0, 16},	/* 129 PortXmitDiscards */
+	{16, 24, 8},	/* 130 PortXmitConstraintErrors */
+	{16, 16, 8},	/* 131 PortRcvConstraintErrors */
+	{16, 8, 8},	/* 132 CounterSelect2 */
+	{16, 4, 4},	/* 133 LocalLinkIntegrityErrors */
+	{16, 0, 4},	/* 134 ExcessiveBufferOverrunErrors */
+	{20, 0, 16},	/* 135 VL15Dropped */
+	{24, 0, 32},	/* 136 PortXmitData */
+	{28, 0, 32},	/* 137 PortRcvData */
+	{32, 0, 32},	/* 138 PortXmitPkts */
+	{36, 0, 32},	/* 139 PortRcvPkts */
+	{40, 0, 32},	/* 140 PortXmitWait */
+	{0, 0, 0},	/* 141  */
+	{0, 0, 0},	/* 142 SmInfoGuid */
+	{0, 0, 0},	/* 143 SmInfoKey */
+	{16, 0, 32},	/* 144 SmActivity */
+	{20, 28, 4},	/* 145 SmPriority */
+	{20, 24, 4},	/* 146 SmState */
+	{24, 24, 8},	/* 147 RmppVers */
+	{24, 16, 8},	/* 148 RmppType */
+	{24, 11, 5},	/* 149 RmppResp */
+	{24, 8, 3},	/* 150 RmppFlags */
+	{24, 0, 8},	/* 151 RmppStatus */
+	{28, 0, 32},	/* 152 RmppData1 */
+	{28, 0, 32},	/* 153 RmppSegNum */
+	{32, 0, 32},	/* 154 RmppData2 */
+	{32, 0, 32},	/* 155 RmppPayload */
+	{32, 0, 32},	/* 156 RmppNewWin */
+	{4, 16, 7},	/* 157 MultiPathNumPath */
+	{12, 0, 8},	/* 158 MultiPathNumSrc */
+	{16, 24, 8},	/* 159 MultiPathNumDest */
+	{0, 0, 0},	/* 160 MultiPathGid */
+	{0, 0, 0},	/* 161 PathRecDGid */
+	{0, 0, 0},	/* 162 PathRecSGid */
+	{40, 16, 16},	/* 163 PathRecDLid */
+	{40, 0, 16},	/* 164 PathRecSLid */
+	{48, 16, 7},	/* 165 PathRecNumPath */
+	{52, 16, 4},	/* 166 PathRecSL */
+	{0, 0, 0},	/* 167 McastMemMGid */
+	{0, 0, 0},	/* 168 McastMemPortGid */
+	{32, 0, 32},	/* 169 McastMemQkey */
+	{36, 16, 16},	/* 170 McastMemMLid */
+	{44, 28, 4},	/* 171 McastMemSL */
+	{36, 8, 6},	/* 172 McastMemMTU */
+	{40, 8, 6},	/* 173 McastMemRate */
+	{36, 0, 8},	/* 174 McastMemTClass */
+	{40, 16, 16},	/* 175 McastMemPkey */
+	{44, 8, 20},	/* 176 McastMemFlowLbl */
+	{48, 24, 4},	/* 177 McastMemJoinState */
+	{48, 23, 1},	/* 178 McastMemProxyJoin */
+	{0, 0, 0},	/* 179 ServRecID */
+	{0, 0, 0},	/* 180 ServRecGid */
+	{24, 16, 16},	/* 181 ServRecPkey */
+	{28, 0, 32},	/* 182 ServRecLease */
+	{0, 0, 0},	/* 183 ServRecKey */
+	{0, 0, 0},	/* 184 ServRecName */
+	{0, 0, 0},	/* 185 ServRecData */
+	{12, 0, 32},	/* 186 ATSNodeAddr */
+	{16, 16, 16},	/* 187 ATSMagicKey */
+	{16, 0, 16},	/* 188 ATSNodeType */
+	{0, 0, 0},	/* 189 ATSNodeName */
+	{0, 0, 0},	/* 190 SLToVLMap */
+	{0, 0, 0},	/* 191 VLArbTbl */
+	{36, 0, 24},	/* 192 OUI */
+	{0, 0, 0},	/* 193 Vendor2Data */
+	{0, 16, 8},	/* 194 PortSelect */
+	{0, 0, 16},	/* 195 CounterSelect */
+	{0, 0, 0},	/* 196 PortXmitData */
+	{0, 0, 0},	/* 197 PortRcvData */
+	{0, 0, 0},	/* 198 PortXmitPkts */
+	{0, 0, 0},	/* 199 PortRcvPkts */
+	{0, 0, 0},	/* 200 PortUnicastXmitPkts */
+	{0, 0, 0},	/* 201 PortUnicastRcvPkts */
+	{0, 0, 0},	/* 202 PortMulticastXmitPkts */
+	{0, 0, 0},	/* 203 PortMulticastRcvPkts */
+	{0, 0, 0},	/* 204  */
+	{0, 0, 0},	/* 205 GUID0 */
+	{0, 24, 8},	/* 206 BaseVersion */
+	{0, 16, 8},	/* 207 ClassVersion */
+	{0, 0, 16},	/* 208 CapabilityMask */
+	{4, 5, 27},	/* 209 CapabilityMask2 */
+	{4, 0, 5},	/* 210 RespTimeVal */
+	{0, 0, 0},	/* 211 RedirectGID */
+	{24, 24, 8},	/* 212 RedirectTC */
+	{24, 20, 4},	/* 213 RedirectSL */
+	{24, 0, 20},	/* 214 RedirectFL */
+	{28, 16, 16},	/* 215 RedirectLID */
+	{28, 0, 16},	/* 216 RedirectPKey */
+	{32, 0, 24},	/* 217 RedirectQP */
+	{36, 0, 32},	/* 218 RedirectQKey */
+	{0, 0, 0},	/* 219 TrapGID */
+	{56, 24, 8},	/* 220 TrapTC */
+	{56, 20, 4},	/* 221 TrapSL */
+	{56, 0, 20},	/* 222 TrapFL */
+	{60, 16, 16},	/* 223 TrapLID */
+	{60, 0, 16},	/* 224 TrapPKey */
+	{64, 24, 8},	/* 225 TrapHL */
+	{64, 0, 24},	/* 226 TrapQP */
+	{68, 0, 32},	/* 227 TrapQKey */
+	{4, 0, 32},	/* 228 XmtDataSL0 */
+	{8, 0, 32},	/* 229 XmtDataSL1 */
+	{12, 0, 32},	/* 230 XmtDataSL2 */
+	{16, 0, 32},	/* 231 XmtDataSL3 */
+	{20, 0, 32},	/* 232 XmtDataSL4 */
+	{24, 0, 32},	/* 233 XmtDataSL5 */
+	{28, 0, 32},	/* 234 XmtDataSL6 */
+	{32, 0, 32},	/* 235 XmtDataSL7 */
+	{36, 0, 32},	/* 236 XmtDataSL8 */
+	{40, 0, 32},	/* 237 XmtDataSL9 */
+	{44, 0, 32},	/* 238 XmtDataSL10 */
+	{48, 0, 32},	/* 239 XmtDataSL11 */
+	{52, 0, 32},	/* 240 XmtDataSL12 */
+	{56, 0, 32},	/* 241 XmtDataSL13 */
+	{60, 0, 32},	/* 242 XmtDataSL14 */
+	{64, 0, 32},	/* 243 XmtDataSL15 */
+	{0, 0, 0},	/* 244  */
+	{4, 0, 32},	/* 245 RcvDataSL0 */
+	{8, 0, 32},	/* 246 RcvDataSL1 */
+	{12, 0, 32},	/* 247 RcvDataSL2 */
+	{16, 0, 32},	/* 248 RcvDataSL3 */
+	{20, 0, 32},	/* 249 RcvDataSL4 */
+	{24, 0, 32},	/* 250 RcvDataSL5 */
+	{28, 0, 32},	/* 251 RcvDataSL6 */
+	{32, 0, 32},	/* 252 RcvDataSL7 */
+	{36, 0, 32},	/* 253 RcvDataSL8 */
+	{40, 0, 32},	/* 254 RcvDataSL9 */
+	{44, 0, 32},	/* 255 RcvDataSL10 */
+	{48, 0, 32},	/* 256 RcvDataSL11 */
+	{52, 0, 32},	/* 257 RcvDataSL12 */
+	{56, 0, 32},	/* 258 RcvDataSL13 */
+	{60, 0, 32},	/* 259 RcvDataSL14 */
+	{64, 0, 32},	/* 260 RcvDataSL15 */
+	{0, 0, 0},	/* 261  */
+	{4, 16, 16},	/* 262 PortInactiveDiscards */
+	{4, 0, 16},	/* 263 PortNeighborMTUDiscards */
+	{8, 16, 16},	/* 264 PortSwLifetimeLimitDiscards */
+	{8, 0, 16},	/* 265 PortSwHOQLifetimeLimitDiscards */
+	{0, 0, 0},	/* 266  */
+	{4, 16, 16},	/* 267 PortLocalPhysicalErrors */
+	{4, 0, 16},	/* 268 PortMalformedPktErrors */
+	{8, 16, 16},	/* 269 PortBufferOverrunErrors */
+	{8, 0, 16},	/* 270 PortDLIDMappingErrors */
+	{12, 16, 16},	/* 271 PortVLMappingErrors */
+	{12, 0, 16},	/* 272 PortLoopingErrors */
+	{0, 0, 0},	/* 273  */
+	{0, 24, 8},	/* 274 OpCode */
+	{0, 16, 8},	/* 275 PortSelect */
+	{0, 8, 8},	/* 276 Tick */
+	{0, 0, 3},	/* 277 CounterWidth */
+	{4, 27, 3},	/* 278 CounterMask0 */
+	{4, 0, 27},	/* 279 CounterMasks1to9 */
+	{8, 16, 15},	/* 280 CounterMasks10to14 */
+	{8, 8, 8},	/* 281 SampleMechanisms */
+	{8, 0, 2},	/* 282 SampleStatus */
+	{0, 0, 0},	/* 283 OptionMask */
+	{0, 0, 0},	/* 284 VendorMask */
+	{28, 0, 32},	/* 285 SampleStart */
+	{32, 0, 32},	/* 286 SampleInterval */
+	{36, 16, 16},	/* 287 Tag */
+	{36, 0, 16},	/* 288 CounterSelect0 */
+	{40, 16, 16},	/* 289 CounterSelect1 */
+	{40, 0, 16},	/* 290 CounterSelect2 */
+	{44, 16, 16},	/* 291 CounterSelect3 */
+	{44, 0, 16},	/* 292 CounterSelect4 */
+	{48, 16, 16},	/* 293 CounterSelect5 */
+	{48, 0, 16},	/* 294 CounterSelect6 */
+	{52, 16, 16},	/* 295 CounterSelect7 */
+	{52, 0, 16},	/* 296 CounterSelect8 */
+	{56, 16, 16},	/* 297 CounterSelect9 */
+	{56, 0, 16},	/* 298 CounterSelect10 */
+	{60, 16, 16},	/* 299 CounterSelect11 */
+	{60, 0, 16},	/* 300 CounterSelect12 */
+	{64, 16, 16},	/* 301 CounterSelect13 */
+	{64, 0, 16},	/* 302 CounterSelect14 */
+	{0, 0, 0},	/* 303 SamplesOnlyOptionMask */
+	{0, 0, 0},	/* 304  */
+	{0, 0, 0},	/* 305 GUID0 */
+	{0, 0, 0},	/* 306 GUID1 */
+	{0, 0, 0},	/* 307 GUID2 */
+	{0, 0, 0},	/* 308 GUID3 */
+	{0, 0, 0},	/* 309 GUID4 */
+	{0, 0, 0},	/* 310 GUID5 */
+	{0, 0, 0},	/* 311 GUID6 */
+	{0, 0, 0},	/* 312 GUID7 */
+	{0, 16, 16},	/* 313 Lid */
+	{0, 8, 8},	/* 314 BlockNum */
+	{0, 0, 0},	/* 315 Guid0 */
+	{0, 0, 0},	/* 316 Guid1 */
+	{0, 0, 0},	/* 317 Guid2 */
+	{0, 0, 0},	/* 318 Guid3 */
+	{0, 0, 0},	/* 319 Guid4 */
+	{0, 0, 0},	/* 320 Guid5 */
+	{0, 0, 0},	/* 321 Guid6 */
+	{0, 0, 0},	/* 322 Guid7 */
+	{60, 16, 16},	/* 323 CapabilityMask2 */
+	{60, 12, 4},	/* 324 LinkSpeedExtActive */
+	{60, 8, 4},	/* 325 LinkSpeedExtSupported */
+	{60, 0, 5},	/* 326 LinkSpeedExtEnabled */
+	{0, 0, 0},	/* 327  */
+	{0, 16, 8},	/* 328 PortSelect */
+	{0, 0, 0},	/* 329 CounterSelect */
+	{16, 16, 16},	/* 330 SyncHeaderErrorCounter */
+	{16, 0, 16},	/* 331 UnknownBlockCounter */
+	{20, 16, 16},	/* 332 ErrorDetectionCounterLane0 */
+	{20, 0, 16},	/* 333 ErrorDetectionCounterLane1 */
+	{24, 16, 16},	/* 334 ErrorDetectionCounterLane2 */
+	{24, 0, 16},	/* 335 ErrorDetectionCounterLane3 */
+	{28, 16, 16},	/* 336 ErrorDetectionCounterLane4 */
+	{28, 0, 16},	/* 337 ErrorDetectionCounterLane5 */
+	{32, 16, 16},	/* 338 ErrorDetectionCounterLane6 */
+	{32, 0, 16},	/* 339 ErrorDetectionCounterLane7 */
+	{36, 16, 16},	/* 340 ErrorDetectionCounterLane8 */
+	{36, 0, 16},	/* 341 ErrorDetectionCounterLane9 */
+	{40, 16, 16},	/* 342 ErrorDetectionCounterLane10 */
+	{40, 0, 16},	/* 343 ErrorDetectionCounterLane11 */
+	{44, 0, 32},	/* 344 FECCorrectableBlockCtrLane0 */
+	{48, 0, 32},	/* 345 FECCorrectableBlockCtrLane1 */
+	{52, 0, 32},	/* 346 FECCorrectableBlockCtrLane2 */
+	{56, 0, 32},	/* 347 FECCorrectableBlockCtrLane3 */
+	{60, 0, 32},	/* 348 FECCorrectableBlockCtrLane4 */
+	{64, 0, 32},	/* 349 FECCorrectableBlockCtrLane5 */
+	{68, 0, 32},	/* 350 FECCorrectableBlockCtrLane6 */
+	{72, 0, 32},	/* 351 FECCorrectableBlockCtrLane7 */
+	{76, 0, 32},	/* 352 FECCorrectableBlockCtrLane8 */
+	{80, 0, 32},	/* 353 FECCorrectableBlockCtrLane9 */
+	{84, 0, 32},	/* 354 FECCorrectableBlockCtrLane10 */
+	{88, 0, 32},	/* 355 FECCorrectableBlockCtrLane11 */
+	{92, 0, 32},	/* 356 FECUncorrectableBlockCtrLane0 */
+	{96, 0, 32},	/* 357 FECUncorrectableBlockCtrLane1 */
+	{100, 0, 32},	/* 358 FECUncorrectableBlockCtrLane2 */
+	{104, 0, 32},	/* 359 FECUncorrectableBlockCtrLane3 */
+	{108, 0, 32},	/* 360 FECUncorrectableBlockCtrLane4 */
+	{112, 0, 32},	/* 361 FECUncorrectableBlockCtrLane5 */
+	{116, 0, 32},	/* 362 FECUncorrectableBlockCtrLane6 */
+	{120, 0, 32},	/* 363 FECUncorrectableBlockCtrLane7 */
+	{124, 0, 32},	/* 364 FECUncorrectableBlockCtrLane8 */
+	{128, 0, 32},	/* 365 FECUncorrectableBlockCtrLane9 */
+	{132, 0, 32},	/* 366 FECUncorrectableBlockCtrLane10 */
+	{136, 0, 32},	/* 367 FECUncorrectableBlockCtrLane11 */
+	{0, 0, 0},	/* 368  */
+	{4, 0, 32},	/* 369 PortOpRcvPkts */
+	{8, 0, 32},	/* 370 PortOpRcvData */
+	{0, 0, 0},	/* 371  */
+	{4, 0, 32},	/* 372 PortXmitFlowPkts */
+	{8, 0, 32},	/* 373 PortRcvFlowPkts */
+	{0, 0, 0},	/* 374  */
+	{4, 16, 16},	/* 375 PortVLOpPackets0 */
+	{4, 0, 16},	/* 376 PortVLOpPackets1 */
+	{8, 16, 16},	/* 377 PortVLOpPackets2 */
+	{8, 0, 16},	/* 378 PortVLOpPackets3 */
+	{12, 16, 16},	/* 379 PortVLOpPackets4 */
+	{12, 0, 16},	/* 380 PortVLOpPackets5 */
+	{16, 16, 16},	/* 381 PortVLOpPackets6 */
+	{16, 0, 16},	/* 382 PortVLOpPackets7 */
+	{20, 16, 16},	/* 383 PortVLOpPackets8 */
+	{20, 0, 16},	/* 384 PortVLOpPackets9 */
+	{24, 16, 16},	/* 385 PortVLOpPackets10 */
+	{24, 0, 16},	/* 386 PortVLOpPackets11 */
+	{28, 16, 16},	/* 387 PortVLOpPackets12 */
+	{28, 0, 16},	/* 388 PortVLOpPackets13 */
+	{32, 16, 16},	/* 389 PortVLOpPackets14 */
+	{32, 0, 16},	/* 390 PortVLOpPackets15 */
+	{0, 0, 0},	/* 391  */
+	{4, 0, 32},	/* 392 PortVLOpData0 */
+	{8, 0, 32},	/* 393 PortVLOpData1 */
+	{12, 0, 32},	/* 394 PortVLOpData2 */
+	{16, 0, 32},	/* 395 PortVLOpData3 */
+	{20, 0, 32},	/* 396 PortVLOpData4 */
+	{24, 0, 32},	/* 397 PortVLOpData5 */
+	{28, 0, 32},	/* 398 PortVLOpData6 */
+	{32, 0, 32},	/* 399 PortVLOpData7 */
+	{36, 0, 32},	/* 400 PortVLOpData8 */
+	{40, 0, 32},	/* 401 PortVLOpData9 */
+	{44, 0, 32},	/* 402 PortVLOpData10 */
+	{48, 0, 32},	/* 403 PortVLOpData11 */
+	{52, 0, 32},	/* 404 PortVLOpData12 */
+	{56, 0, 32},	/* 405 PortVLOpData13 */
+	{60, 0, 32},	/* 406 PortVLOpData14 */
+	{64, 0, 32},	/* 407 PortVLOpData15 */
+	{0, 0, 0},	/* 408  */
+	{4, 30, 2},	/* 409 PortVLXmitFlowCtlUpdateErrors0 */
+	{4, 28, 2},	/* 410 PortVLXmitFlowCtlUpdateErrors1 */
+	{4, 26, 2},	/* 411 PortVLXmitFlowCtlUpdateErrors2 */
+	{4, 24, 2},	/* 412 PortVLXmitFlowCtlUpdateErrors3 */
+	{4, 22, 2},	/* 413 PortVLXmitFlowCtlUpdateErrors4 */
+	{4, 20, 2},	/* 414 PortVLXmitFlowCtlUpdateErrors5 */
+	{4, 18, 2},	/* 415 PortVLXmitFlowCtlUpdateErrors6 */
+	{4, 16, 2},	/* 416 PortVLXmitFlowCtlUpdateErrors7 */
+	{4, 14, 2},	/* 417 PortVLXmitFlowCtlUpdateErrors8 */
+	{4, 12, 2},	/* 418 PortVLXmitFlowCtlUpdateErrors9 */
+	{4, 10, 2},	/* 419 PortVLXmitFlowCtlUpdateErrors10 */
+	{4, 8, 2},	/* 420 PortVLXmitFlowCtlUpdateErrors11 */
+	{4, 6, 2},	/* 421 PortVLXmitFlowCtlUpdateErrors12 */
+	{4, 4, 2},	/* 422 PortVLXmitFlowCtlUpdateErrors13 */
+	{4, 2, 2},	/* 423 PortVLXmitFlowCtlUpdateErrors14 */
+	{4, 0, 2},	/* 424 PortVLXmitFlowCtlUpdateErrors15 */
+	{0, 0, 0},	/* 425  */
+	{4, 16, 16},	/* 426 PortVLXmitWait0 */
+	{4, 0, 16},	/* 427 PortVLXmitWait1 */
+	{8, 16, 16},	/* 428 PortVLXmitWait2 */
+	{8, 0, 16},	/* 429 PortVLXmitWait3 */
+	{12, 16, 16},	/* 430 PortVLXmitWait4 */
+	{12, 0, 16},	/* 431 PortVLXmitWait5 */
+	{16, 16, 16},	/* 432 PortVLXmitWait6 */
+	{16, 0, 16},	/* 433 PortVLXmitWait7 */
+	{20, 16, 16},	/* 434 PortVLXmitWait8 */
+	{20, 0, 16},	/* 435 PortVLXmitWait9 */
+	{24, 16, 16},	/* 436 PortVLXmitWait10 */
+	{24, 0, 16},	/* 437 PortVLXmitWait11 */
+	{28, 16, 16},	/* 438 PortVLXmitWait12 */
+	{28, 0, 16},	/* 439 PortVLXmitWait13 */
+	{32, 16, 16},	/* 440 PortVLXmitWait14 */
+	{32, 0, 16},	/* 441 PortVLXmitWait15 */
+	{0, 0, 0},	/* 442  */
+	{4, 16, 16},	/* 443 SWPortVLCongestion0 */
+	{4, 0, 16},	/* 444 SWPortVLCongestion1 */
+	{8, 16, 16},	/* 445 SWPortVLCongestion2 */
+	{8, 0, 16},	/* 446 SWPortVLCongestion3 */
+	{12, 16, 16},	/* 447 SWPortVLCongestion4 */
+	{12, 0, 16},	/* 448 SWPortVLCongestion5 */
+	{16, 16, 16},	/* 449 SWPortVLCongestion6 */
+	{16, 0, 16},	/* 450 SWPortVLCongestion7 */
+	{20, 16, 16},	/* 451 SWPortVLCongestion8 */
+	{20, 0, 16},	/* 452 SWPortVLCongestion9 */
+	{24, 16, 16},	/* 453 SWPortVLCongestion10 */
+	{24, 0, 16},	/* 454 SWPortVLCongestion11 */
+	{28, 16, 16},	/* 455 SWPortVLCongestion12 */
+	{28, 0, 16},	/* 456 SWPortVLCongestion13 */
+	{32, 16, 16},	/* 457 SWPortVLCongestion14 */
+	{32, 0, 16},	/* 458 SWPortVLCongestion15 */
+	{0, 0, 0},	/* 459  */
+	{4, 0, 32},	/* 460 PortPktRcvFECN */
+	{8, 0, 32},	/* 461 PortPktRcvBECN */
+	{0, 0, 0},	/* 462  */
+	{4, 0, 32},	/* 463 PortSLRcvFECN0 */
+	{8, 0, 32},	/* 464 PortSLRcvFECN1 */
+	{12, 0, 32},	/* 465 PortSLRcvFECN2 */
+	{16, 0, 32},	/* 466 PortSLRcvFECN3 */
+	{20, 0, 32},	/* 467 PortSLRcvFECN4 */
+	{24, 0, 32},	/* 468 PortSLRcvFECN5 */
+	{28, 0, 32},	/* 469 PortSLRcvFECN6 */
+	{32, 0, 32},	/* 470 PortSLRcvFECN7 */
+	{36, 0, 32},	/* 471 PortSLRcvFECN8 */
+	{40, 0, 32},	/* 472 PortSLRcvFECN9 */
+	{44, 0, 32},	/* 473 PortSLRcvFECN10 */
+	{48, 0, 32},	/* 474 PortSLRcvFECN11 */
+	{52, 0, 32},	/* 475 PortSLRcvFECN12 */
+	{56, 0, 32},	/* 476 PortSLRcvFECN13 */
+	{60, 0, 32},	/* 477 PortSLRcvFECN14 */
+	{64, 0, 32},	/* 478 PortSLRcvFECN15 */
+	{0, 0, 0},	/* 479  */
+	{4, 0, 32},	/* 480 PortSLRcvBECN0 */
+	{8, 0, 32},	/* 481 PortSLRcvBECN1 */
+	{12, 0, 32},	/* 482 PortSLRcvBECN2 */
+	{16, 0, 32},	/* 483 PortSLRcvBECN3 */
+	{20, 0, 32},	/* 484 PortSLRcvBECN4 */
+	{24, 0, 32},	/* 485 PortSLRcvBECN5 */
+	{28, 0, 32},	/* 486 PortSLRcvBECN6 */
+	{32, 0, 32},	/* 487 PortSLRcvBECN7 */
+	{36, 0, 32},	/* 488 PortSLRcvBECN8 */
+	{40, 0, 32},	/* 489 PortSLRcvBECN9 */
+	{44, 0, 32},	/* 490 PortSLRcvBECN10 */
+	{48, 0, 32},	/* 491 PortSLRcvBECN11 */
+	{52, 0, 32},	/* 492 PortSLRcvBECN12 */
+	{56, 0, 32},	/* 493 PortSLRcvBECN13 */
+	{60, 0, 32},	/* 494 PortSLRcvBECN14 */
+	{64, 0, 32},	/* 495 PortSLRcvBECN15 */
+	{0, 0, 0},	/* 496  */
+	{4, 0, 32},	/* 497 PortXmitTimeCong */
+	{0, 0, 0},	/* 498  */
+	{4, 0, 32},	/* 499 PortVLXmitTimeCong0 */
+	{8, 0, 32},	/* 500 PortVLXmitTimeCong1 */
+	{12, 0, 32},	/* 501 PortVLXmitTimeCong2 */
+	{16, 0, 32},	/* 502 PortVLXmitTimeCong3 */
+	{20, 0, 32},	/* 503 PortVLXmitTimeCong4 */
+	{24, 0, 32},	/* 504 PortVLXmitTimeCong5 */
+	{28, 0, 32},	/* 505 PortVLXmitTimeCong6 */
+	{32, 0, 32},	/* 506 PortVLXmitTimeCong7 */
+	{36, 0, 32},	/* 507 PortVLXmitTimeCong8 */
+	{40, 0, 32},	/* 508 PortVLXmitTimeCong9 */
+	{44, 0, 32},	/* 509 PortVLXmitTimeCong10 */
+	{48, 0, 32},	/* 510 PortVLXmitTimeCong11 */
+	{52, 0, 32},	/* 511 PortVLXmitTimeCong12 */
+	{56, 0, 32},	/* 512 PortVLXmitTimeCong13 */
+	{60, 0, 32},	/* 513 PortVLXmitTimeCong14 */
+	{0, 0, 0},	/* 514  */
+	{0, 0, 8},	/* 515 StateChangeEnable */
+	{4, 0, 8},	/* 516 LinkSpeedSupported */
+	{8, 0, 8},	/* 517 LinkSpeedEnabled */
+	{12, 0, 8},	/* 518 LinkSpeedActive */
+	{0, 0, 0},	/* 519  */
+	{0, 0, 0},	/* 520 CC_Key */
+	{0, 16, 16},	/* 521 CongestionInfo */
+	{0, 8, 8},	/* 522 ControlTableCap */
+	{0, 0, 0},	/* 523  */
+	{0, 0, 0},	/* 524 CC_Key */
+	{8, 31, 1},	/* 525 CC_KeyProtectBit */
+	{8, 0, 16},	/* 526 CC_KeyLeasePeriod */
+	{12, 16, 16},	/* 527 CC_KeyViolations */
+	{0, 0, 0},	/* 528  */
+	{0, 24, 8},	/* 529 LogType */
+	{0, 16, 8},	/* 530 CongestionFlags */
+	{0, 0, 0},	/* 531  */
+	{0, 0, 16},	/* 532 LogEventsCounter */
+	{4, 0, 32},	/* 533 CurrentTimeStamp */
+	{0, 0, 0},	/* 534 PortMap */
+	{0, 0, 0},	/* 535  */
+	{0, 16, 16},	/* 536 SLID */
+	{0, 0, 16},	/* 537 DLID */
+	{4, 28, 4},	/* 538 SL */
+	{8, 0, 32},	/* 539 Timestamp */
+	{0, 0, 0},	/* 540  */
+	{0, 0, 16},	/* 541 ThresholdEventCounter */
+	{4, 16, 16},	/* 542 ThresholdCongestionEventMap */
+	{8, 0, 32},	/* 543 CurrentTimeStamp */
+	{0, 0, 0},	/* 544  */
+	{0, 8, 24},	/* 545 Local_QP_CN_Entry */
+	{0, 4, 4},	/* 546 SL_CN_Entry */
+	{0, 0, 4},	/* 547 Service_Type_CN_Entry */
+	{4, 8, 24},	/* 548 Remote_QP_Number_CN_Entry */
+	{8, 16, 16},	/* 549 Local_LID_CN */
+	{8, 0, 16},	/* 550 Remote_LID_CN_Entry */
+	{12, 0, 32},	/* 551 Timestamp_CN_Entry */
+	{0, 0, 0},	/* 552  */
+	{0, 0, 32},	/* 553 Control_Map */
+	{0, 0, 0},	/* 554 Victim_Mask */
+	{0, 0, 0},	/* 555 Credit_Mask */
+	{68, 28, 4},	/* 556 Threshold */
+	{68, 16, 8},	/* 557 Packet_Size */
+	{68, 12, 4},	/* 558 CS_Threshold */
+	{72, 16, 16},	/* 559 CS_ReturnDelay */
+	{72, 0, 16},	/* 560 Marking_Rate */
+	{0, 0, 0},	/* 561  */
+	{0, 31, 1},	/* 562 Valid */
+	{0, 30, 1},	/* 563 Control_Type */
+	{0, 24, 4},	/* 564 Threshold */
+	{0, 16, 8},	/* 565 Packet_Size */
+	{0, 0, 16},	/* 566 Cong_Parm_Marking_Rate */
+	{0, 0, 0},	/* 567  */
+	{0, 16, 16},	/* 568 Port_Control */
+	{0, 0, 16},	/* 569 Control_Map */
+	{0, 0, 0},	/* 570  */
+	{0, 16, 16},	/* 571 CCTI_Timer */
+	{0, 8, 8},	/* 572 CCTI_Increase */
+	{0, 0, 8},	/* 573 Trigger_Threshold */
+	{4, 24, 8},	/* 574 CCTI_Min */
+	{0, 0, 0},	/* 575  */
+	{0, 16, 16},	/* 576 CCTI_Limit */
+	{0, 0, 0},	/* 577  */
+	{0, 30, 2},	/* 578 CCT_Shift */
+	{0, 16, 14},	/* 579 CCT_Multiplier */
+	{0, 0, 0},	/* 580  */
+	{0, 0, 32},	/* 581 Timestamp */
+	{0, 0, 0},	/* 582  */
+	{0, 16, 16},	/* 583 Lid */
+	{4, 24, 8},	/* 584 BaseVers */
+	{4, 16, 8},	/* 585 ClassVers */
+	{4, 8, 8},	/* 586 NodeType */
+	{4, 0, 8},	/* 587 NumPorts */
+	{0, 0, 0},	/* 588 SystemGuid */
+	{0, 0, 0},	/* 589 Guid */
+	{0, 0, 0},	/* 590 PortGuid */
+	{32, 16, 16},	/* 591 PartCap */
+	{32, 0, 16},	/* 592 DevId */
+	{36, 0, 32},	/* 593 Revision */
+	{40, 24, 8},	/* 594 LocalPort */
+	{40, 0, 24},	/* 595 VendorId */
+	{0, 0, 0},	/* 596 NodeDesc */
+	{0, 0, 0},	/* 597  */
+	{0, 16, 16},	/* 598 Tag */
+	{0, 0, 2},	/* 599 SampleStatus */
+	{4, 0, 32},	/* 600 Counter0 */
+	{8, 0, 32},	/* 601 Counter1 */
+	{12, 0, 32},	/* 602 Counter2 */
+	{16, 0, 32},	/* 603 Counter3 */
+	{20, 0, 32},	/* 604 Counter4 */
+	{24, 0, 32},	/* 605 Counter5 */
+	{28, 0, 32},	/* 606 Counter6 */
+	{32, 0, 32},	/* 607 Counter7 */
+	{36, 0, 32},	/* 608 Counter8 */
+	{40, 0, 32},	/* 609 Counter9 */
+	{44, 0, 32},	/* 610 Counter10 */
+	{48, 0, 32},	/* 611 Counter11 */
+	{52, 0, 32},	/* 612 Counter12 */
+	{56, 0, 32},	/* 613 Counter13 */
+	{60, 0, 32},	/* 614 Counter14 */
+	{0, 0, 0},	/* 615  */
+	{0, 0, 32},	/* 616 CapMask */
+	{4, 16, 16},	/* 617 FECModeActive */
+	{4, 0, 16},	/* 618 FDRFECModeSupported */
+	{8, 16, 16},	/* 619 FDRFECModeEnabled */
+	{8, 0, 16},	/* 620 EDRFECModeSupported */
+	{12, 16, 16},	/* 621 EDRFECModeEnabled */
+	{0, 0, 0},	/* 622  */
+	{0, 16, 8},	/* 623 PortSelect */
+	{0, 0, 0},	/* 624 CounterSelect */
+	{16, 16, 16},	/* 625 SyncHeaderErrorCounter */
+	{16, 0, 16},	/* 626 UnknownBlockCounter */
+	{44, 0, 32},	/* 627 FECCorrectableSymbolCtrLane0 */
+	{48, 0, 32},	/* 628 FECCorrectableSymbolCtrLane1 */
+	{52, 0, 32},	/* 629 FECCorrectableSymbolCtrLane2 */
+	{56, 0, 32},	/* 630 FECCorrectableSymbolCtrLane3 */
+	{60, 0, 32},	/* 631 FECCorrectableSymbolCtrLane4 */
+	{64, 0, 32},	/* 632 FECCorrectableSymbolCtrLane5 */
+	{68, 0, 32},	/* 633 FECCorrectableSymbolCtrLane6 */
+	{72, 0, 32},	/* 634 FECCorrectableSymbolCtrLane7 */
+	{76, 0, 32},	/* 635 FECCorrectableSymbolCtrLane8 */
+	{80, 0, 32},	/* 636 FECCorrectableSymbolCtrLane9 */
+	{84, 0, 32},	/* 637 FECCorrectableSymbolCtrLane10 */
+	{88, 0, 32},	/* 638 FECCorrectableSymbolCtrLane11 */
+	{140, 0, 32},	/* 639 PortFECCorrectableBlockCtr */
+	{144, 0, 32},	/* 640 PortFECUncorrectableBlockCtr */
+	{148, 0, 32},	/* 641 PortFECCorrectedSymbolCtr */
+	{0, 0, 0},	/* 642  */
+	{4, 0, 32},	/* 643 CounterSelect2 */
+	{0, 0, 0},	/* 644 SymbolErrorCounter */
+	{0, 0, 0},	/* 645 LinkErrorRecoveryCounter */
+	{0, 0, 0},	/* 646 LinkDownedCounter */
+	{0, 0, 0},	/* 647 PortRcvErrors */
+	{0, 0, 0},	/* 648 PortRcvRemotePhysicalErrors */
+	{0, 0, 0},	/* 649 PortRcvSwitchRelayErrors */
+	{0, 0, 0},	/* 650 PortXmitDiscards */
+	{0, 0, 0},	/* 651 PortXmitConstraintErrors */
+	{0, 0, 0},	/* 652 PortRcvConstraintErrors */
+	{0, 0, 0},	/* 653 LocalLinkIntegrityErrors */
+	{0, 0, 0},	/* 654 ExcessiveBufferOverrunErrors */
+	{0, 0, 0},	/* 655 VL15Dropped */
+	{0, 0, 0},	/* 656 PortXmitWait */
+	{0, 0, 0},	/* 657 QP1Dropped */
+	{0, 0, 0},	/* 658  */
+	{0, 0, 0},	/* 659  */
+};
+
+/*
+ * mad_get_field() and mad_set_field() inline; with a constant field
+ * they compile to a load, shift and mask.
+ */
+static inline uint32_t mad_get_field_fast(void *buf, int base_offs,
+					  enum MAD_FIELDS field)
+{
+	const struct mad_field_layout *l = &mad_field_layouts[field];
+	uint32_t w;
+
+	if (!l->bits || (base_offs & 3))
+		return mad_get_field(buf, base_offs, field);
+
+	memcpy(&w, (uint8_t *) buf + base_offs + l->word, sizeof(w));
+	w = ntohl(w) >> l->shift;
+	return l->bits == 32 ? w : w & ((1u << l->bits) - 1);
+}
+
+static inline void mad_set_field_fast(void *buf, int base_offs,
+				      enum MAD_FIELDS field, uint32_t val)
+{
+	const struct mad_field_layout *l = &mad_field_layouts[field];
+	uint8_t *p = (uint8_t *) buf + base_offs + l->word;
+	uint32_t w, mask;
+
+	if (!l->bits || (base_offs & 3)) {
+		mad_set_field(buf, base_offs, field, val);
+		return;
+	}
+
+	mask = (l->bits == 32 ? 0xffffffff : (1u << l->bits) - 1) << l->shift;
+	memcpy(&w, p, sizeof(w));
+	w = (ntohl(w) & ~mask) | ((val << l->shift) & mask);
+	w = htonl(w);
+	memcpy(p, &w, sizeof(w));
+}
+
+/*
+ * Define IBMAD_FAST_FIELDS before including this header to have the
+ * existing mad_get_field() and mad_set_field() calls use them.
+ */
+#ifdef IBMAD_FAST_FIELDS
+#define mad_get_field(buf, base_offs, field) \
+	mad_get_field_fast(buf, base_offs, field)
+#define mad_set_field(buf, base_offs, field, val) \
+	mad_set_field_fast(buf, base_offs, field, val)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif				/* _MAD_FIELDS_H_ */
@@ -1025,8 +1025,25 @@ static uint64_t _get_field64(void *buf, int base_offs, const ib_field_t * f)
 	return ntohll(val);
 }
 
-static void _set_field(void *buf, int base_offs, const ib_field_t * f,
-		       uint32_t val)
+/*
+ * A field which lies within one 32 bit word is that big endian word
+ * shifted right by bitoffs & 31 and masked; one load instead of assembling
+ * it byte by byte.  The generated mad_fields.h inlines the same for
+ * callers.
+ */
+static inline int _in_word(int base_offs, const ib_field_t * f)
+{
+	return !(base_offs & 3) && f->bitlen &&
+	    (f->bitoffs & 31) + f->bitlen <= 32;
+}
+
+static inline uint32_t _word_mask(const ib_field_t * f)
+{
+	return f->bitlen == 32 ? 0xffffffff : (1u << f->bitlen) - 1;
+}
+
+static void _set_field_bytes(void *buf, int base_offs, const ib_field_t * f,
+			     uint32_t val)
 {
 	int prebits = (8 - (f->bitoffs & 7)) & 7;
 	int postbits = (f->bitoffs + f->bitlen) & 7;
@@ -1057,7 +1074,8 @@ static void _set_field(void *buf, int base_offs, const ib_field_t * f,
 	}
 }
 
-static uint32_t _get_field(void *buf, int base_offs, const ib_field_t * f)
+static uint32_t _get_field_bytes(void *buf, int base_offs,
+				 const ib_field_t * f)
 {
 	int prebits = (8 - (f->bitoffs & 7)) & 7;
 	int postbits = (f->bitoffs + f->bitlen) & 7;
@@ -1085,6 +1103,37 @@ static uint32_t _get_field(void *buf, int base_offs, const ib_field_t * f)
 	return (val << prebits) | v;
 }
 
+static void _set_field(void *buf, int base_offs, const ib_field_t * f,
+		       uint32_t val)
+{
+	uint8_t *p = (uint8_t *) buf + base_offs + (f->bitoffs & ~31) / 8;
+	uint32_t w, mask;
+
+	if (!_in_word(base_offs, f)) {
+		_set_field_bytes(buf, base_offs, f, val);
+		return;
+	}
+
+	mask = _word_mask(f) << (f->bitoffs & 31);
+	memcpy(&w, p, sizeof(w));
+	w = ntohl(w);
+	w = (w & ~mask) | ((val << (f->bitoffs & 31)) & mask);
+	w = htonl(w);
+	memcpy(p, &w, sizeof(w));
+}
+
+static uint32_t _get_field(void *buf, int base_offs, const ib_field_t * f)
+{
+	uint8_t *p = (uint8_t *) buf + base_offs + (f->bitoffs & ~31) / 8;
+	uint32_t w;
+
+	if (!_in_word(base_offs, f))
+		return _get_field_bytes(buf, base_offs, f);
+
+	memcpy(&w, p, sizeof(w));
+	return (ntohl(w) >> (f->bitoffs & 31)) & _word_mask(f);
+}
+
 /* field must be byte aligned */
 static void _set_array(void *buf, int base_offs, const ib_field_t * f,
 		       void *val)
@@ -1178,6 +1227,153 @@ void mad_encode_field(uint8_t * buf, enum MAD_FIELDS field, void *val)
 	_set_array(buf, 0, f, val);
 }
 
+/*
+ * Whole attribute decoders: load the attribute as host order words once
+ * and cut every field out of them.  Offsets are the big endian bit
+ * offsets of the field table above.
+ */
+static void _load_words(uint32_t * w, void *buf, int nwords)
+{
+	int i;
+
+	memcpy(w, buf, nwords * sizeof(*w));
+	for (i = 0; i < nwords; i++)
+		w[i] = ntohl(w[i]);
+}
+
+static inline uint32_t _bits(const uint32_t * w, int o, int len)
+{
+	uint32_t v = w[o / 32] >> (32 - (o & 31) - len);
+
+	return len == 32 ? v : v & ((1u << len) - 1);
+}
+
+static inline uint64_t _bits64(const uint32_t * w, int o)
+{
+	return (uint64_t) w[o / 32] << 32 | w[o / 32 + 1];
+}
+
+void mad_decode_portinfo(void *buf, struct ib_portinfo_decoded *pi)
+{
+	uint32_t w[IB_SMP_DATA_SIZE / 4];
+
+	_load_words(w, buf, IB_SMP_DATA_SIZE / 4);
+
+	pi->mkey = _bits64(w, 0);
+	pi->gid_prefix = _bits64(w, 64);
+	pi->lid = _bits(w, 128, 16);
+	pi->sm_lid = _bits(w, 144, 16);
+	pi->capmask = _bits(w, 160, 32);
+	pi->diag_code = _bits(w, 192, 16);
+	pi->mkey_lease_period = _bits(w, 208, 16);
+	pi->local_port = _bits(w, 224, 8);
+	pi->link_width_enabled = _bits(w, 232, 8);
+	pi->link_width_supported = _bits(w, 240, 8);
+	pi->link_width_active = _bits(w, 248, 8);
+	pi->link_speed_supported = _bits(w, 256, 4);
+	pi->state = _bits(w, 260, 4);
+	pi->phys_state = _bits(w, 264, 4);
+	pi->link_down_def_state = _bits(w, 268, 4);
+	pi->mkey_prot_bits = _bits(w, 272, 2);
+	pi->lmc = _bits(w, 277, 3);
+	pi->link_speed_active = _bits(w, 280, 4);
+	pi->link_speed_enabled = _bits(w, 284, 4);
+	pi->neighbor_mtu = _bits(w, 288, 4);
+	pi->smsl = _bits(w, 292, 4);
+	pi->vl_cap = _bits(w, 296, 4);
+	pi->init_type = _bits(w, 300, 4);
+	pi->vl_high_limit = _bits(w, 304, 8);
+	pi->vl_arb_high_cap = _bits(w, 312, 8);
+	pi->vl_arb_low_cap = _bits(w, 320, 8);
+	pi->init_type_reply = _bits(w, 328, 4);
+	pi->mtu_cap = _bits(w, 332, 4);
+	pi->vl_stall_count = _bits(w, 336, 3);
+	pi->hoq_life = _bits(w, 339, 5);
+	pi->oper_vls = _bits(w, 344, 4);
+	pi->part_enf_inb = _bits(w, 348, 1);
+	pi->part_enf_outb = _bits(w, 349, 1);
+	pi->filter_raw_inb = _bits(w, 350, 1);
+	pi->filter_raw_outb = _bits(w, 351, 1);
+	pi->mkey_violations = _bits(w, 352, 16);
+	pi->pkey_violations = _bits(w, 368, 16);
+	pi->qkey_violations = _bits(w, 384, 16);
+	pi->guid_cap = _bits(w, 400, 8);
+	pi->client_reregister = _bits(w, 408, 1);
+	pi->mcast_pkey_trap_supr = _bits(w, 409, 1);
+	pi->subnet_timeout = _bits(w, 411, 5);
+	pi->resp_time_val = _bits(w, 419, 5);
+	pi->local_phys_err = _bits(w, 424, 4);
+	pi->overrun_err = _bits(w, 428, 4);
+	pi->max_credit_hint = _bits(w, 432, 16);
+	pi->link_round_trip = _bits(w, 456, 24);
+	pi->capmask2 = _bits(w, 480, 16);
+	pi->link_speed_ext_active = _bits(w, 496, 4);
+	pi->link_speed_ext_supported = _bits(w, 500, 4);
+	pi->link_speed_ext_enabled = _bits(w, 507, 5);
+}
+
+void mad_decode_perfcounters(void *buf, struct ib_perfcounters_decoded *pc)
+{
+	uint32_t w[352 / 32];
+
+	_load_words(w, buf, 352 / 32);
+
+	pc->port_select = _bits(w, 8, 8);
+	pc->counter_select = _bits(w, 16, 16);
+	pc->symbol_errors = _bits(w, 32, 16);
+	pc->link_recovers = _bits(w, 48, 8);
+	pc->link_downed = _bits(w, 56, 8);
+	pc->rcv_errors = _bits(w, 64, 16);
+	pc->rcv_remote_phys_errors = _bits(w, 80, 16);
+	pc->rcv_switch_relay_errors = _bits(w, 96, 16);
+	pc->xmt_discards = _bits(w, 112, 16);
+	pc->xmt_constraint_errors = _bits(w, 128, 8);
+	pc->rcv_constraint_errors = _bits(w, 136, 8);
+	pc->counter_select2 = _bits(w, 144, 8);
+	pc->link_integrity_errors = _bits(w, 152, 4);
+	pc->excessive_buffer_overrun_errors = _bits(w, 156, 4);
+	pc->vl15_dropped = _bits(w, 176, 16);
+	pc->xmt_data = _bits(w, 192, 32);
+	pc->rcv_data = _bits(w, 224, 32);
+	pc->xmt_pkts = _bits(w, 256, 32);
+	pc->rcv_pkts = _bits(w, 288, 32);
+	pc->xmt_wait = _bits(w, 320, 32);
+}
+
+void mad_decode_perfcounters_ext(void *buf,
+				 struct ib_perfcounters_ext_decoded *pc)
+{
+	uint32_t w[1472 / 32];
+
+	_load_words(w, buf, 1472 / 32);
+
+	pc->port_select = _bits(w, 8, 8);
+	pc->counter_select = _bits(w, 16, 16);
+	pc->counter_select2 = _bits(w, 32, 32);
+	pc->xmt_data = _bits64(w, 64);
+	pc->rcv_data = _bits64(w, 128);
+	pc->xmt_pkts = _bits64(w, 192);
+	pc->rcv_pkts = _bits64(w, 256);
+	pc->xmt_upkts = _bits64(w, 320);
+	pc->rcv_upkts = _bits64(w, 384);
+	pc->xmt_mpkts = _bits64(w, 448);
+	pc->rcv_mpkts = _bits64(w, 512);
+	pc->symbol_errors = _bits64(w, 576);
+	pc->link_recovers = _bits64(w, 640);
+	pc->link_downed = _bits64(w, 704);
+	pc->rcv_errors = _bits64(w, 768);
+	pc->rcv_remote_phys_errors = _bits64(w, 832);
+	pc->rcv_switch_relay_errors = _bits64(w, 896);
+	pc->xmt_discards = _bits64(w, 960);
+	pc->xmt_constraint_errors = _bits64(w, 1024);
+	pc->rcv_constraint_errors = _bits64(w, 1088);
+	pc->link_integrity_errors = _bits64(w, 1152);
+	pc->excessive_buffer_overrun_errors = _bits64(w, 1216);
+	pc->vl15_dropped = _bits64(w, 1280);
+	pc->xmt_wait = _bits64(w, 1344);
+	pc->qp1_dropped = _bits64(w, 1408);
+}
+
 /************************/
 
 static char *_mad_dump_val(const ib_field_t * f, char *buf, int bufsz,
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+ * Generator of mad_fields.h, the inline accessors for the fields which
+ * lie within one 32 bit word.  It reads ib_mad_f directly; the output is
+ * committed, so rerun it with "make mad_fields" when the table changes.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include "fields.c"
+
+#define CHECK_BYTES 2048
+#define CHECK_ROUNDS 64
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 1) ^ (seed << 17);
+}
+
+static void fill(uint8_t * buf)
+{
+	int i;
+
+	for (i = 0; i < CHECK_BYTES; i++)
+		buf[i] = rnd();
+}
+
+/* the word path must agree with the byte path, which is the reference */
+static int check(int field, const ib_field_t * f)
+{
+	uint8_t a[CHECK_BYTES], b[CHECK_BYTES];
+	uint32_t val;
+	int i;
+
+	if (f->bitoffs / 8 + 4 > CHECK_BYTES)
+		return -1;
+
+	for (i = 0; i < CHECK_ROUNDS; i++) {
+		fill(a);
+		if (_get_field(a, 0, f) != _get_field_bytes(a, 0, f))
+			return -1;
+		memcpy(b, a, sizeof(a));
+		val = rnd() & _word_mask(f);
+		_set_field(a, 0, f, val);
+		_set_field_bytes(b, 0, f, val);
+		if (memcmp(a, b, sizeof(a)))
+			return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int field;
+
+	printf("/*\n"
+	       " * Generated by gen_fields from the libibmad field table; "
+	       "do not edit.\n"
+	       " */\n"
+	       "\n"
+	       "#ifndef _MAD_FIELDS_H_\n"
+	       "#define _MAD_FIELDS_H_\n"
+	       "\n"
+	       "#include <string.h>\n"
+	       "#include <arpa/inet.h>\n"
+	       "#include <infiniband/mad.h>\n"
+	       "\n"
+	       "#ifdef __cplusplus\n"
+	       "extern \"C\" {\n"
+	       "#endif\n"
+	       "\n"
+	       "/*\n"
+	       " * Each field within one 32 bit word is that big endian word "
+	       "at byte\n"
+	       " * offset word, shifted right by shift, in bits bits.  Fields "
+	       "with bits 0\n"
+	       " * (wider, or across words) are left to the library.\n"
+	       " */\n"
+	       "struct mad_field_layout {\n"
+	       "\tuint16_t word;\n"
+	       "\tuint8_t shift;\n"
+	       "\tuint8_t bits;\n"
+	       "};\n"
+	       "\n"
+	       "static const struct mad_field_layout "
+	       "mad_field_layouts[IB_FIELD_LAST_ + 1] = {\n");
+
+	for (field = 0; field <= IB_FIELD_LAST_; field++) {
+		const ib_field_t *f = ib_mad_f + field;
+
+		if (!_in_word(0, f)) {
+			printf("\t{0, 0, 0},\t/* %d %s */\n", field, f->name);
+			continue;
+		}
+		if (check(field, f)) {
+			fprintf(stderr, "gen_fields: field %d %s: word and "
+				"byte accessors disagree\n", field, f->name);
+			return 1;
+		}
+		printf("\t{%d, %d, %d},\t/* %d %s */\n", (f->bitoffs & ~31) / 8,
+		       f->bitoffs & 31, f->bitlen, field, f->name);
+	}
+
+	printf("};\n"
+	       "\n"
+	       "/*\n"
+	       " * mad_get_field() and mad_set_field() inline; with a constant "
+	       "field\n"
+	       " * they compile to a load, shift and mask.\n"
+	       " */\n"
+	       "static inline uint32_t mad_get_field_fast(void *buf, int "
+	       "base_offs,\n"
+	       "\t\t\t\t\t  enum MAD_FIELDS field)\n"
+	       "{\n"
+	       "\tconst struct mad_field_layout *l = &mad_field_layouts[field];\n"
+	       "\tuint32_t w;\n"
+	       "\n"
+	       "\tif (!l->bits || (base_offs & 3))\n"
+	       "\t\treturn mad_get_field(buf, base_offs, field);\n"
+	       "\n"
+	       "\tmemcpy(&w, (uint8_t *) buf + base_offs + l->word, "
+	       "sizeof(w));\n"
+	       "\tw = ntohl(w) >> l->shift;\n"
+	       "\treturn l->bits == 32 ? w : w & ((1u << l->bits) - 1);\n"
+	       "}\n"
+	       "\n"
+	       "static inline void mad_set_field_fast(void *buf, int "
+	       "base_offs,\n"
+	       "\t\t\t\t      enum MAD_FIELDS field, uint32_t val)\n"
+	       "{\n"
+	       "\tconst struct mad_field_layout *l = &mad_field_layouts[field];\n"
+	       "\tuint8_t *p = (uint8_t *) buf + base_offs + l->word;\n"
+	       "\tuint32_t w, mask;\n"
+	       "\n"
+	       "\tif (!l->bits || (base_offs & 3)) {\n"
+	       "\t\tmad_set_field(buf, base_offs, field, val);\n"
+	       "\t\treturn;\n"
+	       "\t}\n"
+	       "\n"
+	       "\tmask = (l->bits == 32 ? 0xffffffff : (1u << l->bits) - 1) "
+	       "<< l->shift;\n"
+	       "\tmemcpy(&w, p, sizeof(w));\n"
+	       "\tw = (ntohl(w) & ~mask) | ((val << l->shift) & mask);\n"
+	       "\tw = htonl(w);\n"
+	       "\tmemcpy(p, &w, sizeof(w));\n"
+	       "}\n"
+	       "\n"
+	       "/*\n"
+	       " * Define IBMAD_FAST_FIELDS before including this header to "
+	       "have the\n"
+	       " * existing mad_get_field() and mad_set_field() calls use "
+	       "them.\n"
+	       " */\n"
+	       "#ifdef IBMAD_FAST_FIELDS\n"
+	       "#define mad_get_field(buf, base_offs, field) \\\n"
+	       "\tmad_get_field_fast(buf, base_offs, field)\n"
+	       "#define mad_set_field(buf, base_offs, field, val) \\\n"
+	       "\tmad_set_field_fast(buf, base_offs, field, val)\n"
+	       "#endif\n"
+	       "\n"
+	       "#ifdef __cplusplus\n"
+	       "}\n"
+	       "#endif\n"
+	       "\n"
+	       "#endif\t\t\t\t/* _MAD_FIELDS_H_ */\n");
+	return 0;
+}
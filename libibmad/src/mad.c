@@ -63,11 +63,12 @@ uint64_t mad_trid(void)
 	static uint64_t trid;
 	uint64_t next;
 
-	if (!trid) {
+	/* callers may be on several threads (multi port discovery) */
+	if (!__sync_fetch_and_add(&trid, 0)) {
 		srandom((int)time(0) * getpid());
-		trid = random();
+		__sync_bool_compare_and_swap(&trid, 0, (uint64_t) random());
 	}
-	next = ++trid;
+	next = __sync_add_and_fetch(&trid, 1);
 	next = GET_IB_USERLAND_TID(next);
 	return next;
 }
@@ -37,14 +37,19 @@
 #define MAX_CLASS 256
 
 struct ibmad_port {
+	struct ibmad_transport *tp;	/* transport the port was opened on */
 	int port_id;		/* file descriptor returned by umad_open() */
 	int class_agents[MAX_CLASS];	/* class2agent mapper */
 	int timeout, retries;
 	uint64_t smp_mkey;
+	struct ibmad_port *next;	/* list of open ports, see rpc.c */
 };
 
 extern struct ibmad_port *ibmp;
 extern int madrpc_timeout;
 extern int madrpc_retries;
 
+struct ibmad_transport *mad_port_transport(int port_id);
+struct ibmad_transport *mad_umad_transport(void);
+
 #endif /* _MAD_INTERNAL_H_ */
@@ -84,14 +84,19 @@ int mad_class_agent(int mgmt)
 
 int mad_register_port_client(int port_id, int mgmt, uint8_t rmpp_version)
 {
+	struct ibmad_transport *tp = mad_port_transport(port_id);
 	int vers, agent;
 
+	/* not opened through libibmad: a umad_open_port() descriptor */
+	if (!tp)
+		tp = mad_umad_transport();
+
 	if ((vers = mgmt_class_vers(mgmt)) <= 0) {
 		DEBUG("Unknown class %d mgmt_class", mgmt);
 		return -1;
 	}
 
-	agent = umad_register(port_id, mgmt, vers, rmpp_version, 0);
+	agent = tp->register_agent(tp, port_id, mgmt, vers, rmpp_version, 0);
 	if (agent < 0)
 		DEBUG("Can't register agent for class %d", mgmt);
 
@@ -106,15 +111,22 @@ int mad_register_client(int mgmt, uint8_t rmpp_version)
 int mad_register_client_via(int mgmt, uint8_t rmpp_version,
 			    struct ibmad_port *srcport)
 {
-	int agent;
+	int vers, agent;
 
 	if (!srcport)
 		return -1;
 
-	agent = mad_register_port_client(mad_rpc_portid(srcport), mgmt,
-					 rmpp_version);
-	if (agent < 0)
+	if ((vers = mgmt_class_vers(mgmt)) <= 0) {
+		DEBUG("Unknown class %d mgmt_class", mgmt);
+		return -1;
+	}
+
+	agent = srcport->tp->register_agent(srcport->tp, srcport->port_id, mgmt,
+					    vers, rmpp_version, 0);
+	if (agent < 0) {
+		DEBUG("Can't register agent for class %d", mgmt);
 		return agent;
+	}
 
 	srcport->class_agents[mgmt] = agent;
 	return 0;
@@ -159,15 +171,17 @@ int mad_register_server_via(int mgmt, uint8_t rmpp_version,
 		oui[1] = (class_oui >> 8) & 0xff;
 		oui[2] = class_oui & 0xff;
 		if ((agent =
-		     umad_register_oui(srcport->port_id, mgmt, rmpp_version,
-				       oui, class_method_mask)) < 0) {
+		     srcport->tp->register_oui(srcport->tp, srcport->port_id,
+					       mgmt, rmpp_version, oui,
+					       class_method_mask)) < 0) {
 			DEBUG("Can't register agent for class %d", mgmt);
 			return -1;
 		}
 	} else
 	    if ((agent =
-		 umad_register(srcport->port_id, mgmt, vers, rmpp_version,
-			       class_method_mask)) < 0) {
+		 srcport->tp->register_agent(srcport->tp, srcport->port_id,
+					     mgmt, vers, rmpp_version,
+					     class_method_mask)) < 0) {
 		DEBUG("Can't register agent for class %d", mgmt);
 		return -1;
 	}
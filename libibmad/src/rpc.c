@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <infiniband/umad.h>
 #include <infiniband/mad.h>
@@ -54,6 +55,54 @@ struct ibmad_port *ibmp = &mad_port;
 
 static int iberrs;
 
+/* Ports opened through libibmad, so a bare port_id maps to its transport */
+static struct ibmad_port *open_ports;
+static pthread_mutex_t open_ports_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void port_list_add(struct ibmad_port *p)
+{
+	struct ibmad_port *q;
+
+	pthread_mutex_lock(&open_ports_lock);
+	for (q = open_ports; q; q = q->next)
+		if (q == p)
+			break;
+	if (!q) {
+		p->next = open_ports;
+		open_ports = p;
+	}
+	pthread_mutex_unlock(&open_ports_lock);
+}
+
+static void port_list_del(struct ibmad_port *p)
+{
+	struct ibmad_port **pp;
+
+	pthread_mutex_lock(&open_ports_lock);
+	for (pp = &open_ports; *pp; pp = &(*pp)->next)
+		if (*pp == p) {
+			*pp = p->next;
+			break;
+		}
+	pthread_mutex_unlock(&open_ports_lock);
+}
+
+/* Transport of the open port using port_id, NULL if libibmad did not open it */
+struct ibmad_transport *mad_port_transport(int port_id)
+{
+	struct ibmad_transport *tp = NULL;
+	struct ibmad_port *p;
+
+	pthread_mutex_lock(&open_ports_lock);
+	for (p = open_ports; p; p = p->next)
+		if (p->port_id == port_id) {
+			tp = p->tp;
+			break;
+		}
+	pthread_mutex_unlock(&open_ports_lock);
+	return tp;
+}
+
 int madrpc_retries = MAD_DEF_RETRIES;
 int madrpc_timeout = MAD_DEF_TIMEOUT_MS;
 
@@ -126,8 +175,9 @@ int mad_rpc_class_agent(struct ibmad_port *port, int class)
 }
 
 static int
-_do_madrpc(int port_id, void *sndbuf, void *rcvbuf, int agentid, int len,
-	   int timeout, int max_retries, int *p_error)
+_do_madrpc(struct ibmad_transport *tp, int port_id, void *sndbuf,
+	   void *rcvbuf, int agentid, int len, int timeout, int max_retries,
+	   int *p_error)
 {
 	uint32_t trid;		/* only low 32 bits - see mad_trid() */
 	int retries;
@@ -159,7 +209,8 @@ _do_madrpc(int port_id, void *sndbuf, void *rcvbuf, int agentid, int len,
 			ERRS("retry %d (timeout %d ms)", retries, timeout);
 
 		length = len;
-		if (umad_send(port_id, agentid, sndbuf, length, timeout, 0) < 0) {
+		if (tp->send(tp, port_id, agentid, sndbuf, length, timeout,
+			     0) < 0) {
 			IBWARN("send failed; %s", strerror(errno));
 			return -1;
 		}
@@ -168,7 +219,8 @@ _do_madrpc(int port_id, void *sndbuf, void *rcvbuf, int agentid, int len,
 		/* send packet is lost somewhere. */
 		do {
 			length = len;
-			if (umad_recv(port_id, rcvbuf, &length, timeout) < 0) {
+			if (tp->recv(tp, port_id, rcvbuf, &length,
+				     timeout) < 0) {
 				IBWARN("recv failed: %s", strerror(errno));
 				return -1;
 			}
@@ -235,7 +287,7 @@ void *mad_rpc(const struct ibmad_port *port, ib_rpc_t * rpc,
 		if ((len = mad_build_pkt(sndbuf, rpc, dport, 0, payload)) < 0)
 			return NULL;
 
-		if ((len = _do_madrpc(port->port_id, sndbuf, rcvbuf,
+		if ((len = _do_madrpc(port->tp, port->port_id, sndbuf, rcvbuf,
 				      port->class_agents[rpc->mgtclass & 0xff],
 				      len, mad_get_timeout(port, rpc->timeout),
 				      mad_get_retries(port), &error)) < 0) {
@@ -295,7 +347,7 @@ void *mad_rpc_rmpp(const struct ibmad_port *port, ib_rpc_t * rpc,
 	if ((len = mad_build_pkt(sndbuf, rpc, dport, rmpp, data)) < 0)
 		return NULL;
 
-	if ((len = _do_madrpc(port->port_id, sndbuf, rcvbuf,
+	if ((len = _do_madrpc(port->tp, port->port_id, sndbuf, rcvbuf,
 			      port->class_agents[rpc->mgtclass & 0xff],
 			      len, mad_get_timeout(port, rpc->timeout),
 			      mad_get_retries(port), &error)) < 0) {
@@ -353,19 +405,19 @@ void *madrpc_rmpp(ib_rpc_t * rpc, ib_portid_t * dport, ib_rmpp_hdr_t * rmpp,
 void
 madrpc_init(char *dev_name, int dev_port, int *mgmt_classes, int num_classes)
 {
+	struct ibmad_transport *tp = mad_get_transport();
 	int fd;
 
-	if (umad_init() < 0)
-		IBPANIC("can't init UMAD library");
-
-	if ((fd = umad_open_port(dev_name, dev_port)) < 0)
+	if ((fd = tp->open_port(tp, dev_name, dev_port)) < 0)
 		IBPANIC("can't open UMAD port (%s:%d)",
 		dev_name ? dev_name : "(nil)", dev_port);
 
 	if (num_classes >= MAX_CLASS)
 		IBPANIC("too many classes %d requested", num_classes);
 
+	ibmp->tp = tp;
 	ibmp->port_id = fd;
+	port_list_add(ibmp);
 	memset(ibmp->class_agents, 0xff, sizeof ibmp->class_agents);
 	while (num_classes--) {
 		uint8_t rmpp_version = 0;
@@ -382,6 +434,7 @@ madrpc_init(char *dev_name, int dev_port, int *mgmt_classes, int num_classes)
 struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 				     int *mgmt_classes, int num_classes)
 {
+	struct ibmad_transport *tp = mad_get_transport();
 	struct ibmad_port *p;
 	int port_id;
 
@@ -391,12 +444,6 @@ struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 		return NULL;
 	}
 
-	if (umad_init() < 0) {
-		IBWARN("can't init UMAD library");
-		errno = ENODEV;
-		return NULL;
-	}
-
 	p = malloc(sizeof(*p));
 	if (!p) {
 		errno = ENOMEM;
@@ -404,7 +451,7 @@ struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 	}
 	memset(p, 0, sizeof(*p));
 
-	if ((port_id = umad_open_port(dev_name, dev_port)) < 0) {
+	if ((port_id = tp->open_port(tp, dev_name, dev_port)) < 0) {
 		IBWARN("can't open UMAD port (%s:%d)", dev_name, dev_port);
 		if (!errno)
 			errno = EIO;
@@ -412,7 +459,9 @@ struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 		return NULL;
 	}
 
+	p->tp = tp;
 	p->port_id = port_id;
+	port_list_add(p);
 	memset(p->class_agents, 0xff, sizeof p->class_agents);
 	while (num_classes--) {
 		uint8_t rmpp_version = 0;
@@ -425,7 +474,8 @@ struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 			IBWARN("client_register for mgmt %d failed", mgmt);
 			if (!errno)
 				errno = EINVAL;
-			umad_close_port(port_id);
+			port_list_del(p);
+			tp->close_port(tp, port_id);
 			free(p);
 			return NULL;
 		}
@@ -436,6 +486,7 @@ struct ibmad_port *mad_rpc_open_port(char *dev_name, int dev_port,
 
 void mad_rpc_close_port(struct ibmad_port *port)
 {
-	umad_close_port(port->port_id);
+	port_list_del(port);
+	port->tp->close_port(port->tp, port->port_id);
 	free(port);
 }
@@ -73,9 +73,10 @@ int mad_send_via(ib_rpc_t * rpc, ib_portid_t * dport, ib_rmpp_hdr_t * rmpp,
 		      (char *)umad_get_mad(umad) + rpc->dataoffs, rpc->datasz);
 	}
 
-	if (umad_send(srcport->port_id, srcport->class_agents[rpc->mgtclass & 0xff],
-		      umad, IB_MAD_SIZE, mad_get_timeout(srcport, rpc->timeout),
-		      0) < 0) {
+	if (srcport->tp->send(srcport->tp, srcport->port_id,
+			      srcport->class_agents[rpc->mgtclass & 0xff],
+			      umad, IB_MAD_SIZE,
+			      mad_get_timeout(srcport, rpc->timeout), 0) < 0) {
 		IBWARN("send failed; %s", strerror(errno));
 		return -1;
 	}
@@ -157,9 +158,9 @@ int mad_respond_via(void *umad, ib_portid_t * portid, uint32_t rstatus,
 	if (ibdebug > 1)
 		xdump(stderr, "mad respond pkt\n", mad, IB_MAD_SIZE);
 
-	if (umad_send
-	    (srcport->port_id, srcport->class_agents[rpc.mgtclass], umad,
-	     IB_MAD_SIZE, mad_get_timeout(srcport, rpc.timeout), 0) < 0) {
+	if (srcport->tp->send
+	    (srcport->tp, srcport->port_id, srcport->class_agents[rpc.mgtclass],
+	     umad, IB_MAD_SIZE, mad_get_timeout(srcport, rpc.timeout), 0) < 0) {
 		DEBUG("send failed; %s", strerror(errno));
 		return -1;
 	}
@@ -178,8 +179,9 @@ void *mad_receive_via(void *umad, int timeout, struct ibmad_port *srcport)
 	int agent;
 	int length = IB_MAD_SIZE;
 
-	if ((agent = umad_recv(srcport->port_id, mad, &length,
-			       mad_get_timeout(srcport, timeout))) < 0) {
+	if ((agent = srcport->tp->recv(srcport->tp, srcport->port_id, mad,
+				       &length,
+				       mad_get_timeout(srcport, timeout))) < 0) {
 		if (!umad)
 			umad_free(mad);
 		DEBUG("recv failed: %s", strerror(errno));
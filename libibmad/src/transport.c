@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+#include "mad_internal.h"
+
+static int umad_tp_open_port(struct ibmad_transport *tp, const char *ca_name,
+			     int portnum)
+{
+	if (umad_init() < 0) {
+		IBWARN("can't init UMAD library");
+		errno = ENODEV;
+		return -1;
+	}
+	return umad_open_port((char *)ca_name, portnum);
+}
+
+static int umad_tp_close_port(struct ibmad_transport *tp, int fd)
+{
+	return umad_close_port(fd);
+}
+
+static int umad_tp_get_port(struct ibmad_transport *tp, const char *ca_name,
+			    int portnum, struct umad_port *port)
+{
+	return umad_get_port((char *)ca_name, portnum, port);
+}
+
+static int umad_tp_release_port(struct ibmad_transport *tp,
+				struct umad_port *port)
+{
+	return umad_release_port(port);
+}
+
+static int umad_tp_register(struct ibmad_transport *tp, int fd, int mgmt_class,
+			    int mgmt_version, uint8_t rmpp_version,
+			    long method_mask[])
+{
+	return umad_register(fd, mgmt_class, mgmt_version, rmpp_version,
+			     method_mask);
+}
+
+static int umad_tp_register_oui(struct ibmad_transport *tp, int fd,
+				int mgmt_class, uint8_t rmpp_version,
+				uint8_t oui[3], long method_mask[])
+{
+	return umad_register_oui(fd, mgmt_class, rmpp_version, oui,
+				 method_mask);
+}
+
+static int umad_tp_unregister(struct ibmad_transport *tp, int fd, int agentid)
+{
+	return umad_unregister(fd, agentid);
+}
+
+static int umad_tp_send(struct ibmad_transport *tp, int fd, int agentid,
+			void *umad, int length, int timeout_ms, int retries)
+{
+	return umad_send(fd, agentid, umad, length, timeout_ms, retries);
+}
+
+static int umad_tp_recv(struct ibmad_transport *tp, int fd, void *umad,
+			int *length, int timeout_ms)
+{
+	return umad_recv(fd, umad, length, timeout_ms);
+}
+
+static struct ibmad_transport umad_transport = {
+	.name = "umad",
+	.open_port = umad_tp_open_port,
+	.close_port = umad_tp_close_port,
+	.get_port = umad_tp_get_port,
+	.release_port = umad_tp_release_port,
+	.register_agent = umad_tp_register,
+	.register_oui = umad_tp_register_oui,
+	.unregister_agent = umad_tp_unregister,
+	.send = umad_tp_send,
+	.recv = umad_tp_recv,
+};
+
+static struct ibmad_transport *cur_transport = &umad_transport;
+
+struct ibmad_transport *mad_get_transport(void)
+{
+	return cur_transport;
+}
+
+struct ibmad_transport *mad_umad_transport(void)
+{
+	return &umad_transport;
+}
+
+/* Ports opened after this call use tp; NULL restores libibumad. */
+void mad_set_transport(struct ibmad_transport *tp)
+{
+	cur_transport = tp ? tp : &umad_transport;
+}
+
+struct ibmad_transport *mad_rpc_transport(struct ibmad_port *srcport)
+{
+	return srcport->tp;
+}
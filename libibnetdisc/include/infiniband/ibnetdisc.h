@@ -99,6 +99,14 @@ typedef struct ibnd_node {
 	unsigned char ch_found;
 	struct ibnd_node *htnext;	/* hash table list */
 	struct ibnd_node *type_next;	/* next based on type */
+
+	/* forwarding tables of a switch, see ibnd_load_fts() */
+	uint8_t *lft;		/* out port by LID, 0xFF if none */
+	unsigned lft_size;	/* LinearFDBTop + 1 */
+	uint8_t *mft;		/* port bitmask by MLID - IB_MIN_MCAST_LID */
+	unsigned mft_size;	/* number of MLIDs in mft */
+	unsigned mft_stride;	/* bytes per MLID; port p is bit p % 8
+				   of byte p / 8 */
 } ibnd_node_t;
 
 /** =========================================================================
@@ -144,6 +152,10 @@ typedef struct ibnd_chassis {
 
 /* define config flags */
 #define IBND_CONFIG_MLX_EPI (1 << 0)
+#define IBND_CONFIG_ADAPTIVE_SMPS (1 << 1)	/* AIMD windowing; max_smps
+						 * becomes the window ceiling */
+#define IBND_CONFIG_MULTI_PORT (1 << 2)	/* also scan from the other active
+					 * local ports on the same subnet */
 
 typedef struct ibnd_config {
 	unsigned max_smps;
@@ -154,7 +166,8 @@ typedef struct ibnd_config {
 	unsigned retries;
 	uint32_t flags;
 	uint64_t mkey;
-	uint8_t pad[44];
+	unsigned max_smps_per_switch;	/* adaptive mode only */
+	uint8_t pad[40];
 } ibnd_config_t;
 
 /** =========================================================================
@@ -177,6 +190,8 @@ typedef struct ibnd_fabric {
 	unsigned total_mads_used;
 
 	/* internal use only */
+	/* no longer maintained; guid lookups use tables private to the
+	 * library.  Kept so the structure layout does not change. */
 	ibnd_node_t *nodestbl[HTSZ];
 	ibnd_port_t *portstbl[HTSZ];
 	ibnd_node_t *switches;
@@ -209,6 +224,132 @@ IBND_EXPORT int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 
 #define IBND_CACHE_FABRIC_FLAG_DEFAULT      0x0000
 #define IBND_CACHE_FABRIC_FLAG_NO_OVERWRITE 0x0001
+/* write the version 2 format: mapped rather than parsed on load and
+ * holding forwarding tables, but not readable by older libraries */
+#define IBND_CACHE_FABRIC_FLAG_V2           0x0004
+
+IBND_EXPORT int ibnd_cache_fabric_buf(ibnd_fabric_t * fabric, void **buf,
+				     size_t * len);
+IBND_EXPORT ibnd_fabric_t *ibnd_load_fabric_buf(const void *buf, size_t len,
+					       unsigned int flags);
+	/**
+	 * The version 2 cache image held in memory rather than in a file,
+	 * e.g. to hand a fabric to another process.  *buf is malloc'd and
+	 * freed by the caller; ibnd_load_fabric_buf does not keep buf.
+	 */
+
+/** =========================================================================
+ * Rediscovery
+ * What changed between a previous fabric and the one just rediscovered.
+ * Links are reported once, from the end with the lower guid.
+ */
+typedef enum ibnd_change_type {
+	IBND_CHANGE_NODE_ADDED,
+	IBND_CHANGE_NODE_REMOVED,
+	IBND_CHANGE_LINK_ADDED,
+	IBND_CHANGE_LINK_REMOVED,
+	IBND_CHANGE_PORT_STATE,	/* port or physical state */
+	IBND_CHANGE_PORT_LID,	/* base LID or LMC */
+} ibnd_change_type_t;
+
+typedef struct ibnd_change {
+	struct ibnd_change *next;
+	ibnd_change_type_t type;
+	uint64_t guid;		/* node guid */
+	int portnum;		/* 0 for node changes */
+	uint64_t remote_guid;	/* links only */
+	int remote_portnum;
+} ibnd_change_t;
+
+IBND_EXPORT ibnd_fabric_t *ibnd_rediscover_fabric(ibnd_fabric_t * prev,
+						 char *ca_name, int ca_port,
+						 ib_portid_t * from,
+						 struct ibnd_config *config,
+						 ibnd_change_t ** changes);
+	/**
+	 * prev: fabric found by an earlier scan, e.g. from ibnd_load_fabric
+	 * changes: (optional) set to the list of changes against prev; the
+	 *          list is freed with the returned fabric
+	 * Other parameters are as for ibnd_discover_fabric.  Links recorded
+	 * in prev are trusted while their ports stay up; only new and
+	 * changed parts of the fabric are scanned in full.
+	 */
+
+/** =========================================================================
+ * Forwarding tables
+ * Read the LFT (and MFT) of every switch into the nodes of a fabric so that
+ * routes can be followed without further MADs.  The tables are freed with
+ * the fabric and stored by ibnd_cache_fabric() in the V2 format.
+ */
+#define IBND_FTS_UNICAST	(1 << 0)
+#define IBND_FTS_MULTICAST	(1 << 1)
+
+IBND_EXPORT int ibnd_load_fts(ibnd_fabric_t * fabric, char *ca_name,
+			      int ca_port, struct ibnd_config *config,
+			      unsigned flags);
+	/**
+	 * flags: IBND_FTS_UNICAST, IBND_FTS_MULTICAST or both; 0 is unicast
+	 * Other parameters are as for ibnd_discover_fabric.  Returns 0, or
+	 * -EIO if some blocks could not be read (the tables are kept, the
+	 * entries missing read as 0xFF or no ports), or another negative
+	 * errno.
+	 */
+
+IBND_EXPORT int ibnd_route(ibnd_fabric_t * fabric, uint16_t slid,
+			   uint16_t dlid, ibnd_port_t ** path, int max);
+	/**
+	 * Follow the LFTs from the port with LID slid to dlid.  path[i]
+	 * (optional, max entries) is set to the port by which the route
+	 * leaves its i'th node; the remote port of the last one is on the
+	 * destination.  Returns the number of links crossed, or -ENOENT
+	 * for an unknown LID, -ENODATA if a switch on the way has no LFT,
+	 * -EHOSTUNREACH if the route ends elsewhere, -ELOOP if it does not
+	 * end, or -ENOSPC if path is too short.
+	 */
+
+/** =========================================================================
+ * Fabric view
+ * The commonly used NodeInfo and PortInfo fields of a fabric decoded once
+ * into dense arrays, for passes which scan every port.  A view is a snapshot
+ * and must be destroyed before its fabric.
+ */
+typedef struct ibnd_fabric_view {
+	ibnd_fabric_t *fabric;
+
+	/* nodes, in fabric->nodes order */
+	uint32_t num_nodes;
+	ibnd_node_t **node;
+	uint64_t *node_guid;
+	uint8_t *node_type;
+	uint8_t *node_numports;
+	uint32_t *node_ports;	/* index of the node's port 0 */
+
+	/* ports; node n has numports + 1 entries from node_ports[n], indexed
+	 * by port number.  Entries without a port (port 0 of CAs and routers,
+	 * ports not found) have a NULL port and are otherwise 0. */
+	uint32_t num_ports;
+	ibnd_port_t **port;
+	uint32_t *port_node;	/* node index */
+	uint64_t *port_guid;
+	uint16_t *lid;		/* base LID */
+	uint8_t *lmc;
+	uint8_t *state;		/* PortState */
+	uint8_t *phys_state;	/* PortPhysicalState */
+	/* C14-24.2.1: only valid on ports which are not down, 0 otherwise */
+	uint8_t *width;		/* LinkWidthActive */
+	uint8_t *speed;		/* LinkSpeedActive */
+	uint8_t *speed_ext;	/* LinkSpeedExtActive, 0 if not supported */
+	uint8_t *fdr10;		/* FDR10 active (Mellanox ext. PortInfo) */
+	int32_t *remote;	/* port index of the remote port, -1 if none */
+} ibnd_fabric_view_t;
+
+IBND_EXPORT ibnd_fabric_view_t *ibnd_build_view(ibnd_fabric_t * fabric);
+IBND_EXPORT void ibnd_destroy_view(ibnd_fabric_view_t * view);
+IBND_EXPORT int ibnd_view_find_node(ibnd_fabric_view_t * view,
+				    uint64_t guid);
+	/**
+	 * Returns the index of the node with guid in view, or -1.
+	 */
 
 /** =========================================================================
  * Node operations
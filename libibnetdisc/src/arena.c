@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/** =========================================================================
+ * Arena and fixed size object pools.
+ *
+ * A fabric is built once and then torn down as a whole, so everything it
+ * owns (nodes, ports, port arrays, chassis) is carved out of large chunks
+ * and released in one go.  Short lived objects which are allocated and
+ * freed at a high rate during a scan (SMP descriptors, NodeInfo callback
+ * data) are recycled through a free list backed by an arena.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_ALIGN_UP(x) (((x) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+struct ibnd_arena_chunk {
+	struct ibnd_arena_chunk *next;
+	size_t size;
+	size_t used;
+	/* keep data[] aligned */
+	size_t pad;
+	uint8_t data[];
+};
+
+void arena_init(ibnd_arena_t * arena)
+{
+	memset(arena, 0, sizeof(*arena));
+}
+
+static struct ibnd_arena_chunk *arena_new_chunk(size_t size)
+{
+	struct ibnd_arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+
+	if (!chunk)
+		return NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+void *arena_zalloc(ibnd_arena_t * arena, size_t size)
+{
+	struct ibnd_arena_chunk *chunk = arena->chunks;
+	void *rc;
+
+	size = ARENA_ALIGN_UP(size ? size : 1);
+
+	/* Large objects get a chunk of their own, placed behind the current
+	 * one so the remaining space of that is not wasted. */
+	if (size > ARENA_CHUNK_SIZE / 4) {
+		struct ibnd_arena_chunk *big = arena_new_chunk(size);
+
+		if (!big)
+			return NULL;
+		big->used = size;
+		if (chunk) {
+			big->next = chunk->next;
+			chunk->next = big;
+		} else {
+			big->next = NULL;
+			arena->chunks = big;
+		}
+		arena->nchunks++;
+		arena->bytes += size;
+		memset(big->data, 0, size);
+		return big->data;
+	}
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		chunk = arena_new_chunk(ARENA_CHUNK_SIZE);
+		if (!chunk)
+			return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->nchunks++;
+	}
+
+	rc = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->bytes += size;
+	memset(rc, 0, size);
+	return rc;
+}
+
+void arena_release(ibnd_arena_t * arena)
+{
+	struct ibnd_arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	arena_init(arena);
+}
+
+/* Move all of src's memory to dst; src is left empty. */
+void arena_adopt(ibnd_arena_t * dst, ibnd_arena_t * src)
+{
+	struct ibnd_arena_chunk *last;
+
+	if (!src->chunks)
+		return;
+
+	/* keep dst's current chunk at the head so its free space is used */
+	for (last = src->chunks; last->next; last = last->next)
+		;
+	if (dst->chunks) {
+		last->next = dst->chunks->next;
+		dst->chunks->next = src->chunks;
+	} else
+		dst->chunks = src->chunks;
+	dst->nchunks += src->nchunks;
+	dst->bytes += src->bytes;
+	arena_init(src);
+}
+
+void pool_init(ibnd_pool_t * pool, ibnd_arena_t * arena, size_t obj_size)
+{
+	pool->arena = arena;
+	pool->obj_size = obj_size < sizeof(void *) ? sizeof(void *) : obj_size;
+	pool->free_list = NULL;
+}
+
+void *pool_get(ibnd_pool_t * pool)
+{
+	void *obj = pool->free_list;
+
+	if (!obj)
+		return arena_zalloc(pool->arena, pool->obj_size);
+
+	pool->free_list = *(void **)obj;
+	memset(obj, 0, pool->obj_size);
+	return obj;
+}
+
+void pool_put(ibnd_pool_t * pool, void *obj)
+{
+	if (!obj)
+		return;
+	*(void **)obj = pool->free_list;
+	pool->free_list = obj;
+}
@@ -1197,10 +1197,12 @@ static void voltaire_portmap(ibnd_port_t * port)
 		port->ext_portnum = int2ext_map_slb8[chipnum][portnum];
 }
 
-static int add_chassis(chassis_scan_t * chassis_scan)
+static int add_chassis(chassis_scan_t * chassis_scan, ibnd_fabric_t * fabric)
 {
+	f_internal_t *f_int = (f_internal_t *)fabric;
+
 	if (!(chassis_scan->current_chassis =
-	      calloc(1, sizeof(ibnd_chassis_t)))) {
+	      arena_zalloc(&f_int->arena, sizeof(ibnd_chassis_t)))) {
 		IBND_ERROR("OOM: failed to allocate chassis object\n");
 		return -1;
 	}
@@ -1240,7 +1242,6 @@ int group_nodes(ibnd_fabric_t * fabric)
 	ibnd_node_t *node;
 	int chassisnum = 0;
 	ibnd_chassis_t *chassis;
-	ibnd_chassis_t *ch, *ch_next;
 	chassis_scan_t chassis_scan;
 	int vendor_id;
 
@@ -1275,7 +1276,7 @@ int group_nodes(ibnd_fabric_t * fabric)
 		    || (node->chassis && node->chassis->chassisnum)
 		    || !is_spine(node))
 			continue;
-		if (add_chassis(&chassis_scan))
+		if (add_chassis(&chassis_scan, fabric))
 			goto cleanup;
 		chassis_scan.current_chassis->chassisnum = ++chassisnum;
 		if (build_chassis(node, chassis_scan.current_chassis))
@@ -1294,7 +1295,7 @@ int group_nodes(ibnd_fabric_t * fabric)
 				chassis->nodecount++;
 			else {
 				/* Possible new chassis */
-				if (add_chassis(&chassis_scan))
+				if (add_chassis(&chassis_scan, fabric))
 					goto cleanup;
 				chassis_scan.current_chassis->chassisguid =
 				    get_chassisguid(node);
@@ -1333,12 +1334,7 @@ int group_nodes(ibnd_fabric_t * fabric)
 	return 0;
 
 cleanup:
-	ch = chassis_scan.first_chassis;
-	while (ch) {
-		ch_next = ch->next;
-		free(ch);
-		ch = ch_next;
-	}
+	/* partial chassis records are released with the fabric arena */
 	fabric->chassis = NULL;
 	return -1;
 }
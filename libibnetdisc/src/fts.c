@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/** =========================================================================
+ * Forwarding tables: the LFT and MFT of every switch read into the fabric,
+ * and routes followed through them.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <infiniband/mad.h>
+
+#include "internal.h"
+
+#define MLIDS_PER_BLOCK (IB_SMP_DATA_SIZE / 2)
+
+/* The reads of a switch are numbered LFT blocks first, then one per MFT
+ * block and 16 port chunk. */
+struct fts_switch {
+	ibnd_node_t *node;
+	ib_portid_t path;
+	unsigned nlft;
+	unsigned nmft;
+	unsigned chunks;
+	unsigned next;
+	unsigned done;
+};
+
+struct fts_load {
+	struct fts_switch *sw;
+	unsigned nsw;
+	/* switches with reads left to issue, taken round robin */
+	struct fts_switch **active;
+	unsigned nactive;
+	unsigned cursor;
+};
+
+static int recv_lft(smp_engine_t * engine, ibnd_smp_t * smp, uint8_t * mad,
+		    void *cb_data)
+{
+	struct fts_switch *sw = cb_data;
+	ibnd_node_t *node = sw->node;
+	unsigned first = smp->rpc.attr.mod * IB_SMP_DATA_SIZE;
+	unsigned n = IB_SMP_DATA_SIZE;
+
+	if (first + n > node->lft_size)
+		n = node->lft_size - first;
+	memcpy(node->lft + first, mad + IB_SMP_DATA_OFFS, n);
+	sw->done++;
+	return 0;
+}
+
+/* 32 MLIDs of 16 big endian port bits each */
+static int recv_mft(smp_engine_t * engine, ibnd_smp_t * smp, uint8_t * mad,
+		    void *cb_data)
+{
+	struct fts_switch *sw = cb_data;
+	ibnd_node_t *node = sw->node;
+	uint8_t *data = mad + IB_SMP_DATA_OFFS;
+	unsigned block = smp->rpc.attr.mod & 0x0fffffff;
+	unsigned chunk = smp->rpc.attr.mod >> 28;
+	unsigned i, mlid;
+	uint8_t *bits;
+
+	for (i = 0; i < MLIDS_PER_BLOCK; i++) {
+		mlid = block * MLIDS_PER_BLOCK + i;
+		if (mlid >= node->mft_size)
+			break;
+		bits = node->mft + mlid * node->mft_stride + chunk * 2;
+		bits[0] = data[2 * i + 1];
+		bits[1] = data[2 * i];
+	}
+	sw->done++;
+	return 0;
+}
+
+static int issue_read(smp_engine_t * engine, struct fts_switch *sw,
+		      unsigned idx)
+{
+	unsigned mod;
+
+	if (idx < sw->nlft)
+		return issue_smp(engine, &sw->path, IB_ATTR_LINEARFORWTBL, idx,
+				 recv_lft, sw);
+
+	idx -= sw->nlft;
+	mod = (idx / sw->chunks) | (idx % sw->chunks) << 28;
+	return issue_smp(engine, &sw->path, IB_ATTR_MULTICASTFORWTBL, mod,
+			 recv_mft, sw);
+}
+
+/* A window of reads, one from each switch in turn, so that the SMPs on
+ * the wire are spread over as many SMAs as possible. */
+static int fill_reads(smp_engine_t * engine)
+{
+	struct fts_load *ld = engine->user_data;
+	struct fts_switch *sw;
+	unsigned n;
+	int rc;
+
+	for (n = 0; n < engine->cfg->max_smps && ld->nactive; n++) {
+		if (ld->cursor >= ld->nactive)
+			ld->cursor = 0;
+		sw = ld->active[ld->cursor];
+		if ((rc = issue_read(engine, sw, sw->next++)) != 0)
+			return rc;
+		if (sw->next == sw->nlft + sw->nmft)
+			ld->active[ld->cursor] = ld->active[--ld->nactive];
+		else
+			ld->cursor++;
+	}
+	return 0;
+}
+
+static unsigned lft_size(ibnd_node_t * node)
+{
+	unsigned top;
+
+	mad_decode_field(node->switchinfo, IB_SW_LINEAR_FDB_TOP_F, &top);
+	if (top > IB_MAX_UCAST_LID)
+		top = IB_MAX_UCAST_LID;
+	return top + 1;
+}
+
+/* as dump_fts: MulticastFDBTop if it is set and sane, else the capacity */
+static unsigned mft_size(ibnd_node_t * node)
+{
+	unsigned cap, top, n;
+
+	mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_CAP_F, &cap);
+	mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_TOP_F, &top);
+
+	n = cap;
+	if (top >= IB_MIN_MCAST_LID - 1 && top - (IB_MIN_MCAST_LID - 1) < n)
+		n = top - (IB_MIN_MCAST_LID - 1);
+	if (n > IB_MAX_MCAST_LID - IB_MIN_MCAST_LID + 1)
+		n = IB_MAX_MCAST_LID - IB_MIN_MCAST_LID + 1;
+	return n;
+}
+
+/* Size the tables of node, reusing those of an earlier load if they
+ * still fit. */
+static int setup_switch(f_internal_t * f_int, struct fts_switch *sw,
+			ibnd_node_t * node, unsigned flags)
+{
+	unsigned size, stride;
+
+	sw->node = node;
+	sw->chunks = ALIGN(node->numports + 1, 16) / 16;
+
+	if (f_int->loaded) {
+		if (!node->smalid) {
+			IBND_ERROR("no LID to reach switch 0x%016" PRIx64
+				   " by\n", node->guid);
+			return 0;
+		}
+		sw->path.lid = node->smalid;
+	} else
+		sw->path = node->path_portid;
+
+	if (flags & IBND_FTS_UNICAST) {
+		size = lft_size(node);
+		if (!node->lft || node->lft_size != size) {
+			node->lft = arena_zalloc(&f_int->arena, size);
+			if (!node->lft)
+				return -ENOMEM;
+			node->lft_size = size;
+		}
+		memset(node->lft, 0xff, size);
+		sw->nlft = ALIGN(size, IB_SMP_DATA_SIZE) / IB_SMP_DATA_SIZE;
+	}
+
+	if (flags & IBND_FTS_MULTICAST) {
+		size = mft_size(node);
+		stride = sw->chunks * 2;
+		if (!node->mft || node->mft_size != size ||
+		    node->mft_stride != stride) {
+			node->mft = arena_zalloc(&f_int->arena,
+						 (size_t) size * stride);
+			if (!node->mft)
+				return -ENOMEM;
+			node->mft_size = size;
+			node->mft_stride = stride;
+		}
+		memset(node->mft, 0, (size_t) size * stride);
+		sw->nmft = ALIGN(size, MLIDS_PER_BLOCK) / MLIDS_PER_BLOCK *
+		    sw->chunks;
+	}
+
+	return 0;
+}
+
+int ibnd_load_fts(ibnd_fabric_t * fabric, char *ca_name, int ca_port,
+		  struct ibnd_config *cfg, unsigned flags)
+{
+	f_internal_t *f_int = (f_internal_t *) fabric;
+	struct ibnd_config config = { 0 };
+	struct fts_load ld;
+	smp_engine_t engine;
+	ibnd_node_t *node;
+	unsigned i, incomplete = 0;
+	int rc;
+
+	if (!fabric) {
+		IBND_DEBUG("fabric parameter NULL\n");
+		return -EINVAL;
+	}
+
+	if (!(flags & (IBND_FTS_UNICAST | IBND_FTS_MULTICAST)))
+		flags |= IBND_FTS_UNICAST;
+
+	set_config(&config, cfg);
+	if (!cfg || !cfg->max_smps)
+		config.max_smps = DEFAULT_FTS_MAX_SMPS;
+
+	memset(&ld, 0, sizeof(ld));
+	for (node = fabric->switches; node; node = node->type_next)
+		ld.nsw++;
+	if (!ld.nsw)
+		return 0;
+
+	ld.sw = calloc(ld.nsw, sizeof(*ld.sw));
+	ld.active = calloc(ld.nsw, sizeof(*ld.active));
+	if (!ld.sw || !ld.active) {
+		IBND_ERROR("OOM: forwarding table reads\n");
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0, node = fabric->switches; node;
+	     node = node->type_next, i++) {
+		if ((rc = setup_switch(f_int, &ld.sw[i], node, flags)) != 0) {
+			IBND_ERROR("OOM: forwarding tables\n");
+			goto out;
+		}
+		if (ld.sw[i].nlft + ld.sw[i].nmft &&
+		    (ld.sw[i].path.lid || !f_int->loaded))
+			ld.active[ld.nactive++] = &ld.sw[i];
+	}
+
+	if ((rc = smp_engine_init(&engine, ca_name, ca_port, &ld, &config)))
+		goto out;
+	engine.fill = fill_reads;
+
+	rc = process_mads(&engine);
+	smp_engine_destroy(&engine);
+	if (rc)
+		goto out;
+
+	for (i = 0; i < ld.nsw; i++)
+		if (ld.sw[i].done < ld.sw[i].nlft + ld.sw[i].nmft) {
+			IBND_DEBUG("forwarding tables of 0x%016" PRIx64
+				   " incomplete: %u of %u blocks read\n",
+				   ld.sw[i].node->guid, ld.sw[i].done,
+				   ld.sw[i].nlft + ld.sw[i].nmft);
+			incomplete++;
+		}
+	rc = incomplete ? -EIO : 0;
+
+out:
+	free(ld.sw);
+	free(ld.active);
+	return rc;
+}
+
+/* the switch, or the CA or router port, that owns dlid */
+static int route_arrived(ibnd_port_t * port, ibnd_port_t * dst)
+{
+	if (port->node->type == IB_NODE_SWITCH)
+		return port->node == dst->node;
+	return port == dst;
+}
+
+int ibnd_route(ibnd_fabric_t * fabric, uint16_t slid, uint16_t dlid,
+	       ibnd_port_t ** path, int max)
+{
+	ibnd_port_t *src, *dst, *port, *out;
+	ibnd_node_t *node;
+	unsigned op;
+	int n = 0;
+
+	if (!fabric) {
+		IBND_DEBUG("fabric parameter NULL\n");
+		return -EINVAL;
+	}
+
+	src = ibnd_find_port_lid(fabric, slid);
+	dst = ibnd_find_port_lid(fabric, dlid);
+	if (!src || !dst)
+		return -ENOENT;
+
+	port = src;
+	while (!route_arrived(port, dst)) {
+		node = port->node;
+		if (node->type != IB_NODE_SWITCH) {
+			/* only the source may hand the packet on */
+			if (n)
+				return -EHOSTUNREACH;
+			out = port;
+		} else {
+			if (!node->lft)
+				return -ENODATA;
+			if (dlid >= node->lft_size)
+				return -EHOSTUNREACH;
+			op = node->lft[dlid];
+			if (!op || op > (unsigned)node->numports ||
+			    !(out = node->ports[op]))
+				return -EHOSTUNREACH;
+		}
+		if (!out->remoteport)
+			return -EHOSTUNREACH;
+		if (n > MAXHOPS)
+			return -ELOOP;
+		if (path) {
+			if (n >= max)
+				return -ENOSPC;
+			path[n] = out;
+		}
+		n++;
+		port = out->remoteport;
+	}
+
+	return n;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/** =========================================================================
+ * GUID lookup tables.
+ *
+ * Open addressing with linear probing.  The table doubles once it is 3/4
+ * full, so lookups stay O(1) however large the fabric.  GUIDs are often
+ * sequential within a vendor range, hence the full 64 bit mixer rather
+ * than a plain multiply.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "internal.h"
+
+#define GUID_TBL_MIN_SIZE 256
+
+/* MurmurHash3 finalizer */
+static inline uint64_t guid_mix(uint64_t guid)
+{
+	guid ^= guid >> 33;
+	guid *= 0xff51afd7ed558ccdULL;
+	guid ^= guid >> 33;
+	guid *= 0xc4ceb9fe1a85ec53ULL;
+	guid ^= guid >> 33;
+	return guid;
+}
+
+void guid_tbl_init(guid_tbl_t * tbl)
+{
+	tbl->slots = NULL;
+	tbl->mask = 0;
+	tbl->count = 0;
+}
+
+void guid_tbl_destroy(guid_tbl_t * tbl)
+{
+	free(tbl->slots);
+	guid_tbl_init(tbl);
+}
+
+static guid_tbl_entry_t *guid_tbl_slot(guid_tbl_entry_t * slots, uint32_t mask,
+				       uint64_t guid)
+{
+	uint32_t i = (uint32_t) guid_mix(guid) & mask;
+
+	while (slots[i].obj && slots[i].guid != guid)
+		i = (i + 1) & mask;
+	return &slots[i];
+}
+
+static int guid_tbl_grow(guid_tbl_t * tbl)
+{
+	uint32_t size = tbl->slots ? (tbl->mask + 1) * 2 : GUID_TBL_MIN_SIZE;
+	guid_tbl_entry_t *slots = calloc(size, sizeof(*slots));
+	uint32_t i;
+
+	if (!slots)
+		return -ENOMEM;
+
+	if (tbl->slots) {
+		for (i = 0; i <= tbl->mask; i++)
+			if (tbl->slots[i].obj)
+				*guid_tbl_slot(slots, size - 1,
+					       tbl->slots[i].guid) =
+				    tbl->slots[i];
+		free(tbl->slots);
+	}
+	tbl->slots = slots;
+	tbl->mask = size - 1;
+	return 0;
+}
+
+/* Start tbl empty with exactly size (a power of 2) slots, for callers
+ * which fill tbl->slots themselves, e.g. from a cache file index. */
+int guid_tbl_presize(guid_tbl_t * tbl, uint32_t size)
+{
+	guid_tbl_destroy(tbl);
+	tbl->slots = calloc(size, sizeof(*tbl->slots));
+	if (!tbl->slots)
+		return -ENOMEM;
+	tbl->mask = size - 1;
+	return 0;
+}
+
+void *guid_tbl_find(const guid_tbl_t * tbl, uint64_t guid)
+{
+	if (!tbl->slots)
+		return NULL;
+	return guid_tbl_slot(tbl->slots, tbl->mask, guid)->obj;
+}
+
+int guid_tbl_insert(guid_tbl_t * tbl, uint64_t guid, void *obj, void **prev)
+{
+	guid_tbl_entry_t *e;
+
+	if (!tbl->slots || (tbl->count + 1) * 4 > (tbl->mask + 1) * 3)
+		if (guid_tbl_grow(tbl))
+			return -ENOMEM;
+
+	e = guid_tbl_slot(tbl->slots, tbl->mask, guid);
+	if (prev)
+		*prev = e->obj;
+	if (!e->obj)
+		tbl->count++;
+	e->guid = guid;
+	e->obj = obj;
+	return 0;
+}
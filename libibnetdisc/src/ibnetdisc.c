@@ -61,8 +61,20 @@ struct ni_cbdata
 	ibnd_node_t *node;
 	int port_num;
 };
+/* rediscovery: PortInfo of the far end of a link recorded in scan->prev */
+struct adopt_cbdata
+{
+	ibnd_node_t *node;
+	int port_num;
+	ibnd_port_t *prev_port;	/* the far port, in scan->prev */
+	ib_portid_t path;
+	struct adopt_cbdata *next;	/* waiting for the same switch */
+};
+static struct adopt_cbdata adopt_done;	/* in scan->adopting: answered */
 static int query_node_info(smp_engine_t * engine, ib_portid_t * portid,
 			   struct ni_cbdata * cbdata);
+static int query_remote_node_info(smp_engine_t * engine, ib_portid_t * path,
+				  ibnd_node_t * node, int port_num);
 static int query_port_info(smp_engine_t * engine, ib_portid_t * portid,
 			   ibnd_node_t * node, int portnum);
 ibnd_port_t *ibnd_find_port_dr(ibnd_fabric_t * fabric, char *dr_str);
@@ -258,12 +270,8 @@ int mlnx_ext_port_info_err(smp_engine_t * engine, ibnd_smp_t * smp,
 				rc = extend_dpath(engine, &path, port_num);
 		}
 
-		if (rc > 0) {
-			struct ni_cbdata * cbdata = malloc(sizeof(*cbdata));
-			cbdata->node = node;
-			cbdata->port_num = port_num;
-			query_node_info(engine, &path, cbdata);
-		}
+		if (rc > 0)
+			query_remote_node_info(engine, &path, node, port_num);
 	}
 
 	return 0;
@@ -307,12 +315,8 @@ static int recv_mlnx_ext_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 				rc = extend_dpath(engine, &path, port_num);
 		}
 
-		if (rc > 0) {
-			struct ni_cbdata * cbdata = malloc(sizeof(*cbdata));
-			cbdata->node = node;
-			cbdata->port_num = port_num;
-			query_node_info(engine, &path, cbdata);
-		}
+		if (rc > 0)
+			query_remote_node_info(engine, &path, node, port_num);
 	}
 
 	return 0;
@@ -346,7 +350,8 @@ static int recv_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 	/* this may have been created before */
 	port = node->ports[port_num];
 	if (!port) {
-		port = node->ports[port_num] = calloc(1, sizeof(*port));
+		port = node->ports[port_num] =
+		    arena_zalloc(&f_int->arena, sizeof(*port));
 		if (!port) {
 			IBND_ERROR("Failed to allocate 0x%" PRIx64 " port %u\n",
 				    node->guid, port_num);
@@ -371,13 +376,14 @@ static int recv_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 		port->lmc = node->smalmc;
 	}
 
-	int rc1 = add_to_portguid_hash(port, f_int->fabric.portstbl);
+	int rc1 = add_to_portguid_hash(port, f_int);
 	if (rc1)
 		IBND_ERROR("Error Occurred when trying"
 			   " to insert new port guid 0x%016" PRIx64 " to DB\n",
 			   port->guid);
 
-	add_to_portlid_hash(port, f_int->lid2guid);
+	if (add_to_portlid_hash(port, f_int))
+		return -1;
 
 	if ((scan->cfg->flags & IBND_CONFIG_MLX_EPI)
 	    && is_mlnx_ext_port_info_supported(port)) {
@@ -422,12 +428,8 @@ static int recv_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 				rc = extend_dpath(engine, &path, port_num);
 		}
 
-		if (rc > 0) {
-			struct ni_cbdata * cbdata = malloc(sizeof(*cbdata));
-			cbdata->node = node;
-			cbdata->port_num = port_num;
-			query_node_info(engine, &path, cbdata);
-		}
+		if (rc > 0)
+			query_remote_node_info(engine, &path, node, port_num);
 	}
 
 	return 0;
@@ -460,7 +462,7 @@ static ibnd_node_t *create_node(smp_engine_t * engine, ib_portid_t * path,
 				uint8_t * node_info)
 {
 	f_internal_t *f_int = ((ibnd_scan_t *) engine->user_data)->f_int;
-	ibnd_node_t *rc = calloc(1, sizeof(*rc));
+	ibnd_node_t *rc = arena_zalloc(&f_int->arena, sizeof(*rc));
 	if (!rc) {
 		IBND_ERROR("OOM: node creation failed\n");
 		return NULL;
@@ -471,9 +473,9 @@ static ibnd_node_t *create_node(smp_engine_t * engine, ib_portid_t * path,
 	mad_decode_field(node_info, IB_NODE_TYPE_F, &rc->type);
 	mad_decode_field(node_info, IB_NODE_NPORTS_F, &rc->numports);
 
-	rc->ports = calloc(rc->numports + 1, sizeof(*rc->ports));
+	rc->ports = arena_zalloc(&f_int->arena,
+				 (rc->numports + 1) * sizeof(*rc->ports));
 	if (!rc->ports) {
-		free(rc);
 		IBND_ERROR("OOM: Failed to allocate the ports array\n");
 		return NULL;
 	}
@@ -481,7 +483,7 @@ static ibnd_node_t *create_node(smp_engine_t * engine, ib_portid_t * path,
 	rc->path_portid = *path;
 	memcpy(rc->info, node_info, sizeof(rc->info));
 
-	int rc1 = add_to_nodeguid_hash(rc, f_int->fabric.nodestbl);
+	int rc1 = add_to_nodeguid_hash(rc, f_int);
 	if (rc1)
 		IBND_ERROR("Error Occurred when trying"
 			   " to insert new node guid 0x%016" PRIx64 " to DB\n",
@@ -496,6 +498,25 @@ static ibnd_node_t *create_node(smp_engine_t * engine, ib_portid_t * path,
 	return rc;
 }
 
+/* Rediscovery: a node scan->prev knew keeps its description and
+ * SwitchInfo, so they are not asked for again. */
+static int copy_prev_node(ibnd_scan_t * scan, ibnd_node_t * node)
+{
+	ibnd_node_t *pnode;
+
+	if (!scan->prev)
+		return 0;
+	pnode = ibnd_find_node_guid(scan->prev, node->guid);
+	if (!pnode || pnode->type != node->type ||
+	    pnode->numports != node->numports)
+		return 0;
+
+	memcpy(node->nodedesc, pnode->nodedesc, sizeof(node->nodedesc));
+	memcpy(node->switchinfo, pnode->switchinfo, sizeof(node->switchinfo));
+	node->smaenhsp0 = pnode->smaenhsp0;
+	return 1;
+}
+
 static void link_ports(ibnd_node_t * node, ibnd_port_t * port,
 		       ibnd_node_t * remotenode, ibnd_port_t * remoteport)
 {
@@ -534,6 +555,7 @@ static int recv_node_info(smp_engine_t * engine, ibnd_smp_t * smp,
 	int rem_port_num = 0;
 	ibnd_node_t *node;
 	int node_is_new = 0;
+	int is_stub;
 	uint64_t node_guid = mad_get_field64(node_info, 0, IB_NODE_GUID_F);
 	uint64_t port_guid = mad_get_field64(node_info, 0, IB_NODE_PORT_GUID_F);
 	int port_num = mad_get_field(node_info, 0, IB_NODE_LOCAL_PORT_F);
@@ -542,7 +564,7 @@ static int recv_node_info(smp_engine_t * engine, ibnd_smp_t * smp,
 	if (ni_cbdata) {
 		rem_node = ni_cbdata->node;
 		rem_port_num = ni_cbdata->port_num;
-		free(ni_cbdata);
+		pool_put(&scan->cbdata_pool, ni_cbdata);
 	}
 
 	node = ibnd_find_node_guid(&f_int->fabric, node_guid);
@@ -551,15 +573,24 @@ static int recv_node_info(smp_engine_t * engine, ibnd_smp_t * smp,
 		if (!node)
 			return -1;
 		node_is_new = 1;
+		/* another engine of a multi port scan got here first */
+		if (scan->mp && !claim_guid(scan->mp, node_guid, scan->id)) {
+			if (guid_tbl_insert(&scan->stubs, node_guid, node,
+					    NULL))
+				return -1;
+			mp_reach(scan->mp, node_guid, scan->id);
+		}
 	}
+	is_stub = scan->mp && guid_tbl_find(&scan->stubs, node_guid);
 	IBND_DEBUG("Found %s node GUID 0x%" PRIx64 " (%s)\n",
-		   node_is_new ? "new" : "old", node->guid,
-		   portid2str(&smp->path));
+		   is_stub ? "claimed" : node_is_new ? "new" : "old",
+		   node->guid, portid2str(&smp->path));
 
 	port = node->ports[port_num];
 	if (!port) {
 		/* If we have not see this port before create a shell for it */
-		port = node->ports[port_num] = calloc(1, sizeof(*port));
+		port = node->ports[port_num] =
+		    arena_zalloc(&f_int->arena, sizeof(*port));
 		if (!port)
 			return -1;
 		port->node = node;
@@ -587,14 +618,23 @@ static int recv_node_info(smp_engine_t * engine, ibnd_smp_t * smp,
 		link_ports(node, port, rem_node, rem_node->ports[rem_port_num]);
 	}
 
-	if (node_is_new) {
-		query_node_desc(engine, &smp->path, node);
+	/* The engine which claimed the node explores it; keep the link
+	 * for the merge.  Our own start node still needs its local port. */
+	if (is_stub) {
+		if (rem_node == NULL && node->type != IB_NODE_SWITCH)
+			query_port_info(engine, &smp->path, node, port_num);
+		return 0;
+	}
 
-		if (node->type == IB_NODE_SWITCH) {
-			query_switch_info(engine, &smp->path, node);
-			/* Query PortInfo on Switch Port 0 first */
-			query_port_info(engine, &smp->path, node, 0);
+	if (node_is_new) {
+		if (!copy_prev_node(scan, node)) {
+			query_node_desc(engine, &smp->path, node);
+			if (node->type == IB_NODE_SWITCH)
+				query_switch_info(engine, &smp->path, node);
 		}
+		/* Query PortInfo on Switch Port 0 first */
+		if (node->type == IB_NODE_SWITCH)
+			query_port_info(engine, &smp->path, node, 0);
 	}
 
 	if (node->type != IB_NODE_SWITCH)
@@ -611,93 +651,284 @@ static int query_node_info(smp_engine_t * engine, ib_portid_t * portid,
 			 recv_node_info, (void *)cbdata);
 }
 
-ibnd_node_t *ibnd_find_node_guid(ibnd_fabric_t * fabric, uint64_t guid)
+static int ask_remote_node_info(smp_engine_t * engine, ib_portid_t * path,
+				ibnd_node_t * node, int port_num)
 {
-	int hash = HASHGUID(guid) % HTSZ;
-	ibnd_node_t *node;
+	ibnd_scan_t *scan = engine->user_data;
+	struct ni_cbdata *cbdata = pool_get(&scan->cbdata_pool);
 
-	if (!fabric) {
-		IBND_DEBUG("fabric parameter NULL\n");
-		return NULL;
+	if (!cbdata) {
+		IBND_ERROR("OOM: failed to allocate NodeInfo callback data\n");
+		return -ENOMEM;
 	}
+	cbdata->node = node;
+	cbdata->port_num = port_num;
+	return query_node_info(engine, path, cbdata);
+}
 
-	for (node = fabric->nodestbl[hash]; node; node = node->htnext)
-		if (node->guid == guid)
-			return node;
+static ibnd_port_t *port_shell(f_internal_t * f_int, ibnd_node_t * node,
+			       int port_num, uint64_t guid)
+{
+	ibnd_port_t *port = node->ports[port_num];
 
-	return NULL;
+	if (port)
+		return port;
+	port = node->ports[port_num] = arena_zalloc(&f_int->arena,
+						    sizeof(*port));
+	if (!port)
+		return NULL;
+	port->node = node;
+	port->portnum = port_num;
+	port->guid = guid;
+	return port;
 }
 
-ibnd_node_t *ibnd_find_node_dr(ibnd_fabric_t * fabric, char *dr_str)
+/* Link the port a waiting adopt_cbdata came from to rnode, or if the
+ * expected node was not there, ask what is. */
+static int adopt_link(smp_engine_t * engine, struct adopt_cbdata *cbdata,
+		      ibnd_node_t * rnode)
 {
-	ibnd_port_t *rc = ibnd_find_port_dr(fabric, dr_str);
-	return rc->node;
+	ibnd_scan_t *scan = engine->user_data;
+	ibnd_port_t *pport = cbdata->prev_port, *rport;
+	ibnd_node_t *node = cbdata->node;
+	int port_num = cbdata->port_num;
+	ib_portid_t path = cbdata->path;
+
+	pool_put(&scan->adopt_pool, cbdata);
+	if (!rnode)
+		return ask_remote_node_info(engine, &path, node, port_num);
+
+	rport = port_shell(scan->f_int, rnode, pport->portnum, pport->guid);
+	if (!rport)
+		return -1;
+	link_ports(node, node->ports[port_num], rnode, rport);
+	return 0;
 }
 
-int add_to_nodeguid_hash(ibnd_node_t * node, ibnd_node_t * hash[])
+static int recv_adopt_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
+				uint8_t * mad, void *cb_data)
 {
-	int rc = 0;
-	ibnd_node_t *tblnode;
-	int hash_idx = HASHGUID(node->guid) % HTSZ;
-
-	for (tblnode = hash[hash_idx]; tblnode; tblnode = tblnode->htnext) {
-		if (tblnode == node) {
-			IBND_ERROR("Duplicate Node: Node with guid 0x%016"
-				   PRIx64 " already exists in nodes DB\n",
-				   node->guid);
-			return 1;
+	ibnd_scan_t *scan = engine->user_data;
+	f_internal_t *f_int = scan->f_int;
+	struct adopt_cbdata *cbdata = cb_data, *next;
+	ibnd_node_t *pnode = cbdata->prev_port->node, *rnode = NULL;
+	int port_num = cbdata->prev_port->portnum;
+	uint8_t *port_info = mad + IB_SMP_DATA_OFFS;
+	unsigned lid, plid;
+	int rc = 0, is_new = 0;
+
+	/* whatever is at the end of the path must still have its old LID */
+	lid = mad_get_field(port_info, 0, IB_PORT_LID_F);
+	plid = pnode->type == IB_NODE_SWITCH ?
+	    pnode->smalid : cbdata->prev_port->base_lid;
+	if (lid && lid == plid) {
+		rnode = ibnd_find_node_guid(&f_int->fabric, pnode->guid);
+		if (!rnode) {
+			rnode = create_node(engine, &smp->path, pnode->info);
+			if (!rnode)
+				return -1;
+			copy_prev_node(scan, rnode);
+			is_new = 1;
 		}
+	} else
+		IBND_DEBUG("LID %u found where 0x%" PRIx64 " had %u; %s\n",
+			   lid, pnode->guid, plid, portid2str(&smp->path));
+	if (pnode->type == IB_NODE_SWITCH &&
+	    guid_tbl_insert(&scan->adopting, pnode->guid, &adopt_done, NULL))
+		return -ENOMEM;
+
+	/* this and the links to the same switch found while the PortInfo was
+	 * on the wire */
+	for (; cbdata; cbdata = next) {
+		next = cbdata->next;
+		if (adopt_link(engine, cbdata, rnode))
+			rc = -1;
 	}
-	node->htnext = hash[hash_idx];
-	hash[hash_idx] = node;
-	return rc;
-}
+	if (rc || !rnode || (!is_new && rnode->type == IB_NODE_SWITCH))
+		return rc;
 
-int add_to_portguid_hash(ibnd_port_t * port, ibnd_port_t * hash[])
+	if (scan->cfg->show_progress)
+		dump_endnode(&smp->path, is_new ? "known" : "old", rnode,
+			     rnode->ports[port_num]);
+
+	/* carry on as discovery does once it has the PortInfo */
+	if (rnode->type == IB_NODE_SWITCH)
+		return recv_port0_info(engine, smp, mad, rnode);
+	return recv_port_info(engine, smp, mad, rnode);
+}
+/* Rediscovery: while a port scan->prev had a link on stays up, trust the
+ * link rather than asking the far end for NodeInfo.  A switch which has
+ * been seen already is linked without any MAD; anything else has its
+ * PortInfo read (which discovery needs anyway) and must answer with the
+ * LID it had.  Returns 1 if NodeInfo has to be asked for after all. */
+static int adopt_remote_node(smp_engine_t * engine, ib_portid_t * path,
+			     ibnd_node_t * node, int port_num)
 {
-	int rc = 0;
-	ibnd_port_t *tblport;
-	int hash_idx = HASHGUID(port->guid) % HTSZ;
-
-	for (tblport = hash[hash_idx]; tblport; tblport = tblport->htnext) {
-		if (tblport == port) {
-			IBND_ERROR("Duplicate Port: Port with guid 0x%016"
-				   PRIx64 " already exists in ports DB\n",
-				   port->guid);
+	ibnd_scan_t *scan = engine->user_data;
+	f_internal_t *f_int = scan->f_int;
+	ibnd_node_t *pnode, *rnode;
+	ibnd_port_t *pport, *rport;
+	struct adopt_cbdata *cbdata, *first = NULL;
+
+	pnode = ibnd_find_node_guid(scan->prev, node->guid);
+	if (!pnode || pnode->type != node->type ||
+	    port_num > pnode->numports || !pnode->ports[port_num])
+		return 1;
+	pport = pnode->ports[port_num]->remoteport;
+	if (!pport || pport->portnum > pport->node->numports)
+		return 1;
+
+	rnode = ibnd_find_node_guid(&f_int->fabric, pport->node->guid);
+	if (rnode && rnode->type == IB_NODE_SWITCH) {
+		if (rnode->numports != pport->node->numports)
 			return 1;
-		}
+		rport = port_shell(f_int, rnode, pport->portnum, pport->guid);
+		if (!rport)
+			return -1;
+		link_ports(node, node->ports[port_num], rnode, rport);
+		return 0;
 	}
-	port->htnext = hash[hash_idx];
-	hash[hash_idx] = port;
-	return rc;
+
+	/* one PortInfo per switch; later links to it wait for the answer */
+	if (pport->node->type == IB_NODE_SWITCH)
+		first = guid_tbl_find(&scan->adopting, pport->node->guid);
+	if (first == &adopt_done)
+		return 1;	/* it was not where prev had it */
+
+	cbdata = pool_get(&scan->adopt_pool);
+	if (!cbdata) {
+		IBND_ERROR("OOM: failed to allocate PortInfo callback data\n");
+		return -ENOMEM;
+	}
+	cbdata->next = NULL;
+	cbdata->node = node;
+	cbdata->port_num = port_num;
+	cbdata->prev_port = pport;
+	cbdata->path = *path;
+
+	if (first) {
+		cbdata->next = first->next;
+		first->next = cbdata;
+		return 0;
+	}
+	if (pport->node->type == IB_NODE_SWITCH &&
+	    guid_tbl_insert(&scan->adopting, pport->node->guid, cbdata,
+			    NULL)) {
+		pool_put(&scan->adopt_pool, cbdata);
+		return -ENOMEM;
+	}
+
+	return issue_smp(engine, path, IB_ATTR_PORT_INFO,
+			 pport->node->type == IB_NODE_SWITCH ?
+			 0 : pport->portnum, recv_adopt_port_info, cbdata);
+}
+
+static int query_remote_node_info(smp_engine_t * engine, ib_portid_t * path,
+				  ibnd_node_t * node, int port_num)
+{
+	ibnd_scan_t *scan = engine->user_data;
+	int peer, rc;
+
+	/* let another engine which can reach this switch take the probe */
+	if (scan->mp && node->type == IB_NODE_SWITCH &&
+	    (peer = mp_pick_engine(scan->mp, node->guid, scan->id)) != scan->id)
+		return mp_send_probe(scan->mp, peer, node->guid, port_num);
+
+	if (scan->prev && (rc = adopt_remote_node(engine, path, node,
+						  port_num)) <= 0)
+		return rc;
+
+	return ask_remote_node_info(engine, path, node, port_num);
+}
+
+ibnd_node_t *ibnd_find_node_guid(ibnd_fabric_t * fabric, uint64_t guid)
+{
+	if (!fabric) {
+		IBND_DEBUG("fabric parameter NULL\n");
+		return NULL;
+	}
+
+	return guid_tbl_find(&((f_internal_t *)fabric)->node_guids, guid);
+}
+
+ibnd_node_t *ibnd_find_node_dr(ibnd_fabric_t * fabric, char *dr_str)
+{
+	ibnd_port_t *rc = ibnd_find_port_dr(fabric, dr_str);
+	ib_dr_path_t path;
+
+	if (rc)
+		return rc->node;
+
+	/* a path without hops is the node the scan started from */
+	if (fabric && dr_str && str2drpath(&path, dr_str, 0, 0) != -1 &&
+	    path.cnt == 0)
+		return fabric->from_node;
+	return NULL;
 }
 
-void create_lid2guid(f_internal_t *f_int)
+int add_to_nodeguid_hash(ibnd_node_t * node, f_internal_t * f_int)
 {
-	f_int->lid2guid = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-				NULL, NULL);
+	void *prev = NULL;
+
+	if (guid_tbl_insert(&f_int->node_guids, node->guid, node, &prev)) {
+		IBND_ERROR("OOM: failed to grow node guid table\n");
+		return -1;
+	}
+	if (prev == node) {
+		IBND_ERROR("Duplicate Node: Node with guid 0x%016"
+			   PRIx64 " already exists in nodes DB\n",
+			   node->guid);
+		return 1;
+	}
+	return 0;
 }
 
-void destroy_lid2guid(f_internal_t *f_int)
+/* Switch ports share a single port guid; as before, a lookup returns the
+ * port added last. */
+int add_to_portguid_hash(ibnd_port_t * port, f_internal_t * f_int)
 {
-	if (f_int->lid2guid) {
-		g_hash_table_destroy(f_int->lid2guid);
+	void *prev = NULL;
+
+	if (guid_tbl_insert(&f_int->port_guids, port->guid, port, &prev)) {
+		IBND_ERROR("OOM: failed to grow port guid table\n");
+		return -1;
+	}
+	if (prev == port) {
+		IBND_ERROR("Duplicate Port: Port with guid 0x%016"
+			   PRIx64 " already exists in ports DB\n",
+			   port->guid);
+		return 1;
 	}
+	return 0;
 }
 
-void add_to_portlid_hash(ibnd_port_t * port, GHashTable *htable)
+int add_to_portlid_hash(ibnd_port_t * port, f_internal_t * f_int)
 {
-	uint16_t base_lid = port->base_lid;
-	uint16_t lid_mask = ((1 << port->lmc) -1);
-	uint16_t lid = 0;
+	unsigned base_lid = port->base_lid;
+	unsigned lid_mask = ((1 << port->lmc) -1);
+	unsigned lid = 0;
+	ibnd_port_t ***page;
+
 	/* 0 < valid lid <= 0xbfff */
-	if (base_lid > 0 && base_lid <= 0xbfff) {
-		/* We add the port for all lids
-		 * so it is easier to find any "random" lid specified */
-		for (lid = base_lid; lid <= (base_lid + lid_mask); lid++) {
-			g_hash_table_insert(htable, GINT_TO_POINTER(lid), port);
+	if (base_lid == 0 || base_lid > IB_MAX_UCAST_LID)
+		return 0;
+
+	/* We add the port for all lids
+	 * so it is easier to find any "random" lid specified */
+	for (lid = base_lid; lid <= (base_lid + lid_mask) &&
+	     lid <= IB_MAX_UCAST_LID; lid++) {
+		page = &f_int->lid_pages[lid >> LID_PAGE_SHIFT];
+		if (!*page) {
+			*page = arena_zalloc(&f_int->arena,
+					     LID_PAGE_SIZE * sizeof(**page));
+			if (!*page) {
+				IBND_ERROR("OOM: failed to allocate LID page\n");
+				return -ENOMEM;
+			}
 		}
+		(*page)[lid & (LID_PAGE_SIZE - 1)] = port;
 	}
+	return 0;
 }
 
 void add_to_type_list(ibnd_node_t * node, f_internal_t * f_int)
@@ -719,7 +950,7 @@ void add_to_type_list(ibnd_node_t * node, f_internal_t * f_int)
 	}
 }
 
-static int set_config(struct ibnd_config *config, struct ibnd_config *cfg)
+int set_config(struct ibnd_config *config, struct ibnd_config *cfg)
 {
 	if (!config)
 		return (-EINVAL);
@@ -727,6 +958,13 @@ static int set_config(struct ibnd_config *config, struct ibnd_config *cfg)
 	if (cfg)
 		memcpy(config, cfg, sizeof(*config));
 
+	if (config->flags & IBND_CONFIG_ADAPTIVE_SMPS) {
+		if (!config->max_smps)
+			config->max_smps = DEFAULT_ADAPTIVE_MAX_SMPS;
+		if (!config->max_smps_per_switch)
+			config->max_smps_per_switch =
+			    DEFAULT_MAX_SMPS_PER_SWITCH;
+	}
 	if (!config->max_smps)
 		config->max_smps = DEFAULT_MAX_SMP_ON_WIRE;
 	if (!config->timeout_ms)
@@ -740,24 +978,152 @@ static int set_config(struct ibnd_config *config, struct ibnd_config *cfg)
 f_internal_t *allocate_fabric_internal(void)
 {
 	f_internal_t *f = calloc(1, sizeof(*f));
-	if (f)
-		create_lid2guid(f);
+	if (f) {
+		arena_init(&f->arena);
+		guid_tbl_init(&f->node_guids);
+		guid_tbl_init(&f->port_guids);
+	}
 
 	return (f);
 }
 
-ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
-				    ib_portid_t * from,
-				    struct ibnd_config *cfg)
+/* Probe through a switch on behalf of the engine which explored it. */
+static int run_probe(smp_engine_t * engine, mp_probe_t * probe)
+{
+	ibnd_scan_t *scan = engine->user_data;
+	f_internal_t *f_int = scan->f_int;
+	ibnd_node_t *node = ibnd_find_node_guid(&f_int->fabric, probe->guid);
+	ibnd_port_t *port;
+	ib_portid_t path;
+
+	if (!node || probe->port_num > node->numports) {
+		IBND_ERROR("probe through unknown switch 0x%" PRIx64 "\n",
+			   probe->guid);
+		return 0;
+	}
+
+	port = node->ports[probe->port_num];
+	if (!port) {
+		port = node->ports[probe->port_num] =
+		    arena_zalloc(&f_int->arena, sizeof(*port));
+		if (!port)
+			return -ENOMEM;
+		port->node = node;
+		port->portnum = probe->port_num;
+		port->guid = mad_get_field64(node->info, 0, IB_NODE_PORT_GUID_F);
+	} else if (port->remoteport)
+		return 0;	/* we already came in through this port */
+
+	path = node->path_portid;
+	if (extend_dpath(engine, &path, probe->port_num) > 0)
+		return query_remote_node_info(engine, &path, node,
+					      probe->port_num);
+	return 0;
+}
+
+/* Multi port scans: once idle, run the probes other engines hand over
+ * until every engine is idle.  A failed engine (rc != 0, engine may then
+ * be NULL) still has to drain what was sent before the others noticed;
+ * the probes it drops fail the whole discovery. */
+static int process_probes(ibnd_scan_t * scan, smp_engine_t * engine, int rc)
+{
+	mp_shared_t *mp = scan->mp;
+	mp_probe_t *probe, *next;
+
+	if (rc)
+		mp_set_failed(mp, scan->id);
+	mp_set_idle(mp);
+
+	while (!mp_scan_done(mp)) {
+		mp_set_busy(mp);
+		probe = mp_take_probes(mp, scan->id);
+		if (!probe) {
+			mp_set_idle(mp);
+			usleep(MP_IDLE_POLL_US);
+			continue;
+		}
+
+		for (; probe; probe = next) {
+			next = probe->next;
+			if (!rc)
+				rc = run_probe(engine, probe);
+			free(probe);
+		}
+		if (!rc)
+			rc = process_mads(engine);
+		if (rc)
+			mp_set_failed(mp, scan->id);
+		mp_set_idle(mp);
+	}
+	return rc;
+}
+
+/* Scan the fabric from one local port into scan->f_int. */
+int discover_from_port(ibnd_scan_t * scan, char *ca_name, int ca_port,
+		       ib_portid_t * from)
 {
-	struct ibnd_config config = { 0 };
-	f_internal_t *f_int = NULL;
-	ib_portid_t my_portid = { 0 };
 	smp_engine_t engine;
-	ibnd_scan_t scan;
 	struct ibmad_port *ibmad_port;
 	int nc = 2;
 	int mc[2] = { IB_SMI_CLASS, IB_SMI_DIRECT_CLASS };
+	int rc = 0;
+
+	memset(&scan->selfportid, 0, sizeof(scan->selfportid));
+	scan->initial_hops = from->drpath.cnt;
+	scan->total_smps = 0;
+
+	ibmad_port = mad_rpc_open_port(ca_name, ca_port, mc, nc);
+	if (!ibmad_port) {
+		IBND_ERROR("can't open MAD port (%s:%d)\n", ca_name, ca_port);
+		goto abort;
+	}
+	mad_rpc_set_timeout(ibmad_port, scan->cfg->timeout_ms);
+	mad_rpc_set_retries(ibmad_port, scan->cfg->retries);
+	smp_mkey_set(ibmad_port, scan->cfg->mkey);
+
+	if (ib_resolve_self_via(&scan->selfportid,
+				NULL, NULL, ibmad_port) < 0) {
+		IBND_ERROR("Failed to resolve self\n");
+		mad_rpc_close_port(ibmad_port);
+		goto abort;
+	}
+	mad_rpc_close_port(ibmad_port);
+
+	if (smp_engine_init(&engine, ca_name, ca_port, scan, scan->cfg))
+		goto abort;
+
+	arena_init(&scan->scratch);
+	pool_init(&scan->cbdata_pool, &scan->scratch, sizeof(struct ni_cbdata));
+	pool_init(&scan->adopt_pool, &scan->scratch,
+		  sizeof(struct adopt_cbdata));
+	guid_tbl_init(&scan->adopting);
+
+	IBND_DEBUG("from %s\n", portid2str(from));
+
+	if (!query_node_info(&engine, from, NULL))
+		rc = process_mads(&engine);
+	if (scan->mp)
+		rc = process_probes(scan, &engine, rc);
+
+	scan->total_smps = engine.total_smps;
+	smp_engine_destroy(&engine);
+	guid_tbl_destroy(&scan->adopting);
+	arena_release(&scan->scratch);
+	return rc;
+
+abort:
+	if (scan->mp)
+		process_probes(scan, NULL, -EIO);
+	return -EIO;
+}
+
+static f_internal_t *discover(char *ca_name, int ca_port, ib_portid_t * from,
+			      struct ibnd_config *cfg, ibnd_fabric_t * prev)
+{
+	struct ibnd_config config = { 0 };
+	f_internal_t *f_int = NULL;
+	ib_portid_t my_portid = { 0 };
+	ibnd_scan_t scan;
 
 	/* If not specified start from "my" port */
 	if (!from)
@@ -768,94 +1134,81 @@ ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
 		return NULL;
 	}
 
+	/* a DR or LID start point only makes sense from one port */
+	if ((config.flags & IBND_CONFIG_MULTI_PORT) && !prev &&
+	    !from->lid && !from->drpath.cnt)
+		return (f_internal_t *)discover_multi_port(ca_name, ca_port,
+							   &config);
+
 	f_int = allocate_fabric_internal();
 	if (!f_int) {
 		IBND_ERROR("OOM: failed to calloc ibnd_fabric_t\n");
 		return NULL;
 	}
 
-	memset(&scan.selfportid, 0, sizeof(scan.selfportid));
+	memset(&scan, 0, sizeof(scan));
 	scan.f_int = f_int;
 	scan.cfg = &config;
-	scan.initial_hops = from->drpath.cnt;
-
-	ibmad_port = mad_rpc_open_port(ca_name, ca_port, mc, nc);
-	if (!ibmad_port) {
-		IBND_ERROR("can't open MAD port (%s:%d)\n", ca_name, ca_port);
-		return (NULL);
-	}
-	mad_rpc_set_timeout(ibmad_port, cfg->timeout_ms);
-	mad_rpc_set_retries(ibmad_port, cfg->retries);
-	smp_mkey_set(ibmad_port, cfg->mkey);
-
-	if (ib_resolve_self_via(&scan.selfportid,
-				NULL, NULL, ibmad_port) < 0) {
-		IBND_ERROR("Failed to resolve self\n");
-		mad_rpc_close_port(ibmad_port);
-		return NULL;
-	}
-	mad_rpc_close_port(ibmad_port);
-
-	if (smp_engine_init(&engine, ca_name, ca_port, &scan, &config)) {
-		free(f_int);
-		return (NULL);
-	}
-
-	IBND_DEBUG("from %s\n", portid2str(from));
+	scan.prev = prev;
 
-	if (!query_node_info(&engine, from, NULL))
-		if (process_mads(&engine) != 0)
-			goto error;
+	if (discover_from_port(&scan, ca_name, ca_port, from) != 0)
+		goto error;
 
-	f_int->fabric.total_mads_used = engine.total_smps;
+	f_int->fabric.total_mads_used = scan.total_smps;
 	f_int->fabric.maxhops_discovered += scan.initial_hops;
 
 	if (group_nodes(&f_int->fabric))
 		goto error;
 
-	smp_engine_destroy(&engine);
-	return (ibnd_fabric_t *)f_int;
+	return f_int;
 error:
-	smp_engine_destroy(&engine);
 	ibnd_destroy_fabric(&f_int->fabric);
 	return NULL;
 }
 
-void destroy_node(ibnd_node_t * node)
+ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
+				    ib_portid_t * from,
+				    struct ibnd_config *cfg)
+{
+	return (ibnd_fabric_t *)discover(ca_name, ca_port, from, cfg, NULL);
+}
+
+ibnd_fabric_t *ibnd_rediscover_fabric(ibnd_fabric_t * prev, char *ca_name,
+				      int ca_port, ib_portid_t * from,
+				      struct ibnd_config *cfg,
+				      ibnd_change_t ** changes)
 {
-	int p = 0;
+	f_internal_t *f_int;
 
-	if (node->ports) {
-		for (p = 0; p <= node->numports; p++)
-			free(node->ports[p]);
-		free(node->ports);
+	if (!prev) {
+		IBND_DEBUG("prev parameter NULL\n");
+		return NULL;
+	}
+
+	f_int = discover(ca_name, ca_port, from, cfg, prev);
+	if (!f_int)
+		return NULL;
+
+	if (changes && build_change_set(f_int, prev, changes)) {
+		IBND_ERROR("OOM: failed to build the change set\n");
+		ibnd_destroy_fabric(&f_int->fabric);
+		return NULL;
 	}
-	free(node);
+	return (ibnd_fabric_t *)f_int;
 }
 
 void ibnd_destroy_fabric(ibnd_fabric_t * fabric)
 {
-	ibnd_node_t *node = NULL;
-	ibnd_node_t *next = NULL;
-	ibnd_chassis_t *ch, *ch_next;
+	f_internal_t *f_int = (f_internal_t *)fabric;
 
 	if (!fabric)
 		return;
 
-	ch = fabric->chassis;
-	while (ch) {
-		ch_next = ch->next;
-		free(ch);
-		ch = ch_next;
-	}
-	node = fabric->nodes;
-	while (node) {
-		next = node->next;
-		destroy_node(node);
-		node = next;
-	}
-	destroy_lid2guid((f_internal_t *)fabric);
-	free(fabric);
+	/* nodes, ports, chassis and LID pages all live in the fabric arena */
+	arena_release(&f_int->arena);
+	guid_tbl_destroy(&f_int->node_guids);
+	guid_tbl_destroy(&f_int->port_guids);
+	free(f_int);
 }
 
 void ibnd_iter_nodes(ibnd_fabric_t * fabric, ibnd_iter_node_func_t func,
@@ -915,30 +1268,28 @@ void ibnd_iter_nodes_type(ibnd_fabric_t * fabric, ibnd_iter_node_func_t func,
 ibnd_port_t *ibnd_find_port_lid(ibnd_fabric_t * fabric,
 				uint16_t lid)
 {
-	ibnd_port_t *port;
 	f_internal_t *f = (f_internal_t *)fabric;
+	ibnd_port_t **page;
 
-	port = (ibnd_port_t *)g_hash_table_lookup(f->lid2guid,
-					GINT_TO_POINTER(lid));
+	if (!fabric) {
+		IBND_DEBUG("fabric parameter NULL\n");
+		return NULL;
+	}
 
-	return port;
+	if (lid > IB_MAX_UCAST_LID)
+		return NULL;
+	page = f->lid_pages[lid >> LID_PAGE_SHIFT];
+	return page ? page[lid & (LID_PAGE_SIZE - 1)] : NULL;
 }
 
 ibnd_port_t *ibnd_find_port_guid(ibnd_fabric_t * fabric, uint64_t guid)
 {
-	int hash = HASHGUID(guid) % HTSZ;
-	ibnd_port_t *port;
-
 	if (!fabric) {
 		IBND_DEBUG("fabric parameter NULL\n");
 		return NULL;
 	}
 
-	for (port = fabric->portstbl[hash]; port; port = port->htnext)
-		if (port->guid == guid)
-			return port;
-
-	return NULL;
+	return guid_tbl_find(&((f_internal_t *)fabric)->port_guids, guid);
 }
 
 ibnd_port_t *ibnd_find_port_dr(ibnd_fabric_t * fabric, char *dr_str)
@@ -967,7 +1318,8 @@ ibnd_port_t *ibnd_find_port_dr(ibnd_fabric_t * fabric, char *dr_str)
 		ibnd_port_t *remote_port = NULL;
 		if (path.p[i] == 0)
 			continue;
-		if (!cur_node->ports)
+		if (!cur_node->ports || path.p[i] > cur_node->numports ||
+		    !cur_node->ports[path.p[i]])
 			return NULL;
 
 		remote_port = cur_node->ports[path.p[i]]->remoteport;
@@ -984,8 +1336,8 @@ ibnd_port_t *ibnd_find_port_dr(ibnd_fabric_t * fabric, char *dr_str)
 void ibnd_iter_ports(ibnd_fabric_t * fabric, ibnd_iter_port_func_t func,
 			void *user_data)
 {
-	int i = 0;
-	ibnd_port_t *cur = NULL;
+	ibnd_node_t *node;
+	int p;
 
 	if (!fabric) {
 		IBND_DEBUG("fabric parameter NULL\n");
@@ -997,7 +1349,8 @@ void ibnd_iter_ports(ibnd_fabric_t * fabric, ibnd_iter_port_func_t func,
 		return;
 	}
 
-	for (i = 0; i<HTSZ; i++)
-		for (cur = fabric->portstbl[i]; cur; cur = cur->htnext)
-			func(cur, user_data);
+	for (node = fabric->nodes; node; node = node->next)
+		for (p = 0; p <= node->numports; p++)
+			if (node->ports[p])
+				func(node->ports[p], user_data);
 }
@@ -44,6 +44,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -96,6 +97,70 @@
  * 1 byte - flag indicating if remote port exists
  * 8 bytes - port guid remotely connected to
  * 1 byte - port num remotely connected to
+ *
+ * Version 2 has fixed size records, so it can be mapped and turned into a
+ * fabric in one pass.  Nodes, ports and links are referred to by record
+ * index (0xFFFFFFFF for none) rather than by guid.
+ *
+ * Bytes 1-4 - magic number
+ * Bytes 5-8 - version number (2)
+ * Bytes 9-12 - node count
+ * Bytes 13-16 - port count
+ * Bytes 17-20 - "from node" index
+ * Bytes 21-24 - "from port" number
+ * Bytes 25-28 - maxhops discovered
+ * Bytes 29-32 - node index slots
+ * Bytes 33-36 - port index slots
+ * Bytes 37-40 - forwarding table count
+ * Bytes 41-64 - reserved
+ * then the node records, the port records (the ports of a node follow one
+ * another), the node guid index, the port guid index and the forwarding
+ * tables.
+ *
+ * Node records (IBND_NODE_CACHE_V2_LEN bytes)
+ *
+ * 8 bytes - guid
+ * 4 bytes - index of the first port record
+ * 2 bytes - number of port records
+ * 2 bytes - smalid
+ * 1 byte - type
+ * 1 byte - numports
+ * 1 byte - smalmc
+ * 1 byte - smaenhsp0 flag
+ * 4 bytes - reserved
+ * IB_SMP_DATA_SIZE bytes - switchinfo
+ * IB_SMP_DATA_SIZE bytes - info
+ * IB_SMP_DATA_SIZE bytes - nodedesc
+ *
+ * Port records (IBND_PORT_CACHE_V2_LEN bytes)
+ *
+ * 8 bytes - guid
+ * 4 bytes - node index
+ * 4 bytes - remote port index
+ * 2 bytes - base lid
+ * 1 byte - portnum
+ * 1 byte - external portnum
+ * 1 byte - lmc
+ * 3 bytes - reserved
+ * IB_SMP_DATA_SIZE bytes - info
+ *
+ * The indexes are open addressed tables of 4 byte record indexes, a power
+ * of 2 in size, laid out as the library's guid tables are (MurmurHash3
+ * finalizer, linear probing) so they load without rehashing.
+ *
+ * Forwarding tables (IBND_FT_CACHE_V2_LEN bytes, then the tables, padded
+ * to a multiple of 8 bytes), one for each switch with tables loaded
+ *
+ * 4 bytes - node index
+ * 4 bytes - LFT size
+ * 4 bytes - MFT size
+ * 2 bytes - MFT stride
+ * 2 bytes - reserved
+ * LFT size bytes - the LFT
+ * MFT size * MFT stride bytes - the MFT
+ *
+ * Files with forwarding tables are not read by libraries which predate
+ * them.
  */
 
 /* Structs that hold cache info temporarily before
@@ -112,7 +177,6 @@ typedef struct ibnd_node_cache {
 	uint8_t ports_stored_count;
 	ibnd_port_cache_key_t *port_cache_keys;
 	struct ibnd_node_cache *next;
-	struct ibnd_node_cache *htnext;
 	int node_stored_to_fabric;
 } ibnd_node_cache_t;
 
@@ -131,8 +195,9 @@ typedef struct ibnd_fabric_cache {
 	uint64_t from_node_guid;
 	ibnd_node_cache_t *nodes_cache;
 	ibnd_port_cache_t *ports_cache;
-	ibnd_node_cache_t *nodescachetbl[HTSZ];
-	ibnd_port_cache_t *portscachetbl[HTSZ];
+	guid_tbl_t nodescachetbl;
+	/* first port cache of each guid; the rest chain off htnext */
+	guid_tbl_t portscachetbl;
 } ibnd_fabric_cache_t;
 
 #define IBND_FABRIC_CACHE_BUFLEN  4096
@@ -146,6 +211,13 @@ typedef struct ibnd_fabric_cache {
 #define IBND_PORT_CACHE_KEY_LEN        (8 + 1)
 #define IBND_PORT_CACHE_LEN            (31 + IB_SMP_DATA_SIZE)
 
+#define IBND_FABRIC_CACHE_VERSION_2    0x00000002
+#define IBND_FABRIC_CACHE_V2_HEADER_LEN (64)
+#define IBND_NODE_CACHE_V2_LEN         (24 + IB_SMP_DATA_SIZE*3)
+#define IBND_PORT_CACHE_V2_LEN         (24 + IB_SMP_DATA_SIZE)
+#define IBND_CACHE_V2_NONE             0xFFFFFFFF
+#define IBND_FT_CACHE_V2_LEN           (16)
+
 static ssize_t ibnd_read(int fd, void *buf, size_t count)
 {
 	size_t count_done = 0;
@@ -257,9 +329,8 @@ static int _load_header_info(int fd, ibnd_fabric_cache_t * fabric_cache,
 
 static void _destroy_ibnd_node_cache(ibnd_node_cache_t * node_cache)
 {
+	/* the node itself belongs to the fabric arena */
 	free(node_cache->port_cache_keys);
-	if (!node_cache->node_stored_to_fabric && node_cache->node)
-		destroy_node(node_cache->node);
 	free(node_cache);
 }
 
@@ -286,26 +357,28 @@ static void _destroy_ibnd_fabric_cache(ibnd_fabric_cache_t * fabric_cache)
 	while (port_cache) {
 		port_cache_next = port_cache->next;
 
-		if (!port_cache->port_stored_to_fabric && port_cache->port)
-			free(port_cache->port);
 		free(port_cache);
 
 		port_cache = port_cache_next;
 	}
 
+	guid_tbl_destroy(&fabric_cache->nodescachetbl);
+	guid_tbl_destroy(&fabric_cache->portscachetbl);
 	free(fabric_cache);
 }
 
-static void store_node_cache(ibnd_node_cache_t * node_cache,
-			     ibnd_fabric_cache_t * fabric_cache)
+static int store_node_cache(ibnd_node_cache_t * node_cache,
+			    ibnd_fabric_cache_t * fabric_cache)
 {
-	int hash_indx = HASHGUID(node_cache->node->guid) % HTSZ;
+	if (guid_tbl_insert(&fabric_cache->nodescachetbl,
+			    node_cache->node->guid, node_cache, NULL)) {
+		IBND_DEBUG("OOM: nodescachetbl\n");
+		return -1;
+	}
 
 	node_cache->next = fabric_cache->nodes_cache;
 	fabric_cache->nodes_cache = node_cache;
-
-	node_cache->htnext = fabric_cache->nodescachetbl[hash_indx];
-	fabric_cache->nodescachetbl[hash_indx] = node_cache;
+	return 0;
 }
 
 static int _load_node(int fd, ibnd_fabric_cache_t * fabric_cache)
@@ -323,13 +396,12 @@ static int _load_node(int fd, ibnd_fabric_cache_t * fabric_cache)
 	}
 	memset(node_cache, '\0', sizeof(ibnd_node_cache_t));
 
-	node = (ibnd_node_t *) malloc(sizeof(ibnd_node_t));
+	node = arena_zalloc(&fabric_cache->f_int->arena, sizeof(ibnd_node_t));
 	if (!node) {
 		IBND_DEBUG("OOM: node\n");
 		free(node_cache);
 		return -1;
 	}
-	memset(node, '\0', sizeof(ibnd_node_t));
 
 	node_cache->node = node;
 
@@ -388,7 +460,8 @@ static int _load_node(int fd, ibnd_fabric_cache_t * fabric_cache)
 		}
 	}
 
-	store_node_cache(node_cache, fabric_cache);
+	if (store_node_cache(node_cache, fabric_cache) < 0)
+		goto cleanup;
 
 	return 0;
 
@@ -397,16 +470,21 @@ cleanup:
 	return -1;
 }
 
-static void store_port_cache(ibnd_port_cache_t * port_cache,
-			     ibnd_fabric_cache_t * fabric_cache)
+static int store_port_cache(ibnd_port_cache_t * port_cache,
+			    ibnd_fabric_cache_t * fabric_cache)
 {
-	int hash_indx = HASHGUID(port_cache->port->guid) % HTSZ;
+	void *prev = NULL;
+
+	if (guid_tbl_insert(&fabric_cache->portscachetbl,
+			    port_cache->port->guid, port_cache, &prev)) {
+		IBND_DEBUG("OOM: portscachetbl\n");
+		return -1;
+	}
+	port_cache->htnext = prev;
 
 	port_cache->next = fabric_cache->ports_cache;
 	fabric_cache->ports_cache = port_cache;
-
-	port_cache->htnext = fabric_cache->portscachetbl[hash_indx];
-	fabric_cache->portscachetbl[hash_indx] = port_cache;
+	return 0;
 }
 
 static int _load_port(int fd, ibnd_fabric_cache_t * fabric_cache)
@@ -424,13 +502,12 @@ static int _load_port(int fd, ibnd_fabric_cache_t * fabric_cache)
 	}
 	memset(port_cache, '\0', sizeof(ibnd_port_cache_t));
 
-	port = (ibnd_port_t *) malloc(sizeof(ibnd_port_t));
+	port = arena_zalloc(&fabric_cache->f_int->arena, sizeof(ibnd_port_t));
 	if (!port) {
 		IBND_DEBUG("OOM: port\n");
 		free(port_cache);
 		return -1;
 	}
-	memset(port, '\0', sizeof(ibnd_port_t));
 
 	port_cache->port = port;
 
@@ -453,12 +530,12 @@ static int _load_port(int fd, ibnd_fabric_cache_t * fabric_cache)
 	    _unmarshall8(buf + offset,
 			 &port_cache->remoteport_cache_key.portnum);
 
-	store_port_cache(port_cache, fabric_cache);
+	if (store_port_cache(port_cache, fabric_cache) < 0)
+		goto cleanup;
 
 	return 0;
 
 cleanup:
-	free(port);
 	free(port_cache);
 	return -1;
 }
@@ -466,13 +543,12 @@ cleanup:
 static ibnd_port_cache_t *_find_port(ibnd_fabric_cache_t * fabric_cache,
 				     ibnd_port_cache_key_t * port_cache_key)
 {
-	int hash_indx = HASHGUID(port_cache_key->guid) % HTSZ;
 	ibnd_port_cache_t *port_cache;
 
-	for (port_cache = fabric_cache->portscachetbl[hash_indx];
+	for (port_cache = guid_tbl_find(&fabric_cache->portscachetbl,
+					port_cache_key->guid);
 	     port_cache; port_cache = port_cache->htnext) {
-		if (port_cache->port->guid == port_cache_key->guid
-		    && port_cache->port->portnum == port_cache_key->portnum)
+		if (port_cache->port->portnum == port_cache_key->portnum)
 			return port_cache;
 	}
 
@@ -482,16 +558,7 @@ static ibnd_port_cache_t *_find_port(ibnd_fabric_cache_t * fabric_cache,
 static ibnd_node_cache_t *_find_node(ibnd_fabric_cache_t * fabric_cache,
 				     uint64_t guid)
 {
-	int hash_indx = HASHGUID(guid) % HTSZ;
-	ibnd_node_cache_t *node_cache;
-
-	for (node_cache = fabric_cache->nodescachetbl[hash_indx];
-	     node_cache; node_cache = node_cache->htnext) {
-		if (node_cache->node->guid == guid)
-			return node_cache;
-	}
-
-	return NULL;
+	return guid_tbl_find(&fabric_cache->nodescachetbl, guid);
 }
 
 static int _fill_port(ibnd_fabric_cache_t * fabric_cache, ibnd_node_t * node,
@@ -515,8 +582,7 @@ static int _fill_port(ibnd_fabric_cache_t * fabric_cache, ibnd_node_t * node,
 	/* achu: needed if user wishes to re-cache a loaded fabric.
 	 * Otherwise, mostly unnecessary to do this.
 	 */
-	int rc = add_to_portguid_hash(port_cache->port,
-				      fabric_cache->f_int->fabric.portstbl);
+	int rc = add_to_portguid_hash(port_cache->port, fabric_cache->f_int);
 	if (rc) {
 		IBND_DEBUG("Error Occurred when trying"
 			   " to insert new port guid 0x%016" PRIx64 " to DB\n",
@@ -545,9 +611,7 @@ static int _rebuild_nodes(ibnd_fabric_cache_t * fabric_cache)
 		fabric_cache->f_int->fabric.nodes = node;
 
 		int rc = add_to_nodeguid_hash(node_cache->node,
-					      fabric_cache->
-					      f_int->
-					      fabric.nodestbl);
+					      fabric_cache->f_int);
 		if (rc) {
 			IBND_DEBUG("Error Occurred when trying"
 				   " to insert new node guid 0x%016" PRIx64 " to DB\n",
@@ -561,7 +625,9 @@ static int _rebuild_nodes(ibnd_fabric_cache_t * fabric_cache)
 		/* Rebuild node ports array */
 
 		if (!(node->ports =
-		      calloc(sizeof(*node->ports), node->numports + 1))) {
+		      arena_zalloc(&fabric_cache->f_int->arena,
+				   sizeof(*node->ports) *
+				   (node->numports + 1)))) {
 			IBND_DEBUG("OOM: node->ports\n");
 			return -1;
 		}
@@ -614,13 +680,308 @@ static int _rebuild_ports(ibnd_fabric_cache_t * fabric_cache)
 		} else
 			port->remoteport = NULL;
 
-		add_to_portlid_hash(port, fabric_cache->f_int->lid2guid);
+		if (add_to_portlid_hash(port, fabric_cache->f_int) < 0)
+			return -1;
 		port_cache = port_cache_next;
 	}
 
 	return 0;
 }
 
+static int _load_version(int fd, uint32_t * version)
+{
+	uint8_t buf[8];
+	uint32_t magic = 0;
+
+	if (ibnd_read(fd, buf, sizeof(buf)) < 0)
+		return -1;
+
+	_unmarshall32(buf, &magic);
+	_unmarshall32(buf + 4, version);
+
+	if (magic != IBND_FABRIC_CACHE_MAGIC) {
+		IBND_DEBUG("invalid fabric cache file\n");
+		return -1;
+	}
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		IBND_DEBUG("lseek: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Fill tbl straight from a v2 index; the slot positions are the ones
+ * guid_tbl would have chosen, so nothing is rehashed. */
+static int _load_index_v2(guid_tbl_t * tbl, uint8_t * index, uint32_t slots,
+			  uint32_t count, uint8_t * records, size_t rec_len,
+			  void *objs, size_t obj_size)
+{
+	uint32_t i, idx;
+	uint64_t guid;
+
+	if (guid_tbl_presize(tbl, slots)) {
+		IBND_DEBUG("OOM: guid table\n");
+		return -1;
+	}
+
+	for (i = 0; i < slots; i++) {
+		_unmarshall32(index + i * 4, &idx);
+		if (idx == IBND_CACHE_V2_NONE)
+			continue;
+		if (idx >= count || tbl->count + 1 >= slots) {
+			IBND_DEBUG("Cache invalid: bad index entry\n");
+			return -1;
+		}
+		_unmarshall64(records + idx * rec_len, &guid);
+		tbl->slots[i].guid = guid;
+		tbl->slots[i].obj = (char *)objs + idx * obj_size;
+		tbl->count++;
+	}
+
+	return 0;
+}
+
+static int _load_fts_v2(f_internal_t * f_int, uint8_t * map, size_t size,
+			uint64_t offset, uint32_t count, ibnd_node_t * nodes,
+			uint32_t node_count)
+{
+	uint32_t i, node_idx, lft_size, mft_size;
+	uint16_t stride;
+	ibnd_node_t *node;
+	uint64_t len;
+	uint8_t *p;
+
+	for (i = 0; i < count; i++) {
+		if (offset + IBND_FT_CACHE_V2_LEN > size)
+			goto invalid;
+		p = map + offset;
+		p += _unmarshall32(p, &node_idx);
+		p += _unmarshall32(p, &lft_size);
+		p += _unmarshall32(p, &mft_size);
+		p += _unmarshall16(p, &stride);
+		p += 2;
+
+		if (node_idx >= node_count)
+			goto invalid;
+		node = &nodes[node_idx];
+		len = IBND_FT_CACHE_V2_LEN + (uint64_t) lft_size +
+		    (uint64_t) mft_size * stride;
+		if (node->type != IB_NODE_SWITCH || node->lft || node->mft
+		    || lft_size > IB_MAX_UCAST_LID + 1
+		    || mft_size > IB_MAX_MCAST_LID - IB_MIN_MCAST_LID + 1
+		    || (mft_size && stride !=
+			ALIGN(node->numports + 1, 16) / 8)
+		    || offset + len > size)
+			goto invalid;
+
+		if (lft_size) {
+			if (!(node->lft = arena_zalloc(&f_int->arena,
+						       lft_size)))
+				goto oom;
+			p += _unmarshall_buf(p, node->lft, lft_size);
+			node->lft_size = lft_size;
+		}
+		if (mft_size) {
+			if (!(node->mft = arena_zalloc(&f_int->arena,
+						       (size_t) mft_size *
+						       stride)))
+				goto oom;
+			_unmarshall_buf(p, node->mft, mft_size * stride);
+			node->mft_size = mft_size;
+			node->mft_stride = stride;
+		}
+		offset += ALIGN(len, 8);
+	}
+
+	if (count && offset != size)
+		goto invalid;
+	return 0;
+
+invalid:
+	IBND_DEBUG("Cache invalid: bad forwarding table record %u\n", i);
+	return -1;
+oom:
+	IBND_DEBUG("OOM: forwarding tables\n");
+	return -1;
+}
+
+/* Rebuild f_int from a complete v2 image, be it a mapped file or a
+ * buffer handed over by ibnd_load_fabric_buf(). */
+static int _load_map_v2(uint8_t * map, size_t size, f_internal_t * f_int)
+{
+	ibnd_fabric_t *fabric = &f_int->fabric;
+	uint32_t node_count, port_count, from_node, from_portnum, maxhops;
+	uint32_t node_slots, port_slots, ft_count;
+	uint64_t node_off, port_off, index_off, ft_off;
+	ibnd_node_t *nodes = NULL;
+	ibnd_port_t *ports = NULL;
+	ibnd_node_t **tail = &fabric->nodes;
+	size_t offset;
+	uint32_t i;
+	uint16_t tmp16;
+	uint8_t tmp8;
+	uint8_t *p;
+
+	if (size < IBND_FABRIC_CACHE_V2_HEADER_LEN) {
+		IBND_DEBUG("Cache invalid: truncated header\n");
+		return -1;
+	}
+
+	offset = 8;		/* magic and version checked by the caller */
+	offset += _unmarshall32(map + offset, &node_count);
+	offset += _unmarshall32(map + offset, &port_count);
+	offset += _unmarshall32(map + offset, &from_node);
+	offset += _unmarshall32(map + offset, &from_portnum);
+	offset += _unmarshall32(map + offset, &maxhops);
+	offset += _unmarshall32(map + offset, &node_slots);
+	offset += _unmarshall32(map + offset, &port_slots);
+	offset += _unmarshall32(map + offset, &ft_count);
+
+	node_off = IBND_FABRIC_CACHE_V2_HEADER_LEN;
+	port_off = node_off + (uint64_t) node_count * IBND_NODE_CACHE_V2_LEN;
+	index_off = port_off + (uint64_t) port_count * IBND_PORT_CACHE_V2_LEN;
+	ft_off = index_off + ((uint64_t) node_slots + port_slots) * 4;
+
+	if (!node_count || from_node >= node_count
+	    || node_slots <= node_count || (node_slots & (node_slots - 1))
+	    || port_slots <= port_count || (port_slots & (port_slots - 1))
+	    || (ft_count ? ft_off > size : ft_off != size)) {
+		IBND_DEBUG("Cache invalid: bad header\n");
+		return -1;
+	}
+
+	nodes = arena_zalloc(&f_int->arena, sizeof(*nodes) * node_count);
+	if (port_count)
+		ports = arena_zalloc(&f_int->arena, sizeof(*ports) * port_count);
+	if (!nodes || (port_count && !ports)) {
+		IBND_DEBUG("OOM: nodes and ports\n");
+		return -1;
+	}
+
+	for (i = 0; i < node_count; i++) {
+		ibnd_node_t *node = &nodes[i];
+
+		p = map + node_off + (size_t) i * IBND_NODE_CACHE_V2_LEN;
+		offset = _unmarshall64(p, &node->guid);
+		offset += 6;	/* port range, not needed to rebuild */
+		offset += _unmarshall16(p + offset, &node->smalid);
+		offset += _unmarshall8(p + offset, &tmp8);
+		node->type = tmp8;
+		offset += _unmarshall8(p + offset, &tmp8);
+		node->numports = tmp8;
+		offset += _unmarshall8(p + offset, &node->smalmc);
+		offset += _unmarshall8(p + offset, &tmp8);
+		node->smaenhsp0 = tmp8;
+		offset += 4;
+		offset += _unmarshall_buf(p + offset, node->switchinfo,
+					  IB_SMP_DATA_SIZE);
+		offset += _unmarshall_buf(p + offset, node->info,
+					  IB_SMP_DATA_SIZE);
+		_unmarshall_buf(p + offset, node->nodedesc, IB_SMP_DATA_SIZE);
+
+		if (!(node->ports = arena_zalloc(&f_int->arena,
+						 sizeof(*node->ports) *
+						 (node->numports + 1)))) {
+			IBND_DEBUG("OOM: node->ports\n");
+			return -1;
+		}
+
+		*tail = node;
+		tail = &node->next;
+		add_to_type_list(node, f_int);
+	}
+
+	for (i = 0; i < port_count; i++) {
+		ibnd_port_t *port = &ports[i];
+		uint32_t node_idx, remote_idx;
+
+		p = map + port_off + (size_t) i * IBND_PORT_CACHE_V2_LEN;
+		offset = _unmarshall64(p, &port->guid);
+		offset += _unmarshall32(p + offset, &node_idx);
+		offset += _unmarshall32(p + offset, &remote_idx);
+		offset += _unmarshall16(p + offset, &tmp16);
+		port->base_lid = tmp16;
+		offset += _unmarshall8(p + offset, &tmp8);
+		port->portnum = tmp8;
+		offset += _unmarshall8(p + offset, &tmp8);
+		port->ext_portnum = tmp8;
+		offset += _unmarshall8(p + offset, &port->lmc);
+		offset += 3;
+		_unmarshall_buf(p + offset, port->info, IB_SMP_DATA_SIZE);
+
+		if (node_idx >= node_count
+		    || (remote_idx != IBND_CACHE_V2_NONE
+			&& remote_idx >= port_count)
+		    || port->portnum > nodes[node_idx].numports
+		    || nodes[node_idx].ports[port->portnum]) {
+			IBND_DEBUG("Cache invalid: bad port record %u\n", i);
+			return -1;
+		}
+
+		port->node = &nodes[node_idx];
+		port->node->ports[port->portnum] = port;
+		if (remote_idx != IBND_CACHE_V2_NONE)
+			port->remoteport = &ports[remote_idx];
+
+		if (add_to_portlid_hash(port, f_int) < 0)
+			return -1;
+	}
+
+	p = map + index_off;
+	if (_load_index_v2(&f_int->node_guids, p, node_slots, node_count,
+			   map + node_off, IBND_NODE_CACHE_V2_LEN,
+			   nodes, sizeof(*nodes)) < 0)
+		return -1;
+	p += (size_t) node_slots * 4;
+	if (_load_index_v2(&f_int->port_guids, p, port_slots, port_count,
+			   map + port_off, IBND_PORT_CACHE_V2_LEN,
+			   ports, sizeof(*ports)) < 0)
+		return -1;
+
+	if (_load_fts_v2(f_int, map, size, ft_off, ft_count, nodes,
+			 node_count) < 0)
+		return -1;
+
+	fabric->from_node = &nodes[from_node];
+	fabric->from_portnum = from_portnum;
+	fabric->maxhops_discovered = maxhops;
+
+	if (group_nodes(fabric))
+		return -1;
+
+	return 0;
+}
+
+static int _load_fabric_v2(int fd, f_internal_t * f_int)
+{
+	struct stat statbuf;
+	uint8_t *map;
+	size_t size;
+	int rc;
+
+	if (fstat(fd, &statbuf) < 0) {
+		IBND_DEBUG("fstat: %s\n", strerror(errno));
+		return -1;
+	}
+	size = statbuf.st_size;
+	if (size < IBND_FABRIC_CACHE_V2_HEADER_LEN) {
+		IBND_DEBUG("Cache invalid: truncated header\n");
+		return -1;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		IBND_DEBUG("mmap: %s\n", strerror(errno));
+		return -1;
+	}
+
+	rc = _load_map_v2(map, size, f_int);
+	munmap(map, size);
+	return rc;
+}
+
 ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 {
 	unsigned int node_count = 0;
@@ -628,6 +989,7 @@ ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 	ibnd_fabric_cache_t *fabric_cache = NULL;
 	f_internal_t *f_int = NULL;
 	ibnd_node_cache_t *node_cache = NULL;
+	uint32_t version = 0;
 	int fd = -1;
 	unsigned int i;
 
@@ -657,6 +1019,15 @@ ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 
 	fabric_cache->f_int = f_int;
 
+	if (_load_version(fd, &version) < 0)
+		goto cleanup;
+
+	if (version == IBND_FABRIC_CACHE_VERSION_2) {
+		if (_load_fabric_v2(fd, f_int) < 0)
+			goto cleanup;
+		goto done;
+	}
+
 	if (_load_header_info(fd, fabric_cache, &node_count, &port_count) < 0)
 		goto cleanup;
 
@@ -687,6 +1058,8 @@ ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags)
 	if (group_nodes(&f_int->fabric))
 		goto cleanup;
 
+done:
+	f_int->loaded = 1;
 	_destroy_ibnd_fabric_cache(fabric_cache);
 	close(fd);
 	return (ibnd_fabric_t *)&f_int->fabric;
@@ -698,6 +1071,40 @@ cleanup:
 	return NULL;
 }
 
+ibnd_fabric_t *ibnd_load_fabric_buf(const void *buf, size_t len,
+				    unsigned int flags)
+{
+	uint8_t *map = (uint8_t *) buf;
+	f_internal_t *f_int;
+	uint32_t magic, version;
+
+	if (!buf || len < 8) {
+		IBND_DEBUG("invalid fabric cache buffer\n");
+		return NULL;
+	}
+
+	_unmarshall32(map, &magic);
+	_unmarshall32(map + 4, &version);
+	if (magic != IBND_FABRIC_CACHE_MAGIC
+	    || version != IBND_FABRIC_CACHE_VERSION_2) {
+		IBND_DEBUG("invalid fabric cache buffer\n");
+		return NULL;
+	}
+
+	if (!(f_int = allocate_fabric_internal())) {
+		IBND_DEBUG("OOM: fabric\n");
+		return NULL;
+	}
+
+	if (_load_map_v2(map, len, f_int) < 0) {
+		ibnd_destroy_fabric((ibnd_fabric_t *)f_int);
+		return NULL;
+	}
+
+	f_int->loaded = 1;
+	return (ibnd_fabric_t *)&f_int->fabric;
+}
+
 static ssize_t ibnd_write(int fd, const void *buf, size_t count)
 {
 	size_t count_done = 0;
@@ -879,6 +1286,242 @@ static int _cache_port(int fd, ibnd_port_t * port)
 	return 0;
 }
 
+static uint32_t _cache_index_slots_v2(uint32_t count)
+{
+	uint32_t slots = 1;
+
+	while (slots < count * 2 || slots <= count)
+		slots <<= 1;
+	return slots;
+}
+
+static size_t _cache_index_v2(uint8_t * outbuf, guid_tbl_t * tbl)
+{
+	size_t offset = 0;
+	uint32_t i;
+
+	for (i = 0; i <= tbl->mask; i++)
+		offset += _marshall32(outbuf + offset, tbl->slots[i].obj ?
+				      (uint32_t) ((uintptr_t) tbl->slots[i].obj
+						  - 1) : IBND_CACHE_V2_NONE);
+	return offset;
+}
+
+/* Record indexes are kept in guid tables as index + 1, so that index 0 is
+ * not mistaken for an empty slot.  The node and port pointer maps use the
+ * same tables keyed by address. */
+static uint32_t _cache_lookup_v2(guid_tbl_t * tbl, const void *obj)
+{
+	if (!obj)
+		return IBND_CACHE_V2_NONE;
+	return (uint32_t) ((uintptr_t) guid_tbl_find(tbl, (uintptr_t) obj) - 1);
+}
+
+static uint64_t _cache_ft_len_v2(ibnd_node_t * node)
+{
+	if (!node->lft && !node->mft)
+		return 0;
+	return ALIGN(IBND_FT_CACHE_V2_LEN + (uint64_t) node->lft_size +
+		     (uint64_t) node->mft_size * node->mft_stride, 8);
+}
+
+static size_t _cache_ft_v2(uint8_t * outbuf, ibnd_node_t * node,
+			   uint32_t node_idx)
+{
+	size_t offset = 0;
+
+	offset += _marshall32(outbuf + offset, node_idx);
+	offset += _marshall32(outbuf + offset, node->lft ? node->lft_size : 0);
+	offset += _marshall32(outbuf + offset, node->mft ? node->mft_size : 0);
+	offset += _marshall16(outbuf + offset,
+			      node->mft ? (uint16_t) node->mft_stride : 0);
+	offset += 2;
+	if (node->lft)
+		offset += _marshall_buf(outbuf + offset, node->lft,
+					node->lft_size);
+	if (node->mft)
+		offset += _marshall_buf(outbuf + offset, node->mft,
+					node->mft_size * node->mft_stride);
+	return ALIGN(offset, 8);
+}
+
+static int _cache_buf_v2(ibnd_fabric_t * fabric, uint8_t ** outbuf,
+			 size_t * outlen)
+{
+	guid_tbl_t node_idx, port_idx, node_guids, port_guids;
+	uint32_t node_count = 0, port_count = 0, ft_count = 0;
+	uint32_t node_slots, port_slots;
+	uint64_t ft_len = 0;
+	ibnd_node_t *node;
+	ibnd_port_t *port;
+	uint8_t *buf = NULL;
+	size_t len, offset;
+	int rc = -1;
+	int i;
+
+	guid_tbl_init(&node_idx);
+	guid_tbl_init(&port_idx);
+	guid_tbl_init(&node_guids);
+	guid_tbl_init(&port_guids);
+
+	/* number nodes in list order, and each node's ports after it */
+	for (node = fabric->nodes; node; node = node->next) {
+		if (guid_tbl_insert(&node_idx, (uintptr_t) node,
+				    (void *)(uintptr_t) ++node_count, NULL))
+			goto oom;
+		if (_cache_ft_len_v2(node)) {
+			ft_count++;
+			ft_len += _cache_ft_len_v2(node);
+		}
+		for (i = 0; i <= node->numports; i++)
+			if (node->ports[i]
+			    && guid_tbl_insert(&port_idx,
+					       (uintptr_t) node->ports[i],
+					       (void *)(uintptr_t) ++port_count,
+					       NULL))
+				goto oom;
+	}
+
+	node_slots = _cache_index_slots_v2(node_count);
+	port_slots = _cache_index_slots_v2(port_count);
+	if (guid_tbl_presize(&node_guids, node_slots)
+	    || guid_tbl_presize(&port_guids, port_slots))
+		goto oom;
+
+	len = IBND_FABRIC_CACHE_V2_HEADER_LEN +
+	    (size_t) node_count * IBND_NODE_CACHE_V2_LEN +
+	    (size_t) port_count * IBND_PORT_CACHE_V2_LEN +
+	    ((size_t) node_slots + port_slots) * 4 + ft_len;
+	if (!(buf = calloc(1, len)))
+		goto oom;
+
+	offset = 0;
+	offset += _marshall32(buf + offset, IBND_FABRIC_CACHE_MAGIC);
+	offset += _marshall32(buf + offset, IBND_FABRIC_CACHE_VERSION_2);
+	offset += _marshall32(buf + offset, node_count);
+	offset += _marshall32(buf + offset, port_count);
+	offset += _marshall32(buf + offset,
+			      _cache_lookup_v2(&node_idx, fabric->from_node));
+	offset += _marshall32(buf + offset, fabric->from_portnum);
+	offset += _marshall32(buf + offset, fabric->maxhops_discovered);
+	offset += _marshall32(buf + offset, node_slots);
+	offset += _marshall32(buf + offset, port_slots);
+	offset += _marshall32(buf + offset, ft_count);
+	offset = IBND_FABRIC_CACHE_V2_HEADER_LEN;
+
+	port_count = 0;
+	for (node = fabric->nodes; node; node = node->next) {
+		uint32_t first_port = port_count;
+		size_t nports_offset;
+
+		if (guid_tbl_insert(&node_guids, node->guid,
+				    guid_tbl_find(&node_idx, (uintptr_t) node),
+				    NULL))
+			goto oom;
+
+		offset += _marshall64(buf + offset, node->guid);
+		offset += _marshall32(buf + offset, first_port);
+		nports_offset = offset;
+		offset += 2;
+		offset += _marshall16(buf + offset, node->smalid);
+		offset += _marshall8(buf + offset, (uint8_t) node->type);
+		offset += _marshall8(buf + offset, (uint8_t) node->numports);
+		offset += _marshall8(buf + offset, node->smalmc);
+		offset += _marshall8(buf + offset, (uint8_t) node->smaenhsp0);
+		offset += 4;
+		offset += _marshall_buf(buf + offset, node->switchinfo,
+					IB_SMP_DATA_SIZE);
+		offset += _marshall_buf(buf + offset, node->info,
+					IB_SMP_DATA_SIZE);
+		offset += _marshall_buf(buf + offset, node->nodedesc,
+					IB_SMP_DATA_SIZE);
+
+		for (i = 0; i <= node->numports; i++)
+			if (node->ports[i])
+				port_count++;
+		_marshall16(buf + nports_offset, port_count - first_port);
+	}
+
+	for (node = fabric->nodes; node; node = node->next) {
+		for (i = 0; i <= node->numports; i++) {
+			port = node->ports[i];
+			if (!port)
+				continue;
+
+			if (guid_tbl_insert(&port_guids, port->guid,
+					    guid_tbl_find(&port_idx,
+							  (uintptr_t) port),
+					    NULL))
+				goto oom;
+
+			offset += _marshall64(buf + offset, port->guid);
+			offset += _marshall32(buf + offset,
+					      _cache_lookup_v2(&node_idx, node));
+			offset += _marshall32(buf + offset,
+					      _cache_lookup_v2(&port_idx,
+							       port->remoteport));
+			offset += _marshall16(buf + offset, port->base_lid);
+			offset += _marshall8(buf + offset,
+					     (uint8_t) port->portnum);
+			offset += _marshall8(buf + offset,
+					     (uint8_t) port->ext_portnum);
+			offset += _marshall8(buf + offset, port->lmc);
+			offset += 3;
+			offset += _marshall_buf(buf + offset, port->info,
+						IB_SMP_DATA_SIZE);
+		}
+	}
+
+	offset += _cache_index_v2(buf + offset, &node_guids);
+	offset += _cache_index_v2(buf + offset, &port_guids);
+
+	for (node = fabric->nodes; node; node = node->next)
+		if (_cache_ft_len_v2(node))
+			offset += _cache_ft_v2(buf + offset, node,
+					       _cache_lookup_v2(&node_idx,
+								node));
+
+	*outbuf = buf;
+	*outlen = offset;
+	buf = NULL;
+	rc = 0;
+	goto cleanup;
+
+oom:
+	IBND_DEBUG("OOM: fabric cache index\n");
+cleanup:
+	free(buf);
+	guid_tbl_destroy(&node_idx);
+	guid_tbl_destroy(&port_idx);
+	guid_tbl_destroy(&node_guids);
+	guid_tbl_destroy(&port_guids);
+	return rc;
+}
+
+static int _cache_fabric_v2(int fd, ibnd_fabric_t * fabric)
+{
+	uint8_t *buf;
+	size_t len;
+	int rc;
+
+	if (_cache_buf_v2(fabric, &buf, &len) < 0)
+		return -1;
+
+	rc = ibnd_write(fd, buf, len) < 0 ? -1 : 0;
+	free(buf);
+	return rc;
+}
+
+int ibnd_cache_fabric_buf(ibnd_fabric_t * fabric, void **buf, size_t * len)
+{
+	if (!fabric || !buf || !len) {
+		IBND_DEBUG("invalid parameter\n");
+		return -1;
+	}
+
+	return _cache_buf_v2(fabric, (uint8_t **) buf, len);
+}
+
 int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		      unsigned int flags)
 {
@@ -887,7 +1530,6 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 	ibnd_node_t *node_next = NULL;
 	unsigned int node_count = 0;
 	ibnd_port_t *port = NULL;
-	ibnd_port_t *port_next = NULL;
 	unsigned int port_count = 0;
 	int fd;
 	int i;
@@ -923,6 +1565,12 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		return -1;
 	}
 
+	if (flags & IBND_CACHE_FABRIC_FLAG_V2) {
+		if (_cache_fabric_v2(fd, fabric) < 0)
+			goto cleanup;
+		goto done;
+	}
+
 	if (_cache_header_info(fd, fabric) < 0)
 		goto cleanup;
 
@@ -937,22 +1585,24 @@ int ibnd_cache_fabric(ibnd_fabric_t * fabric, const char *file,
 		node = node_next;
 	}
 
-	for (i = 0; i < HTSZ; i++) {
-		port = fabric->portstbl[i];
-		while (port) {
-			port_next = port->htnext;
+	/* exactly the ports _cache_node() stored keys for */
+	for (node = fabric->nodes; node; node = node->next) {
+		for (i = 0; i <= node->numports; i++) {
+			port = node->ports[i];
+			if (!port)
+				continue;
 
 			if (_cache_port(fd, port) < 0)
 				goto cleanup;
 
 			port_count++;
-			port = port_next;
 		}
 	}
 
 	if (_cache_header_counts(fd, node_count, port_count) < 0)
 		goto cleanup;
 
+done:
 	if (close(fd) < 0) {
 		IBND_DEBUG("close: %s\n", strerror(errno));
 		goto cleanup;
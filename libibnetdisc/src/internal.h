@@ -40,7 +40,9 @@
 
 #include <infiniband/ibnetdisc.h>
 #include <complib/cl_qmap.h>
-#include <glib.h>
+
+#define IBMAD_FAST_FIELDS
+#include <infiniband/mad_fields.h>
 
 #define	IBND_DEBUG(fmt, ...) \
 	if (ibdebug) { \
@@ -58,22 +60,153 @@
 #define DEFAULT_TIMEOUT 1000
 #define DEFAULT_RETRIES 3
 
+/* adaptive (IBND_CONFIG_ADAPTIVE_SMPS) window defaults */
+#define DEFAULT_ADAPTIVE_MAX_SMPS 64
+#define DEFAULT_ADAPTIVE_START_SMPS 16
+#define DEFAULT_MAX_SMPS_PER_SWITCH 4
+#define ADAPTIVE_RTT_CONGESTED 4	/* rtt > N * min rtt is congestion */
+#define ADAPTIVE_QUEUE_SCAN 64	/* queued SMPs searched for a free switch */
+#define SWITCH_LOAD_TBL_SZ 1024
+
+/* forwarding table reads (ibnd_load_fts) on the wire; one per switch as
+ * they are issued round robin */
+#define DEFAULT_FTS_MAX_SMPS 64
+
+/* engine timer wheel; timeouts and retries are scheduled in user space */
+#define SMP_WHEEL_SLOTS 256
+#define SMP_WHEEL_TICK_MS 4
+#define RETRY_BACKOFF_BASE_MS 8
+#define RETRY_BACKOFF_MAX_MS 1000
+
+/* arena.c */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct ibnd_arena {
+	struct ibnd_arena_chunk *chunks;
+	unsigned nchunks;
+	size_t bytes;
+} ibnd_arena_t;
+
+typedef struct ibnd_pool {
+	ibnd_arena_t *arena;
+	size_t obj_size;
+	void *free_list;
+} ibnd_pool_t;
+
+void arena_init(ibnd_arena_t * arena);
+void *arena_zalloc(ibnd_arena_t * arena, size_t size);
+void arena_release(ibnd_arena_t * arena);
+void arena_adopt(ibnd_arena_t * dst, ibnd_arena_t * src);
+void pool_init(ibnd_pool_t * pool, ibnd_arena_t * arena, size_t obj_size);
+void *pool_get(ibnd_pool_t * pool);
+void pool_put(ibnd_pool_t * pool, void *obj);
+
+/* guid_tbl.c */
+typedef struct guid_tbl_entry {
+	uint64_t guid;
+	void *obj;		/* NULL marks an empty slot */
+} guid_tbl_entry_t;
+
+typedef struct guid_tbl {
+	guid_tbl_entry_t *slots;
+	uint32_t mask;
+	uint32_t count;
+} guid_tbl_t;
+
+void guid_tbl_init(guid_tbl_t * tbl);
+void guid_tbl_destroy(guid_tbl_t * tbl);
+int guid_tbl_presize(guid_tbl_t * tbl, uint32_t size);
+void *guid_tbl_find(const guid_tbl_t * tbl, uint64_t guid);
+int guid_tbl_insert(guid_tbl_t * tbl, uint64_t guid, void *obj, void **prev);
+
+/* LID to port map; the unicast LID space split into lazily allocated pages */
+#define LID_PAGE_SHIFT 8
+#define LID_PAGE_SIZE (1 << LID_PAGE_SHIFT)
+#define LID_PAGES ((IB_MAX_UCAST_LID + 1) >> LID_PAGE_SHIFT)
+
 typedef struct f_internal {
 	ibnd_fabric_t fabric;
-	GHashTable *lid2guid;
+	ibnd_port_t **lid_pages[LID_PAGES];
+	/* nodes, ports, chassis and LID pages; freed with the fabric */
+	ibnd_arena_t arena;
+	/* replace the fixed size nodestbl/portstbl of ibnd_fabric_t */
+	guid_tbl_t node_guids;
+	guid_tbl_t port_guids;
+	/* read from a cache file; path_portid is not valid */
+	int loaded;
 } f_internal_t;
 f_internal_t *allocate_fabric_internal(void);
-void create_lid2guid(f_internal_t *f_int);
-void destroy_lid2guid(f_internal_t *f_int);
-void add_to_portlid_hash(ibnd_port_t * port, GHashTable *htable);
+int set_config(struct ibnd_config *config, struct ibnd_config *cfg);
+int add_to_portlid_hash(ibnd_port_t * port, f_internal_t * f_int);
+
+/* multiport.c: state shared by the engines of a multi port scan */
+#define GUID_CLAIMS_SIZE (1 << 17)
+#define MAX_DISCOVER_PORTS 16
+#define MP_IDLE_POLL_US 200
+
+typedef struct mp_probe {
+	struct mp_probe *next;
+	uint64_t guid;		/* switch to probe through */
+	int port_num;
+} mp_probe_t;
+
+typedef struct mp_shared {
+	/* GUIDs, who explores them and which engines have a path to them */
+	struct guid_claim {
+		uint64_t guid;
+		int owner;
+		uint32_t reach;
+	} *slots;
+	uint32_t mask;
+	int nengines;
+	/* engines busy plus probes not yet taken; 0 ends the scan */
+	int work;
+	struct {
+		mp_probe_t *mailbox;	/* lock free stack */
+		int failed;
+		int owes_work;	/* took probes, or nodes the claims missed */
+		unsigned next_peer;
+	} eng[MAX_DISCOVER_PORTS];
+} mp_shared_t;
+
+int claim_guid(mp_shared_t * mp, uint64_t guid, int id);
+void mp_reach(mp_shared_t * mp, uint64_t guid, int id);
+int mp_pick_engine(mp_shared_t * mp, uint64_t guid, int id);
+int mp_send_probe(mp_shared_t * mp, int to, uint64_t guid, int port_num);
+mp_probe_t *mp_take_probes(mp_shared_t * mp, int id);
+void mp_set_idle(mp_shared_t * mp);
+void mp_set_busy(mp_shared_t * mp);
+void mp_set_failed(mp_shared_t * mp, int id);
+int mp_scan_done(mp_shared_t * mp);
 
 typedef struct ibnd_scan {
 	ib_portid_t selfportid;
 	f_internal_t *f_int;
 	struct ibnd_config *cfg;
 	unsigned initial_hops;
+	unsigned total_smps;
+	/* per scan callback data; freed when the scan completes */
+	ibnd_arena_t scratch;
+	ibnd_pool_t cbdata_pool;
+	ibnd_pool_t adopt_pool;
+	/* rediscovery only: the fabric found last time and the switches
+	 * whose PortInfo is on the wire */
+	ibnd_fabric_t *prev;
+	guid_tbl_t adopting;
+	/* multi port scans only: nodes claimed by this engine are explored,
+	 * others are recorded as stubs so their links can be merged */
+	mp_shared_t *mp;
+	int id;
+	guid_tbl_t stubs;
 } ibnd_scan_t;
 
+int discover_from_port(ibnd_scan_t * scan, char *ca_name, int ca_port,
+		       ib_portid_t * from);
+int build_change_set(f_internal_t * f_int, ibnd_fabric_t * prev,
+		     ibnd_change_t ** changes);
+ibnd_fabric_t *discover_multi_port(char *ca_name, int ca_port,
+				   struct ibnd_config *cfg);
+
 typedef struct ibnd_smp ibnd_smp_t;
 typedef struct smp_engine smp_engine_t;
 typedef int (*smp_comp_cb_t) (smp_engine_t * engine, ibnd_smp_t * smp,
@@ -81,13 +214,29 @@ typedef int (*smp_comp_cb_t) (smp_engine_t * engine, ibnd_smp_t * smp,
 struct ibnd_smp {
 	cl_map_item_t on_wire;
 	struct ibnd_smp *qnext;
+	struct ibnd_smp *tnext;	/* timer wheel slot list */
+	struct ibnd_smp *tprev;
+	uint64_t deadline_ms;
+	unsigned attempts;
+	int retry_wait;		/* on the wheel waiting to be re-issued */
 	smp_comp_cb_t cb;
 	void *cb_data;
 	ib_portid_t path;
 	ib_rpc_t rpc;
+	uint64_t sent_us;
+	unsigned sw_slot;
 };
 
+typedef struct smp_hop_stats {
+	unsigned sent;
+	unsigned completed;
+	unsigned timeouts;
+	uint64_t srtt_us;
+	uint64_t min_rtt_us;
+} smp_hop_stats_t;
+
 struct smp_engine {
+	struct ibmad_transport *tp;
 	int umad_fd;
 	int smi_agent;
 	int smi_dir_agent;
@@ -97,6 +246,29 @@ struct smp_engine {
 	cl_qmap_t smps_on_wire;
 	struct ibnd_config *cfg;
 	unsigned total_smps;
+	unsigned total_retries;
+
+	/* optional; called when the queue runs dry so that a long list of
+	 * SMPs can be issued a window at a time rather than all at once */
+	int (*fill) (smp_engine_t * engine);
+	int filling;
+
+	/* SMP descriptors are recycled rather than malloc'ed per MAD */
+	ibnd_arena_t smp_arena;
+	ibnd_pool_t smp_pool;
+
+	/* deadlines of SMPs on the wire and of retries waiting to be sent */
+	ibnd_smp_t *wheel[SMP_WHEEL_SLOTS];
+	uint64_t wheel_tick;
+	unsigned timers;
+	unsigned rand_seed;
+
+	/* adaptive windowing state */
+	unsigned window;
+	unsigned window_acc;
+	unsigned since_decrease;
+	smp_hop_stats_t hop_stats[MAXHOPS + 1];
+	uint16_t sw_load[SWITCH_LOAD_TBL_SZ];
 };
 
 int smp_engine_init(smp_engine_t * engine, char * ca_name, int ca_port,
@@ -106,12 +278,10 @@ int issue_smp(smp_engine_t * engine, ib_portid_t * portid,
 int process_mads(smp_engine_t * engine);
 void smp_engine_destroy(smp_engine_t * engine);
 
-int add_to_nodeguid_hash(ibnd_node_t * node, ibnd_node_t * hash[]);
+int add_to_nodeguid_hash(ibnd_node_t * node, f_internal_t * f_int);
 
-int add_to_portguid_hash(ibnd_port_t * port, ibnd_port_t * hash[]);
+int add_to_portguid_hash(ibnd_port_t * port, f_internal_t * f_int);
 
 void add_to_type_list(ibnd_node_t * node, f_internal_t * fabric);
 
-void destroy_node(ibnd_node_t * node);
-
 #endif				/* _INTERNAL_H_ */
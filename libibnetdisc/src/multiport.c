@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/** =========================================================================
+ * Discovery from several local ports at once.
+ *
+ * One smp_engine runs per local port, each in its own thread and each on
+ * its own private fabric.  The engines share only a table of claimed
+ * GUIDs: the first engine to find a node explores it, the others record it
+ * as a stub so the link they came in on is not lost.  Once all engines are
+ * done the private fabrics are merged, by GUID, into the fabric returned
+ * to the caller and DR paths are recomputed relative to its from_node.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+#include "internal.h"
+#include "chassis.h"
+
+typedef struct port_scan {
+	pthread_t thread;
+	char ca_name[UMAD_CA_NAME_LEN];
+	int ca_port;
+	ibnd_scan_t scan;
+	int rc;
+} port_scan_t;
+
+static inline uint32_t claim_hash(uint64_t guid)
+{
+	guid ^= guid >> 33;
+	guid *= 0xff51afd7ed558ccdULL;
+	guid ^= guid >> 33;
+	return (uint32_t) guid;
+}
+
+static struct guid_claim *find_claim(mp_shared_t * mp, uint64_t guid)
+{
+	uint32_t i = claim_hash(guid) & mp->mask;
+	uint32_t n;
+	uint64_t cur;
+
+	for (n = 0; n <= mp->mask; n++, i = (i + 1) & mp->mask) {
+		cur = __atomic_load_n(&mp->slots[i].guid, __ATOMIC_ACQUIRE);
+		if (cur == guid)
+			return &mp->slots[i];
+		if (!cur)
+			break;
+	}
+	return NULL;
+}
+
+/* Lock free: a slot is taken by compare-and-swap on its guid.  Returns 1
+ * if the caller now owns guid.  Should the table fill up every caller owns
+ * the node and the merge sorts out the duplicates; the caller can then no
+ * longer fail without losing part of the fabric. */
+int claim_guid(mp_shared_t * mp, uint64_t guid, int id)
+{
+	uint32_t i = claim_hash(guid) & mp->mask;
+	uint32_t n;
+	uint64_t cur;
+
+	if (!guid)
+		return 1;
+
+	for (n = 0; n <= mp->mask; n++, i = (i + 1) & mp->mask) {
+		cur = __sync_val_compare_and_swap(&mp->slots[i].guid, 0, guid);
+		if (cur == 0) {
+			/* owner is only read once the engines are joined */
+			mp->slots[i].owner = id;
+			__sync_fetch_and_or(&mp->slots[i].reach, 1U << id);
+			return 1;
+		}
+		if (cur == guid)
+			return 0;
+	}
+	mp->eng[id].owes_work = 1;
+	return 1;
+}
+
+/* Engine id has a DR path to guid; it may be handed probes through it. */
+void mp_reach(mp_shared_t * mp, uint64_t guid, int id)
+{
+	struct guid_claim *c = find_claim(mp, guid);
+
+	if (c)
+		__sync_fetch_and_or(&c->reach, 1U << id);
+}
+
+/* Spread the probes through a switch round robin over the engines which
+ * can reach it. */
+int mp_pick_engine(mp_shared_t * mp, uint64_t guid, int id)
+{
+	struct guid_claim *c = find_claim(mp, guid);
+	uint32_t reach;
+	unsigned i, e;
+
+	if (!c)
+		return id;
+	reach = __atomic_load_n(&c->reach, __ATOMIC_ACQUIRE);
+	for (i = 0; i < (unsigned) mp->nengines; i++) {
+		e = (mp->eng[id].next_peer + i) % mp->nengines;
+		if ((reach & (1U << e)) &&
+		    !__atomic_load_n(&mp->eng[e].failed, __ATOMIC_ACQUIRE)) {
+			mp->eng[id].next_peer = e + 1;
+			return e;
+		}
+	}
+	return id;
+}
+
+int mp_send_probe(mp_shared_t * mp, int to, uint64_t guid, int port_num)
+{
+	mp_probe_t *probe = malloc(sizeof(*probe));
+	mp_probe_t *head;
+
+	if (!probe)
+		return -ENOMEM;
+	probe->guid = guid;
+	probe->port_num = port_num;
+
+	/* count it before it is visible so work can not drop to 0 early */
+	__sync_fetch_and_add(&mp->work, 1);
+	do {
+		head = __atomic_load_n(&mp->eng[to].mailbox, __ATOMIC_ACQUIRE);
+		probe->next = head;
+	} while (!__sync_bool_compare_and_swap(&mp->eng[to].mailbox, head,
+					       probe));
+	return 0;
+}
+
+/* Take all probes handed to engine id; the caller must be marked busy
+ * first and frees them. */
+mp_probe_t *mp_take_probes(mp_shared_t * mp, int id)
+{
+	mp_probe_t *list = __atomic_exchange_n(&mp->eng[id].mailbox, NULL,
+					       __ATOMIC_ACQ_REL);
+	mp_probe_t *probe;
+	int n = 0;
+
+	for (probe = list; probe; probe = probe->next)
+		n++;
+	if (n) {
+		mp->eng[id].owes_work = 1;
+		__sync_fetch_and_sub(&mp->work, n);
+	}
+	return list;
+}
+
+void mp_set_idle(mp_shared_t * mp)
+{
+	__sync_fetch_and_sub(&mp->work, 1);
+}
+
+void mp_set_busy(mp_shared_t * mp)
+{
+	__sync_fetch_and_add(&mp->work, 1);
+}
+
+/* engine id no longer takes probes; those already sent are dropped, which
+ * fails the whole discovery (see engine_lost_work) */
+void mp_set_failed(mp_shared_t * mp, int id)
+{
+	__atomic_store_n(&mp->eng[id].failed, 1, __ATOMIC_RELEASE);
+}
+
+int mp_scan_done(mp_shared_t * mp)
+{
+	return __atomic_load_n(&mp->work, __ATOMIC_ACQUIRE) == 0;
+}
+
+static int claim_owner(mp_shared_t * mp, uint64_t guid)
+{
+	struct guid_claim *c = find_claim(mp, guid);
+
+	return c ? c->owner : -1;
+}
+
+/* Once the engines are joined: could engine id have left part of the
+ * fabric unscanned?  Nobody else explores the nodes it claimed, nor the
+ * switch ports it was handed probes for. */
+static int engine_lost_work(mp_shared_t * mp, int id)
+{
+	uint32_t i;
+
+	if (mp->eng[id].owes_work)
+		return 1;
+	for (i = 0; i <= mp->mask; i++)
+		if (mp->slots[i].guid && mp->slots[i].owner == id)
+			return 1;
+	return 0;
+}
+
+/* The requested port plus every other active local port on the same
+ * subnet, i.e. with the same SM and subnet prefix.  Only libibumad can
+ * list the local CAs; through any other transport (IBDIAG_SIM) the scan
+ * is from the requested port alone. */
+static int find_subnet_ports(char *ca_name, int ca_port, port_scan_t * ps)
+{
+	struct ibmad_transport *tp = mad_get_transport();
+	char names[UMAD_MAX_DEVICES][UMAD_CA_NAME_LEN];
+	umad_port_t self;
+	umad_ca_t ca;
+	umad_port_t *port;
+	int nca, i, p, n = 0, is_umad = !strcmp(tp->name, "umad");
+
+	if (is_umad && umad_init() < 0) {
+		IBND_ERROR("umad_init failed\n");
+		return -EIO;
+	}
+	if (tp->get_port(tp, ca_name, ca_port, &self) < 0) {
+		IBND_ERROR("can't get UMAD port (%s:%d)\n", ca_name, ca_port);
+		return -EIO;
+	}
+	snprintf(ps[n].ca_name, sizeof(ps[n].ca_name), "%s", self.ca_name);
+	ps[n++].ca_port = self.portnum;
+
+	nca = is_umad ? umad_get_cas_names(names, UMAD_MAX_DEVICES) : 0;
+	for (i = 0; i < nca && n < MAX_DISCOVER_PORTS; i++) {
+		if (umad_get_ca(names[i], &ca) < 0)
+			continue;
+		for (p = 1; p <= ca.numports && n < MAX_DISCOVER_PORTS; p++) {
+			port = ca.ports[p];
+			if (!port || port->state != IB_LINK_ACTIVE)
+				continue;
+			if (!strcmp(port->ca_name, self.ca_name) &&
+			    port->portnum == self.portnum)
+				continue;
+			if (port->sm_lid != self.sm_lid ||
+			    port->gid_prefix != self.gid_prefix)
+				continue;
+			snprintf(ps[n].ca_name, sizeof(ps[n].ca_name), "%s",
+				 port->ca_name);
+			ps[n++].ca_port = port->portnum;
+		}
+		umad_release_ca(&ca);
+	}
+	tp->release_port(tp, &self);
+	return n;
+}
+
+static void *port_scan_thread(void *arg)
+{
+	port_scan_t *ps = arg;
+	ib_portid_t from = { 0 };
+
+	ps->rc = discover_from_port(&ps->scan, ps->ca_name, ps->ca_port, &from);
+	if (ps->rc)
+		IBND_ERROR("discovery from %s:%d failed; %d\n",
+			   ps->ca_name, ps->ca_port, ps->rc);
+	return NULL;
+}
+
+static ibnd_node_t *master_node(f_internal_t * f_int, uint64_t guid)
+{
+	return ibnd_find_node_guid(&f_int->fabric, guid);
+}
+
+static int port_has_info(ibnd_port_t * port)
+{
+	return mad_get_field(port->info, 0, IB_PORT_STATE_F) != 0;
+}
+
+/* Give the master copy of a node the ports only a stub knows about. */
+static void merge_stub_ports(ibnd_node_t * stub, ibnd_node_t * m)
+{
+	ibnd_port_t *port, *mport;
+	int p, n = stub->numports < m->numports ? stub->numports : m->numports;
+
+	for (p = 0; p <= n; p++) {
+		port = stub->ports[p];
+		if (!port)
+			continue;
+		mport = m->ports[p];
+		if (!mport) {
+			m->ports[p] = port;
+			port->node = m;
+		} else if (!port_has_info(mport) && port_has_info(port)) {
+			memcpy(mport->info, port->info, sizeof(mport->info));
+			memcpy(mport->ext_info, port->ext_info,
+			       sizeof(mport->ext_info));
+			mport->base_lid = port->base_lid;
+			mport->lmc = port->lmc;
+			mport->ext_portnum = port->ext_portnum;
+		}
+	}
+	if (!m->nodedesc[0])
+		memcpy(m->nodedesc, stub->nodedesc, sizeof(m->nodedesc));
+}
+
+/* Re-point every link an engine saw at the master copies of its ends. */
+static void merge_links(f_internal_t * f_int, ibnd_node_t * node)
+{
+	ibnd_node_t *m = master_node(f_int, node->guid), *rm;
+	ibnd_port_t *port, *rport, *mport, *rmport;
+	int p;
+
+	for (p = 0; p <= node->numports; p++) {
+		port = node->ports[p];
+		if (!port || !(rport = port->remoteport))
+			continue;
+		rm = master_node(f_int, rport->node->guid);
+		if (!rm || p > m->numports || rport->portnum > rm->numports)
+			continue;
+		mport = m->ports[p];
+		if (!mport)
+			continue;
+		/* only this engine saw the far port; hand it to the master */
+		rmport = rm->ports[rport->portnum];
+		if (!rmport) {
+			rmport = rm->ports[rport->portnum] = rport;
+			rport->node = rm;
+		}
+		mport->remoteport = rmport;
+		rmport->remoteport = mport;
+	}
+}
+
+/* Recompute DR paths (and maxhops) relative to the merged from_node.  As
+ * in discovery, paths only continue through switches. */
+static int rebuild_paths(f_internal_t * f_int, unsigned nnodes)
+{
+	ibnd_fabric_t *fabric = &f_int->fabric;
+	ibnd_node_t **queue, *node, *rnode;
+	ibnd_port_t *port;
+	ib_dr_path_t *dr;
+	guid_tbl_t seen;
+	unsigned head = 0, tail = 0;
+	int p;
+
+	if (!fabric->from_node)
+		return -1;
+	if (!(queue = calloc(nnodes + 1, sizeof(*queue))))
+		return -ENOMEM;
+	guid_tbl_init(&seen);
+
+	node = fabric->from_node;
+	memset(&node->path_portid, 0, sizeof(node->path_portid));
+	fabric->maxhops_discovered = 0;
+	if (guid_tbl_insert(&seen, node->guid, node, NULL))
+		goto oom;
+	queue[tail++] = node;
+
+	while (head < tail) {
+		node = queue[head++];
+		for (p = 1; p <= node->numports; p++) {
+			if (node->type != IB_NODE_SWITCH &&
+			    !(node == fabric->from_node &&
+			      p == fabric->from_portnum))
+				continue;
+			port = node->ports[p];
+			if (!port || !port->remoteport)
+				continue;
+			rnode = port->remoteport->node;
+			if (guid_tbl_find(&seen, rnode->guid))
+				continue;
+			if (node->path_portid.drpath.cnt >=
+			    IB_SUBNET_PATH_HOPS_MAX - 1)
+				continue;
+			if (guid_tbl_insert(&seen, rnode->guid, rnode, NULL))
+				goto oom;
+			dr = &rnode->path_portid.drpath;
+			rnode->path_portid = node->path_portid;
+			dr->p[++dr->cnt] = (uint8_t) p;
+			if ((unsigned) dr->cnt > fabric->maxhops_discovered)
+				fabric->maxhops_discovered = dr->cnt;
+			if (tail < nnodes)
+				queue[tail++] = rnode;
+		}
+	}
+
+	if (seen.count != nnodes)
+		IBND_DEBUG("%u of %u nodes not reachable from the from node;"
+			   " their DR paths are relative to another port\n",
+			   nnodes - seen.count, nnodes);
+	guid_tbl_destroy(&seen);
+	free(queue);
+	return 0;
+oom:
+	guid_tbl_destroy(&seen);
+	free(queue);
+	return -ENOMEM;
+}
+
+static int merge_fabrics(f_internal_t * f_int, port_scan_t * ps, int n,
+			 mp_shared_t * mp)
+{
+	ibnd_node_t *node, *next;
+	unsigned nnodes = 0;
+	int i, p, owner;
+
+	/* 1: choose the master copy of every node: the one explored by the
+	 * engine that claimed it, or failing that, the first one seen */
+	for (i = 0; i < n; i++)
+		for (node = ps[i].scan.f_int->fabric.nodes; node;
+		     node = node->next) {
+			owner = claim_owner(mp, node->guid);
+			if (owner >= 0 && owner != i)
+				continue;
+			if (master_node(f_int, node->guid))
+				continue;
+			if (add_to_nodeguid_hash(node, f_int))
+				return -1;
+		}
+	for (i = 0; i < n; i++)
+		for (node = ps[i].scan.f_int->fabric.nodes; node;
+		     node = node->next)
+			if (!master_node(f_int, node->guid) &&
+			    add_to_nodeguid_hash(node, f_int))
+				return -1;
+
+	/* 2: ports and data only the stubs have */
+	for (i = 0; i < n; i++)
+		for (node = ps[i].scan.f_int->fabric.nodes; node;
+		     node = node->next)
+			if (master_node(f_int, node->guid) != node)
+				merge_stub_ports(node,
+						 master_node(f_int, node->guid));
+
+	/* 3: links, from whichever side saw them */
+	for (i = 0; i < n; i++)
+		for (node = ps[i].scan.f_int->fabric.nodes; node;
+		     node = node->next)
+			merge_links(f_int, node);
+
+	/* 4: fabric lists and port lookups over the masters only */
+	for (i = 0; i < n; i++)
+		for (node = ps[i].scan.f_int->fabric.nodes; node;
+		     node = next) {
+			next = node->next;
+			if (master_node(f_int, node->guid) != node)
+				continue;
+			node->next = f_int->fabric.nodes;
+			f_int->fabric.nodes = node;
+			add_to_type_list(node, f_int);
+			for (p = 0; p <= node->numports; p++) {
+				if (!node->ports[p])
+					continue;
+				if (add_to_portguid_hash(node->ports[p],
+							 f_int) < 0)
+					return -1;
+				if (add_to_portlid_hash(node->ports[p], f_int))
+					return -1;
+			}
+			nnodes++;
+		}
+
+	for (i = 0; i < n; i++)
+		f_int->fabric.total_mads_used += ps[i].scan.total_smps;
+
+	node = ps[0].scan.f_int->fabric.from_node;
+	if (!node)
+		return -1;
+	f_int->fabric.from_node = master_node(f_int, node->guid);
+	f_int->fabric.from_portnum = ps[0].scan.f_int->fabric.from_portnum;
+
+	return rebuild_paths(f_int, nnodes);
+}
+
+ibnd_fabric_t *discover_multi_port(char *ca_name, int ca_port,
+				   struct ibnd_config *cfg)
+{
+	port_scan_t ps[MAX_DISCOVER_PORTS];
+	mp_shared_t mp;
+	f_internal_t *f_int = NULL;
+	int n, i, started = 0;
+
+	memset(ps, 0, sizeof(ps));
+	n = find_subnet_ports(ca_name, ca_port, ps);
+	if (n <= 0)
+		return NULL;
+	IBND_DEBUG("multi port discovery over %d port(s)\n", n);
+
+	memset(&mp, 0, sizeof(mp));
+	mp.mask = GUID_CLAIMS_SIZE - 1;
+	mp.nengines = n;
+	mp.work = n;
+	mp.slots = calloc(GUID_CLAIMS_SIZE, sizeof(*mp.slots));
+	if (!mp.slots) {
+		IBND_ERROR("OOM: failed to allocate GUID claims\n");
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		ps[i].scan.f_int = allocate_fabric_internal();
+		if (!ps[i].scan.f_int) {
+			IBND_ERROR("OOM: failed to calloc ibnd_fabric_t\n");
+			goto out;
+		}
+		ps[i].scan.cfg = cfg;
+		ps[i].scan.mp = &mp;
+		ps[i].scan.id = i;
+		guid_tbl_init(&ps[i].scan.stubs);
+	}
+
+	for (started = 0; started < n; started++)
+		if (pthread_create(&ps[started].thread, NULL,
+				   port_scan_thread, &ps[started])) {
+			IBND_ERROR("failed to start discovery thread for"
+				   " %s:%d\n", ps[started].ca_name,
+				   ps[started].ca_port);
+			break;
+		}
+	/* engines which never ran are neither busy nor take probes */
+	for (i = started; i < n; i++) {
+		ps[i].rc = -EAGAIN;
+		mp_set_failed(&mp, i);
+		mp_set_idle(&mp);
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(ps[i].thread, NULL);
+
+	/* the other ports only add bandwidth; the requested one must work,
+	 * and any other may only fail before it took on part of the fabric */
+	if (ps[0].rc)
+		goto out;
+	for (i = 1; i < n; i++)
+		if (ps[i].rc && engine_lost_work(&mp, i)) {
+			IBND_ERROR("discovery from %s:%d failed part way;"
+				   " the fabric would be incomplete\n",
+				   ps[i].ca_name, ps[i].ca_port);
+			goto out;
+		}
+
+	if (!(f_int = allocate_fabric_internal())) {
+		IBND_ERROR("OOM: failed to calloc ibnd_fabric_t\n");
+		goto out;
+	}
+	for (i = 0; i < n; i++)
+		arena_adopt(&f_int->arena, &ps[i].scan.f_int->arena);
+
+	if (merge_fabrics(f_int, ps, n, &mp) || group_nodes(&f_int->fabric)) {
+		IBND_ERROR("failed to merge multi port discovery\n");
+		ibnd_destroy_fabric(&f_int->fabric);
+		f_int = NULL;
+	}
+
+out:
+	for (i = 0; i < n; i++) {
+		guid_tbl_destroy(&ps[i].scan.stubs);
+		/* nodes and ports now belong to f_int */
+		ibnd_destroy_fabric((ibnd_fabric_t *)ps[i].scan.f_int);
+	}
+	free(mp.slots);
+	return (ibnd_fabric_t *)f_int;
+}
@@ -37,6 +37,10 @@
 #endif				/* HAVE_CONFIG_H */
 
 #include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
 #include <infiniband/ibnetdisc.h>
 #include <infiniband/umad.h>
 #include "internal.h"
@@ -44,6 +48,11 @@
 extern int mlnx_ext_port_info_err(smp_engine_t * engine, ibnd_smp_t * smp,
 				  uint8_t * mad, void *cb_data);
 
+static int is_adaptive(smp_engine_t * engine)
+{
+	return (engine->cfg->flags & IBND_CONFIG_ADAPTIVE_SMPS);
+}
+
 static void queue_smp(smp_engine_t * engine, ibnd_smp_t * smp)
 {
 	smp->qnext = NULL;
@@ -56,6 +65,15 @@ static void queue_smp(smp_engine_t * engine, ibnd_smp_t * smp)
 	}
 }
 
+/* retries go to the front so they are not stuck behind a long BFS queue */
+static void queue_smp_head(smp_engine_t * engine, ibnd_smp_t * smp)
+{
+	smp->qnext = engine->smp_queue_head;
+	engine->smp_queue_head = smp;
+	if (!engine->smp_queue_tail)
+		engine->smp_queue_tail = smp;
+}
+
 static ibnd_smp_t *get_smp(smp_engine_t * engine)
 {
 	ibnd_smp_t *head = engine->smp_queue_head;
@@ -69,6 +87,208 @@ static ibnd_smp_t *get_smp(smp_engine_t * engine)
 	return rc;
 }
 
+/* In adaptive mode skip (a bounded number of) SMPs whose forwarding switch
+ * already has max_smps_per_switch outstanding.
+ */
+static ibnd_smp_t *get_next_smp(smp_engine_t * engine)
+{
+	ibnd_smp_t *prev = NULL;
+	ibnd_smp_t *smp;
+	unsigned n = 0;
+
+	if (!is_adaptive(engine))
+		return get_smp(engine);
+
+	for (smp = engine->smp_queue_head; smp && n < ADAPTIVE_QUEUE_SCAN;
+	     prev = smp, smp = smp->qnext, n++) {
+		if (engine->sw_load[smp->sw_slot] >=
+		    engine->cfg->max_smps_per_switch)
+			continue;
+		if (!prev)
+			return get_smp(engine);
+		prev->qnext = smp->qnext;
+		if (engine->smp_queue_tail == smp)
+			engine->smp_queue_tail = prev;
+		return smp;
+	}
+	return NULL;
+}
+
+static uint64_t get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t get_time_ms(void)
+{
+	return get_time_us() / 1000;
+}
+
+static void timer_add(smp_engine_t * engine, ibnd_smp_t * smp,
+		      uint64_t deadline_ms)
+{
+	unsigned slot = (deadline_ms / SMP_WHEEL_TICK_MS) % SMP_WHEEL_SLOTS;
+
+	smp->deadline_ms = deadline_ms;
+	smp->tprev = NULL;
+	smp->tnext = engine->wheel[slot];
+	if (smp->tnext)
+		smp->tnext->tprev = smp;
+	engine->wheel[slot] = smp;
+	engine->timers++;
+}
+
+static void timer_del(smp_engine_t * engine, ibnd_smp_t * smp)
+{
+	unsigned slot = (smp->deadline_ms / SMP_WHEEL_TICK_MS) % SMP_WHEEL_SLOTS;
+
+	if (smp->tprev)
+		smp->tprev->tnext = smp->tnext;
+	else
+		engine->wheel[slot] = smp->tnext;
+	if (smp->tnext)
+		smp->tnext->tprev = smp->tprev;
+	smp->tnext = smp->tprev = NULL;
+	engine->timers--;
+}
+
+/* time to wait in umad_recv for the first non empty wheel slot */
+static int next_timer_ms(smp_engine_t * engine)
+{
+	uint64_t now, tick;
+	int wait;
+	unsigned i;
+
+	if (!engine->timers)
+		return -1;
+
+	now = get_time_ms();
+	tick = now / SMP_WHEEL_TICK_MS;
+	for (i = 0; i < SMP_WHEEL_SLOTS; i++)
+		if (engine->wheel[(tick + i) % SMP_WHEEL_SLOTS])
+			break;
+
+	wait = (int)((tick + i + 1) * SMP_WHEEL_TICK_MS - now);
+	return (wait > 0 ? wait : 1);
+}
+
+/* exponential backoff with up to 50% random jitter */
+static unsigned retry_backoff_ms(smp_engine_t * engine, unsigned attempt)
+{
+	unsigned backoff = RETRY_BACKOFF_BASE_MS;
+
+	while (--attempt && backoff < RETRY_BACKOFF_MAX_MS)
+		backoff <<= 1;
+	if (backoff > RETRY_BACKOFF_MAX_MS)
+		backoff = RETRY_BACKOFF_MAX_MS;
+
+	return (backoff + rand_r(&engine->rand_seed) % (backoff / 2 + 1));
+}
+
+static unsigned smp_hops(ibnd_smp_t * smp)
+{
+	return (smp->path.drpath.cnt > MAXHOPS ? MAXHOPS :
+		(unsigned) smp->path.drpath.cnt);
+}
+
+/* The switch which forwards a DR SMP onto its last link is identified by
+ * the DR path minus the final hop.  LID routed SMPs are keyed by DLID.
+ * Collisions only make the per switch limit more conservative.
+ */
+static unsigned switch_slot(ib_portid_t * path)
+{
+	uint32_t h = 2166136261u;
+	int i;
+
+	if (path->lid > 0 && path->drpath.drslid != 0xffff &&
+	    path->drpath.drdlid != 0xffff)
+		return (path->lid % SWITCH_LOAD_TBL_SZ);
+
+	h = (h ^ path->drpath.drslid) * 16777619u;
+	for (i = 1; i < path->drpath.cnt; i++)
+		h = (h ^ path->drpath.p[i]) * 16777619u;
+	return (h % SWITCH_LOAD_TBL_SZ);
+}
+
+static unsigned window_limit(smp_engine_t * engine)
+{
+	return (is_adaptive(engine) ? engine->window : engine->cfg->max_smps);
+}
+
+/* additive increase: one more slot per window worth of good completions */
+static void window_grow(smp_engine_t * engine)
+{
+	if (++engine->window_acc < engine->window)
+		return;
+	engine->window_acc = 0;
+	if (engine->window < engine->cfg->max_smps)
+		engine->window++;
+}
+
+/* multiplicative decrease, at most once per window worth of sends so a
+ * burst of timeouts from a single loss event only halves the window once.
+ */
+static void window_shrink(smp_engine_t * engine)
+{
+	if (engine->since_decrease < engine->window)
+		return;
+	engine->since_decrease = 0;
+	engine->window_acc = 0;
+	engine->window /= 2;
+	if (!engine->window)
+		engine->window = 1;
+	IBND_DEBUG("SMP window reduced to %u\n", engine->window);
+}
+
+static void smp_sent(smp_engine_t * engine, ibnd_smp_t * smp)
+{
+	if (!is_adaptive(engine))
+		return;
+
+	smp->sent_us = get_time_us();
+	engine->sw_load[smp->sw_slot]++;
+	engine->hop_stats[smp_hops(smp)].sent++;
+	engine->since_decrease++;
+}
+
+static void smp_done(smp_engine_t * engine, ibnd_smp_t * smp, int status)
+{
+	smp_hop_stats_t *hs;
+	uint64_t rtt;
+
+	if (!is_adaptive(engine))
+		return;
+
+	engine->sw_load[smp->sw_slot]--;
+	hs = &engine->hop_stats[smp_hops(smp)];
+
+	if (status == ETIMEDOUT) {
+		hs->timeouts++;
+		window_shrink(engine);
+		return;
+	}
+
+	hs->completed++;
+	rtt = get_time_us() - smp->sent_us;
+	if (!rtt)
+		rtt = 1;
+	if (!hs->min_rtt_us || rtt < hs->min_rtt_us)
+		hs->min_rtt_us = rtt;
+	if (!hs->srtt_us)
+		hs->srtt_us = rtt;
+	else
+		hs->srtt_us = (7 * hs->srtt_us + rtt) / 8;
+
+	/* queueing delay building up on this path; hold the window */
+	if (rtt > ADAPTIVE_RTT_CONGESTED * hs->min_rtt_us)
+		return;
+
+	window_grow(engine);
+}
+
 static int send_smp(ibnd_smp_t * smp, smp_engine_t * engine)
 {
 	int rc = 0;
@@ -93,8 +313,10 @@ static int send_smp(ibnd_smp_t * smp, smp_engine_t * engine)
 		return rc;
 	}
 
-	if ((rc = umad_send(engine->umad_fd, agent, umad, IB_MAD_SIZE,
-			    engine->cfg->timeout_ms, engine->cfg->retries)) < 0) {
+	/* retries are scheduled by the engine, see smp_timeout() */
+	if ((rc = engine->tp->send(engine->tp, engine->umad_fd, agent, umad,
+				   IB_MAD_SIZE, engine->cfg->timeout_ms,
+				   0)) < 0) {
 		IBND_ERROR("send failed; %d\n", rc);
 		return rc;
 	}
@@ -107,17 +329,32 @@ static int process_smp_queue(smp_engine_t * engine)
 	int rc = 0;
 	ibnd_smp_t *smp;
 	while (cl_qmap_count(&engine->smps_on_wire)
-	       < engine->cfg->max_smps) {
-		smp = get_smp(engine);
+	       < window_limit(engine)) {
+		if (!engine->smp_queue_head && engine->fill &&
+		    !engine->filling) {
+			engine->filling = 1;
+			rc = engine->fill(engine);
+			engine->filling = 0;
+			if (rc)
+				return rc;
+		}
+		smp = get_next_smp(engine);
 		if (!smp)
 			return 0;
 
+		/* a new trid per attempt; late responses to an earlier
+		 * attempt are then simply dropped */
+		smp->rpc.trid = mad_trid();
 		if ((rc = send_smp(smp, engine)) != 0) {
-			free(smp);
+			pool_put(&engine->smp_pool, smp);
 			return rc;
 		}
 		cl_qmap_insert(&engine->smps_on_wire, (uint32_t) smp->rpc.trid,
 			       (cl_map_item_t *) smp);
+		timer_add(engine, smp,
+			  get_time_ms() + engine->cfg->timeout_ms);
+		smp_sent(engine, smp);
+		smp->attempts++;
 		engine->total_smps++;
 	}
 	return 0;
@@ -126,7 +363,7 @@ static int process_smp_queue(smp_engine_t * engine)
 int issue_smp(smp_engine_t * engine, ib_portid_t * portid,
 	      unsigned attrid, unsigned mod, smp_comp_cb_t cb, void *cb_data)
 {
-	ibnd_smp_t *smp = calloc(1, sizeof *smp);
+	ibnd_smp_t *smp = pool_get(&engine->smp_pool);
 	if (!smp) {
 		IBND_ERROR("OOM\n");
 		return -ENOMEM;
@@ -141,8 +378,8 @@ int issue_smp(smp_engine_t * engine, ib_portid_t * portid,
 	smp->rpc.timeout = engine->cfg->timeout_ms;
 	smp->rpc.datasz = IB_SMP_DATA_SIZE;
 	smp->rpc.dataoffs = IB_SMP_DATA_OFFS;
-	smp->rpc.trid = mad_trid();
 	smp->rpc.mkey = engine->cfg->mkey;
+	smp->sw_slot = switch_slot(portid);
 
 	if (portid->lid <= 0 || portid->drpath.drslid == 0xffff ||
 	    portid->drpath.drdlid == 0xffff)
@@ -157,6 +394,87 @@ int issue_smp(smp_engine_t * engine, ib_portid_t * portid,
 	return process_smp_queue(engine);
 }
 
+static int smp_error(smp_engine_t * engine, ibnd_smp_t * smp, uint8_t * mad)
+{
+	if (smp->rpc.attr.id == IB_ATTR_MLNX_EXT_PORT_INFO)
+		return mlnx_ext_port_info_err(engine, smp, mad, smp->cb_data);
+	return 0;
+}
+
+/* smp has been taken off the wire and the wheel; either schedule a retry
+ * (freeing the window slot while it waits) or give up on it.
+ */
+static int smp_timeout(smp_engine_t * engine, ibnd_smp_t * smp)
+{
+	uint8_t mad[IB_MAD_SIZE];
+	int rc;
+
+	smp_done(engine, smp, ETIMEDOUT);
+
+	if (smp->attempts <= engine->cfg->retries) {
+		IBND_DEBUG("timeout (%s Attr 0x%x:%u) attempt %u; retrying\n",
+			   portid2str(&smp->path), smp->rpc.attr.id,
+			   smp->rpc.attr.mod, smp->attempts);
+		smp->retry_wait = 1;
+		timer_add(engine, smp, get_time_ms() +
+			  retry_backoff_ms(engine, smp->attempts));
+		engine->total_retries++;
+		return process_smp_queue(engine);
+	}
+
+	rc = process_smp_queue(engine);
+	if (rc)
+		goto error;
+
+	IBND_ERROR("umad (%s Attr 0x%x:%u) bad status %d; %s\n",
+		   portid2str(&smp->path), smp->rpc.attr.id,
+		   smp->rpc.attr.mod, ETIMEDOUT, strerror(ETIMEDOUT));
+
+	memset(mad, 0, sizeof(mad));
+	mad_set_field(mad, 0, IB_MAD_ATTRMOD_F, smp->rpc.attr.mod);
+	rc = smp_error(engine, smp, mad);
+
+error:
+	pool_put(&engine->smp_pool, smp);
+	return rc;
+}
+
+static int expire_timers(smp_engine_t * engine)
+{
+	uint64_t now = get_time_ms();
+	uint64_t tick = now / SMP_WHEEL_TICK_MS;
+	uint64_t t = engine->wheel_tick;
+	ibnd_smp_t *smp, *next;
+	int rc;
+
+	if (tick - t >= SMP_WHEEL_SLOTS)
+		t = tick - SMP_WHEEL_SLOTS + 1;
+
+	for (; t <= tick; t++) {
+		for (smp = engine->wheel[t % SMP_WHEEL_SLOTS]; smp;
+		     smp = next) {
+			next = smp->tnext;
+			if (smp->deadline_ms > now)
+				continue;
+
+			timer_del(engine, smp);
+			if (smp->retry_wait) {
+				smp->retry_wait = 0;
+				queue_smp_head(engine, smp);
+				continue;
+			}
+
+			cl_qmap_remove_item(&engine->smps_on_wire,
+					    &smp->on_wire);
+			if ((rc = smp_timeout(engine, smp)) != 0)
+				return rc;
+		}
+	}
+	engine->wheel_tick = tick;
+
+	return process_smp_queue(engine);
+}
+
 static int process_one_recv(smp_engine_t * engine)
 {
 	int rc = 0;
@@ -169,9 +487,12 @@ static int process_one_recv(smp_engine_t * engine)
 
 	memset(umad, 0, sizeof(umad));
 
-	/* wait for the next message */
-	if ((rc = umad_recv(engine->umad_fd, umad, &length,
-			    -1)) < 0) {
+	/* wait for the next message or the next timer to expire */
+	rc = engine->tp->recv(engine->tp, engine->umad_fd, umad, &length,
+			      next_timer_ms(engine));
+	if (rc == -ETIMEDOUT || rc == -EAGAIN)
+		return expire_timers(engine);
+	if (rc < 0) {
 		IBND_ERROR("umad_recv failed: %d\n", rc);
 		return -1;
 	}
@@ -181,61 +502,66 @@ static int process_one_recv(smp_engine_t * engine)
 
 	smp = (ibnd_smp_t *) cl_qmap_remove(&engine->smps_on_wire, trid);
 	if ((cl_map_item_t *) smp == cl_qmap_end(&engine->smps_on_wire)) {
-		IBND_ERROR("Failed to find matching smp for trid (%x)\n", trid);
-		return -1;
+		IBND_DEBUG("Dropping response for expired trid (%x)\n", trid);
+		return expire_timers(engine);
+	}
+	timer_del(engine, smp);
+
+	if ((status = umad_status(umad)) == ETIMEDOUT) {
+		if ((rc = smp_timeout(engine, smp)) != 0)
+			return rc;
+		return expire_timers(engine);
 	}
 
+	smp_done(engine, smp, status);
+
 	rc = process_smp_queue(engine);
 	if (rc)
 		goto error;
 
-	if ((status = umad_status(umad))) {
+	if (status) {
 		IBND_ERROR("umad (%s Attr 0x%x:%u) bad status %d; %s\n",
 			   portid2str(&smp->path), smp->rpc.attr.id,
 			   smp->rpc.attr.mod, status, strerror(status));
-		if (smp->rpc.attr.id == IB_ATTR_MLNX_EXT_PORT_INFO)
-			rc = mlnx_ext_port_info_err(engine, smp, mad,
-						    smp->cb_data);
+		rc = smp_error(engine, smp, mad);
 	} else if ((status = mad_get_field(mad, 0, IB_DRSMP_STATUS_F))) {
 		IBND_ERROR("mad (%s Attr 0x%x:%u) bad status 0x%x\n",
 			   portid2str(&smp->path), smp->rpc.attr.id,
 			   smp->rpc.attr.mod, status);
-		if (smp->rpc.attr.id == IB_ATTR_MLNX_EXT_PORT_INFO)
-			rc = mlnx_ext_port_info_err(engine, smp, mad,
-						    smp->cb_data);
+		rc = smp_error(engine, smp, mad);
 	} else
 		rc = smp->cb(engine, smp, mad, smp->cb_data);
 
 error:
-	free(smp);
-	return rc;
+	pool_put(&engine->smp_pool, smp);
+	if (rc)
+		return rc;
+	return expire_timers(engine);
 }
 
 int smp_engine_init(smp_engine_t * engine, char * ca_name, int ca_port,
 		    void *user_data, ibnd_config_t *cfg)
 {
 	memset(engine, 0, sizeof(*engine));
+	arena_init(&engine->smp_arena);
+	pool_init(&engine->smp_pool, &engine->smp_arena, sizeof(ibnd_smp_t));
 
-	if (umad_init() < 0) {
-		IBND_ERROR("umad_init failed\n");
-		return -EIO;
-	}
-
-	engine->umad_fd = umad_open_port(ca_name, ca_port);
+	engine->tp = mad_get_transport();
+	engine->umad_fd = engine->tp->open_port(engine->tp, ca_name, ca_port);
 	if (engine->umad_fd < 0) {
 		IBND_ERROR("can't open UMAD port (%s:%d)\n", ca_name, ca_port);
 		return -EIO;
 	}
 
-	if ((engine->smi_agent = umad_register(engine->umad_fd,
-	     IB_SMI_CLASS, 1, 0, 0)) < 0) {
+	if ((engine->smi_agent = engine->tp->register_agent(engine->tp,
+	     engine->umad_fd, IB_SMI_CLASS, 1, 0, 0)) < 0) {
 		IBND_ERROR("Failed to register SMI agent on (%s:%d)\n",
 			   ca_name, ca_port);
 		goto eio_close;
 	}
 
-	if ((engine->smi_dir_agent = umad_register(engine->umad_fd,
-	     IB_SMI_DIRECT_CLASS, 1, 0, 0)) < 0) {
+	if ((engine->smi_dir_agent = engine->tp->register_agent(engine->tp,
+	     engine->umad_fd, IB_SMI_DIRECT_CLASS, 1, 0, 0)) < 0) {
 		IBND_ERROR("Failed to register SMI_DIRECT agent on (%s:%d)\n",
 			   ca_name, ca_port);
 		goto eio_close;
@@ -244,42 +570,64 @@ int smp_engine_init(smp_engine_t * engine, char * ca_name, int ca_port,
 	engine->user_data = user_data;
 	cl_qmap_init(&engine->smps_on_wire);
 	engine->cfg = cfg;
+	engine->wheel_tick = get_time_ms() / SMP_WHEEL_TICK_MS;
+	engine->rand_seed = (unsigned) get_time_us() ^ (unsigned) getpid();
+	engine->window = DEFAULT_ADAPTIVE_START_SMPS;
+	if (engine->window > cfg->max_smps)
+		engine->window = cfg->max_smps;
 	return (0);
 
 eio_close:
-	umad_close_port(engine->umad_fd);
+	engine->tp->close_port(engine->tp, engine->umad_fd);
 	return (-EIO);
 }
 
+static void dump_hop_stats(smp_engine_t * engine)
+{
+	smp_hop_stats_t *hs;
+	int i;
+
+	IBND_DEBUG("adaptive SMP window: final %u max %u per switch %u\n",
+		   engine->window, engine->cfg->max_smps,
+		   engine->cfg->max_smps_per_switch);
+	for (i = 0; i <= MAXHOPS; i++) {
+		hs = &engine->hop_stats[i];
+		if (!hs->sent)
+			continue;
+		IBND_DEBUG("   hops %2d: sent %u completed %u timeouts %u"
+			   " srtt %" PRIu64 "us min %" PRIu64 "us\n", i,
+			   hs->sent, hs->completed, hs->timeouts,
+			   hs->srtt_us, hs->min_rtt_us);
+	}
+}
+
 void smp_engine_destroy(smp_engine_t * engine)
 {
-	cl_map_item_t *item;
-	ibnd_smp_t *smp;
+	IBND_DEBUG("SMPs sent %u; retried %u\n", engine->total_smps,
+		   engine->total_retries);
+	if (is_adaptive(engine))
+		dump_hop_stats(engine);
 
-	/* remove queued smps */
-	smp = get_smp(engine);
-	if (smp)
+	if (engine->smp_queue_head)
 		IBND_ERROR("outstanding SMP's\n");
-	for ( /* */ ; smp; smp = get_smp(engine))
-		free(smp);
-
-	/* remove smps from the wire queue */
-	item = cl_qmap_head(&engine->smps_on_wire);
-	if (item != cl_qmap_end(&engine->smps_on_wire))
+	if (!cl_is_qmap_empty(&engine->smps_on_wire))
 		IBND_ERROR("outstanding SMP's on wire\n");
-	for ( /* */ ; item != cl_qmap_end(&engine->smps_on_wire);
-	     item = cl_qmap_head(&engine->smps_on_wire)) {
-		cl_qmap_remove_item(&engine->smps_on_wire, item);
-		free(item);
-	}
+	cl_qmap_remove_all(&engine->smps_on_wire);
 
-	umad_close_port(engine->umad_fd);
+	/* queued, retry waiting and on wire smps all belong to the pool */
+	arena_release(&engine->smp_arena);
+
+	engine->tp->close_port(engine->tp, engine->umad_fd);
 }
 
 int process_mads(smp_engine_t * engine)
 {
 	int rc;
-	while (!cl_is_qmap_empty(&engine->smps_on_wire))
+
+	/* start sending what a fill callback has to offer */
+	if ((rc = process_smp_queue(engine)) != 0)
+		return rc;
+	while (!cl_is_qmap_empty(&engine->smps_on_wire) || engine->timers)
 		if ((rc = process_one_recv(engine)) != 0)
 			return rc;
 	return 0;
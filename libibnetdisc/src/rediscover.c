@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/** =========================================================================
+ * Change set of a rediscovery: what differs between the fabric found and
+ * the previous one it was rediscovered from.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <infiniband/mad.h>
+
+#include "internal.h"
+
+struct change_list {
+	f_internal_t *f_int;
+	ibnd_change_t **tail;
+};
+
+static int add_change(struct change_list *cl, ibnd_change_type_t type,
+		      ibnd_port_t * port, ibnd_node_t * node)
+{
+	ibnd_change_t *c = arena_zalloc(&cl->f_int->arena, sizeof(*c));
+
+	if (!c)
+		return -ENOMEM;
+	c->type = type;
+	if (port) {
+		c->guid = port->node->guid;
+		c->portnum = port->portnum;
+		if (port->remoteport) {
+			c->remote_guid = port->remoteport->node->guid;
+			c->remote_portnum = port->remoteport->portnum;
+		}
+	} else
+		c->guid = node->guid;
+
+	*cl->tail = c;
+	cl->tail = &c->next;
+	return 0;
+}
+
+static ibnd_port_t *same_port(ibnd_fabric_t * fabric, ibnd_port_t * port)
+{
+	ibnd_node_t *node = ibnd_find_node_guid(fabric, port->node->guid);
+
+	if (!node || port->portnum > node->numports)
+		return NULL;
+	return node->ports[port->portnum];
+}
+
+/* port has a link which other has too (compared by guid and port number) */
+static int link_in(ibnd_fabric_t * other, ibnd_port_t * port)
+{
+	ibnd_port_t *oport = same_port(other, port);
+	ibnd_port_t *r = port->remoteport;
+
+	return oport && oport->remoteport &&
+	    oport->remoteport->node->guid == r->node->guid &&
+	    oport->remoteport->portnum == r->portnum;
+}
+
+/* report each link once, from its lower end */
+static int lower_end(ibnd_port_t * port)
+{
+	ibnd_port_t *r = port->remoteport;
+
+	return port->node->guid < r->node->guid ||
+	    (port->node->guid == r->node->guid && port->portnum < r->portnum);
+}
+
+/* links in fabric but not in other */
+static int diff_links(struct change_list *cl, ibnd_fabric_t * fabric,
+		      ibnd_fabric_t * other, ibnd_change_type_t type)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *port;
+	int p;
+
+	for (node = fabric->nodes; node; node = node->next)
+		for (p = 0; p <= node->numports; p++) {
+			port = node->ports[p];
+			if (!port || !port->remoteport || !lower_end(port) ||
+			    link_in(other, port))
+				continue;
+			if (add_change(cl, type, port, NULL))
+				return -ENOMEM;
+		}
+	return 0;
+}
+
+static int diff_ports(struct change_list *cl, ibnd_node_t * node,
+		      ibnd_fabric_t * prev)
+{
+	ibnd_port_t *port, *pport;
+	int p;
+
+	for (p = 0; p <= node->numports; p++) {
+		port = node->ports[p];
+		if (!port || !(pport = same_port(prev, port)))
+			continue;
+		if ((mad_get_field(port->info, 0, IB_PORT_STATE_F) !=
+		     mad_get_field(pport->info, 0, IB_PORT_STATE_F) ||
+		     mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F) !=
+		     mad_get_field(pport->info, 0, IB_PORT_PHYS_STATE_F)) &&
+		    add_change(cl, IBND_CHANGE_PORT_STATE, port, NULL))
+			return -ENOMEM;
+		if ((port->base_lid != pport->base_lid ||
+		     port->lmc != pport->lmc) &&
+		    add_change(cl, IBND_CHANGE_PORT_LID, port, NULL))
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+int build_change_set(f_internal_t * f_int, ibnd_fabric_t * prev,
+		     ibnd_change_t ** changes)
+{
+	ibnd_fabric_t *fabric = &f_int->fabric;
+	struct change_list cl = { f_int, changes };
+	ibnd_node_t *node;
+
+	*changes = NULL;
+
+	for (node = prev->nodes; node; node = node->next)
+		if (!ibnd_find_node_guid(fabric, node->guid) &&
+		    add_change(&cl, IBND_CHANGE_NODE_REMOVED, NULL, node))
+			return -ENOMEM;
+	for (node = fabric->nodes; node; node = node->next)
+		if (!ibnd_find_node_guid(prev, node->guid) &&
+		    add_change(&cl, IBND_CHANGE_NODE_ADDED, NULL, node))
+			return -ENOMEM;
+
+	if (diff_links(&cl, prev, fabric, IBND_CHANGE_LINK_REMOVED) ||
+	    diff_links(&cl, fabric, prev, IBND_CHANGE_LINK_ADDED))
+		return -ENOMEM;
+
+	for (node = fabric->nodes; node; node = node->next)
+		if (diff_ports(&cl, node, prev))
+			return -ENOMEM;
+	return 0;
+}
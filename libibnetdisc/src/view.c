@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/** =========================================================================
+ * Fabric view: the fields most tools look at, decoded once into arrays.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <infiniband/mad.h>
+
+#include "internal.h"
+
+/* every array starts on its own cache line */
+#define VIEW_ALIGN 64
+
+typedef struct v_internal {
+	ibnd_fabric_view_t view;
+	guid_tbl_t nodes;	/* node index + 1 by node guid */
+	void *mem;
+} v_internal_t;
+
+/* lay the arrays out in mem, or only size them if mem is NULL */
+static size_t carve(ibnd_fabric_view_t * v, uint8_t * mem)
+{
+	size_t off = 0;
+
+#define CARVE(field, n) do { \
+	if (mem) \
+		v->field = (void *)(mem + off); \
+	off += ALIGN((n) * sizeof(*v->field), VIEW_ALIGN); \
+} while (0)
+
+	CARVE(node, v->num_nodes);
+	CARVE(node_guid, v->num_nodes);
+	CARVE(node_type, v->num_nodes);
+	CARVE(node_numports, v->num_nodes);
+	CARVE(node_ports, v->num_nodes);
+	CARVE(port, v->num_ports);
+	CARVE(port_node, v->num_ports);
+	CARVE(port_guid, v->num_ports);
+	CARVE(lid, v->num_ports);
+	CARVE(lmc, v->num_ports);
+	CARVE(state, v->num_ports);
+	CARVE(phys_state, v->num_ports);
+	CARVE(width, v->num_ports);
+	CARVE(speed, v->num_ports);
+	CARVE(speed_ext, v->num_ports);
+	CARVE(fdr10, v->num_ports);
+	CARVE(remote, v->num_ports);
+#undef CARVE
+
+	return off;
+}
+
+static void decode_port(ibnd_fabric_view_t * v, uint32_t i,
+			ibnd_port_t * port)
+{
+	ibnd_node_t *node = port->node;
+	uint8_t *info = NULL;
+	uint32_t cap_mask;
+
+	v->port[i] = port;
+	v->port_guid[i] = port->guid;
+	v->lid[i] = port->base_lid;
+	v->lmc[i] = port->lmc;
+	v->state[i] = mad_get_field(port->info, 0, IB_PORT_STATE_F);
+	v->phys_state[i] = mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F);
+
+	if (v->state[i] == IB_LINK_DOWN)
+		return;
+
+	/* the capability mask of switch ports is in port 0 */
+	if (node->type != IB_NODE_SWITCH)
+		info = port->info;
+	else if (node->ports[0])
+		info = node->ports[0]->info;
+	if (!info)
+		return;
+
+	v->width[i] = mad_get_field(port->info, 0, IB_PORT_LINK_WIDTH_ACTIVE_F);
+	v->speed[i] = mad_get_field(port->info, 0, IB_PORT_LINK_SPEED_ACTIVE_F);
+	cap_mask = mad_get_field(info, 0, IB_PORT_CAPMASK_F);
+	if (cap_mask & CL_NTOH32(IB_PORT_CAP_HAS_EXT_SPEEDS))
+		v->speed_ext[i] = mad_get_field(port->info, 0,
+					IB_PORT_LINK_SPEED_EXT_ACTIVE_F);
+	v->fdr10[i] = !!(mad_get_field(port->ext_info, 0,
+				IB_MLNX_EXT_PORT_LINK_SPEED_ACTIVE_F) & FDR10);
+}
+
+ibnd_fabric_view_t *ibnd_build_view(ibnd_fabric_t * fabric)
+{
+	v_internal_t *v_int;
+	ibnd_fabric_view_t *v;
+	ibnd_node_t *node;
+	uint32_t n, i, size;
+	int p;
+
+	if (!fabric) {
+		IBND_DEBUG("fabric parameter NULL\n");
+		return NULL;
+	}
+
+	if (!(v_int = calloc(1, sizeof(*v_int)))) {
+		IBND_ERROR("OOM: failed to allocate fabric view\n");
+		return NULL;
+	}
+	v = &v_int->view;
+	v->fabric = fabric;
+	guid_tbl_init(&v_int->nodes);
+
+	for (node = fabric->nodes; node; node = node->next) {
+		v->num_nodes++;
+		v->num_ports += node->numports + 1;
+	}
+
+	/* twice the nodes, rounded up to a power of 2 */
+	for (size = 16; size < 2 * v->num_nodes; size <<= 1)
+		;
+	if (!(v_int->mem = calloc(1, carve(v, NULL) + VIEW_ALIGN)) ||
+	    guid_tbl_presize(&v_int->nodes, size)) {
+		IBND_ERROR("OOM: failed to allocate fabric view\n");
+		goto error;
+	}
+	carve(v, (uint8_t *)ALIGN((uintptr_t)v_int->mem, VIEW_ALIGN));
+
+	for (n = 0, i = 0, node = fabric->nodes; node; node = node->next, n++) {
+		v->node[n] = node;
+		v->node_guid[n] = node->guid;
+		v->node_type[n] = node->type;
+		v->node_numports[n] = node->numports;
+		v->node_ports[n] = i;
+		if (guid_tbl_insert(&v_int->nodes, node->guid,
+				    (void *)(uintptr_t)(n + 1), NULL)) {
+			IBND_ERROR("OOM: failed to index fabric view\n");
+			goto error;
+		}
+		for (p = 0; p <= node->numports; p++, i++) {
+			v->port_node[i] = n;
+			v->remote[i] = -1;
+			if (node->ports[p])
+				decode_port(v, i, node->ports[p]);
+		}
+	}
+
+	/* a second pass, now that every node has an index */
+	for (i = 0; i < v->num_ports; i++) {
+		ibnd_port_t *rem;
+		int r;
+
+		if (!v->port[i] || !(rem = v->port[i]->remoteport))
+			continue;
+		if ((r = ibnd_view_find_node(v, rem->node->guid)) >= 0 &&
+		    rem->portnum <= v->node_numports[r])
+			v->remote[i] = v->node_ports[r] + rem->portnum;
+	}
+
+	return v;
+
+error:
+	ibnd_destroy_view(v);
+	return NULL;
+}
+
+void ibnd_destroy_view(ibnd_fabric_view_t * view)
+{
+	v_internal_t *v_int = (v_internal_t *)view;
+
+	if (!view)
+		return;
+
+	guid_tbl_destroy(&v_int->nodes);
+	free(v_int->mem);
+	free(v_int);
+}
+
+int ibnd_view_find_node(ibnd_fabric_view_t * view, uint64_t guid)
+{
+	uintptr_t idx;
+
+	if (!view) {
+		IBND_DEBUG("view parameter NULL\n");
+		return -1;
+	}
+
+	idx = (uintptr_t)guid_tbl_find(&((v_internal_t *)view)->nodes, guid);
+	return (int)idx - 1;
+}
@@ -45,25 +45,27 @@
 #include <getopt.h>
 #include <netinet/in.h>
 #include <assert.h>
+#include <errno.h>
 
 #include <infiniband/umad.h>
 #include <infiniband/mad.h>
 #include <complib/cl_nodenamemap.h>
+#include <complib/cl_qmap.h>
 
 #include <infiniband/ibnetdisc.h>
 
 #include "ibdiag_common.h"
+#include "ibdiag_sa.h"
 
 struct ibmad_port *srcport;
 
 unsigned startlid = 0, endlid = 0;
 
-static int brief, dump_all, multicast;
+static int brief, dump_all, multicast, via_sa;
 
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
-
-#define IB_MLIDS_IN_BLOCK	(IB_SMP_DATA_SIZE/2)
+static struct ibdiag_out out;
 
 int dump_mlid(char *str, int strlen, unsigned mlid, unsigned nports,
 	      uint16_t mft[16][IB_MLIDS_IN_BLOCK])
@@ -110,23 +112,31 @@ int dump_mlid(char *str, int strlen, unsigned mlid, unsigned nports,
 
 uint16_t mft[16][IB_MLIDS_IN_BLOCK] = { { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0 }, { 0}, { 0 }, { 0 } };
 
-void dump_multicast_tables(ibnd_node_t * node, unsigned startlid,
-			    unsigned endlid, struct ibmad_port * mad_port)
+/* A switch whose table is being read.  The blocks (and for multicast the
+ * port mask chunks of each block) are read by ft_run(), stored in tbl in
+ * order and printed once all of them have completed.
+ */
+struct ft_switch {
+	struct ft_switch *next;
+	ibnd_node_t *node;
+	const char *mapnd;
+	unsigned startlid, endlid;
+	unsigned cap, top;
+	unsigned startblock, nblocks, chunks;
+	unsigned nreads, issued, completed, in_flight;
+	uint8_t *tbl;		/* nreads * IB_SMP_DATA_SIZE */
+};
+
+static uint8_t *ft_block(struct ft_switch *sw, unsigned idx)
 {
-	ib_portid_t *portid = &node->path_portid;
-	char nd[IB_SMP_DATA_SIZE] = { 0 };
-	char str[512];
-	char *s;
-	uint64_t nodeguid;
-	uint32_t mod;
-	unsigned block, i, j, e, nports, cap, chunks, startblock, lastblock,
-	    top;
-	char *mapnd = NULL;
-	int n = 0;
+	return sw->tbl + idx * IB_SMP_DATA_SIZE;
+}
 
-	memcpy(nd, node->nodedesc, strlen(node->nodedesc));
-	nports = node->numports;
-	nodeguid = node->guid;
+void setup_multicast_table(struct ft_switch *sw, unsigned startlid,
+			   unsigned endlid)
+{
+	ibnd_node_t *node = sw->node;
+	unsigned cap, top, lastblock;
 
 	mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_CAP_F, &cap);
 	mad_decode_field(node->switchinfo, IB_SW_MCAST_FDB_TOP_F, &top);
@@ -154,14 +164,36 @@ void dump_multicast_tables(ibnd_node_t * node, unsigned startlid,
 		endlid = IB_MAX_MCAST_LID;
 	}
 
-	mapnd = remap_node_name(node_name_map, nodeguid, nd);
+	sw->startlid = startlid;
+	sw->endlid = endlid;
+	sw->cap = cap;
+	sw->top = top;
+	sw->chunks = ALIGN(node->numports + 1, 16) / 16;
+	sw->startblock = startlid / IB_MLIDS_IN_BLOCK;
+	lastblock = endlid / IB_MLIDS_IN_BLOCK;
+	sw->nblocks = lastblock >= sw->startblock ?
+	    lastblock - sw->startblock + 1 : 0;
+	sw->nreads = sw->nblocks * sw->chunks;
+}
+
+void dump_multicast_tables(struct ft_switch *sw)
+{
+	ibnd_node_t *node = sw->node;
+	ib_portid_t *portid = &node->path_portid;
+	char str[512];
+	char *s;
+	unsigned block, i, j, e, nports;
+	int n = 0;
+
+	nports = node->numports;
 
-	printf("Multicast mlids [0x%x-0x%x] of switch %s guid 0x%016" PRIx64
-	       " (%s):\n", startlid, endlid, portid2str(portid), nodeguid,
-	       mapnd);
+	ibdiag_out_printf(&out, "Multicast mlids [0x%x-0x%x] of switch %s guid "
+			  "0x%016" PRIx64 " (%s):\n", sw->startlid,
+			  sw->endlid, portid2str(portid), node->guid,
+			  sw->mapnd);
 
 	if (brief)
-		printf(" MLid       Port Mask\n");
+		ibdiag_out_printf(&out, " MLid       Port Mask\n");
 	else {
 		if (nports > 9) {
 			for (i = 0, s = str; i <= nports; i++) {
@@ -169,60 +201,41 @@ void dump_multicast_tables(ibnd_node_t * node, unsigned startlid,
 				*s++ = ' ';
 			}
 			*s = 0;
-			printf("            %s\n", str);
+			ibdiag_out_printf(&out, "            %s\n", str);
 		}
 		for (i = 0, s = str; i <= nports; i++)
 			s += sprintf(s, "%d ", i % 10);
-		printf("     Ports: %s\n", str);
-		printf(" MLid\n");
+		ibdiag_out_printf(&out, "     Ports: %s\n", str);
+		ibdiag_out_printf(&out, " MLid\n");
 	}
 	if (ibverbose)
-		printf("Switch multicast mlid capability is %d top is 0x%x\n",
-		       cap, top);
-
-	chunks = ALIGN(nports + 1, 16) / 16;
+		ibdiag_out_printf(&out, "Switch multicast mlid capability is "
+				  "%d top is 0x%x\n", sw->cap, sw->top);
 
-	startblock = startlid / IB_MLIDS_IN_BLOCK;
-	lastblock = endlid / IB_MLIDS_IN_BLOCK;
-	for (block = startblock; block <= lastblock; block++) {
-		for (j = 0; j < chunks; j++) {
-			int status;
-			mod = (block - IB_MIN_MCAST_LID / IB_MLIDS_IN_BLOCK)
-			    | (j << 28);
-
-			DEBUG("reading block %x chunk %d mod %x", block, j,
-			      mod);
-			if (!smp_query_status_via
-			    (mft + j, portid, IB_ATTR_MULTICASTFORWTBL, mod, 0,
-			     &status, mad_port)) {
-				fprintf(stderr, "SubnGet(MFT) failed on switch "
-						"'%s' %s Node GUID 0x%"PRIx64
-						" SMA LID %d; MAD status 0x%x "
-						"AM 0x%x\n",
-						mapnd, portid2str(portid),
-						node->guid, node->smalid,
-						status, mod);
-			}
-		}
+	for (block = sw->startblock; block < sw->startblock + sw->nblocks;
+	     block++) {
+		for (j = 0; j < sw->chunks; j++)
+			memcpy(mft[j], ft_block(sw, (block - sw->startblock) *
+						sw->chunks + j),
+			       IB_SMP_DATA_SIZE);
 
 		i = block * IB_MLIDS_IN_BLOCK;
 		e = i + IB_MLIDS_IN_BLOCK;
-		if (i < startlid)
-			i = startlid;
-		if (e > endlid + 1)
-			e = endlid + 1;
+		if (i < sw->startlid)
+			i = sw->startlid;
+		if (e > sw->endlid + 1)
+			e = sw->endlid + 1;
 
 		for (; i < e; i++) {
 			if (dump_mlid(str, sizeof str, i, nports, mft) == 0)
 				continue;
-			printf("0x%04x      %s\n", i, str);
+			ibdiag_out_printf(&out, "0x%04x      %s\n", i, str);
 			n++;
 		}
 	}
 
-	printf("%d %smlids dumped \n", n, dump_all ? "" : "valid ");
-
-	free(mapnd);
+	ibdiag_out_printf(&out, "%d %smlids dumped \n", n,
+			  dump_all ? "" : "valid ");
 }
 
 int dump_lid(char *str, int str_len, int lid, int valid,
@@ -237,8 +250,7 @@ int dump_lid(char *str, int str_len, int lid, int valid,
 	char ntype[50], sguid[30];
 	uint64_t nodeguid;
 	int baselid, lmc, type;
-	char *mapnd = NULL;
-	int rc;
+	const char *mapnd;
 
 	if (brief) {
 		str[0] = 0;
@@ -289,38 +301,21 @@ int dump_lid(char *str, int str_len, int lid, int valid,
 		*last_port_lid = baselid + (1 << lmc) - 1;
 	}
 
-	mapnd = remap_node_name(node_name_map, nodeguid, nd);
- 
-	rc = snprintf(str, str_len, ": (%s portguid %s: '%s')",
-		      mad_dump_val(IB_NODE_TYPE_F, ntype, sizeof ntype,
-				   &type), mad_dump_val(IB_NODE_PORT_GUID_F,
-							sguid, sizeof sguid,
-							portguid),
-		      mapnd);
+	mapnd = ibdiag_remap_node_name(node_name_map, nodeguid, nd);
 
-	free(mapnd);
-	return rc;
+	return snprintf(str, str_len, ": (%s portguid %s: '%s')",
+			mad_dump_val(IB_NODE_TYPE_F, ntype, sizeof ntype,
+				     &type),
+			mad_dump_val(IB_NODE_PORT_GUID_F, sguid, sizeof sguid,
+				     portguid),
+			mapnd);
 }
 
-void dump_unicast_tables(ibnd_node_t * node, int startlid, int endlid,
-			struct ibmad_port *mad_port, ibnd_fabric_t *fabric)
+void setup_unicast_table(struct ft_switch *sw, int startlid, int endlid)
 {
-	ib_portid_t * portid = &node->path_portid;
-	char lft[IB_SMP_DATA_SIZE] = { 0 };
-	char nd[IB_SMP_DATA_SIZE] = { 0 };
-	char str[200];
-	uint64_t nodeguid;
-	int block, i, e, top;
-	unsigned nports;
-	int n = 0, startblock, endblock;
-	char *mapnd = NULL;
-	int last_port_lid = 0, base_port_lid = 0;
-	uint64_t portguid = 0;
+	int top, endblock;
 
-	mad_decode_field(node->switchinfo, IB_SW_LINEAR_FDB_TOP_F, &top);
-	nodeguid = node->guid;
-	nports = node->numports;
-	memcpy(nd, node->nodedesc, strlen(node->nodedesc));
+	mad_decode_field(sw->node->switchinfo, IB_SW_LINEAR_FDB_TOP_F, &top);
 
 	if (!endlid || endlid > top)
 		endlid = top;
@@ -331,30 +326,44 @@ void dump_unicast_tables(ibnd_node_t * node, int startlid, int endlid,
 		endlid = IB_MAX_UCAST_LID;
 	}
 
-	mapnd = remap_node_name(node_name_map, nodeguid, nd);
+	sw->startlid = startlid;
+	sw->endlid = endlid;
+	sw->top = top;
+	sw->chunks = 1;
+	sw->startblock = startlid / IB_SMP_DATA_SIZE;
+	endblock = ALIGN(endlid, IB_SMP_DATA_SIZE) / IB_SMP_DATA_SIZE;
+	sw->nblocks = endblock > (int)sw->startblock ?
+	    endblock - sw->startblock : 0;
+	sw->nreads = sw->nblocks;
+}
+
+void dump_unicast_tables(struct ft_switch *sw, ibnd_fabric_t *fabric)
+{
+	ibnd_node_t *node = sw->node;
+	ib_portid_t * portid = &node->path_portid;
+	uint8_t *lft;
+	char str[200], port[3];
+	int block, i, e;
+	unsigned nports;
+	int n = 0, startlid, endlid;
+	int last_port_lid = 0, base_port_lid = 0;
+	uint64_t portguid = 0;
 
-	printf("Unicast lids [0x%x-0x%x] of switch %s guid 0x%016" PRIx64
-	       " (%s):\n", startlid, endlid, portid2str(portid), nodeguid,
-	       mapnd);
+	nports = node->numports;
+	startlid = sw->startlid;
+	endlid = sw->endlid;
 
-	DEBUG("Switch top is 0x%x\n", top);
+	ibdiag_out_printf(&out, "Unicast lids [0x%x-0x%x] of switch %s guid "
+			  "0x%016" PRIx64 " (%s):\n", startlid, endlid,
+			  portid2str(portid), node->guid, sw->mapnd);
 
-	printf("  Lid  Out   Destination\n");
-	printf("       Port     Info \n");
-	startblock = startlid / IB_SMP_DATA_SIZE;
-	endblock = ALIGN(endlid, IB_SMP_DATA_SIZE) / IB_SMP_DATA_SIZE;
-	for (block = startblock; block < endblock; block++) {
-		int status;
-		DEBUG("reading block %d", block);
-		if (!smp_query_status_via(lft, portid, IB_ATTR_LINEARFORWTBL, block,
-				   0, &status, mad_port)) {
-			fprintf(stderr, "SubnGet(LFT) failed on switch "
-					"'%s' %s Node GUID 0x%"PRIx64
-					" SMA LID %d; MAD status 0x%x AM 0x%x\n",
-					mapnd, portid2str(portid),
-					node->guid, node->smalid,
-					status, block);
-		}
+	DEBUG("Switch top is 0x%x\n", sw->top);
+
+	ibdiag_out_printf(&out, "  Lid  Out   Destination\n");
+	ibdiag_out_printf(&out, "       Port     Info \n");
+	for (block = sw->startblock; block < (int)(sw->startblock + sw->nblocks);
+	     block++) {
+		lft = ft_block(sw, block - sw->startblock);
 		i = block * IB_SMP_DATA_SIZE;
 		e = i + IB_SMP_DATA_SIZE;
 		if (i < startlid)
@@ -370,32 +379,445 @@ void dump_unicast_tables(ibnd_node_t * node, int startlid, int endlid,
 				continue;
 			dump_lid(str, sizeof str, i, valid, fabric,
 				&last_port_lid, &base_port_lid, &portguid);
-			printf("0x%04x %03u %s\n", i, outport & 0xff, str);
+			outport &= 0xff;
+			port[0] = '0' + outport / 100;
+			port[1] = '0' + outport / 10 % 10;
+			port[2] = '0' + outport % 10;
+
+			/* "0x%04x %03u %s\n" */
+			ibdiag_out_str(&out, "0x");
+			ibdiag_out_hex(&out, i, 4);
+			ibdiag_out_char(&out, ' ');
+			ibdiag_out_mem(&out, port, sizeof(port));
+			ibdiag_out_char(&out, ' ');
+			ibdiag_out_str(&out, str);
+			ibdiag_out_char(&out, '\n');
 			n++;
 		}
 	}
 
-	printf("%d %slids dumped \n", n, dump_all ? "" : "valid ");
-	free(mapnd);
+	ibdiag_out_printf(&out, "%d %slids dumped \n", n,
+			  dump_all ? "" : "valid ");
+}
+
+/* Table reads.
+ *
+ * The blocks of all switches are read asynchronously: up to ft_window
+ * SMPs are kept on the wire, at most FT_READS_PER_SWITCH of them to any
+ * one switch, whose SMA answers them one at a time anyway.  Switches are
+ * started in discovery order as earlier ones run out of blocks to read,
+ * and their tables are printed in that same order, so the output does
+ * not depend on the window.  As in libibnetdisc, umad completes every
+ * send and reads which timed out are sent again up to "retries" times.
+ */
+#define DEFAULT_FT_WINDOW 128
+#define FT_READS_PER_SWITCH 4
+
+static unsigned ft_window = DEFAULT_FT_WINDOW;
+
+struct ft_read {
+	cl_map_item_t on_wire;	/* keep first */
+	struct ft_read *qnext;
+	struct ft_switch *sw;
+	unsigned idx;
+	unsigned attempts;
+};
+
+struct ft_engine {
+	struct ibmad_port *port;
+	struct ibmad_transport *tp;
+	int fd;
+	unsigned window;
+	unsigned timeout_ms;
+	unsigned retries;
+	cl_qmap_t on_wire;
+	struct ft_read *retry;	/* timed out, to be sent again first */
+	struct ft_switch *pending;	/* not started, in discovery order */
+	struct ft_switch *pending_tail;
+	struct ft_switch *active;	/* started, not yet printed */
+	struct ft_switch *active_tail;
+	unsigned nactive;
+	ibnd_fabric_t *fabric;
+};
+
+static void add_switch(ibnd_node_t * node, void *user_data)
+{
+	struct ft_engine *engine = user_data;
+	struct ft_switch *sw = calloc(1, sizeof(*sw));
+
+	if (!sw)
+		IBEXIT("out of memory");
+	sw->node = node;
+	if (engine->pending_tail)
+		engine->pending_tail->next = sw;
+	else
+		engine->pending = sw;
+	engine->pending_tail = sw;
 }
 
-void dump_node(ibnd_node_t *node, struct ibmad_port *mad_port,
-		ibnd_fabric_t *fabric)
+static void start_switch(struct ft_engine *engine)
 {
+	struct ft_switch *sw = engine->pending;
+	char nd[IB_SMP_DATA_SIZE + 1] = { 0 };
+
+	engine->pending = sw->next;
+	if (!engine->pending)
+		engine->pending_tail = NULL;
+	sw->next = NULL;
+
+	memcpy(nd, sw->node->nodedesc, strlen(sw->node->nodedesc));
+	sw->mapnd = ibdiag_remap_node_name(node_name_map, sw->node->guid, nd);
+
 	if (multicast)
-		dump_multicast_tables(node, startlid, endlid, mad_port);
+		setup_multicast_table(sw, startlid, endlid);
+	else
+		setup_unicast_table(sw, startlid, endlid);
+
+	/* blocks which cannot be read are dumped as zero, as before */
+	if (sw->nreads &&
+	    !(sw->tbl = calloc(sw->nreads, IB_SMP_DATA_SIZE)))
+		IBEXIT("out of memory");
+
+	if (engine->active_tail)
+		engine->active_tail->next = sw;
+	else
+		engine->active = sw;
+	engine->active_tail = sw;
+	engine->nactive++;
+}
+
+static void drop_switch(struct ft_engine *engine)
+{
+	struct ft_switch *sw = engine->active;
+
+	engine->active = sw->next;
+	if (!engine->active)
+		engine->active_tail = NULL;
+	engine->nactive--;
+
+	free(sw->tbl);
+	free(sw);
+}
+
+static void finish_switch(struct ft_engine *engine)
+{
+	struct ft_switch *sw = engine->active;
+
+	if (multicast)
+		dump_multicast_tables(sw);
+	else
+		dump_unicast_tables(sw, engine->fabric);
+
+	drop_switch(engine);
+}
+
+static unsigned read_attr_mod(struct ft_switch *sw, unsigned idx)
+{
+	unsigned block = sw->startblock + idx / sw->chunks;
+
+	if (!multicast)
+		return block;
+	return (block - IB_MIN_MCAST_LID / IB_MLIDS_IN_BLOCK) |
+	    ((idx % sw->chunks) << 28);
+}
+
+static void complete_read(struct ft_read *r, uint8_t * data, int status)
+{
+	struct ft_switch *sw = r->sw;
+	ibnd_node_t *node = sw->node;
+
+	if (data)
+		memcpy(ft_block(sw, r->idx), data, IB_SMP_DATA_SIZE);
+	else
+		fprintf(stderr, "SubnGet(%s) failed on switch '%s' %s"
+			" Node GUID 0x%" PRIx64 " SMA LID %d; MAD status 0x%x"
+			" AM 0x%x\n", multicast ? "MFT" : "LFT", sw->mapnd,
+			portid2str(&node->path_portid), node->guid,
+			node->smalid, status, read_attr_mod(sw, r->idx));
+
+	sw->in_flight--;
+	sw->completed++;
+	free(r);
+}
+
+/* Next block of the oldest switch which can take another read, starting
+ * a new switch if none can. */
+static struct ft_read *next_read(struct ft_engine *engine)
+{
+	struct ft_switch *sw;
+	struct ft_read *r;
+
+	if ((r = engine->retry)) {
+		engine->retry = r->qnext;
+		return r;
+	}
+
+	for (;;) {
+		for (sw = engine->active; sw; sw = sw->next)
+			if (sw->issued < sw->nreads &&
+			    sw->in_flight < FT_READS_PER_SWITCH)
+				break;
+		if (sw)
+			break;
+		if (!engine->pending || engine->nactive >= engine->window)
+			return NULL;
+		start_switch(engine);
+	}
+
+	if (!(r = calloc(1, sizeof(*r))))
+		IBEXIT("out of memory");
+	r->sw = sw;
+	r->idx = sw->issued++;
+	sw->in_flight++;
+	return r;
+}
+
+static int send_read(struct ft_engine *engine, struct ft_read *r)
+{
+	uint8_t umad[1024];
+	ib_portid_t *portid = &r->sw->node->path_portid;
+	ib_rpc_t rpc = { 0 };
+
+	memset(umad, 0, umad_size() + IB_MAD_SIZE);
+
+	rpc.method = IB_MAD_METHOD_GET;
+	rpc.attr.id = multicast ? IB_ATTR_MULTICASTFORWTBL :
+	    IB_ATTR_LINEARFORWTBL;
+	rpc.attr.mod = read_attr_mod(r->sw, r->idx);
+	rpc.timeout = engine->timeout_ms;
+	rpc.datasz = IB_SMP_DATA_SIZE;
+	rpc.dataoffs = IB_SMP_DATA_OFFS;
+	rpc.mkey = smp_mkey_get(engine->port);
+	rpc.trid = mad_trid();
+
+	/* see smp_query_status_via() */
+	if ((portid->lid <= 0) ||
+	    (portid->drpath.drslid == 0xffff) ||
+	    (portid->drpath.drdlid == 0xffff))
+		rpc.mgtclass = IB_SMI_DIRECT_CLASS;
 	else
-		dump_unicast_tables(node, startlid, endlid,
-						mad_port, fabric);
+		rpc.mgtclass = IB_SMI_CLASS;
+	portid->sl = 0;
+	portid->qp = 0;
+
+	DEBUG("reading block idx %u mod %x route %s", r->idx, rpc.attr.mod,
+	      portid2str(portid));
+
+	if (mad_build_pkt(umad, &rpc, portid, NULL, NULL) < 0) {
+		IBWARN("mad_build_pkt failed; dport (%s)", portid2str(portid));
+		return -EIO;
+	}
+
+	if (engine->tp->send(engine->tp, engine->fd,
+			     mad_rpc_class_agent(engine->port, rpc.mgtclass),
+			     umad, IB_MAD_SIZE, engine->timeout_ms, 0) < 0) {
+		IBWARN("send failed; %s", strerror(errno));
+		return -EIO;
+	}
+
+	cl_qmap_insert(&engine->on_wire, (uint32_t) rpc.trid, &r->on_wire);
+	r->attempts++;
+	return 0;
 }
 
-void process_switch(ibnd_node_t * node, void *fabric)
+static void process_reads(struct ft_engine *engine)
 {
-	dump_node(node, srcport, (ibnd_fabric_t *)fabric);
+	struct ft_read *r;
+
+	for (;;) {
+		/* printing a switch makes room for the next one */
+		while (engine->active &&
+		       engine->active->completed == engine->active->nreads)
+			finish_switch(engine);
+
+		if (cl_qmap_count(&engine->on_wire) >= engine->window ||
+		    !(r = next_read(engine)))
+			break;
+		if (send_read(engine, r))
+			complete_read(r, NULL, 0);
+	}
+}
+
+static void fail_reads(struct ft_engine *engine)
+{
+	struct ft_read *r;
+
+	while (!cl_is_qmap_empty(&engine->on_wire)) {
+		r = (struct ft_read *)cl_qmap_head(&engine->on_wire);
+		cl_qmap_remove_item(&engine->on_wire, &r->on_wire);
+		complete_read(r, NULL, 0);
+	}
+	while ((r = engine->retry)) {
+		engine->retry = r->qnext;
+		complete_read(r, NULL, 0);
+	}
+}
+
+static int ft_run(struct ft_engine *engine)
+{
+	uint8_t umad[sizeof(struct ib_user_mad) + IB_MAD_SIZE];
+	struct ft_read *r;
+	int length, status;
+	uint8_t *mad;
+	uint32_t trid;
+
+	for (;;) {
+		process_reads(engine);
+		if (cl_is_qmap_empty(&engine->on_wire))
+			break;
+
+		length = umad_size() + IB_MAD_SIZE;
+		if (engine->tp->recv(engine->tp, engine->fd, umad, &length,
+				     -1) < 0) {
+			IBWARN("umad_recv failed; %s", strerror(errno));
+			fail_reads(engine);
+			return -EIO;
+		}
+
+		mad = umad_get_mad(umad);
+		trid = (uint32_t) mad_get_field64(mad, 0, IB_MAD_TRID_F);
+		r = (struct ft_read *)cl_qmap_remove(&engine->on_wire, trid);
+		if (&r->on_wire == cl_qmap_end(&engine->on_wire)) {
+			DEBUG("dropping response for trid 0x%x", trid);
+			continue;
+		}
+
+		if ((status = umad_status(umad)) == ETIMEDOUT &&
+		    r->attempts <= engine->retries) {
+			DEBUG("timeout reading %s AM 0x%x; retrying",
+			      portid2str(&r->sw->node->path_portid),
+			      read_attr_mod(r->sw, r->idx));
+			r->qnext = engine->retry;
+			engine->retry = r;
+			continue;
+		}
+		if (status) {
+			complete_read(r, NULL, 0);
+			continue;
+		}
+
+		status = mad_get_field(mad, 0, IB_DRSMP_STATUS_F);
+		if (status)
+			complete_read(r, NULL, status);
+		else
+			complete_read(r, mad + IB_SMP_DATA_OFFS, 0);
+	}
+
+	return 0;
+}
+
+static int dump_switches(ibnd_fabric_t * fabric, struct ibmad_port *port)
+{
+	struct ft_engine engine;
+	int rc;
+
+	memset(&engine, 0, sizeof(engine));
+	cl_qmap_init(&engine.on_wire);
+	engine.port = port;
+	engine.tp = mad_rpc_transport(port);
+	engine.fd = mad_rpc_portid(port);
+	engine.window = ft_window ? ft_window : 1;
+	engine.timeout_ms = ibd_timeout ? ibd_timeout : MAD_DEF_TIMEOUT_MS;
+	engine.retries = MAD_DEF_RETRIES;
+	engine.fabric = fabric;
+
+	ibnd_iter_nodes_type(fabric, add_switch, IB_NODE_SWITCH, &engine);
+
+	rc = ft_run(&engine);
+
+	/* print what could be read if the receive failed */
+	while (engine.active) {
+		engine.active->completed = engine.active->nreads;
+		finish_switch(&engine);
+	}
+	while (engine.pending) {
+		struct ft_switch *sw = engine.pending;
+		engine.pending = sw->next;
+		free(sw);
+	}
+	return rc;
+}
+
+/* Tables from the SA.
+ *
+ * With --via-sa the tables are the SM's copy of them: every LFTRecord (or
+ * MFTRecord) of the subnet is fetched in one GetTable, copied into the
+ * switches found by discovery and printed as if read from the switches.
+ * All the tables are held at once, and blocks which the SA has no record
+ * of are dumped as zero.
+ */
+static void store_record(struct ft_switch **by_lid, void *rec)
+{
+	ib_lft_record_t *lftr = rec;	/* the MFTRecord starts the same */
+	struct ft_switch *sw;
+	void *data;
+	int idx;
+
+	if (!(sw = by_lid[cl_ntoh16(lftr->lid)]))
+		return;
+
+	idx = sa_ft_record_index(rec, multicast, sw->startblock, sw->nblocks,
+				 sw->chunks, &data);
+	if (idx >= 0)
+		memcpy(ft_block(sw, idx), data, IB_SMP_DATA_SIZE);
+}
+
+static int dump_switches_via_sa(ibnd_fabric_t * fabric)
+{
+	struct ft_engine engine;
+	struct ft_switch **by_lid;
+	struct sa_handle *h;
+	struct sa_cursor c;
+	void *rec;
+	int rc = -1;
+
+	memset(&engine, 0, sizeof(engine));
+	engine.fabric = fabric;
+
+	if (!(by_lid = calloc(IB_MAX_UCAST_LID + 1, sizeof(*by_lid))))
+		IBEXIT("out of memory");
+
+	ibnd_iter_nodes_type(fabric, add_switch, IB_NODE_SWITCH, &engine);
+	while (engine.pending) {
+		start_switch(&engine);
+		if (engine.active_tail->node->smalid <= IB_MAX_UCAST_LID)
+			by_lid[engine.active_tail->node->smalid] =
+			    engine.active_tail;
+	}
+
+	if (!(h = sa_get_handle()))
+		goto out;
+
+	if ((rc = sa_query_cursor(h, IB_MAD_METHOD_GET_TABLE,
+				  multicast ? IB_SA_ATTR_MFTRECORD :
+				  IB_SA_ATTR_LFTRECORD, 0, 0, ibd_sakey,
+				  NULL, 0, &c))) {
+		fprintf(stderr, "Query SA failed: %s\n", strerror(rc));
+		rc = -1;
+	} else if (c.status != IB_SA_MAD_STATUS_SUCCESS) {
+		sa_report_err(c.status);
+		rc = -1;
+	} else
+		while ((rec = sa_cursor_next(&c)))
+			store_record(by_lid, rec);
+
+	sa_free_handle(h);
+
+out:
+	/* tables the SA did not give us would only print as zeros */
+	while (engine.active)
+		if (rc)
+			drop_switch(&engine);
+		else
+			finish_switch(&engine);
+	free(by_lid);
+	return rc;
 }
 
 static int process_opt(void *context, int ch, char *optarg)
 {
+	struct ibnd_config *cfg = context;
+
 	switch (ch) {
 	case 'a':
 		dump_all++;
@@ -406,9 +828,18 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 'n':
 		brief++;
 		break;
+	case 'o':
+		cfg->max_smps = strtoul(optarg, NULL, 0);
+		break;
 	case 1:
 		node_name_map_file = strdup(optarg);
 		break;
+	case 2:
+		ft_window = strtoul(optarg, NULL, 0);
+		break;
+	case 3:
+		via_sa = 1;
+		break;
 	default:
 		return -1;
 	}
@@ -430,6 +861,14 @@ int main(int argc, char **argv)
 		 "do not try to resolve destinations"},
 		{"Multicast", 'M', 0, NULL, "show multicast forwarding tables"},
 		{"node-name-map", 1, 1, "<file>", "node name map file"},
+		{"outstanding_smps", 'o', 1, NULL,
+		 "specify the number of outstanding SMP's which should be "
+		 "issued during the scan"},
+		{"outstanding_fts", 2, 1, NULL,
+		 "specify the number of forwarding table blocks which should "
+		 "be read in parallel"},
+		{"via-sa", 3, 0, NULL,
+		 "read the tables from the SA instead of the switches"},
 		{0}
 	};
 	char usage_args[] = "[<dest dr_path|lid|guid> [<startlid> [<endlid>]]]";
@@ -458,6 +897,7 @@ int main(int argc, char **argv)
 		endlid = strtoul(argv[1], 0, 0);
 
 	node_name_map = open_node_name_map(node_name_map_file);
+	ibdiag_out_init(&out, stdout);
 
 	if (ibd_timeout)
 		config.timeout_ms = ibd_timeout;
@@ -481,7 +921,11 @@ int main(int argc, char **argv)
 			mad_rpc_set_timeout(srcport, ibd_timeout);
 		}
 
-		ibnd_iter_nodes_type(fabric, process_switch, IB_NODE_SWITCH, fabric);
+		if (via_sa) {
+			if (dump_switches_via_sa(fabric))
+				rc = -1;
+		} else if (dump_switches(fabric, srcport))
+			rc = -1;
 
 		mad_rpc_close_port(srcport);
 
@@ -492,6 +936,9 @@ int main(int argc, char **argv)
 Exit:
 	ibnd_destroy_fabric(fabric);
 
+	if (ibdiag_out_close(&out))
+		IBEXIT("writing the forwarding tables failed\n");
+	ibdiag_free_node_names();
 	close_node_name_map(node_name_map);
 	exit(rc);
 }
@@ -249,6 +249,25 @@ static void replace_portguid(ibnd_node_t *node, void *user_data)
 	}
 }
 
+/* Write the new cache in the format of the original, so that a version 2
+ * cache keeps its forwarding tables and a version 1 one stays readable by
+ * older releases.  The version is the second little endian word. */
+static unsigned orig_cache_flags(const char *file)
+{
+	static const uint8_t v2[4] = { 2, 0, 0, 0 };
+	unsigned flags = IBND_CACHE_FABRIC_FLAG_DEFAULT;
+	uint8_t hdr[8];
+	FILE *f;
+
+	if (!(f = fopen(file, "r")))
+		return flags;
+	if (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+	    !memcmp(hdr + 4, v2, sizeof(v2)))
+		flags = IBND_CACHE_FABRIC_FLAG_V2;
+	fclose(f);
+	return flags;
+}
+
 int main(int argc, char **argv)
 {
 	ibnd_fabric_t *fabric = NULL;
@@ -348,7 +367,8 @@ int main(int argc, char **argv)
 				portguid_before);
 	}
 
-	if (ibnd_cache_fabric(fabric, new_cache_file, 0) < 0)
+	if (ibnd_cache_fabric(fabric, new_cache_file,
+			      orig_cache_flags(orig_cache_file)) < 0)
 		IBEXIT("caching new cache data failed");
 
 	ibnd_destroy_fabric(fabric);
@@ -45,6 +45,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -53,11 +54,15 @@
 #include <getopt.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <assert.h>
 #include <stdarg.h>
 
 #include <infiniband/umad.h>
 #include <infiniband/mad.h>
 #include <ibdiag_common.h>
+#include <ibdiag_sim.h>
+#include <ibdiag_rcache.h>
+#include <ibdiag_daemon.h>
 #include <ibdiag_version.h>
 
 int ibverbose;
@@ -75,6 +80,16 @@ uint64_t ibd_mkey;
 uint64_t ibd_sakey = 0;
 int show_keys = 0;
 char *ibd_nd_format = NULL;
+int ibd_format_supported = 0;
+enum ibdiag_format ibd_format = IBDIAG_FORMAT_TEXT;
+char *ibd_resolve_cache = NULL;
+int ibd_daemon_supported = 0;
+char *ibd_daemon = NULL;
+
+/* --format, --resolve_cache and --daemon have no short option */
+#define OPT_FORMAT 0x7f
+#define OPT_RESOLVE_CACHE 0x1f
+#define OPT_DAEMON 0x1e
 
 static const char *prog_name;
 static const char *prog_args;
@@ -159,6 +174,18 @@ void read_ibdiag_config(const char *file)
 			} else {
 				ibd_ibnetdisc_flags &= ~IBND_CONFIG_MLX_EPI;
 			}
+		} else if (strncmp(name, "adaptive_smps",
+				   strlen("adaptive_smps")) == 0) {
+			if (val_str_true(val_str))
+				ibd_ibnetdisc_flags |= IBND_CONFIG_ADAPTIVE_SMPS;
+			else
+				ibd_ibnetdisc_flags &= ~IBND_CONFIG_ADAPTIVE_SMPS;
+		} else if (strncmp(name, "multi_port",
+				   strlen("multi_port")) == 0) {
+			if (val_str_true(val_str))
+				ibd_ibnetdisc_flags |= IBND_CONFIG_MULTI_PORT;
+			else
+				ibd_ibnetdisc_flags &= ~IBND_CONFIG_MULTI_PORT;
 		} else if (strncmp(name, "m_key", strlen("m_key")) == 0) {
 			ibd_mkey = strtoull(val_str, 0, 0);
 		} else if (strncmp(name, "sa_key",
@@ -167,6 +194,13 @@ void read_ibdiag_config(const char *file)
 		} else if (strncmp(name, "nd_format",
 				   strlen("nd_format")) == 0) {
 			ibd_nd_format = strdup(val_str);
+		} else if (strncmp(name, "resolve_cache",
+				   strlen("resolve_cache")) == 0) {
+			free(ibd_resolve_cache);
+			ibd_resolve_cache = strdup(val_str);
+		} else if (strncmp(name, "daemon", strlen("daemon")) == 0) {
+			free(ibd_daemon);
+			ibd_daemon = strdup(val_str);
 		}
 	}
 
@@ -287,6 +321,27 @@ static int process_opt(int ch, char *optarg)
 			}
                 }
                 break;
+	case OPT_FORMAT:
+		if (!strcmp(optarg, "text"))
+			ibd_format = IBDIAG_FORMAT_TEXT;
+		else if (!strcmp(optarg, "ndjson"))
+			ibd_format = IBDIAG_FORMAT_NDJSON;
+		else if (!strcmp(optarg, "csv"))
+			ibd_format = IBDIAG_FORMAT_CSV;
+		else if (!strcmp(optarg, "binary"))
+			ibd_format = IBDIAG_FORMAT_BINARY;
+		else
+			IBEXIT("Invalid format \"%s\"; use text, ndjson, csv "
+			       "or binary", optarg);
+		break;
+	case OPT_RESOLVE_CACHE:
+		free(ibd_resolve_cache);
+		ibd_resolve_cache = strdup(optarg);
+		break;
+	case OPT_DAEMON:
+		free(ibd_daemon);
+		ibd_daemon = strdup(optarg ? optarg : IBDIAGD_SOCKET);
+		break;
 	default:
 		return -1;
 	}
@@ -305,6 +360,12 @@ static const struct ibdiag_opt common_opts[] = {
 	{"sm_port", 's', 1, "<lid>", "SM port lid"},
 	{"show_keys", 'K', 0, NULL, "display security keys in output"},
 	{"m_key", 'y', 1, "<key>", "M_Key to use in request"},
+	{"format", OPT_FORMAT, 1, "<fmt>",
+	 "output format: text (default), ndjson, csv or binary"},
+	{"resolve_cache", OPT_RESOLVE_CACHE, 1, "<file>",
+	 "cache GUID/GID to LID resolutions in <file>"},
+	{"daemon", OPT_DAEMON, 2, "[=<socket>]",
+	 "take the fabric from ibdiagd, default socket " IBDIAGD_SOCKET},
 	{"errors", 'e', 0, NULL, "show send and receive errors"},
 	{"verbose", 'v', 0, NULL, "increase verbosity level"},
 	{"debug", 'd', 0, NULL, "raise debug level"},
@@ -350,6 +411,10 @@ static struct option *make_long_opts(const char *exclude_str,
 	for (o = common_opts; o->name; o++) {
 		if (exclude_str && strchr(exclude_str, o->letter))
 			continue;
+		if (o->letter == OPT_FORMAT && !ibd_format_supported)
+			continue;
+		if (o->letter == OPT_DAEMON && !ibd_daemon_supported)
+			continue;
 		make_opt(l++, o, map);
 	}
 
@@ -410,6 +475,8 @@ int ibdiag_process_opts(int argc, char *const argv[], void *cxt,
 			ibdiag_show_usage();
 	}
 
+	ibdiag_sim_setup();
+
 	return 0;
 }
 
@@ -564,20 +631,21 @@ int is_mlnx_ext_port_info_supported(uint32_t vendorid,
  */
 int resolve_sm_portid(char *ca_name, uint8_t portnum, ib_portid_t *sm_id)
 {
+	struct ibmad_transport *tp = mad_get_transport();
 	umad_port_t port;
 	int rc;
 
 	if (!sm_id)
 		return (-1);
 
-	if ((rc = umad_get_port(ca_name, portnum, &port)) < 0)
+	if ((rc = tp->get_port(tp, ca_name, portnum, &port)) < 0)
 		return rc;
 
 	memset(sm_id, 0, sizeof(*sm_id));
 	sm_id->lid = port.sm_lid;
 	sm_id->sl = port.sm_sl;
 
-	umad_release_port(&port);
+	tp->release_port(tp, &port);
 
 	return 0;
 }
@@ -589,6 +657,7 @@ int resolve_sm_portid(char *ca_name, uint8_t portnum, ib_portid_t *sm_id)
 int resolve_self(char *ca_name, uint8_t ca_port, ib_portid_t *portid,
 		 int *portnum, ibmad_gid_t *gid)
 {
+	struct ibmad_transport *tp = mad_get_transport();
 	umad_port_t port;
 	uint64_t prefix, guid;
 	int rc;
@@ -596,7 +665,7 @@ int resolve_self(char *ca_name, uint8_t ca_port, ib_portid_t *portid,
 	if (!(portid || portnum || gid))
 		return (-1);
 
-	if ((rc = umad_get_port(ca_name, ca_port, &port)) < 0)
+	if ((rc = tp->get_port(tp, ca_name, ca_port, &port)) < 0)
 		return rc;
 
 	if (portid) {
@@ -614,7 +683,7 @@ int resolve_self(char *ca_name, uint8_t ca_port, ib_portid_t *portid,
 		mad_encode_field(*gid, IB_GID_GUID_F, &guid);
 	}
 
-	umad_release_port(&port);
+	tp->release_port(tp, &port);
 
 	return 0;
 }
@@ -626,6 +695,10 @@ int resolve_gid(char *ca_name, uint8_t ca_port, ib_portid_t * portid,
 	ib_portid_t sm_portid;
 	char buf[IB_SA_DATA_SIZE] = { 0 };
 
+	if (ibd_resolve_cache &&
+	    !rcache_lookup(ibd_resolve_cache, ca_name, ca_port, gid, portid, 0))
+		return 0;
+
 	if (!sm_id) {
 		sm_id = &sm_portid;
 		if (resolve_sm_portid(ca_name, ca_port, sm_id) < 0)
@@ -636,6 +709,9 @@ int resolve_gid(char *ca_name, uint8_t ca_port, ib_portid_t * portid,
 	     ib_path_query_via(srcport, gid, gid, sm_id, buf)) < 0)
 		return -1;
 
+	/* the path queried is not from this port, so neither is its SL */
+	if (ibd_resolve_cache)
+		rcache_store(gid, portid, 0);
 	return 0;
 }
 
@@ -648,6 +724,18 @@ int resolve_guid(char *ca_name, uint8_t ca_port, ib_portid_t *portid,
 	uint64_t prefix;
 	ibmad_gid_t selfgid;
 
+	memcpy(&prefix, portid->gid, sizeof(prefix));
+	if (!prefix)
+		mad_set_field64(portid->gid, 0, IB_GID_PREFIX_F,
+				IB_DEFAULT_SUBN_PREFIX);
+	if (guid)
+		mad_set_field64(portid->gid, 0, IB_GID_GUID_F, *guid);
+
+	if (ibd_resolve_cache &&
+	    !rcache_lookup(ibd_resolve_cache, ca_name, ca_port, portid->gid,
+			   portid, 1))
+		return 0;
+
 	if (!sm_id) {
 		sm_id = &sm_portid;
 		if (resolve_sm_portid(ca_name, ca_port, sm_id) < 0)
@@ -657,18 +745,13 @@ int resolve_guid(char *ca_name, uint8_t ca_port, ib_portid_t *portid,
 	if (resolve_self(ca_name, ca_port, NULL, NULL, &selfgid) < 0)
 		return -1;
 
-	memcpy(&prefix, portid->gid, sizeof(prefix));
-	if (!prefix)
-		mad_set_field64(portid->gid, 0, IB_GID_PREFIX_F,
-				IB_DEFAULT_SUBN_PREFIX);
-	if (guid)
-		mad_set_field64(portid->gid, 0, IB_GID_GUID_F, *guid);
-
 	if ((portid->lid =
 	     ib_path_query_via(srcport, selfgid, portid->gid, sm_id, buf)) < 0)
 		return -1;
 
 	mad_decode_field(buf, IB_SA_PR_SL_F, &portid->sl);
+	if (ibd_resolve_cache)
+		rcache_store(portid->gid, portid, 1);
 	return 0;
 }
 
@@ -909,6 +992,95 @@ void dump_portinfo(void *pi, int tabs)
 	}
 }
 
+void ibdiag_print_changes(FILE * f, ibnd_change_t * c)
+{
+	for (; c; c = c->next)
+		switch (c->type) {
+		case IBND_CHANGE_NODE_ADDED:
+			fprintf(f, "node 0x%016" PRIx64 " added\n", c->guid);
+			break;
+		case IBND_CHANGE_NODE_REMOVED:
+			fprintf(f, "node 0x%016" PRIx64 " removed\n", c->guid);
+			break;
+		case IBND_CHANGE_LINK_ADDED:
+		case IBND_CHANGE_LINK_REMOVED:
+			fprintf(f, "link 0x%016" PRIx64 "[%d] - 0x%016" PRIx64
+				"[%d] %s\n", c->guid, c->portnum,
+				c->remote_guid, c->remote_portnum,
+				c->type == IBND_CHANGE_LINK_ADDED ?
+				"added" : "removed");
+			break;
+		case IBND_CHANGE_PORT_STATE:
+			fprintf(f, "port 0x%016" PRIx64 "[%d] state changed\n",
+				c->guid, c->portnum);
+			break;
+		case IBND_CHANGE_PORT_LID:
+			fprintf(f, "port 0x%016" PRIx64 "[%d] LID changed\n",
+				c->guid, c->portnum);
+			break;
+		}
+}
+
+/* The daemon may sweep another subnet than the one ca_name/ca_port are on;
+ * only take its fabric if the local port is in it. */
+static ibnd_fabric_t *daemon_fabric(char *ca_name, int ca_port)
+{
+	ibnd_fabric_t *fabric;
+	ibmad_gid_t gid;
+	uint64_t guid = 0;
+
+	if (resolve_self(ca_name, ca_port, NULL, NULL, &gid) < 0)
+		return NULL;
+	mad_decode_field(gid, IB_GID_GUID_F, &guid);
+
+	if (!(fabric = ibdiagd_fetch_fabric(ibd_daemon, NULL)))
+		return NULL;
+	if (!ibnd_find_port_guid(fabric, guid)) {
+		IBWARN("port 0x%016" PRIx64 " is not in the fabric of %s",
+		       guid, ibd_daemon);
+		ibnd_destroy_fabric(fabric);
+		return NULL;
+	}
+	return fabric;
+}
+
+/* Scan the whole fabric; with a hint_file, rediscover it against the
+ * fabric cached there so that only what changed is scanned in full, and
+ * with -v list what changed.
+ * With --daemon the fabric ibdiagd keeps is used instead, unless the scan
+ * is limited to fewer hops than the daemon's. */
+ibnd_fabric_t *ibdiag_discover_fabric(char *ca_name, int ca_port,
+				      struct ibnd_config *cfg,
+				      const char *hint_file)
+{
+	ibnd_fabric_t *prev, *fabric;
+	ibnd_change_t *changes = NULL;
+
+	if (ibd_daemon && ibd_daemon_supported && !(cfg && cfg->max_hops)) {
+		if ((fabric = daemon_fabric(ca_name, ca_port)))
+			return fabric;
+		IBWARN("no fabric from ibdiagd; scanning the fabric");
+	}
+
+	if (!hint_file)
+		return ibnd_discover_fabric(ca_name, ca_port, NULL, cfg);
+
+	if (!(prev = ibnd_load_fabric(hint_file, 0))) {
+		IBWARN("loading cached fabric %s failed; doing a full scan",
+		       hint_file);
+		return ibnd_discover_fabric(ca_name, ca_port, NULL, cfg);
+	}
+	fabric = ibnd_rediscover_fabric(prev, ca_name, ca_port, NULL, cfg,
+					&changes);
+	ibnd_destroy_fabric(prev);
+	/* on stderr, so as not to mix with the report */
+	if (fabric && ibverbose) {
+		fprintf(stderr, "changes since %s:\n", hint_file);
+		ibdiag_print_changes(stderr, changes);
+	}
+	return fabric;
+}
+
 op_fn_t *match_op(const match_rec_t match_tbl[], char *name)
 {
 	const match_rec_t *r;
@@ -918,3 +1090,448 @@ op_fn_t *match_op(const match_rec_t match_tbl[], char *name)
 			return r->fn;
 	return NULL;
 }
+
+void ibdiag_out_init(struct ibdiag_out *o, FILE * f)
+{
+	o->f = f;
+	o->len = 0;
+	o->err = 0;
+	/* without a buffer everything goes straight to the stream */
+	o->buf = malloc(IBDIAG_OUT_BUFSZ);
+	o->size = o->buf ? IBDIAG_OUT_BUFSZ : 0;
+}
+
+static void out_drain(struct ibdiag_out *o)
+{
+	if (o->len && fwrite(o->buf, 1, o->len, o->f) != o->len)
+		o->err = 1;
+	o->len = 0;
+}
+
+int ibdiag_out_flush(struct ibdiag_out *o)
+{
+	out_drain(o);
+	if (fflush(o->f))
+		o->err = 1;
+	return o->err ? -1 : 0;
+}
+
+int ibdiag_out_close(struct ibdiag_out *o)
+{
+	int rc = ibdiag_out_flush(o);
+
+	free(o->buf);
+	o->buf = NULL;
+	o->size = 0;
+	return rc;
+}
+
+void ibdiag_out_mem(struct ibdiag_out *o, const char *s, size_t n)
+{
+	if (n > o->size - o->len) {
+		out_drain(o);
+		if (n >= o->size) {
+			if (fwrite(s, 1, n, o->f) != n)
+				o->err = 1;
+			return;
+		}
+	}
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+}
+
+static void out_spaces(struct ibdiag_out *o, int n)
+{
+	static const char spaces[] = "                                ";
+
+	while (n > 0) {
+		int k = n < (int)sizeof(spaces) - 1 ? n : (int)sizeof(spaces) - 1;
+
+		ibdiag_out_mem(o, spaces, k);
+		n -= k;
+	}
+}
+
+void ibdiag_out_pad(struct ibdiag_out *o, const char *s, int width)
+{
+	size_t len = strlen(s);
+
+	if ((int)len < width)
+		out_spaces(o, width - len);
+	ibdiag_out_mem(o, s, len);
+}
+
+static void out_num(struct ibdiag_out *o, uint64_t val, int neg, int width)
+{
+	char tmp[21], *p = tmp + sizeof(tmp);
+
+	do {
+		*--p = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	if (neg)
+		*--p = '-';
+	out_spaces(o, width - (tmp + sizeof(tmp) - p));
+	ibdiag_out_mem(o, p, tmp + sizeof(tmp) - p);
+}
+
+void ibdiag_out_uint(struct ibdiag_out *o, uint64_t val, int width)
+{
+	out_num(o, val, 0, width);
+}
+
+void ibdiag_out_int(struct ibdiag_out *o, int64_t val, int width)
+{
+	if (val < 0)
+		out_num(o, -(uint64_t) val, 1, width);
+	else
+		out_num(o, val, 0, width);
+}
+
+/* lower case hex, zero padded to width digits */
+void ibdiag_out_hex(struct ibdiag_out *o, uint64_t val, int width)
+{
+	static const char digits[] = "0123456789abcdef";
+	char tmp[16], *p = tmp + sizeof(tmp);
+
+	if (width > (int)sizeof(tmp))
+		width = sizeof(tmp);
+	do {
+		*--p = digits[val & 0xf];
+		val >>= 4;
+	} while (val);
+	while (p > tmp + sizeof(tmp) - width)
+		*--p = '0';
+	ibdiag_out_mem(o, p, tmp + sizeof(tmp) - p);
+}
+
+void ibdiag_out_printf(struct ibdiag_out *o, const char *fmt, ...)
+{
+	va_list args;
+	size_t room = o->size - o->len;
+	int n;
+
+	if (!o->size) {
+		va_start(args, fmt);
+		if (vfprintf(o->f, fmt, args) < 0)
+			o->err = 1;
+		va_end(args);
+		return;
+	}
+
+	va_start(args, fmt);
+	n = vsnprintf(o->buf + o->len, room, fmt, args);
+	va_end(args);
+	if (n < 0) {
+		o->err = 1;
+		return;
+	}
+	if ((size_t) n < room) {
+		o->len += n;
+		return;
+	}
+
+	out_drain(o);
+	va_start(args, fmt);
+	if ((size_t) n < o->size)
+		o->len = vsnprintf(o->buf, o->size, fmt, args);
+	else if (vfprintf(o->f, fmt, args) < 0)
+		o->err = 1;
+	va_end(args);
+}
+
+static void rec_put(struct ibdiag_rec *r, const void *p, size_t n)
+{
+	if (n > sizeof(r->buf) - r->len) {
+		r->out->err = 1;
+		return;
+	}
+	memcpy(r->buf + r->len, p, n);
+	r->len += n;
+}
+
+static void rec_put_le(struct ibdiag_rec *r, uint64_t val, int bytes)
+{
+	uint8_t b[8];
+	int i;
+
+	for (i = 0; i < bytes; i++, val >>= 8)
+		b[i] = val & 0xff;
+	rec_put(r, b, bytes);
+}
+
+static void rec_header(struct ibdiag_rec *r)
+{
+	const struct ibdiag_field *f;
+	uint8_t b[4];
+
+	r->header_done = 1;
+	if (r->format == IBDIAG_FORMAT_CSV) {
+		for (f = r->fields; f->name; f++) {
+			if (f != r->fields)
+				ibdiag_out_char(r->out, ',');
+			ibdiag_out_str(r->out, f->name);
+		}
+		ibdiag_out_char(r->out, '\n');
+	} else if (r->format == IBDIAG_FORMAT_BINARY) {
+		ibdiag_out_mem(r->out, "IBDR", 4);
+		b[0] = 1;
+		b[1] = 0;
+		b[2] = r->nfields & 0xff;
+		b[3] = r->nfields >> 8;
+		ibdiag_out_mem(r->out, (char *)b, 4);
+		for (f = r->fields; f->name; f++) {
+			b[0] = f->type;
+			b[1] = strlen(f->name);
+			ibdiag_out_mem(r->out, (char *)b, 2);
+			ibdiag_out_mem(r->out, f->name, b[1]);
+		}
+	}
+}
+
+void ibdiag_rec_init(struct ibdiag_rec *r, struct ibdiag_out *o,
+		     const struct ibdiag_field *fields)
+{
+	r->out = o;
+	r->format = ibd_format;
+	r->fields = fields;
+	for (r->nfields = 0; fields[r->nfields].name; r->nfields++)
+		;
+	r->field = 0;
+	r->header_done = 0;
+	r->len = 0;
+}
+
+void ibdiag_rec_begin(struct ibdiag_rec *r)
+{
+	if (!r->header_done)
+		rec_header(r);
+	r->field = 0;
+	r->len = 0;
+	if (r->format == IBDIAG_FORMAT_NDJSON)
+		ibdiag_out_char(r->out, '{');
+}
+
+/* the separator and, for ndjson, the name of the next field */
+static const struct ibdiag_field *rec_field(struct ibdiag_rec *r)
+{
+	const struct ibdiag_field *f = &r->fields[r->field++];
+
+	assert(r->field <= r->nfields);
+	if (r->format == IBDIAG_FORMAT_NDJSON) {
+		if (f != r->fields)
+			ibdiag_out_char(r->out, ',');
+		ibdiag_out_char(r->out, '"');
+		ibdiag_out_str(r->out, f->name);
+		ibdiag_out_str(r->out, "\":");
+	} else if (r->format == IBDIAG_FORMAT_CSV && f != r->fields)
+		ibdiag_out_char(r->out, ',');
+	return f;
+}
+
+void ibdiag_rec_uint(struct ibdiag_rec *r, uint64_t val)
+{
+	const struct ibdiag_field *f = rec_field(r);
+	int quote = r->format == IBDIAG_FORMAT_NDJSON;
+
+	if (r->format == IBDIAG_FORMAT_BINARY)
+		rec_put_le(r, val, 8);
+	else if (f->type == IBDIAG_FIELD_GUID) {
+		/* GUIDs do not fit a JSON number */
+		if (quote)
+			ibdiag_out_char(r->out, '"');
+		ibdiag_out_str(r->out, "0x");
+		ibdiag_out_hex(r->out, val, 16);
+		if (quote)
+			ibdiag_out_char(r->out, '"');
+	} else
+		ibdiag_out_uint(r->out, val, 0);
+}
+
+void ibdiag_rec_str(struct ibdiag_rec *r, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t n;
+
+	rec_field(r);
+	if (r->format == IBDIAG_FORMAT_BINARY) {
+		n = strlen(s);
+		if (n > 0xffff)
+			n = 0xffff;
+		rec_put_le(r, n, 2);
+		rec_put(r, s, n);
+		return;
+	}
+
+	ibdiag_out_char(r->out, '"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+
+		if (r->format == IBDIAG_FORMAT_CSV) {
+			if (c == '"')
+				ibdiag_out_char(r->out, '"');
+			ibdiag_out_char(r->out, c);
+		} else if (c == '"' || c == '\\') {
+			ibdiag_out_char(r->out, '\\');
+			ibdiag_out_char(r->out, c);
+		} else if (c < 0x20) {
+			ibdiag_out_str(r->out, "\\u00");
+			ibdiag_out_char(r->out, hex[c >> 4]);
+			ibdiag_out_char(r->out, hex[c & 0xf]);
+		} else
+			ibdiag_out_char(r->out, c);
+	}
+	ibdiag_out_char(r->out, '"');
+}
+
+void ibdiag_rec_end(struct ibdiag_rec *r)
+{
+	uint8_t b[4];
+
+	assert(r->field == r->nfields);
+	if (r->format == IBDIAG_FORMAT_BINARY) {
+		b[0] = r->len & 0xff;
+		b[1] = r->len >> 8 & 0xff;
+		b[2] = b[3] = 0;
+		ibdiag_out_mem(r->out, (char *)b, 4);
+		ibdiag_out_mem(r->out, (char *)r->buf, r->len);
+	} else if (r->format == IBDIAG_FORMAT_NDJSON)
+		ibdiag_out_str(r->out, "}\n");
+	else
+		ibdiag_out_char(r->out, '\n');
+}
+
+void ibdiag_rec_counters(struct ibdiag_rec *r,
+			 const struct ib_perfcounters_decoded *pc,
+			 const struct ib_perfcounters_ext_decoded *pce,
+			 int ext_errors)
+{
+	static const struct ib_perfcounters_decoded pc_none;
+	static const struct ib_perfcounters_ext_decoded pce_none;
+	const struct ib_perfcounters_ext_decoded *e = pce ? pce : &pce_none;
+
+	if (!pc)
+		pc = &pc_none;
+	if (ext_errors && pce) {
+		ibdiag_rec_uint(r, e->symbol_errors);
+		ibdiag_rec_uint(r, e->link_recovers);
+		ibdiag_rec_uint(r, e->link_downed);
+		ibdiag_rec_uint(r, e->rcv_errors);
+		ibdiag_rec_uint(r, e->rcv_remote_phys_errors);
+		ibdiag_rec_uint(r, e->rcv_switch_relay_errors);
+		ibdiag_rec_uint(r, e->xmt_discards);
+		ibdiag_rec_uint(r, e->xmt_constraint_errors);
+		ibdiag_rec_uint(r, e->rcv_constraint_errors);
+		ibdiag_rec_uint(r, e->link_integrity_errors);
+		ibdiag_rec_uint(r, e->excessive_buffer_overrun_errors);
+		ibdiag_rec_uint(r, e->vl15_dropped);
+		ibdiag_rec_uint(r, e->xmt_wait);
+		ibdiag_rec_uint(r, e->qp1_dropped);
+	} else {
+		ibdiag_rec_uint(r, pc->symbol_errors);
+		ibdiag_rec_uint(r, pc->link_recovers);
+		ibdiag_rec_uint(r, pc->link_downed);
+		ibdiag_rec_uint(r, pc->rcv_errors);
+		ibdiag_rec_uint(r, pc->rcv_remote_phys_errors);
+		ibdiag_rec_uint(r, pc->rcv_switch_relay_errors);
+		ibdiag_rec_uint(r, pc->xmt_discards);
+		ibdiag_rec_uint(r, pc->xmt_constraint_errors);
+		ibdiag_rec_uint(r, pc->rcv_constraint_errors);
+		ibdiag_rec_uint(r, pc->link_integrity_errors);
+		ibdiag_rec_uint(r, pc->excessive_buffer_overrun_errors);
+		ibdiag_rec_uint(r, pc->vl15_dropped);
+		ibdiag_rec_uint(r, pc->xmt_wait);
+		ibdiag_rec_uint(r, 0);
+	}
+
+	if (pce) {
+		ibdiag_rec_uint(r, e->xmt_data);
+		ibdiag_rec_uint(r, e->rcv_data);
+		ibdiag_rec_uint(r, e->xmt_pkts);
+		ibdiag_rec_uint(r, e->rcv_pkts);
+	} else {
+		ibdiag_rec_uint(r, pc->xmt_data);
+		ibdiag_rec_uint(r, pc->rcv_data);
+		ibdiag_rec_uint(r, pc->xmt_pkts);
+		ibdiag_rec_uint(r, pc->rcv_pkts);
+	}
+	ibdiag_rec_uint(r, e->xmt_upkts);
+	ibdiag_rec_uint(r, e->rcv_upkts);
+	ibdiag_rec_uint(r, e->xmt_mpkts);
+	ibdiag_rec_uint(r, e->rcv_mpkts);
+}
+
+/* remapped node names by GUID; the node description is kept as well as
+ * the same GUID may have another one in a second fabric (diffs) */
+struct node_name {
+	uint64_t guid;
+	char *nodedesc;
+	char *name;
+};
+
+static struct node_name *node_names;
+static size_t node_names_size, node_names_used;
+
+static size_t node_name_slot(struct node_name *tbl, size_t size,
+			     uint64_t guid)
+{
+	size_t i = (guid * 0x9e3779b97f4a7c15ULL) >> 32 & (size - 1);
+
+	while (tbl[i].name && tbl[i].guid != guid)
+		i = (i + 1) & (size - 1);
+	return i;
+}
+
+static void grow_node_names(void)
+{
+	size_t size = node_names_size ? node_names_size * 2 : 1024, i;
+	struct node_name *tbl = calloc(size, sizeof(*tbl));
+
+	if (!tbl)
+		IBEXIT("out of memory");
+	for (i = 0; i < node_names_size; i++)
+		if (node_names[i].name)
+			tbl[node_name_slot(tbl, size, node_names[i].guid)] =
+			    node_names[i];
+	free(node_names);
+	node_names = tbl;
+	node_names_size = size;
+}
+
+const char *ibdiag_remap_node_name(nn_map_t * map, uint64_t guid,
+				   const char *nodedesc)
+{
+	struct node_name *n;
+
+	if (2 * (node_names_used + 1) > node_names_size)
+		grow_node_names();
+
+	n = &node_names[node_name_slot(node_names, node_names_size, guid)];
+	if (n->name) {
+		if (!strcmp(n->nodedesc, nodedesc))
+			return n->name;
+		free(n->nodedesc);
+		free(n->name);
+	} else
+		node_names_used++;
+
+	n->guid = guid;
+	n->nodedesc = strdup(nodedesc);
+	n->name = remap_node_name(map, guid, (char *)nodedesc);
+	if (!n->nodedesc || !n->name)
+		IBEXIT("out of memory");
+	return n->name;
+}
+
+void ibdiag_free_node_names(void)
+{
+	size_t i;
+
+	for (i = 0; i < node_names_size; i++) {
+		free(node_names[i].nodedesc);
+		free(node_names[i].name);
+	}
+	free(node_names);
+	node_names = NULL;
+	node_names_size = node_names_used = 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <infiniband/mad.h>
+#include <infiniband/ibnetdisc.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_daemon.h"
+
+/* the daemon answers from memory, so anything slower is a stuck peer */
+#define IBDIAGD_CLIENT_TIMEOUT 10
+#define IBDIAGD_MAX_LENGTH (1U << 30)
+
+int ibdiagd_read_full(int fd, void *buf, size_t length)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (length) {
+		if ((n = read(fd, p, length)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -EIO;
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+int ibdiagd_write_full(int fd, const void *buf, size_t length)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (length) {
+		if ((n = write(fd, p, length)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -EIO;
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+static int daemon_connect(const char *path)
+{
+	struct timeval tv = { IBDIAGD_CLIENT_TIMEOUT, 0 };
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		IBWARN("socket path too long: %s", path);
+		return -1;
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		IBWARN("socket: %s", strerror(errno));
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		IBWARN("can't connect to %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	return fd;
+}
+
+ibnd_fabric_t *ibdiagd_fetch_fabric(const char *path,
+				    struct ibdiagd_reply *reply)
+{
+	struct ibdiagd_req req = { IBDIAGD_MAGIC, IBDIAGD_VERSION,
+		IBDIAGD_OP_FABRIC, 0
+	};
+	struct ibdiagd_reply rep;
+	ibnd_fabric_t *fabric = NULL;
+	void *buf = NULL;
+	int fd;
+
+	if ((fd = daemon_connect(path)) < 0)
+		return NULL;
+
+	if (ibdiagd_write_full(fd, &req, sizeof(req)) < 0 ||
+	    ibdiagd_read_full(fd, &rep, sizeof(rep)) < 0) {
+		IBWARN("no reply from %s", path);
+		goto out;
+	}
+	if (rep.magic != IBDIAGD_MAGIC || rep.status != IBDIAGD_OK ||
+	    rep.length > IBDIAGD_MAX_LENGTH) {
+		IBWARN("%s refused the request (status %u)", path, rep.status);
+		goto out;
+	}
+	if (!(buf = malloc(rep.length))) {
+		IBWARN("out of memory for a %u byte fabric", rep.length);
+		goto out;
+	}
+	if (ibdiagd_read_full(fd, buf, rep.length) < 0) {
+		IBWARN("short reply from %s", path);
+		goto out;
+	}
+	if (!(fabric = ibnd_load_fabric_buf(buf, rep.length, 0))) {
+		IBWARN("bad fabric from %s", path);
+		goto out;
+	}
+	DEBUG("fabric generation %" PRIu64 " from %s", rep.generation, path);
+	if (reply)
+		*reply = rep;
+out:
+	free(buf);
+	close(fd);
+	return fabric;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/umad.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_pma.h"
+
+#define PMA_MAX_REDIRECTS 4
+/* how far down the queue to look for a query to an idle LID */
+#define PMA_QUEUE_SCAN 64
+#define PMA_LID_COUNT (1 << 16)
+
+static void queue_query(struct pma_engine *engine, struct pma_query *q)
+{
+	q->qnext = NULL;
+	if (!engine->queue_head) {
+		engine->queue_head = q;
+		engine->queue_tail = q;
+	} else {
+		engine->queue_tail->qnext = q;
+		engine->queue_tail = q;
+	}
+}
+
+static void queue_query_head(struct pma_engine *engine, struct pma_query *q)
+{
+	q->qnext = engine->queue_head;
+	engine->queue_head = q;
+	if (!engine->queue_tail)
+		engine->queue_tail = q;
+}
+
+/* Oldest query whose destination has fewer than max_per_lid on the wire,
+ * so that one slow PMA does not hold up the whole window.
+ */
+static struct pma_query *get_next_query(struct pma_engine *engine)
+{
+	struct pma_query *prev = NULL;
+	struct pma_query *q;
+	unsigned n = 0;
+
+	for (q = engine->queue_head; q && n < PMA_QUEUE_SCAN;
+	     prev = q, q = q->qnext, n++) {
+		if (engine->lid_load[(uint16_t) q->portid.lid] >=
+		    engine->max_per_lid)
+			continue;
+		if (prev)
+			prev->qnext = q->qnext;
+		else
+			engine->queue_head = q->qnext;
+		if (engine->queue_tail == q)
+			engine->queue_tail = prev;
+		return q;
+	}
+	return NULL;
+}
+
+static void complete_query(struct pma_engine *engine, struct pma_query *q,
+			   uint8_t * data, int status)
+{
+	if (status)
+		engine->failures++;
+	q->cb(q, data, status);
+	free(q);
+}
+
+static int send_query(struct pma_engine *engine, struct pma_query *q)
+{
+	uint8_t umad[1024];
+
+	memset(umad, 0, umad_size() + IB_MAD_SIZE);
+
+	/* a new trid per send; responses to a redirected or failed
+	 * attempt are then simply dropped */
+	q->rpc.trid = mad_trid();
+	if (mad_build_pkt(umad, &q->rpc, &q->portid, NULL, q->payload) < 0) {
+		IBWARN("mad_build_pkt failed; dport (%s)",
+		       portid2str(&q->portid));
+		return -EIO;
+	}
+
+	/* retries are issued by the engine, see pma_engine_run() */
+	if (engine->tp->send(engine->tp, engine->fd, engine->agent, umad,
+			     IB_MAD_SIZE, engine->timeout_ms, 0) < 0) {
+		IBWARN("send failed; %s", strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void process_queue(struct pma_engine *engine)
+{
+	struct pma_query *q;
+
+	while (cl_qmap_count(&engine->on_wire) < engine->window) {
+		if (!(q = get_next_query(engine)))
+			return;
+
+		if (send_query(engine, q)) {
+			complete_query(engine, q, NULL, EIO);
+			continue;
+		}
+		cl_qmap_insert(&engine->on_wire, (uint32_t) q->rpc.trid,
+			       &q->on_wire);
+		engine->lid_load[(uint16_t) q->portid.lid]++;
+		engine->total++;
+		q->attempts++;
+	}
+}
+
+/* see redirect_port() in libibmad */
+static int redirect_query(struct pma_query *q, uint8_t * mad)
+{
+	ib_portid_t *portid = &q->portid;
+
+	if (++q->redirects > PMA_MAX_REDIRECTS)
+		return -1;
+
+	portid->lid = mad_get_field(mad, 64, IB_CPI_REDIRECT_LID_F);
+	if (!portid->lid) {
+		IBWARN("GID-based redirection is not supported");
+		return -1;
+	}
+
+	portid->qp = mad_get_field(mad, 64, IB_CPI_REDIRECT_QP_F);
+	portid->qkey = mad_get_field(mad, 64, IB_CPI_REDIRECT_QKEY_F);
+	portid->sl = (uint8_t) mad_get_field(mad, 64, IB_CPI_REDIRECT_SL_F);
+
+	DEBUG("redirected to lid %d, qp 0x%x, qkey 0x%x, sl 0x%x",
+	      portid->lid, portid->qp, portid->qkey, portid->sl);
+	return 0;
+}
+
+static void fail_all(struct pma_engine *engine)
+{
+	struct pma_query *q;
+
+	while (!cl_is_qmap_empty(&engine->on_wire)) {
+		q = (struct pma_query *)cl_qmap_head(&engine->on_wire);
+		cl_qmap_remove_item(&engine->on_wire, &q->on_wire);
+		complete_query(engine, q, NULL, EIO);
+	}
+	/* callbacks may queue more, fail those as well */
+	while ((q = engine->queue_head)) {
+		engine->queue_head = q->qnext;
+		if (!engine->queue_head)
+			engine->queue_tail = NULL;
+		complete_query(engine, q, NULL, EIO);
+	}
+}
+
+int pma_engine_run(struct pma_engine *engine)
+{
+	uint8_t umad[sizeof(struct ib_user_mad) + IB_MAD_SIZE];
+	struct pma_query *q;
+	int length, status;
+	uint8_t *mad;
+	uint32_t trid;
+
+	for (;;) {
+		process_queue(engine);
+		if (cl_is_qmap_empty(&engine->on_wire))
+			break;
+
+		/* umad completes every send, with ETIMEDOUT if need be */
+		length = umad_size() + IB_MAD_SIZE;
+		if (engine->tp->recv(engine->tp, engine->fd, umad, &length,
+				     -1) < 0) {
+			IBWARN("umad_recv failed; %s", strerror(errno));
+			fail_all(engine);
+			return -EIO;
+		}
+
+		mad = umad_get_mad(umad);
+		trid = (uint32_t) mad_get_field64(mad, 0, IB_MAD_TRID_F);
+		q = (struct pma_query *)cl_qmap_remove(&engine->on_wire, trid);
+		if (&q->on_wire == cl_qmap_end(&engine->on_wire)) {
+			DEBUG("dropping response for trid 0x%x", trid);
+			continue;
+		}
+		engine->lid_load[(uint16_t) q->portid.lid]--;
+
+		if ((status = umad_status(umad)) == ETIMEDOUT &&
+		    q->attempts <= engine->retries) {
+			DEBUG("timeout on %s attr 0x%x; retrying",
+			      portid2str(&q->portid), q->rpc.attr.id);
+			queue_query_head(engine, q);
+			continue;
+		}
+		if (status) {
+			complete_query(engine, q, NULL,
+				       status == ETIMEDOUT ? ETIMEDOUT : EIO);
+			continue;
+		}
+
+		status = mad_get_field(mad, 0, IB_MAD_STATUS_F);
+		if (status == IB_MAD_STS_REDIRECT && !redirect_query(q, mad)) {
+			queue_query_head(engine, q);
+			continue;
+		}
+
+		if (status) {
+			DEBUG("MAD completed with error status 0x%x;"
+			      " dport (%s)", status, portid2str(&q->portid));
+			complete_query(engine, q, NULL, EIO);
+		} else
+			complete_query(engine, q, mad + IB_PC_DATA_OFFS, 0);
+	}
+
+	return 0;
+}
+
+static struct pma_query *new_query(struct pma_engine *engine,
+				   ib_portid_t * portid, int portnum,
+				   unsigned method, unsigned attr_id,
+				   pma_comp_cb_t cb, void *cb_data)
+{
+	struct pma_query *q = calloc(1, sizeof(*q));
+
+	if (!q)
+		return NULL;
+
+	q->portid = *portid;
+	if (!q->portid.qp)
+		q->portid.qp = 1;
+	if (!q->portid.qkey)
+		q->portid.qkey = IB_DEFAULT_QP1_QKEY;
+	q->portnum = portnum;
+	q->cb = cb;
+	q->cb_data = cb_data;
+
+	q->rpc.mgtclass = IB_PERFORMANCE_CLASS;
+	q->rpc.method = method;
+	q->rpc.attr.id = attr_id;
+	q->rpc.attr.mod = 0;
+	q->rpc.timeout = engine->timeout_ms;
+	q->rpc.datasz = IB_PC_DATA_SZ;
+	q->rpc.dataoffs = IB_PC_DATA_OFFS;
+
+	/* Same for attribute IDs */
+	mad_set_field(q->payload, 0, IB_PC_PORT_SELECT_F, portnum);
+	return q;
+}
+
+int pma_query_async(struct pma_engine *engine, ib_portid_t * portid,
+		    int portnum, unsigned attr_id, pma_comp_cb_t cb,
+		    void *cb_data)
+{
+	struct pma_query *q = new_query(engine, portid, portnum,
+					IB_MAD_METHOD_GET, attr_id, cb,
+					cb_data);
+
+	if (!q)
+		return -ENOMEM;
+	queue_query(engine, q);
+	return 0;
+}
+
+int pma_reset_async(struct pma_engine *engine, ib_portid_t * portid,
+		    int portnum, unsigned mask, unsigned attr_id,
+		    pma_comp_cb_t cb, void *cb_data)
+{
+	struct pma_query *q = new_query(engine, portid, portnum,
+					IB_MAD_METHOD_SET, attr_id, cb,
+					cb_data);
+
+	if (!q)
+		return -ENOMEM;
+
+	if (!mask)
+		mask = ~0;
+	mad_set_field(q->payload, 0, IB_PC_COUNTER_SELECT_F, mask);
+	mask = mask >> 16;
+	if (attr_id == IB_GSI_PORT_COUNTERS_EXT)
+		mad_set_field(q->payload, 0, IB_PC_EXT_COUNTER_SELECT2_F, mask);
+	else
+		mad_set_field(q->payload, 0, IB_PC_COUNTER_SELECT2_F, mask);
+
+	queue_query(engine, q);
+	return 0;
+}
+
+int pma_engine_open(struct pma_engine *engine, char *ca, int ca_port,
+		    unsigned window, unsigned max_per_lid, unsigned timeout_ms)
+{
+	memset(engine, 0, sizeof(*engine));
+	cl_qmap_init(&engine->on_wire);
+
+	engine->window = window ? window : 1;
+	engine->max_per_lid = max_per_lid ? max_per_lid : 1;
+	if (engine->max_per_lid > 255)
+		engine->max_per_lid = 255;
+	engine->timeout_ms = timeout_ms ? timeout_ms : MAD_DEF_TIMEOUT_MS;
+	engine->retries = MAD_DEF_RETRIES;
+
+	if (!(engine->lid_load = calloc(PMA_LID_COUNT,
+					sizeof(*engine->lid_load)))) {
+		IBWARN("calloc failed");
+		return -ENOMEM;
+	}
+
+	engine->tp = mad_get_transport();
+	if ((engine->fd = engine->tp->open_port(engine->tp, ca, ca_port)) < 0) {
+		IBWARN("umad_open_port on port %s:%d failed",
+		       ca ? ca : "", ca_port);
+		goto err;
+	}
+
+	if ((engine->agent = engine->tp->register_agent(engine->tp, engine->fd,
+							IB_PERFORMANCE_CLASS,
+							1, 0, NULL)) < 0) {
+		IBWARN("umad_register for PerfMgt class failed on port %s:%d",
+		       ca ? ca : "", ca_port);
+		engine->tp->close_port(engine->tp, engine->fd);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	free(engine->lid_load);
+	engine->lid_load = NULL;
+	return -EIO;
+}
+
+void pma_engine_close(struct pma_engine *engine)
+{
+	struct pma_query *q;
+
+	while ((q = engine->queue_head)) {
+		engine->queue_head = q->qnext;
+		free(q);
+	}
+	while (!cl_is_qmap_empty(&engine->on_wire)) {
+		q = (struct pma_query *)cl_qmap_head(&engine->on_wire);
+		cl_qmap_remove_item(&engine->on_wire, &q->on_wire);
+		free(q);
+	}
+
+	engine->tp->unregister_agent(engine->tp, engine->fd, engine->agent);
+	engine->tp->close_port(engine->tp, engine->fd);
+	free(engine->lid_load);
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_rcache.h"
+
+#define RCACHE_MAGIC "IBRC"
+#define RCACHE_VERSION 2
+#define RCACHE_BITS 14
+#define RCACHE_SLOTS (1 << RCACHE_BITS)
+/* empty the table rather than let probe sequences grow without bound */
+#define RCACHE_MAX_USED (RCACHE_SLOTS / 4 * 3)
+/*
+ * The SM may move a remote port to another LID without anything in the
+ * epoch changing; entries older than this are resolved again.
+ */
+#define RCACHE_MAX_AGE 600
+
+#define RCACHE_ENT_USED	0x1
+#define RCACHE_ENT_SL	0x2
+
+/* what the cached LIDs depend on */
+struct rcache_epoch {
+	uint64_t port_guid;
+	uint64_t gid_prefix;
+	uint16_t base_lid;
+	uint16_t sm_lid;
+	uint8_t lmc;
+	uint8_t sm_sl;
+	uint8_t pad[2];
+};
+
+struct rcache_hdr {
+	char magic[4];
+	uint32_t version;
+	uint32_t nslots;
+	uint32_t used;
+	struct rcache_epoch epoch;
+};
+
+struct rcache_ent {
+	uint8_t gid[16];
+	uint16_t lid;
+	uint8_t sl;
+	uint8_t flags;
+	uint32_t stamp;		/* time() of the last store */
+};
+
+#define RCACHE_SIZE (sizeof(struct rcache_hdr) + \
+		     RCACHE_SLOTS * sizeof(struct rcache_ent))
+
+static struct {
+	int fd;
+	int writable;
+	int disabled;
+	struct rcache_hdr *hdr;
+	struct rcache_ent *ent;
+	struct rcache_epoch epoch;	/* of our port, found at open */
+} rc = { -1, 0, 0, NULL, NULL };
+
+static int rcache_get_epoch(char *ca_name, uint8_t ca_port,
+			    struct rcache_epoch *e)
+{
+	struct ibmad_transport *tp = mad_get_transport();
+	umad_port_t port;
+
+	if (tp->get_port(tp, ca_name, ca_port, &port) < 0)
+		return -1;
+
+	memset(e, 0, sizeof(*e));
+	e->port_guid = port.port_guid;
+	e->gid_prefix = port.gid_prefix;
+	e->base_lid = port.base_lid;
+	e->sm_lid = port.sm_lid;
+	e->lmc = port.lmc;
+	e->sm_sl = port.sm_sl;
+
+	tp->release_port(tp, &port);
+	return 0;
+}
+
+static int rcache_valid(const struct rcache_epoch *e)
+{
+	return !memcmp(rc.hdr->magic, RCACHE_MAGIC, 4) &&
+	    rc.hdr->version == RCACHE_VERSION &&
+	    rc.hdr->nslots == RCACHE_SLOTS &&
+	    !memcmp(&rc.hdr->epoch, e, sizeof(*e));
+}
+
+/*
+ * A tool on another local port may have emptied and restamped the file
+ * since we opened it; its entries are not ours to read or add to.  Called
+ * with the file locked.
+ */
+static int rcache_ours(void)
+{
+	return !memcmp(&rc.hdr->epoch, &rc.epoch, sizeof(rc.epoch));
+}
+
+static void rcache_close(void)
+{
+	if (rc.hdr)
+		munmap(rc.hdr, RCACHE_SIZE);
+	if (rc.fd >= 0)
+		close(rc.fd);
+	rc.hdr = NULL;
+	rc.ent = NULL;
+	rc.fd = -1;
+}
+
+static int rcache_open(const char *file, char *ca_name, uint8_t ca_port)
+{
+	struct rcache_epoch e;
+	struct stat st;
+	void *map;
+
+	if (rcache_get_epoch(ca_name, ca_port, &e) < 0)
+		return -1;
+
+	/* a cache kept by someone else can still be looked up */
+	rc.writable = 1;
+	if ((rc.fd = open(file, O_RDWR | O_CREAT, 0644)) < 0 &&
+	    (errno == EACCES || errno == EROFS)) {
+		rc.writable = 0;
+		rc.fd = open(file, O_RDONLY);
+	}
+	if (rc.fd < 0) {
+		DEBUG("cannot open resolve cache %s: %s", file,
+		      strerror(errno));
+		return -1;
+	}
+
+	if (flock(rc.fd, rc.writable ? LOCK_EX : LOCK_SH) < 0 ||
+	    fstat(rc.fd, &st) < 0)
+		goto err;
+	if (st.st_size != RCACHE_SIZE) {
+		if (!rc.writable) {
+			errno = EINVAL;
+			goto err;
+		}
+		if (ftruncate(rc.fd, RCACHE_SIZE) < 0)
+			goto err;
+	}
+
+	map = mmap(NULL, RCACHE_SIZE,
+		   rc.writable ? PROT_READ | PROT_WRITE : PROT_READ,
+		   MAP_SHARED, rc.fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	rc.hdr = map;
+	rc.ent = (struct rcache_ent *)(rc.hdr + 1);
+	rc.epoch = e;
+
+	if (!rcache_valid(&e)) {
+		if (!rc.writable) {
+			DEBUG("resolve cache %s is stale", file);
+			rcache_close();
+			return -1;
+		}
+		DEBUG("resolve cache %s is new or stale; emptying it", file);
+		memset(rc.ent, 0, RCACHE_SLOTS * sizeof(*rc.ent));
+		rc.hdr->epoch = e;
+		rc.hdr->nslots = RCACHE_SLOTS;
+		rc.hdr->version = RCACHE_VERSION;
+		rc.hdr->used = 0;
+		memcpy(rc.hdr->magic, RCACHE_MAGIC, 4);
+	}
+
+	flock(rc.fd, LOCK_UN);
+	return 0;
+
+err:
+	DEBUG("cannot map resolve cache %s: %s", file, strerror(errno));
+	rcache_close();
+	return -1;
+}
+
+static unsigned rcache_hash(ibmad_gid_t gid)
+{
+	uint64_t h;
+
+	memcpy(&h, gid + 8, sizeof(h));
+	h ^= gid[7];
+	return (unsigned)((h * 0x9e3779b97f4a7c15ULL) >> (64 - RCACHE_BITS));
+}
+
+/* slot holding gid, or the free slot where it would go */
+static struct rcache_ent *rcache_find(ibmad_gid_t gid)
+{
+	unsigned i = rcache_hash(gid);
+	struct rcache_ent *ent;
+
+	for (;; i = (i + 1) & (RCACHE_SLOTS - 1)) {
+		ent = &rc.ent[i];
+		if (!(ent->flags & RCACHE_ENT_USED) ||
+		    !memcmp(ent->gid, gid, sizeof(ent->gid)))
+			return ent;
+	}
+}
+
+int rcache_lookup(const char *file, char *ca_name, uint8_t ca_port,
+		  ibmad_gid_t gid, ib_portid_t * portid, int want_sl)
+{
+	struct rcache_ent *ent;
+	int ret = -1;
+
+	if (!rc.hdr) {
+		if (rc.disabled || rcache_open(file, ca_name, ca_port) < 0) {
+			rc.disabled = 1;
+			return -1;
+		}
+	}
+
+	flock(rc.fd, LOCK_SH);
+	if (!rcache_ours()) {
+		flock(rc.fd, LOCK_UN);
+		DEBUG("resolve cache taken over by another port");
+		return -1;
+	}
+	ent = rcache_find(gid);
+	if (ent->flags & RCACHE_ENT_USED &&
+	    (!want_sl || ent->flags & RCACHE_ENT_SL) &&
+	    (uint32_t)time(NULL) - ent->stamp <= RCACHE_MAX_AGE) {
+		portid->lid = ent->lid;
+		if (want_sl)
+			portid->sl = ent->sl;
+		ret = 0;
+	}
+	flock(rc.fd, LOCK_UN);
+
+	if (ret)
+		DEBUG("resolve cache miss");
+	else
+		DEBUG("resolve cache hit: lid %d", portid->lid);
+	return ret;
+}
+
+void rcache_store(ibmad_gid_t gid, const ib_portid_t * portid, int sl_valid)
+{
+	struct rcache_ent *ent;
+
+	if (!rc.hdr || !rc.writable)
+		return;
+
+	flock(rc.fd, LOCK_EX);
+	if (!rcache_ours()) {
+		flock(rc.fd, LOCK_UN);
+		return;
+	}
+	if (rc.hdr->used >= RCACHE_MAX_USED) {
+		memset(rc.ent, 0, RCACHE_SLOTS * sizeof(*rc.ent));
+		rc.hdr->used = 0;
+	}
+	ent = rcache_find(gid);
+	if (!(ent->flags & RCACHE_ENT_USED)) {
+		memcpy(ent->gid, gid, sizeof(ent->gid));
+		rc.hdr->used++;
+	}
+	if (sl_valid) {
+		ent->sl = portid->sl;
+		ent->flags |= RCACHE_ENT_SL;
+	} else if (ent->lid != portid->lid)
+		ent->flags &= ~RCACHE_ENT_SL;
+	ent->lid = portid->lid;
+	ent->stamp = (uint32_t)time(NULL);
+	ent->flags |= RCACHE_ENT_USED;
+	flock(rc.fd, LOCK_UN);
+}
@@ -67,14 +67,18 @@ struct sa_handle * sa_get_handle(void)
 	if (!handle->dport.qkey)
 		handle->dport.qkey = IB_DEFAULT_QP1_QKEY;
 
-	if ((handle->fd = umad_open_port(ibd_ca, ibd_ca_port)) < 0) {
+	handle->tp = mad_get_transport();
+	if ((handle->fd = handle->tp->open_port(handle->tp, ibd_ca,
+						ibd_ca_port)) < 0) {
 		IBWARN("umad_open_port on port %s:%d failed",
 			ibd_ca ? "" : ibd_ca,
 			ibd_ca_port);
 		goto err;
 	}
-	if ((handle->agent = umad_register(handle->fd, IB_SA_CLASS, 2, 1, NULL)) < 0) {
-		umad_close_port(handle->fd);
+	if ((handle->agent = handle->tp->register_agent(handle->tp, handle->fd,
+							IB_SA_CLASS, 2, 1,
+							NULL)) < 0) {
+		handle->tp->close_port(handle->tp, handle->fd);
 		IBWARN("umad_register for SA class failed on port %s:%d",
 		       ibd_ca ? "" : ibd_ca,
 		       ibd_ca_port);
@@ -90,19 +94,34 @@ err:
 
 void sa_free_handle(struct sa_handle * h)
 {
-	umad_unregister(h->fd, h->agent);
-	umad_close_port(h->fd);
+	h->tp->unregister_agent(h->tp, h->fd, h->agent);
+	h->tp->close_port(h->tp, h->fd);
+	if (h->umad)
+		free(h->umad);
 	free(h);
 }
 
-int sa_query(struct sa_handle * h, uint8_t method,
-		    uint16_t attr, uint32_t mod, uint64_t comp_mask,
-		    uint64_t sm_key, void *data, size_t datasz,
-		    struct sa_query_result *result)
+/* Send the query and receive the response into *umadp, which holds *sizep
+ * bytes after the umad header and is grown when the response is larger;
+ * *lenp is set to the response length. */
+static int sa_rpc(struct sa_handle * h, uint8_t method,
+		  uint16_t attr, uint32_t mod, uint64_t comp_mask,
+		  uint64_t sm_key, void *data, size_t datasz,
+		  void **umadp, int *sizep, int *lenp)
 {
 	ib_rpc_t rpc;
-	void *umad, *mad;
-	int ret, offset, len = 256;
+	void *umad = *umadp;
+	int ret, len = 256;
+
+	if (*sizep < len) {
+		umad = realloc(umad, umad_size() + len);
+		if (!umad)
+			IBPANIC("cannot alloc mem for umad: %s\n",
+				strerror(errno));
+		*umadp = umad;
+		*sizep = len;
+	}
+	memset(umad, 0, umad_size() + len);
 
 	memset(&rpc, 0, sizeof(rpc));
 	rpc.mgtclass = IB_SA_CLASS;
@@ -113,10 +132,6 @@ int sa_query(struct sa_handle * h, uint8_t method,
 	rpc.datasz = datasz;
 	rpc.dataoffs = IB_SA_DATA_OFFS;
 
-	umad = calloc(1, len + umad_size());
-	if (!umad)
-		IBPANIC("cannot alloc mem for umad: %s\n", strerror(errno));
-
 	mad_build_pkt(umad, &rpc, &h->dport, NULL, data);
 
 	mad_set_field64(umad_get_mad(umad), 0, IB_SA_MKEY_F, sm_key);
@@ -124,51 +139,140 @@ int sa_query(struct sa_handle * h, uint8_t method,
 	if (ibdebug > 1)
 		xdump(stdout, "SA Request:\n", umad_get_mad(umad), len);
 
-	ret = umad_send(h->fd, h->agent, umad, len, ibd_timeout, 0);
+	ret = h->tp->send(h->tp, h->fd, h->agent, umad, len, ibd_timeout, 0);
 	if (ret < 0) {
 		IBWARN("umad_send failed: attr 0x%x: %s\n",
 			attr, strerror(errno));
-		free(umad);
 		return (-ret);
 	}
 
+	len = *sizep;
 recv_mad:
-	ret = umad_recv(h->fd, umad, &len, ibd_timeout);
+	ret = h->tp->recv(h->tp, h->fd, umad, &len, ibd_timeout);
 	if (ret < 0) {
 		if (errno == ENOSPC) {
 			umad = realloc(umad, umad_size() + len);
+			if (!umad)
+				IBPANIC("cannot alloc mem for umad: %s\n",
+					strerror(errno));
+			*umadp = umad;
+			*sizep = len;
 			goto recv_mad;
 		}
 		IBWARN("umad_recv failed: attr 0x%x: %s\n", attr,
 			strerror(errno));
-		free(umad);
 		return (-ret);
 	}
 
 	if ((ret = umad_status(umad)))
 		return ret;
 
-	mad = umad_get_mad(umad);
-
 	if (ibdebug > 1)
-		xdump(stdout, "SA Response:\n", mad, len);
-
-	method = (uint8_t) mad_get_field(mad, 0, IB_MAD_METHOD_F);
-	offset = mad_get_field(mad, 0, IB_SA_ATTROFFS_F);
-	result->status = mad_get_field(mad, 0, IB_MAD_STATUS_F);
-	result->p_result_madw = mad;
-	if (result->status != IB_SA_MAD_STATUS_SUCCESS)
-		result->result_cnt = 0;
+		xdump(stdout, "SA Response:\n", umad_get_mad(umad), len);
+
+	*lenp = len;
+	return 0;
+}
+
+/* status, number and size of the records of a response */
+static void sa_parse_response(void *mad, int len, uint32_t *status,
+			      unsigned *cnt, size_t *recsz)
+{
+	uint8_t method = (uint8_t) mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	int offset = mad_get_field(mad, 0, IB_SA_ATTROFFS_F);
+
+	*status = mad_get_field(mad, 0, IB_MAD_STATUS_F);
+	*recsz = offset << 3;
+	if (*status != IB_SA_MAD_STATUS_SUCCESS)
+		*cnt = 0;
 	else if (method != IB_MAD_METHOD_GET_TABLE)
-		result->result_cnt = 1;
+		*cnt = 1;
 	else if (!offset)
-		result->result_cnt = 0;
+		*cnt = 0;
 	else
-		result->result_cnt = (len - IB_SA_DATA_OFFS) / (offset << 3);
+		*cnt = (len - IB_SA_DATA_OFFS) / (offset << 3);
+}
+
+int sa_query(struct sa_handle * h, uint8_t method,
+		    uint16_t attr, uint32_t mod, uint64_t comp_mask,
+		    uint64_t sm_key, void *data, size_t datasz,
+		    struct sa_query_result *result)
+{
+	void *umad = NULL;
+	size_t recsz;
+	int ret, size = 0, len;
+
+	ret = sa_rpc(h, method, attr, mod, comp_mask, sm_key, data, datasz,
+		     &umad, &size, &len);
+	if (ret) {
+		free(umad);
+		return ret;
+	}
 
+	result->p_result_madw = umad_get_mad(umad);
+	sa_parse_response(result->p_result_madw, len, &result->status,
+			  &result->result_cnt, &recsz);
 	return 0;
 }
 
+int sa_query_cursor(struct sa_handle * h, uint8_t method,
+		    uint16_t attr, uint32_t mod, uint64_t comp_mask,
+		    uint64_t sm_key, void *data, size_t datasz,
+		    struct sa_cursor *c)
+{
+	void *mad;
+	int ret, len;
+
+	memset(c, 0, sizeof(*c));
+	ret = sa_rpc(h, method, attr, mod, comp_mask, sm_key, data, datasz,
+		     &h->umad, &h->umad_size, &len);
+	if (ret)
+		return ret;
+
+	mad = umad_get_mad(h->umad);
+	sa_parse_response(mad, len, &c->status, &c->left, &c->recsz);
+	c->next = (uint8_t *) mad + IB_SA_DATA_OFFS;
+	return 0;
+}
+
+void *sa_cursor_next(struct sa_cursor *c)
+{
+	void *rec;
+
+	if (!c->left)
+		return NULL;
+	rec = c->next;
+	c->next += c->recsz;
+	c->left--;
+	return rec;
+}
+
+int sa_ft_record_index(void *rec, int multicast, unsigned startblock,
+		       unsigned nblocks, unsigned chunks, void **data)
+{
+	ib_lft_record_t *lftr = rec;
+	ib_mft_record_t *mftr = rec;
+	unsigned block, position = 0;
+
+	/* blocks are numbered as the SMP attribute modifier has them */
+	if (multicast) {
+		position = cl_ntoh16(mftr->position_block_num) >> 12;
+		block = (cl_ntoh16(mftr->position_block_num) &
+			 IB_MCAST_BLOCK_ID_MASK_HO) +
+		    IB_MIN_MCAST_LID / IB_MLIDS_IN_BLOCK;
+		if (position >= chunks)
+			return -1;
+	} else
+		block = cl_ntoh16(lftr->block_num);
+
+	if (block < startblock || block >= startblock + nblocks)
+		return -1;
+
+	/* both records carry the 64 bytes of the SMP attribute */
+	*data = multicast ? (void *)mftr->mft : (void *)lftr->lft;
+	return (block - startblock) * chunks + position;
+}
+
 void sa_free_result_mad(struct sa_query_result *result)
 {
 	if (result->p_result_madw) {
@@ -0,0 +1,1988 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <infiniband/ibnetdisc.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_sim.h"
+
+/* in-process handles are handed out as fds above any real one */
+#define SIM_FD_BASE 4096
+#define SIM_MAX_PORTS 254
+#define SIM_MAX_LID 0xbfff
+#define SIM_GID_PREFIX 0xfe80000000000000ULL
+#define SIM_SW_GUID 0x0002c90200000000ULL
+#define SIM_CA_GUID 0x0002c90300000000ULL
+#define SIM_DEVID 0xbeef
+#define SIM_LFT_CAP 0xc000
+#define SIM_MFT_CAP 256
+
+/* error counters kept per port: SymbolErrors, RcvErrors, XmitDiscards */
+#define SIM_NUM_ERRS 3
+
+/* SA component mask bits */
+#define SIM_NR_LID		(1ULL << 0)
+#define SIM_NR_NODETYPE		(1ULL << 4)
+#define SIM_NR_NODEGUID		(1ULL << 7)
+#define SIM_NR_PORTGUID		(1ULL << 8)
+#define SIM_PR_DGID		(1ULL << 2)
+#define SIM_PR_SGID		(1ULL << 3)
+#define SIM_PR_DLID		(1ULL << 4)
+#define SIM_PR_SLID		(1ULL << 5)
+#define SIM_LFTR_LID		(1ULL << 0)
+#define SIM_LFTR_BLOCK		(1ULL << 1)
+#define SIM_MFTR_LID		(1ULL << 0)
+#define SIM_MFTR_POSITION	(1ULL << 1)
+#define SIM_MFTR_BLOCK		(1ULL << 3)
+#define SIM_SA_NO_RECORDS	(3 << 8)
+
+#define SIM_NODE_INFO_SIZE	40
+#define SIM_NR_RECSZ	112	/* IB_SA_NR_RECSZ rounded up to 8 bytes */
+#define SIM_PR_RECSZ	IB_SA_PR_RECSZ
+#define SIM_LFTR_RECSZ	72
+#define SIM_MFTR_RECSZ	72
+
+struct sim_node;
+
+struct sim_port {
+	struct sim_node *node;
+	struct sim_port *remote;
+	uint64_t guid;
+	uint16_t lid;
+	uint8_t lmc;
+	uint8_t portnum;
+	uint8_t info[IB_SMP_DATA_SIZE];
+	uint8_t ext_info[IB_SMP_DATA_SIZE];
+	uint64_t clear_ns;	/* data counters last cleared */
+	uint32_t errs[SIM_NUM_ERRS];
+};
+
+struct sim_node {
+	int type;
+	int nports;
+	int swidx;
+	uint64_t guid;
+	uint8_t info[IB_SMP_DATA_SIZE];
+	uint8_t swinfo[IB_SMP_DATA_SIZE];
+	uint8_t desc[IB_SMP_DATA_SIZE];
+	struct sim_port *ports;	/* ports[0] .. ports[nports] */
+	uint64_t busy_until;
+	uint8_t *lft;		/* computed on first use */
+};
+
+struct sim_msg {
+	uint64_t due;
+	uint64_t seq;
+	int length;		/* of the MAD, excluding the umad header */
+	uint8_t umad[];
+};
+
+struct sim_handle {
+	int in_use;
+	int nagents;
+	struct sim_msg **heap;
+	unsigned nheap;
+	unsigned heapsz;
+};
+
+struct sim_fabric {
+	struct sim_node *nodes;
+	unsigned nnodes;
+	unsigned nswitches;
+	struct sim_port *port_mem;
+	unsigned nport_mem;
+	unsigned nport_used;
+
+	struct sim_port **lids;
+	unsigned max_lid;
+	struct sim_port **guids;	/* open addressed on port guid */
+	unsigned guid_mask;
+
+	struct sim_port *local;
+	uint16_t sm_lid;
+
+	unsigned latency_ns;
+	double loss;
+	unsigned sma_rate;
+	double traffic;		/* bytes per ns per port */
+	unsigned errors;
+	unsigned seed;
+
+	uint64_t start_ns;
+	uint64_t seq;
+	struct sim_handle *handles;
+	unsigned nhandles;
+
+	/* scratch space for computing LFTs */
+	int *bfs_dist;
+	unsigned *bfs_queue;
+	uint8_t *bfs_mask;
+};
+
+uint64_t sim_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	       == EINTR)
+		;
+}
+
+static unsigned guid_slot(uint64_t guid, unsigned mask)
+{
+	guid ^= guid >> 33;
+	guid *= 0xff51afd7ed558ccdULL;
+	guid ^= guid >> 33;
+	return (unsigned)guid & mask;
+}
+
+static struct sim_port *find_guid(struct sim_fabric *f, uint64_t guid)
+{
+	unsigned i = guid_slot(guid, f->guid_mask);
+
+	for (; f->guids[i]; i = (i + 1) & f->guid_mask)
+		if (f->guids[i]->guid == guid)
+			return f->guids[i];
+	return NULL;
+}
+
+static struct sim_port *find_lid(struct sim_fabric *f, unsigned lid)
+{
+	return lid <= f->max_lid ? f->lids[lid] : NULL;
+}
+
+static int sim_alloc(struct sim_fabric *f, unsigned nnodes, unsigned nports)
+{
+	f->nodes = calloc(nnodes, sizeof(*f->nodes));
+	f->port_mem = calloc(nports, sizeof(*f->port_mem));
+	if (!f->nodes || !f->port_mem)
+		return -ENOMEM;
+	f->nport_mem = nports;
+	return 0;
+}
+
+static struct sim_node *add_node(struct sim_fabric *f, int type, int nports,
+				 uint64_t guid)
+{
+	struct sim_node *node = &f->nodes[f->nnodes++];
+	int i;
+
+	node->type = type;
+	node->nports = nports;
+	node->guid = guid;
+	node->swidx = type == IB_NODE_SWITCH ? (int)f->nswitches++ : -1;
+	node->ports = &f->port_mem[f->nport_used];
+	f->nport_used += nports + 1;
+	for (i = 0; i <= nports; i++) {
+		node->ports[i].node = node;
+		node->ports[i].portnum = i;
+		node->ports[i].guid = type == IB_NODE_SWITCH ? guid : guid + i;
+	}
+	return node;
+}
+
+static void init_node_info(struct sim_node *node)
+{
+	uint8_t *ni = node->info;
+
+	mad_set_field(ni, 0, IB_NODE_BASE_VERS_F, 1);
+	mad_set_field(ni, 0, IB_NODE_CLASS_VERS_F, 1);
+	mad_set_field(ni, 0, IB_NODE_TYPE_F, node->type);
+	mad_set_field(ni, 0, IB_NODE_NPORTS_F, node->nports);
+	mad_set_field64(ni, 0, IB_NODE_SYSTEM_GUID_F, node->guid);
+	mad_set_field64(ni, 0, IB_NODE_GUID_F, node->guid);
+	mad_set_field64(ni, 0, IB_NODE_PORT_GUID_F, node->ports[1].guid);
+	mad_set_field(ni, 0, IB_NODE_PARTITION_CAP_F, 8);
+	mad_set_field(ni, 0, IB_NODE_DEVID_F, SIM_DEVID);
+	mad_set_field(ni, 0, IB_NODE_LOCAL_PORT_F, 1);
+	mad_set_field(ni, 0, IB_NODE_VENDORID_F, 0x2c9);
+}
+
+static void init_port_info(struct sim_fabric *f, struct sim_port *p)
+{
+	struct sim_node *node = p->node;
+	uint8_t *pi = p->info;
+	int up = p->remote || (node->type == IB_NODE_SWITCH && !p->portnum);
+
+	mad_set_field64(pi, 0, IB_PORT_GID_PREFIX_F, SIM_GID_PREFIX);
+	mad_set_field(pi, 0, IB_PORT_LID_F, node->type == IB_NODE_SWITCH ?
+		      node->ports[0].lid : p->lid);
+	mad_set_field(pi, 0, IB_PORT_SMLID_F, f->sm_lid);
+	mad_set_field(pi, 0, IB_PORT_LOCAL_PORT_F, p->portnum);
+	mad_set_field(pi, 0, IB_PORT_LINK_WIDTH_ENABLED_F, 3);
+	mad_set_field(pi, 0, IB_PORT_LINK_WIDTH_SUPPORTED_F, 3);
+	mad_set_field(pi, 0, IB_PORT_LINK_WIDTH_ACTIVE_F, 2);
+	mad_set_field(pi, 0, IB_PORT_LINK_SPEED_SUPPORTED_F, 7);
+	mad_set_field(pi, 0, IB_PORT_STATE_F, up ? 4 : 1);
+	mad_set_field(pi, 0, IB_PORT_PHYS_STATE_F, up ? 5 : 2);
+	mad_set_field(pi, 0, IB_PORT_LINK_SPEED_ACTIVE_F, 4);
+	mad_set_field(pi, 0, IB_PORT_LINK_SPEED_ENABLED_F, 7);
+	mad_set_field(pi, 0, IB_PORT_NEIGHBOR_MTU_F, 5);
+	mad_set_field(pi, 0, IB_PORT_MTU_CAP_F, 5);
+	mad_set_field(pi, 0, IB_PORT_VL_CAP_F, 4);
+	mad_set_field(pi, 0, IB_PORT_OPER_VLS_F, 4);
+}
+
+static void link_ports(struct sim_port *a, struct sim_port *b)
+{
+	a->remote = b;
+	b->remote = a;
+}
+
+static int build_lid_tables(struct sim_fabric *f)
+{
+	unsigned i, n, j, size;
+	struct sim_port *p;
+	int k;
+
+	f->lids = calloc(f->max_lid + 1, sizeof(*f->lids));
+	for (size = 2; size < 2 * f->nport_used; size <<= 1)
+		;
+	f->guids = calloc(size, sizeof(*f->guids));
+	f->guid_mask = size - 1;
+	if (!f->lids || !f->guids)
+		return -ENOMEM;
+
+	for (n = 0; n < f->nnodes; n++) {
+		for (k = 0; k <= f->nodes[n].nports; k++) {
+			p = &f->nodes[n].ports[k];
+			if (p->lid)
+				for (j = 0; j < (1u << p->lmc) &&
+				     p->lid + j <= f->max_lid; j++)
+					f->lids[p->lid + j] = p;
+			if (!p->portnum && f->nodes[n].type != IB_NODE_SWITCH)
+				continue;
+			if (k && f->nodes[n].type == IB_NODE_SWITCH)
+				continue;
+			if (find_guid(f, p->guid))
+				continue;
+			for (i = guid_slot(p->guid, f->guid_mask); f->guids[i];
+			     i = (i + 1) & f->guid_mask)
+				;
+			f->guids[i] = p;
+		}
+	}
+	return 0;
+}
+
+/* Hand out LIDs to switches (port 0) and connected CA ports in order, and
+ * fill in the attributes which depend on them. */
+static int finish_generated(struct sim_fabric *f)
+{
+	unsigned n, lid = 1;
+	struct sim_node *node;
+	int k;
+
+	for (n = 0; n < f->nnodes; n++) {
+		node = &f->nodes[n];
+		if (node->type == IB_NODE_SWITCH)
+			node->ports[0].lid = lid++;
+		else
+			for (k = 1; k <= node->nports; k++)
+				if (node->ports[k].remote)
+					node->ports[k].lid = lid++;
+		if (lid > SIM_MAX_LID) {
+			IBWARN("simulated fabric needs more than %u LIDs",
+			       SIM_MAX_LID);
+			return -EINVAL;
+		}
+	}
+	f->max_lid = lid - 1;
+
+	for (n = 0; n < f->nnodes && !f->local; n++)
+		if (f->nodes[n].type != IB_NODE_SWITCH)
+			f->local = &f->nodes[n].ports[1];
+	if (!f->local)
+		return -EINVAL;
+	f->sm_lid = f->local->lid;
+
+	for (n = 0; n < f->nnodes; n++) {
+		node = &f->nodes[n];
+		init_node_info(node);
+		for (k = node->type == IB_NODE_SWITCH ? 0 : 1;
+		     k <= node->nports; k++)
+			init_port_info(f, &node->ports[k]);
+		if (node->type == IB_NODE_SWITCH) {
+			mad_set_field(node->swinfo, 0, IB_SW_LINEAR_FDB_CAP_F,
+				      SIM_LFT_CAP);
+			mad_set_field(node->swinfo, 0, IB_SW_LINEAR_FDB_TOP_F,
+				      f->max_lid);
+			mad_set_field(node->swinfo, 0, IB_SW_MCAST_FDB_CAP_F,
+				      SIM_MFT_CAP);
+			mad_set_field(node->swinfo, 0, IB_SW_MCAST_FDB_TOP_F,
+				      IB_MIN_MCAST_LID);
+		}
+	}
+	return build_lid_tables(f);
+}
+
+/* S spines, L leaves and H hosts on every leaf; each leaf has one link to
+ * every spine. */
+static int build_fattree2(struct sim_fabric *f, unsigned S, unsigned L,
+			  unsigned H)
+{
+	struct sim_node **leaf, *spine0, *host;
+	unsigned s, l, h, nnodes;
+	int rc;
+
+	if (!S || !L || L > SIM_MAX_PORTS || H + S > SIM_MAX_PORTS)
+		return -EINVAL;
+
+	nnodes = S + L + L * H;
+	if ((rc = sim_alloc(f, nnodes, S * (L + 1) + L * (H + S + 1) +
+			    2 * L * H)))
+		return rc;
+	if (!(leaf = calloc(L, sizeof(*leaf))))
+		return -ENOMEM;
+
+	spine0 = &f->nodes[0];
+	for (s = 0; s < S; s++)
+		snprintf((char *)add_node(f, IB_NODE_SWITCH, L,
+					  SIM_SW_GUID + f->nnodes)->desc,
+			 IB_SMP_DATA_SIZE, "spine%u", s);
+	for (l = 0; l < L; l++) {
+		leaf[l] = add_node(f, IB_NODE_SWITCH, H + S,
+				   SIM_SW_GUID + f->nnodes);
+		snprintf((char *)leaf[l]->desc, IB_SMP_DATA_SIZE, "leaf%u", l);
+		for (s = 0; s < S; s++)
+			link_ports(&leaf[l]->ports[H + 1 + s],
+				   &spine0[s].ports[l + 1]);
+	}
+	for (l = 0; l < L; l++)
+		for (h = 0; h < H; h++) {
+			host = add_node(f, IB_NODE_CA, 1,
+					SIM_CA_GUID + 2 * f->nnodes);
+			snprintf((char *)host->desc, IB_SMP_DATA_SIZE,
+				 "host%u-%u HCA-1", l, h);
+			link_ports(&host->ports[1], &leaf[l]->ports[h + 1]);
+		}
+	free(leaf);
+	return finish_generated(f);
+}
+
+/* Three level K-ary fat tree: K pods of K/2 edge and K/2 aggregation
+ * switches, (K/2)^2 core switches and K/2 hosts on every edge switch. */
+static int build_fattree3(struct sim_fabric *f, unsigned K)
+{
+	struct sim_node *core, *edge, *agg, *host;
+	unsigned k2, p, a, e, j, h;
+	int rc;
+
+	if (K < 2 || K % 2 || K > SIM_MAX_PORTS)
+		return -EINVAL;
+	k2 = K / 2;
+
+	if ((rc = sim_alloc(f, k2 * k2 + K * K + K * k2 * k2,
+			    (k2 * k2 + K * K) * (K + 1) + 2 * K * k2 * k2)))
+		return rc;
+
+	core = &f->nodes[0];
+	for (j = 0; j < k2 * k2; j++)
+		snprintf((char *)add_node(f, IB_NODE_SWITCH, K,
+					  SIM_SW_GUID + f->nnodes)->desc,
+			 IB_SMP_DATA_SIZE, "core%u", j);
+	for (p = 0; p < K; p++) {
+		agg = &f->nodes[f->nnodes];
+		for (a = 0; a < k2; a++) {
+			snprintf((char *)add_node(f, IB_NODE_SWITCH, K,
+						  SIM_SW_GUID + f->nnodes)->desc,
+				 IB_SMP_DATA_SIZE, "pod%u-agg%u", p, a);
+			for (j = 0; j < k2; j++)
+				link_ports(&agg[a].ports[k2 + 1 + j],
+					   &core[a * k2 + j].ports[p + 1]);
+		}
+		edge = &f->nodes[f->nnodes];
+		for (e = 0; e < k2; e++) {
+			snprintf((char *)add_node(f, IB_NODE_SWITCH, K,
+						  SIM_SW_GUID + f->nnodes)->desc,
+				 IB_SMP_DATA_SIZE, "pod%u-edge%u", p, e);
+			for (a = 0; a < k2; a++)
+				link_ports(&edge[e].ports[k2 + 1 + a],
+					   &agg[a].ports[e + 1]);
+		}
+		for (e = 0; e < k2; e++)
+			for (h = 0; h < k2; h++) {
+				host = add_node(f, IB_NODE_CA, 1,
+						SIM_CA_GUID + 2 * f->nnodes);
+				snprintf((char *)host->desc, IB_SMP_DATA_SIZE,
+					 "pod%u-host%u-%u HCA-1", p, e, h);
+				link_ports(&host->ports[1],
+					   &edge[e].ports[h + 1]);
+			}
+	}
+	return finish_generated(f);
+}
+
+/* Dragonfly of G groups of A routers with H hosts each.  Routers in a
+ * group are fully connected and every pair of groups has one global link,
+ * spread over the routers of the group. */
+static int build_dragonfly(struct sim_fabric *f, unsigned G, unsigned A,
+			   unsigned H)
+{
+	struct sim_node *router, *host;
+	unsigned P, nports, g, a, b, h, j, k;
+	int rc;
+
+	if (!G || !A)
+		return -EINVAL;
+	P = (G - 1 + A - 1) / A;
+	nports = H + A - 1 + P;
+	if (nports > SIM_MAX_PORTS)
+		return -EINVAL;
+
+	if ((rc = sim_alloc(f, G * A * (H + 1),
+			    G * A * (nports + 1) + 2 * G * A * H)))
+		return rc;
+
+	router = &f->nodes[0];
+	for (g = 0; g < G; g++)
+		for (a = 0; a < A; a++) {
+			snprintf((char *)add_node(f, IB_NODE_SWITCH, nports,
+						  SIM_SW_GUID + f->nnodes)->desc,
+				 IB_SMP_DATA_SIZE, "group%u-router%u", g, a);
+			for (b = 0; b < a; b++)
+				link_ports(&router[g * A + a].ports[H + 1 + b],
+					   &router[g * A + b].ports[H + a]);
+		}
+	/* global link j of a group (to the j-th other group) is on router
+	 * j % A, global port j / A */
+	for (g = 0; g < G; g++)
+		for (k = g + 1; k < G; k++) {
+			j = k - 1;
+			a = g * A + j % A;
+			b = k * A + g % A;
+			link_ports(&router[a].ports[H + A + j / A],
+				   &router[b].ports[H + A + g / A]);
+		}
+	for (g = 0; g < G; g++)
+		for (a = 0; a < A; a++)
+			for (h = 0; h < H; h++) {
+				host = add_node(f, IB_NODE_CA, 1,
+						SIM_CA_GUID + 2 * f->nnodes);
+				snprintf((char *)host->desc, IB_SMP_DATA_SIZE,
+					 "group%u-host%u-%u HCA-1", g, a, h);
+				link_ports(&host->ports[1],
+					   &router[g * A + a].ports[h + 1]);
+			}
+	return finish_generated(f);
+}
+
+/* X x Y x Z torus of switches with H hosts each; ports H+1 .. H+6 go to
+ * the +x, -x, +y, -y, +z and -z neighbours. */
+static int build_torus(struct sim_fabric *f, unsigned X, unsigned Y,
+		       unsigned Z, unsigned H)
+{
+	unsigned dim[3] = { X, Y, Z }, c[3], n, d, i, h;
+	struct sim_node *sw, *host;
+	int rc;
+
+	if (!X || !Y || !Z || H + 6 > SIM_MAX_PORTS)
+		return -EINVAL;
+	n = X * Y * Z;
+	if ((rc = sim_alloc(f, n * (H + 1), n * (H + 7) + 2 * n * H)))
+		return rc;
+
+	sw = &f->nodes[0];
+	for (i = 0; i < n; i++)
+		snprintf((char *)add_node(f, IB_NODE_SWITCH, H + 6,
+					  SIM_SW_GUID + f->nnodes)->desc,
+			 IB_SMP_DATA_SIZE, "torus-%u-%u-%u",
+			 i % X, i / X % Y, i / (X * Y));
+	for (i = 0; i < n; i++) {
+		c[0] = i % X;
+		c[1] = i / X % Y;
+		c[2] = i / (X * Y);
+		for (d = 0; d < 3; d++) {
+			unsigned save = c[d], next;
+
+			if (dim[d] < 2)
+				continue;
+			c[d] = (c[d] + 1) % dim[d];
+			next = c[0] + X * (c[1] + Y * c[2]);
+			c[d] = save;
+			link_ports(&sw[i].ports[H + 1 + 2 * d],
+				   &sw[next].ports[H + 2 + 2 * d]);
+		}
+	}
+	for (i = 0; i < n; i++)
+		for (h = 0; h < H; h++) {
+			host = add_node(f, IB_NODE_CA, 1,
+					SIM_CA_GUID + 2 * f->nnodes);
+			snprintf((char *)host->desc, IB_SMP_DATA_SIZE,
+				 "torus-%u-%u-%u-host%u HCA-1",
+				 i % X, i / X % Y, i / (X * Y), h);
+			link_ports(&host->ports[1], &sw[i].ports[h + 1]);
+		}
+	return finish_generated(f);
+}
+
+/* Nodes, ports, LIDs and the raw attributes come from the cache as they
+ * were discovered. */
+static int build_from_cache(struct sim_fabric *f, const char *file)
+{
+	ibnd_fabric_t *fabric;
+	ibnd_node_t *in;
+	ibnd_port_t *ip;
+	struct sim_node *node, **map;
+	struct sim_port *p;
+	unsigned nnodes = 0, nports = 0, n;
+	int k, rc = -ENOMEM;
+
+	if (!(fabric = ibnd_load_fabric(file, 0))) {
+		IBWARN("failed to load fabric cache %s", file);
+		return -EIO;
+	}
+
+	for (in = fabric->nodes; in; in = in->next) {
+		nnodes++;
+		nports += in->numports + 1;
+	}
+	if ((rc = sim_alloc(f, nnodes, nports)))
+		goto out;
+	if (!(map = calloc(nnodes, sizeof(*map))))
+		goto out;
+
+	/* map[n] is the sim node made from the n-th cache node */
+	for (n = 0, in = fabric->nodes; in; in = in->next, n++) {
+		node = add_node(f, in->type, in->numports, in->guid);
+		map[n] = node;
+		memcpy(node->info, in->info, sizeof(node->info));
+		memcpy(node->swinfo, in->switchinfo, sizeof(node->swinfo));
+		memcpy(node->desc, in->nodedesc, sizeof(node->desc));
+		for (k = 0; k <= in->numports; k++) {
+			if (!(ip = in->ports[k]))
+				continue;
+			p = &node->ports[k];
+			p->guid = ip->guid;
+			memcpy(p->info, ip->info, sizeof(p->info));
+			memcpy(p->ext_info, ip->ext_info, sizeof(p->ext_info));
+			if (k == 0 || in->type != IB_NODE_SWITCH) {
+				p->lid = ip->base_lid;
+				p->lmc = ip->lmc;
+				if (p->lid + (1u << p->lmc) - 1 > f->max_lid)
+					f->max_lid = p->lid + (1u << p->lmc) - 1;
+			}
+		}
+	}
+	if (f->max_lid > SIM_MAX_LID)
+		f->max_lid = SIM_MAX_LID;
+
+	if ((rc = build_lid_tables(f)))
+		goto out_map;
+	for (n = 0, in = fabric->nodes; in; in = in->next, n++)
+		for (k = 1; k <= in->numports; k++) {
+			ip = in->ports[k];
+			if (!ip) {
+				/* not in the cache, so it was down */
+				init_port_info(f, &map[n]->ports[k]);
+				continue;
+			}
+			if (!ip->remoteport)
+				continue;
+			p = find_guid(f, ip->remoteport->node->type ==
+				      IB_NODE_SWITCH ?
+				      ip->remoteport->node->guid :
+				      ip->remoteport->guid);
+			if (!p)
+				continue;
+			p = &p->node->ports[ip->remoteport->portnum];
+			map[n]->ports[k].remote = p;
+		}
+
+	for (n = 0, in = fabric->nodes; in; in = in->next, n++)
+		if (in == fabric->from_node)
+			break;
+	if (in && fabric->from_portnum > 0 &&
+	    fabric->from_portnum <= map[n]->nports)
+		f->local = &map[n]->ports[fabric->from_portnum];
+	else if (in)
+		for (k = 1; k <= map[n]->nports && !f->local; k++)
+			if (map[n]->ports[k].remote)
+				f->local = &map[n]->ports[k];
+	if (!f->local) {
+		IBWARN("no local port found in %s", file);
+		rc = -EINVAL;
+		goto out_map;
+	}
+	if (f->local->node->type == IB_NODE_SWITCH)
+		f->sm_lid = f->local->node->ports[0].lid;
+	else
+		f->sm_lid = f->local->lid;
+	rc = 0;
+
+out_map:
+	free(map);
+out:
+	ibnd_destroy_fabric(fabric);
+	return rc;
+}
+
+static void place_errors(struct sim_fabric *f)
+{
+	struct sim_port *p;
+	unsigned i;
+
+	for (i = 0; i < f->nport_used; i++) {
+		p = &f->port_mem[i];
+		if (!p->remote || (unsigned)rand_r(&f->seed) % 1000 >= f->errors)
+			continue;
+		p->errs[0] = 1 + rand_r(&f->seed) % 50;
+		p->errs[1] = rand_r(&f->seed) % 10;
+		p->errs[2] = rand_r(&f->seed) % 20;
+	}
+}
+
+/* LFTs are min hop: BFS from the switch over switch to switch links,
+ * collecting for every switch the set of local ports which start a
+ * shortest path to it, then spread the LIDs behind each switch over that
+ * set. */
+#define SIM_MASK_BYTES 32
+
+static int pick_port(uint8_t *mask, unsigned lid)
+{
+	unsigned n = 0, i;
+
+	for (i = 0; i < SIM_MASK_BYTES * 8; i++)
+		if (mask[i / 8] & (1 << (i % 8)))
+			n++;
+	if (!n)
+		return 0xff;
+	n = lid % n;
+	for (i = 0; i < SIM_MASK_BYTES * 8; i++)
+		if ((mask[i / 8] & (1 << (i % 8))) && !n--)
+			return i;
+	return 0xff;
+}
+
+static int compute_lft(struct sim_fabric *f, struct sim_node *sw)
+{
+	unsigned head = 0, tail = 0, lid, size;
+	struct sim_node *u, *r;
+	struct sim_port *p;
+	uint8_t *mask;
+	int k, d;
+
+	size = (f->max_lid / IB_SMP_DATA_SIZE + 1) * IB_SMP_DATA_SIZE;
+	if (!(sw->lft = malloc(size)))
+		return -ENOMEM;
+	memset(sw->lft, 0xff, size);
+
+	if (!f->bfs_dist) {
+		f->bfs_dist = malloc(f->nswitches * sizeof(*f->bfs_dist));
+		f->bfs_queue = malloc(f->nswitches * sizeof(*f->bfs_queue));
+		f->bfs_mask = malloc(f->nswitches * SIM_MASK_BYTES);
+		if (!f->bfs_dist || !f->bfs_queue || !f->bfs_mask)
+			return -ENOMEM;
+	}
+	memset(f->bfs_dist, 0xff, f->nswitches * sizeof(*f->bfs_dist));
+	memset(f->bfs_mask, 0, f->nswitches * SIM_MASK_BYTES);
+
+	f->bfs_dist[sw->swidx] = 0;
+	f->bfs_queue[tail++] = sw - f->nodes;
+	while (head < tail) {
+		u = &f->nodes[f->bfs_queue[head++]];
+		d = f->bfs_dist[u->swidx];
+		for (k = 1; k <= u->nports; k++) {
+			p = u->ports[k].remote;
+			if (!p || p->node->type != IB_NODE_SWITCH)
+				continue;
+			r = p->node;
+			mask = &f->bfs_mask[r->swidx * SIM_MASK_BYTES];
+			if (f->bfs_dist[r->swidx] < 0) {
+				f->bfs_dist[r->swidx] = d + 1;
+				f->bfs_queue[tail++] = r - f->nodes;
+			} else if (f->bfs_dist[r->swidx] != d + 1)
+				continue;
+			if (u == sw)
+				mask[k / 8] |= 1 << (k % 8);
+			else {
+				uint8_t *umask = &f->bfs_mask[u->swidx *
+							      SIM_MASK_BYTES];
+				int i;
+
+				for (i = 0; i < SIM_MASK_BYTES; i++)
+					mask[i] |= umask[i];
+			}
+		}
+	}
+
+	for (lid = 1; lid <= f->max_lid; lid++) {
+		if (!(p = f->lids[lid]))
+			continue;
+		if (p->node == sw) {
+			sw->lft[lid] = 0;
+			continue;
+		}
+		if (p->node->type != IB_NODE_SWITCH) {
+			if (!(p = p->remote))
+				continue;
+			if (p->node == sw) {
+				sw->lft[lid] = p->portnum;
+				continue;
+			}
+		}
+		if (p->node->type == IB_NODE_SWITCH &&
+		    f->bfs_dist[p->node->swidx] > 0)
+			sw->lft[lid] = pick_port(&f->bfs_mask[p->node->swidx *
+							      SIM_MASK_BYTES],
+						 lid);
+	}
+	return 0;
+}
+
+/* receive queue of a handle: a binary heap on (due, seq) */
+static int msg_before(struct sim_msg *a, struct sim_msg *b)
+{
+	return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static int heap_push(struct sim_handle *h, struct sim_msg *m)
+{
+	struct sim_msg **heap;
+	unsigned i, parent;
+
+	if (h->nheap == h->heapsz) {
+		heap = realloc(h->heap, (h->heapsz ? 2 * h->heapsz : 64) *
+			       sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+		h->heap = heap;
+		h->heapsz = h->heapsz ? 2 * h->heapsz : 64;
+	}
+	for (i = h->nheap++; i; i = parent) {
+		parent = (i - 1) / 2;
+		if (!msg_before(m, h->heap[parent]))
+			break;
+		h->heap[i] = h->heap[parent];
+	}
+	h->heap[i] = m;
+	return 0;
+}
+
+static struct sim_msg *heap_pop(struct sim_handle *h)
+{
+	struct sim_msg *top = h->heap[0], *last = h->heap[--h->nheap];
+	unsigned i = 0, c;
+
+	while ((c = 2 * i + 1) < h->nheap) {
+		if (c + 1 < h->nheap && msg_before(h->heap[c + 1], h->heap[c]))
+			c++;
+		if (!msg_before(h->heap[c], last))
+			break;
+		h->heap[i] = h->heap[c];
+		i = c;
+	}
+	h->heap[i] = last;
+	return top;
+}
+
+static struct sim_handle *get_handle(struct sim_fabric *f, int h)
+{
+	if (h < 0 || (unsigned)h >= f->nhandles || !f->handles[h].in_use)
+		return NULL;
+	return &f->handles[h];
+}
+
+int sim_open(struct sim_fabric *f)
+{
+	struct sim_handle *handles;
+	unsigned i;
+
+	for (i = 0; i < f->nhandles; i++)
+		if (!f->handles[i].in_use)
+			break;
+	if (i == f->nhandles) {
+		handles = realloc(f->handles, (i + 1) * sizeof(*handles));
+		if (!handles)
+			return -ENOMEM;
+		f->handles = handles;
+		f->nhandles++;
+	}
+	memset(&f->handles[i], 0, sizeof(f->handles[i]));
+	f->handles[i].in_use = 1;
+	return i;
+}
+
+void sim_close(struct sim_fabric *f, int h)
+{
+	struct sim_handle *sh = get_handle(f, h);
+
+	if (!sh)
+		return;
+	while (sh->nheap)
+		free(heap_pop(sh));
+	free(sh->heap);
+	sh->heap = NULL;
+	sh->in_use = 0;
+}
+
+int sim_next(struct sim_fabric *f, int h, uint64_t *due, int *length)
+{
+	struct sim_handle *sh = get_handle(f, h);
+
+	if (!sh || !sh->nheap)
+		return -1;
+	*due = sh->heap[0]->due;
+	*length = sh->heap[0]->length;
+	return 0;
+}
+
+int sim_take(struct sim_fabric *f, int h, void *umad)
+{
+	struct sim_handle *sh = get_handle(f, h);
+	struct sim_msg *m;
+	int agent;
+
+	if (!sh || !sh->nheap)
+		return -1;
+	m = heap_pop(sh);
+	memcpy(umad, m->umad, umad_size() + m->length);
+	agent = ((struct ib_user_mad *)m->umad)->agent_id;
+	free(m);
+	return agent;
+}
+
+void sim_get_port(struct sim_fabric *f, umad_port_t *port)
+{
+	memset(port, 0, sizeof(*port));
+	strncpy(port->ca_name, "sim0", sizeof(port->ca_name) - 1);
+	strncpy(port->link_layer, "InfiniBand", sizeof(port->link_layer) - 1);
+	port->portnum = f->local->portnum;
+	port->base_lid = f->local->lid;
+	port->lmc = f->local->lmc;
+	port->sm_lid = f->sm_lid;
+	port->state = 4;
+	port->phys_state = 5;
+	port->rate = 40;
+	port->gid_prefix = htobe64(SIM_GID_PREFIX);
+	port->port_guid = htobe64(f->local->guid);
+}
+
+/* a copy of the request, with room for a response of length bytes */
+static struct sim_msg *new_msg(void *umad, int req_len, int length)
+{
+	struct sim_msg *m;
+
+	if (!(m = calloc(1, sizeof(*m) + umad_size() + length)))
+		return NULL;
+	memcpy(m->umad, umad, umad_size() +
+	       (req_len < length ? req_len : length));
+	m->length = length;
+	return m;
+}
+
+/* MulticastForwardingTable block of a switch: one group, the broadcast
+ * MLID, flooded to every link */
+static void mft_block(struct sim_node *node, unsigned position,
+		      unsigned block, uint8_t *data)
+{
+	unsigned k;
+
+	memset(data, 0, IB_SMP_DATA_SIZE);
+	if (block)
+		return;
+	/* port masks are big endian, 16 ports per chunk */
+	for (k = 0; k < 16; k++) {
+		unsigned pn = position * 16 + k;
+
+		if (pn && pn <= (unsigned)node->nports &&
+		    node->ports[pn].remote)
+			data[1 - k / 8] |= 1 << (k % 8);
+	}
+}
+
+/* SMA: answer the SMP in mad, received by node on port in */
+static int sim_smp(struct sim_fabric *f, struct sim_node *node,
+		   struct sim_port *in, uint8_t *mad)
+{
+	uint8_t *data = mad + IB_SMP_DATA_OFFS;
+	int method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	unsigned mod = mad_get_field(mad, 0, IB_MAD_ATTRMOD_F);
+	struct sim_port *p;
+	unsigned block;
+
+	switch (mad_get_field(mad, 0, IB_MAD_ATTRID_F)) {
+	case IB_ATTR_NODE_DESC:
+		memcpy(data, node->desc, IB_SMP_DATA_SIZE);
+		break;
+	case IB_ATTR_NODE_INFO:
+		memcpy(data, node->info, IB_SMP_DATA_SIZE);
+		mad_set_field64(data, 0, IB_NODE_PORT_GUID_F, in->guid);
+		mad_set_field(data, 0, IB_NODE_LOCAL_PORT_F, in->portnum);
+		break;
+	case IB_ATTR_SWITCH_INFO:
+		if (node->type != IB_NODE_SWITCH)
+			return IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		memcpy(data, node->swinfo, IB_SMP_DATA_SIZE);
+		break;
+	case IB_ATTR_PORT_INFO:
+	case IB_ATTR_MLNX_EXT_PORT_INFO:
+		if (mod > (unsigned)node->nports)
+			return IB_MAD_STS_INV_ATTR_VALUE;
+		p = !mod && node->type != IB_NODE_SWITCH ? in : &node->ports[mod];
+		if (mad_get_field(mad, 0, IB_MAD_ATTRID_F) ==
+		    IB_ATTR_MLNX_EXT_PORT_INFO) {
+			memcpy(data, p->ext_info, IB_SMP_DATA_SIZE);
+			break;
+		}
+		memcpy(data, p->info, IB_SMP_DATA_SIZE);
+		mad_set_field(data, 0, IB_PORT_LOCAL_PORT_F, in->portnum);
+		break;
+	case IB_ATTR_LINEARFORWTBL:
+		if (node->type != IB_NODE_SWITCH)
+			return IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		block = mod & 0xffff;
+		if ((block + 1) * IB_SMP_DATA_SIZE > SIM_LFT_CAP)
+			return IB_MAD_STS_INV_ATTR_VALUE;
+		if (!node->lft && compute_lft(f, node) < 0)
+			return IB_MAD_STS_BUSY;
+		if (block * IB_SMP_DATA_SIZE > f->max_lid) {
+			memset(data, 0xff, IB_SMP_DATA_SIZE);
+			break;
+		}
+		if (method == IB_MAD_METHOD_SET)
+			memcpy(node->lft + block * IB_SMP_DATA_SIZE, data,
+			       IB_SMP_DATA_SIZE);
+		else
+			memcpy(data, node->lft + block * IB_SMP_DATA_SIZE,
+			       IB_SMP_DATA_SIZE);
+		break;
+	case IB_ATTR_MULTICASTFORWTBL:
+		if (node->type != IB_NODE_SWITCH)
+			return IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		block = mod & 0x1ff;
+		if ((block + 1) * (IB_SMP_DATA_SIZE / 2) > SIM_MFT_CAP ||
+		    (mod >> 28) * 16 > (unsigned)node->nports)
+			return IB_MAD_STS_INV_ATTR_VALUE;
+		if (method == IB_MAD_METHOD_SET)
+			return IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		mft_block(node, mod >> 28, block, data);
+		break;
+	default:
+		return IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+	}
+	return 0;
+}
+
+/* Data counters grow at the configured traffic rate from the last time
+ * they were cleared; packets are taken to be 2KB. */
+static uint64_t port_bytes(struct sim_fabric *f, struct sim_port *p,
+			   uint64_t now)
+{
+	if (!p->remote)
+		return 0;
+	return (uint64_t)(f->traffic * (double)(now - p->clear_ns));
+}
+
+static uint32_t sat32(uint64_t v)
+{
+	return v > 0xffffffffULL ? 0xffffffff : (uint32_t)v;
+}
+
+static uint32_t sat16(uint64_t v)
+{
+	return v > 0xffff ? 0xffff : (uint32_t)v;
+}
+
+/* PMA of node: PortCounters and PortCountersExtended from the model,
+ * everything else which the tools query reads as zero */
+static int sim_pma(struct sim_fabric *f, struct sim_node *node,
+		   uint8_t *mad, uint64_t now)
+{
+	uint8_t *data = mad + IB_PC_DATA_OFFS;
+	int method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	int attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	unsigned sel, first, last, k, i;
+	uint64_t bytes = 0, errs[SIM_NUM_ERRS] = { 0 };
+	uint16_t cap;
+	struct sim_port *p;
+
+	if (attr == CLASS_PORT_INFO) {
+		memset(data, 0, IB_PC_DATA_SZ);
+		cap = (1 << 9) | (1 << 12);	/* ExtWidth, PortXmitWait */
+		if (node->type == IB_NODE_SWITCH)
+			cap |= 1 << 8;		/* AllPortSelect */
+		mad_set_field(data, 0, IB_CPI_BASEVER_F, 1);
+		mad_set_field(data, 0, IB_CPI_CLASSVER_F, 1);
+		mad_set_field(data, 0, IB_CPI_CAPMASK_F, cap);
+		mad_set_field(data, 0, IB_CPI_RESP_TIME_VALUE_F, 18);
+		return 0;
+	}
+
+	sel = attr == IB_GSI_PORT_COUNTERS_EXT ?
+	    mad_get_field(data, 0, IB_PC_EXT_PORT_SELECT_F) :
+	    mad_get_field(data, 0, IB_PC_PORT_SELECT_F);
+	if (sel == 0xff && node->type == IB_NODE_SWITCH) {
+		first = 1;
+		last = node->nports;
+	} else if (sel <= (unsigned)node->nports &&
+		   (sel || node->type == IB_NODE_SWITCH)) {
+		first = last = sel;
+	} else
+		return IB_MAD_STS_INV_ATTR_VALUE;
+
+	if (attr != IB_GSI_PORT_COUNTERS && attr != IB_GSI_PORT_COUNTERS_EXT) {
+		memset(data + 8, 0, IB_PC_DATA_SZ - 8);
+		return 0;
+	}
+
+	for (k = first; k <= last; k++) {
+		p = &node->ports[k];
+		if (method == IB_MAD_METHOD_SET) {
+			sel = mad_get_field(data, 0, attr == IB_GSI_PORT_COUNTERS ?
+					    IB_PC_COUNTER_SELECT_F :
+					    IB_PC_EXT_COUNTER_SELECT_F);
+			if (attr == IB_GSI_PORT_COUNTERS_EXT ? sel & 0xff :
+			    sel & 0xf000)
+				p->clear_ns = now;
+			if (attr == IB_GSI_PORT_COUNTERS) {
+				if (sel & (1 << 0))
+					p->errs[0] = 0;
+				if (sel & (1 << 3))
+					p->errs[1] = 0;
+				if (sel & (1 << 6))
+					p->errs[2] = 0;
+			}
+		}
+		bytes += port_bytes(f, p, now);
+		for (i = 0; i < SIM_NUM_ERRS; i++)
+			errs[i] += p->errs[i];
+	}
+
+	if (attr == IB_GSI_PORT_COUNTERS_EXT) {
+		mad_set_field64(data, 0, IB_PC_EXT_XMT_BYTES_F, bytes / 4);
+		mad_set_field64(data, 0, IB_PC_EXT_RCV_BYTES_F, bytes / 4);
+		mad_set_field64(data, 0, IB_PC_EXT_XMT_PKTS_F, bytes / 2048);
+		mad_set_field64(data, 0, IB_PC_EXT_RCV_PKTS_F, bytes / 2048);
+		mad_set_field64(data, 0, IB_PC_EXT_XMT_UPKTS_F, bytes / 2048);
+		mad_set_field64(data, 0, IB_PC_EXT_RCV_UPKTS_F, bytes / 2048);
+		mad_set_field64(data, 0, IB_PC_EXT_XMT_MPKTS_F, 0);
+		mad_set_field64(data, 0, IB_PC_EXT_RCV_MPKTS_F, 0);
+		return 0;
+	}
+
+	mad_set_field(data, 0, IB_PC_ERR_SYM_F, sat16(errs[0]));
+	mad_set_field(data, 0, IB_PC_ERR_RCV_F, sat16(errs[1]));
+	mad_set_field(data, 0, IB_PC_XMT_DISCARDS_F, sat16(errs[2]));
+	mad_set_field(data, 0, IB_PC_XMT_BYTES_F, sat32(bytes / 4));
+	mad_set_field(data, 0, IB_PC_RCV_BYTES_F, sat32(bytes / 4));
+	mad_set_field(data, 0, IB_PC_XMT_PKTS_F, sat32(bytes / 2048));
+	mad_set_field(data, 0, IB_PC_RCV_PKTS_F, sat32(bytes / 2048));
+	mad_set_field(data, 0, IB_PC_XMT_WAIT_F, sat32(bytes / 65536));
+	return 0;
+}
+
+static uint16_t port_lid(struct sim_port *p)
+{
+	return p->node->type == IB_NODE_SWITCH ? p->node->ports[0].lid :
+	    p->lid;
+}
+
+/* the port a base LID belongs to, NULL for LMC aliases */
+static struct sim_port *base_lid_port(struct sim_fabric *f, unsigned lid)
+{
+	struct sim_port *p = find_lid(f, lid);
+
+	return p && port_lid(p) == lid ? p : NULL;
+}
+
+static struct sim_port *gid_port(uint8_t *gid, struct sim_fabric *f)
+{
+	uint64_t guid;
+
+	memcpy(&guid, gid + 8, sizeof(guid));
+	return find_guid(f, be64toh(guid));
+}
+
+static void make_gid(uint8_t *gid, uint64_t guid)
+{
+	uint64_t v = htobe64(SIM_GID_PREFIX);
+
+	memcpy(gid, &v, 8);
+	v = htobe64(guid);
+	memcpy(gid + 8, &v, 8);
+}
+
+/* LFTRecord has no libibmad fields: LID, BlockNum, 4 reserved bytes and
+ * the 64 byte block */
+static unsigned get_be16(uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static void put_be16(uint8_t *p, unsigned v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/* Fill rec with the next record for the query (cursor starts at 0), and
+ * return 1, or 0 once there are no more. */
+static int sa_next_record(struct sim_fabric *f, int attr, uint64_t comp,
+			  uint8_t *query, unsigned *cursor, uint8_t *rec)
+{
+	uint8_t gid[16];
+	struct sim_port *p, *q;
+	unsigned lid, block, nblocks, pos;
+
+	switch (attr) {
+	case IB_SA_ATTR_NODERECORD:
+		for (; *cursor <= f->max_lid; (*cursor)++) {
+			if (!(p = base_lid_port(f, *cursor)))
+				continue;
+			lid = *cursor;
+			if (comp & SIM_NR_LID &&
+			    mad_get_field(query, 0, IB_SA_NR_LID_F) != lid)
+				continue;
+			if (comp & SIM_NR_NODETYPE &&
+			    mad_get_field(query, 0, IB_SA_NR_TYPE_F) !=
+			    (unsigned)p->node->type)
+				continue;
+			if (comp & SIM_NR_NODEGUID &&
+			    mad_get_field64(query, 0, IB_SA_NR_GUID_F) !=
+			    p->node->guid)
+				continue;
+			if (comp & SIM_NR_PORTGUID &&
+			    mad_get_field64(query, 0, IB_SA_NR_PORT_GUID_F) !=
+			    p->guid)
+				continue;
+			memset(rec, 0, SIM_NR_RECSZ);
+			mad_set_field(rec, 0, IB_SA_NR_LID_F, lid);
+			memcpy(rec + 4, p->node->info, SIM_NODE_INFO_SIZE);
+			mad_set_field64(rec, 0, IB_SA_NR_PORT_GUID_F, p->guid);
+			mad_set_field(rec, 0, IB_SA_NR_LOCAL_PORT_F, p->portnum);
+			memcpy(rec + 4 + SIM_NODE_INFO_SIZE, p->node->desc,
+			       IB_SMP_DATA_SIZE);
+			(*cursor)++;
+			return 1;
+		}
+		return 0;
+	case IB_SA_ATTR_PATHRECORD:
+		q = NULL;
+		if (comp & SIM_PR_DGID) {
+			mad_decode_field(query, IB_SA_PR_DGID_F, gid);
+			if (!(q = gid_port(gid, f)))
+				return 0;
+		}
+		for (; *cursor <= f->max_lid; (*cursor)++) {
+			if (!(p = base_lid_port(f, *cursor)))
+				continue;
+			lid = *cursor;
+			if (q && p != q)
+				continue;
+			if (comp & SIM_PR_DLID &&
+			    mad_get_field(query, 0, IB_SA_PR_DLID_F) != lid)
+				continue;
+			memset(rec, 0, SIM_PR_RECSZ);
+			make_gid(gid, p->guid);
+			mad_encode_field(rec, IB_SA_PR_DGID_F, gid);
+			make_gid(gid, f->local->guid);
+			mad_encode_field(rec, IB_SA_PR_SGID_F, gid);
+			mad_set_field(rec, 0, IB_SA_PR_DLID_F, lid);
+			mad_set_field(rec, 0, IB_SA_PR_SLID_F,
+				      port_lid(f->local));
+			mad_set_field(rec, 0, IB_SA_PR_NPATH_F, 0x80 | 1);
+			(*cursor)++;
+			return 1;
+		}
+		return 0;
+	case IB_SA_ATTR_LFTRECORD:
+		nblocks = f->max_lid / IB_SMP_DATA_SIZE + 1;
+		for (; *cursor < f->nnodes * nblocks; (*cursor)++) {
+			p = &f->nodes[*cursor / nblocks].ports[0];
+			block = *cursor % nblocks;
+			if (p->node->type != IB_NODE_SWITCH)
+				continue;
+			if (comp & SIM_LFTR_LID && get_be16(query) != p->lid)
+				continue;
+			if (comp & SIM_LFTR_BLOCK && get_be16(query + 2) != block)
+				continue;
+			if (!p->node->lft && compute_lft(f, p->node) < 0)
+				return 0;
+			memset(rec, 0, SIM_LFTR_RECSZ);
+			put_be16(rec, p->lid);
+			put_be16(rec + 2, block);
+			memcpy(rec + 8, p->node->lft + block * IB_SMP_DATA_SIZE,
+			       IB_SMP_DATA_SIZE);
+			(*cursor)++;
+			return 1;
+		}
+		return 0;
+	case IB_SA_ATTR_MFTRECORD:
+		/* only block 0, the broadcast MLID, is in use */
+		for (; *cursor < f->nnodes * 16; (*cursor)++) {
+			p = &f->nodes[*cursor / 16].ports[0];
+			pos = *cursor % 16;
+			if (p->node->type != IB_NODE_SWITCH ||
+			    pos * 16 > (unsigned)p->node->nports)
+				continue;
+			if (comp & SIM_MFTR_LID && get_be16(query) != p->lid)
+				continue;
+			if (comp & SIM_MFTR_POSITION &&
+			    get_be16(query + 2) >> 12 != pos)
+				continue;
+			if (comp & SIM_MFTR_BLOCK &&
+			    (get_be16(query + 2) & 0x1ff) != 0)
+				continue;
+			memset(rec, 0, SIM_MFTR_RECSZ);
+			put_be16(rec, p->lid);
+			put_be16(rec + 2, pos << 12);
+			mft_block(p->node, pos, 0, rec + 8);
+			(*cursor)++;
+			return 1;
+		}
+		return 0;
+	}
+	return 0;
+}
+
+/* SA: Get answers with the first matching record, GetTable with all of
+ * them in one response as RMPP reassembly would deliver it */
+static struct sim_msg *sim_sa(struct sim_fabric *f, void *umad, int length,
+			      int *status)
+{
+	uint8_t *mad = umad_get_mad(umad), *query, *data;
+	uint8_t rec[SIM_NR_RECSZ];
+	int method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	int attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	uint64_t comp = mad_get_field64(mad, 0, IB_SA_COMPMASK_F);
+	unsigned cursor = 0, n = 0, recsz;
+	struct sim_msg *m;
+
+	query = mad + IB_SA_DATA_OFFS;
+	*status = 0;
+	switch (attr) {
+	case IB_SA_ATTR_NODERECORD:
+		recsz = SIM_NR_RECSZ;
+		break;
+	case IB_SA_ATTR_PATHRECORD:
+		recsz = SIM_PR_RECSZ;
+		break;
+	case IB_SA_ATTR_LFTRECORD:
+		recsz = SIM_LFTR_RECSZ;
+		break;
+	case IB_SA_ATTR_MFTRECORD:
+		recsz = SIM_MFTR_RECSZ;
+		break;
+	default:
+		*status = IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		return new_msg(umad, length, IB_MAD_SIZE);
+	}
+
+	if (method == IB_MAD_METHOD_GET) {
+		if (!(m = new_msg(umad, length, IB_MAD_SIZE)))
+			return NULL;
+		data = umad_get_mad(m->umad) + IB_SA_DATA_OFFS;
+		memset(data, 0, IB_SA_DATA_SIZE);
+		if (sa_next_record(f, attr, comp, query, &cursor, rec))
+			memcpy(data, rec, recsz);
+		else
+			*status = SIM_SA_NO_RECORDS;
+		return m;
+	}
+	if (method != IB_MAD_METHOD_GET_TABLE) {
+		*status = IB_MAD_STS_METHOD_NOT_SUPPORTED;
+		return new_msg(umad, length, IB_MAD_SIZE);
+	}
+
+	while (sa_next_record(f, attr, comp, query, &cursor, rec))
+		n++;
+	if (!(m = new_msg(umad, length, IB_SA_DATA_OFFS + n * recsz)))
+		return NULL;
+	data = umad_get_mad(m->umad);
+	mad_set_field(data, 0, IB_SA_ATTROFFS_F, recsz / 8);
+	data += IB_SA_DATA_OFFS;
+	for (cursor = 0; n--; data += recsz)
+		sa_next_record(f, attr, comp, query, &cursor, data);
+	return m;
+}
+
+/* Follow the initial path of a directed route SMP; returns the port it
+ * arrives on, or NULL if it is dropped on the way. */
+static struct sim_port *route_dr(struct sim_fabric *f, uint16_t dlid,
+				 uint8_t *mad)
+{
+	uint8_t *path = mad + 128;
+	int hops = mad_get_field(mad, 0, IB_DRSMP_HOPCNT_F), i;
+	struct sim_port *cur, *out;
+	struct sim_node *node;
+
+	if (dlid == 0xffff)
+		cur = f->local;
+	else if (!(cur = find_lid(f, dlid)))
+		return NULL;
+	else if (cur->node->type == IB_NODE_SWITCH)
+		cur = &cur->node->ports[0];
+
+	for (i = 1; i <= hops; i++) {
+		node = cur->node;
+		if (node->type == IB_NODE_SWITCH) {
+			if (!path[i] || path[i] > node->nports)
+				return NULL;
+			out = &node->ports[path[i]];
+		} else if (i == 1)
+			out = cur;
+		else
+			return NULL;	/* CAs don't forward */
+		if (!(cur = out->remote))
+			return NULL;
+	}
+	return cur;
+}
+
+static uint64_t sim_rand(struct sim_fabric *f)
+{
+	return (uint64_t)rand_r(&f->seed) * ((uint64_t)RAND_MAX + 1) +
+	    rand_r(&f->seed);
+}
+
+static int sim_lost(struct sim_fabric *f)
+{
+	return f->loss > 0 &&
+	    (double)sim_rand(f) / ((double)RAND_MAX + 1) /
+	    ((double)RAND_MAX + 1) < f->loss;
+}
+
+int sim_send(struct sim_fabric *f, int h, void *umad, int length)
+{
+	struct ib_user_mad *um = umad;
+	struct sim_handle *sh = get_handle(f, h);
+	uint8_t *mad = umad_get_mad(umad), *rmad;
+	int mgmt = mad_get_field(mad, 0, IB_MAD_MGMTCLASS_F);
+	int method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	uint16_t dlid = be16toh(um->addr.lid);
+	uint64_t now = sim_now(), due, timeout_ns;
+	struct sim_port *in = NULL;
+	struct sim_msg *m = NULL;
+	unsigned attempt;
+	int status = 0;
+
+	if (!sh)
+		return -EINVAL;
+	if (method & IB_MAD_RESPONSE)
+		return 0;
+	timeout_ns = (uint64_t)um->timeout_ms * 1000000;
+
+	for (attempt = 0; attempt <= um->retries; attempt++)
+		if (!sim_lost(f))
+			break;
+	if (attempt > um->retries)
+		goto timeout;
+
+	if (mgmt == IB_SMI_DIRECT_CLASS)
+		in = route_dr(f, dlid, mad);
+	else if ((in = find_lid(f, dlid)) &&
+		 in->node->type == IB_NODE_SWITCH)
+		in = &in->node->ports[0];
+	if (!in)
+		goto timeout;
+
+	now += attempt * timeout_ns + f->latency_ns / 2;
+	if (mgmt == IB_SMI_DIRECT_CLASS || mgmt == IB_SMI_CLASS) {
+		if (!(m = new_msg(umad, length, IB_MAD_SIZE)))
+			return -ENOMEM;
+		status = sim_smp(f, in->node, in, umad_get_mad(m->umad));
+		if (f->sma_rate) {
+			if (in->node->busy_until > now)
+				now = in->node->busy_until;
+			now += 1000000000ULL / f->sma_rate;
+			in->node->busy_until = now;
+		}
+	} else if (mgmt == IB_PERFORMANCE_CLASS) {
+		if (!(m = new_msg(umad, length, IB_MAD_SIZE)))
+			return -ENOMEM;
+		status = sim_pma(f, in->node, umad_get_mad(m->umad), now);
+	} else if (mgmt == IB_SA_CLASS) {
+		if (!(m = sim_sa(f, umad, length, &status)))
+			return -ENOMEM;
+	} else
+		goto timeout;
+	due = now + f->latency_ns / 2;
+
+	rmad = umad_get_mad(m->umad);
+	mad_set_field(rmad, 0, IB_MAD_METHOD_F,
+		      method == IB_MAD_METHOD_GET_TABLE ?
+		      IB_MAD_METHOD_GET_TABLE_RESPONSE :
+		      IB_MAD_METHOD_GET_RESPONSE);
+	if (mgmt == IB_SMI_DIRECT_CLASS) {
+		mad_set_field(rmad, 0, IB_DRSMP_STATUS_F, status);
+		mad_set_field(rmad, 0, IB_DRSMP_DIRECTION_F, 1);
+	} else {
+		mad_set_field(rmad, 0, IB_MAD_STATUS_F, status);
+		((struct ib_user_mad *)m->umad)->addr.lid =
+		    htobe16(port_lid(in));
+	}
+	((struct ib_user_mad *)m->umad)->status = 0;
+	goto queue;
+
+timeout:
+	if (!um->timeout_ms)
+		return 0;	/* no response was expected */
+	if (!(m = new_msg(umad, length, length)))
+		return -ENOMEM;
+	((struct ib_user_mad *)m->umad)->status = ETIMEDOUT;
+	due = sim_now() + (um->retries + 1) * timeout_ns;
+queue:
+	m->due = due;
+	m->seq = f->seq++;
+	if (heap_push(sh, m) < 0) {
+		free(m);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+struct sim_fabric *sim_fabric_create(const char *spec)
+{
+	struct sim_fabric *f;
+	char *str, *tok, *val, *save = NULL;
+	const char *cache = NULL;
+	unsigned S = 0, L = 0, H = 0, K = 0, i;
+	unsigned dfly[3] = { 0 }, torus[4] = { 0 };
+	int rc = -EINVAL;
+
+	if (!(f = calloc(1, sizeof(*f))) || !(str = strdup(spec))) {
+		free(f);
+		return NULL;
+	}
+	f->latency_ns = 20000;
+	f->seed = 1;
+
+	for (tok = strtok_r(str, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (!(val = strchr(tok, '='))) {
+			IBWARN("simulated fabric: bad spec item \"%s\"", tok);
+			goto err;
+		}
+		*val++ = '\0';
+		if (!strcmp(tok, "fattree")) {
+			if (sscanf(val, "%u:%u:%u", &S, &L, &H) == 3)
+				K = 0;
+			else if (sscanf(val, "%u", &K) == 1)
+				S = 0;
+			else {
+				IBWARN("simulated fabric: bad fattree \"%s\"",
+				       val);
+				goto err;
+			}
+		} else if (!strcmp(tok, "dragonfly")) {
+			if (sscanf(val, "%u:%u:%u", &dfly[0], &dfly[1],
+				   &dfly[2]) != 3) {
+				IBWARN("simulated fabric: bad dragonfly \"%s\"",
+				       val);
+				goto err;
+			}
+		} else if (!strcmp(tok, "torus")) {
+			if (sscanf(val, "%u:%u:%u:%u", &torus[0], &torus[1],
+				   &torus[2], &torus[3]) != 4) {
+				IBWARN("simulated fabric: bad torus \"%s\"",
+				       val);
+				goto err;
+			}
+		} else if (!strcmp(tok, "cache"))
+			cache = val;
+		else if (!strcmp(tok, "latency"))
+			f->latency_ns = strtoul(val, NULL, 0) * 1000;
+		else if (!strcmp(tok, "loss"))
+			f->loss = strtod(val, NULL) / 100;
+		else if (!strcmp(tok, "sma_rate"))
+			f->sma_rate = strtoul(val, NULL, 0);
+		else if (!strcmp(tok, "traffic"))
+			f->traffic = strtod(val, NULL) / 1000;
+		else if (!strcmp(tok, "errors"))
+			f->errors = strtoul(val, NULL, 0);
+		else if (!strcmp(tok, "seed"))
+			f->seed = strtoul(val, NULL, 0);
+		else {
+			IBWARN("simulated fabric: unknown key \"%s\"", tok);
+			goto err;
+		}
+	}
+
+	if (cache)
+		rc = build_from_cache(f, cache);
+	else if (S)
+		rc = build_fattree2(f, S, L, H);
+	else if (K)
+		rc = build_fattree3(f, K);
+	else if (dfly[0])
+		rc = build_dragonfly(f, dfly[0], dfly[1], dfly[2]);
+	else if (torus[0])
+		rc = build_torus(f, torus[0], torus[1], torus[2], torus[3]);
+	else
+		IBWARN("simulated fabric: no topology in \"%s\"", spec);
+	if (rc < 0)
+		goto err;
+
+	f->start_ns = sim_now();
+	for (i = 0; i < f->nport_used; i++)
+		f->port_mem[i].clear_ns = f->start_ns;
+	place_errors(f);
+	free(str);
+	return f;
+
+err:
+	free(str);
+	sim_fabric_destroy(f);
+	return NULL;
+}
+
+void sim_fabric_destroy(struct sim_fabric *f)
+{
+	unsigned i;
+
+	if (!f)
+		return;
+	for (i = 0; i < f->nhandles; i++)
+		sim_close(f, i);
+	for (i = 0; i < f->nnodes; i++)
+		free(f->nodes[i].lft);
+	free(f->handles);
+	free(f->nodes);
+	free(f->port_mem);
+	free(f->lids);
+	free(f->guids);
+	free(f->bfs_dist);
+	free(f->bfs_queue);
+	free(f->bfs_mask);
+	free(f);
+}
+
+/* In-process transport: every open port is a handle on one fabric. */
+static int sim_tp_open_port(struct ibmad_transport *tp, const char *ca_name,
+			    int portnum)
+{
+	int h = sim_open(tp->priv);
+
+	if (h < 0) {
+		errno = -h;
+		return -1;
+	}
+	return h + SIM_FD_BASE;
+}
+
+static int sim_tp_close_port(struct ibmad_transport *tp, int fd)
+{
+	sim_close(tp->priv, fd - SIM_FD_BASE);
+	return 0;
+}
+
+static int sim_tp_get_port(struct ibmad_transport *tp, const char *ca_name,
+			   int portnum, struct umad_port *port)
+{
+	sim_get_port(tp->priv, port);
+	return 0;
+}
+
+static int sim_tp_release_port(struct ibmad_transport *tp,
+			       struct umad_port *port)
+{
+	return 0;
+}
+
+static int sim_tp_register(struct ibmad_transport *tp, int fd, int mgmt_class,
+			   int mgmt_version, uint8_t rmpp_version,
+			   long method_mask[])
+{
+	struct sim_handle *sh = get_handle(tp->priv, fd - SIM_FD_BASE);
+
+	if (!sh) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	return sh->nagents++;
+}
+
+static int sim_tp_register_oui(struct ibmad_transport *tp, int fd,
+			       int mgmt_class, uint8_t rmpp_version,
+			       uint8_t oui[3], long method_mask[])
+{
+	return sim_tp_register(tp, fd, mgmt_class, 1, rmpp_version,
+			       method_mask);
+}
+
+static int sim_tp_unregister(struct ibmad_transport *tp, int fd, int agentid)
+{
+	return 0;
+}
+
+static void fill_send(void *umad, int agentid, int timeout_ms, int retries)
+{
+	struct ib_user_mad *um = umad;
+
+	um->agent_id = agentid;
+	um->timeout_ms = timeout_ms;
+	um->retries = retries;
+	um->status = 0;
+}
+
+static int sim_tp_send(struct ibmad_transport *tp, int fd, int agentid,
+		       void *umad, int length, int timeout_ms, int retries)
+{
+	int rc;
+
+	fill_send(umad, agentid, timeout_ms, retries);
+	if ((rc = sim_send(tp->priv, fd - SIM_FD_BASE, umad, length)) < 0)
+		errno = -rc;
+	return rc;
+}
+
+static int sim_tp_recv(struct ibmad_transport *tp, int fd, void *umad,
+		       int *length, int timeout_ms)
+{
+	struct sim_fabric *f = tp->priv;
+	int h = fd - SIM_FD_BASE, mlen;
+	uint64_t due, deadline = 0;
+
+	/* as with umad_recv(), a timeout of 0 blocks */
+	if (timeout_ms > 0)
+		deadline = sim_now() + (uint64_t)timeout_ms * 1000000;
+	if (sim_next(f, h, &due, &mlen) < 0 ||
+	    (timeout_ms > 0 && due > deadline)) {
+		/* nothing is in flight which could arrive in time */
+		if (timeout_ms > 0)
+			sleep_until(deadline);
+		errno = ETIMEDOUT;
+		return -ETIMEDOUT;
+	}
+	sleep_until(due);
+	if (*length < mlen) {
+		*length = mlen;
+		errno = ENOSPC;
+		return -ENOSPC;
+	}
+	*length = mlen;
+	return sim_take(f, h, umad);
+}
+
+/* Client side of an ibdiagsim server: the socket is the port fd, and
+ * responses arrive as RECV frames when they are due. */
+struct sim_pending {
+	int fd;
+	uint32_t length;
+	void *buf;
+	struct sim_pending *next;
+};
+
+struct sim_client {
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	int next_agent;
+	struct sim_pending *pending;
+};
+
+int sim_write_frame(int fd, uint32_t type, const void *buf, uint32_t length)
+{
+	struct sim_frame hdr = { type, length };
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+		return -EIO;
+	while (length) {
+		if ((n = write(fd, p, length)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -EIO;
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+static int read_full(int fd, void *buf, size_t length)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (length) {
+		if ((n = read(fd, p, length)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -EIO;
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+/* read one frame; *buf is malloced and must be freed by the caller */
+int sim_read_frame(int fd, uint32_t *type, void **buf, uint32_t *length)
+{
+	struct sim_frame hdr;
+
+	if (read_full(fd, &hdr, sizeof(hdr)) < 0)
+		return -EIO;
+	if (hdr.length > SIM_FRAME_MAX || !(*buf = malloc(hdr.length + 1)))
+		return -EIO;
+	if (read_full(fd, *buf, hdr.length) < 0) {
+		free(*buf);
+		return -EIO;
+	}
+	*type = hdr.type;
+	*length = hdr.length;
+	return 0;
+}
+
+static int client_connect(struct sim_client *c)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, c->path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		IBWARN("can't connect to %s: %s", c->path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int client_open_port(struct ibmad_transport *tp, const char *ca_name,
+			    int portnum)
+{
+	return client_connect(tp->priv);
+}
+
+static int client_close_port(struct ibmad_transport *tp, int fd)
+{
+	struct sim_client *c = tp->priv;
+	struct sim_pending **pp = &c->pending, *p;
+
+	while ((p = *pp)) {
+		if (p->fd == fd) {
+			*pp = p->next;
+			free(p->buf);
+			free(p);
+		} else
+			pp = &p->next;
+	}
+	return close(fd);
+}
+
+static int client_get_port(struct ibmad_transport *tp, const char *ca_name,
+			   int portnum, struct umad_port *port)
+{
+	uint32_t type, length;
+	void *buf = NULL;
+	int fd, rc = -1;
+
+	if ((fd = client_connect(tp->priv)) < 0)
+		return -1;
+	if (!sim_write_frame(fd, SIM_FRAME_GETPORT, NULL, 0) &&
+	    !sim_read_frame(fd, &type, &buf, &length)) {
+		if (type == SIM_FRAME_GETPORT && length == sizeof(*port)) {
+			memcpy(port, buf, sizeof(*port));
+			port->pkeys = NULL;
+			port->pkeys_size = 0;
+			rc = 0;
+		}
+		free(buf);
+	}
+	close(fd);
+	return rc;
+}
+
+static int client_register(struct ibmad_transport *tp, int fd, int mgmt_class,
+			   int mgmt_version, uint8_t rmpp_version,
+			   long method_mask[])
+{
+	return ((struct sim_client *)tp->priv)->next_agent++;
+}
+
+static int client_register_oui(struct ibmad_transport *tp, int fd,
+			       int mgmt_class, uint8_t rmpp_version,
+			       uint8_t oui[3], long method_mask[])
+{
+	return ((struct sim_client *)tp->priv)->next_agent++;
+}
+
+static int client_send(struct ibmad_transport *tp, int fd, int agentid,
+		       void *umad, int length, int timeout_ms, int retries)
+{
+	fill_send(umad, agentid, timeout_ms, retries);
+	if (sim_write_frame(fd, SIM_FRAME_SEND, umad, umad_size() + length)) {
+		errno = EIO;
+		return -EIO;
+	}
+	return 0;
+}
+
+static int client_recv(struct ibmad_transport *tp, int fd, void *umad,
+		       int *length, int timeout_ms)
+{
+	struct sim_client *c = tp->priv;
+	struct sim_pending **pp, *p;
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	uint32_t type, len;
+	void *buf;
+	int mlen, rc;
+
+	for (pp = &c->pending; *pp && (*pp)->fd != fd; pp = &(*pp)->next)
+		;
+	if ((p = *pp)) {
+		*pp = p->next;
+		buf = p->buf;
+		len = p->length;
+		free(p);
+	} else {
+		do {
+			rc = poll(&pfd, 1, timeout_ms ? timeout_ms : -1);
+		} while (rc < 0 && errno == EINTR);
+		if (rc == 0) {
+			errno = ETIMEDOUT;
+			return -ETIMEDOUT;
+		}
+		if (rc < 0 || sim_read_frame(fd, &type, &buf, &len) < 0) {
+			errno = EIO;
+			return -EIO;
+		}
+		if (type != SIM_FRAME_RECV || len < umad_size()) {
+			free(buf);
+			errno = EIO;
+			return -EIO;
+		}
+	}
+
+	mlen = len - umad_size();
+	if (*length < mlen) {
+		/* keep it for the retry with a larger buffer */
+		if (!(p = malloc(sizeof(*p)))) {
+			free(buf);
+			errno = ENOMEM;
+			return -ENOMEM;
+		}
+		p->fd = fd;
+		p->buf = buf;
+		p->length = len;
+		p->next = c->pending;
+		c->pending = p;
+		*length = mlen;
+		errno = ENOSPC;
+		return -ENOSPC;
+	}
+	memcpy(umad, buf, len);
+	free(buf);
+	*length = mlen;
+	return ((struct ib_user_mad *)umad)->agent_id;
+}
+
+struct ibmad_transport *sim_transport_create(const char *spec)
+{
+	struct ibmad_transport *tp;
+	struct sim_client *c;
+
+	if (!(tp = calloc(1, sizeof(*tp))))
+		return NULL;
+
+	if (!strncmp(spec, "unix=", 5)) {
+		if (strlen(spec + 5) >= sizeof(c->path) ||
+		    !(c = calloc(1, sizeof(*c)))) {
+			free(tp);
+			return NULL;
+		}
+		strcpy(c->path, spec + 5);
+		tp->name = "ibdiagsim";
+		tp->priv = c;
+		tp->open_port = client_open_port;
+		tp->close_port = client_close_port;
+		tp->get_port = client_get_port;
+		tp->release_port = sim_tp_release_port;
+		tp->register_agent = client_register;
+		tp->register_oui = client_register_oui;
+		tp->unregister_agent = sim_tp_unregister;
+		tp->send = client_send;
+		tp->recv = client_recv;
+		return tp;
+	}
+
+	if (!(tp->priv = sim_fabric_create(spec))) {
+		free(tp);
+		return NULL;
+	}
+	tp->name = "sim";
+	tp->open_port = sim_tp_open_port;
+	tp->close_port = sim_tp_close_port;
+	tp->get_port = sim_tp_get_port;
+	tp->release_port = sim_tp_release_port;
+	tp->register_agent = sim_tp_register;
+	tp->register_oui = sim_tp_register_oui;
+	tp->unregister_agent = sim_tp_unregister;
+	tp->send = sim_tp_send;
+	tp->recv = sim_tp_recv;
+	return tp;
+}
+
+int ibdiag_sim_setup(void)
+{
+	const char *spec = getenv(IBDIAG_SIM_ENV);
+	struct ibmad_transport *tp;
+
+	if (!spec || !*spec)
+		return 0;
+	if (!(tp = sim_transport_create(spec)))
+		IBPANIC("can't set up simulated fabric \"%s\"", spec);
+	mad_set_transport(tp);
+	return 1;
+}
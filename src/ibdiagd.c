@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+ * ibdiagd: keep the fabric in memory, rescanning it in the background, and
+ * hand it to the tools run with --daemon over a UNIX socket.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <infiniband/mad.h>
+#include <infiniband/ibnetdisc.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_daemon.h"
+
+#define DEFAULT_INTERVAL 60
+/* the whole exchange with a client, request and reply, must fit in this */
+#define CLIENT_TIMEOUT_MS 5000
+/* connections beyond this many are closed unanswered */
+#define MAX_CLIENTS 64
+
+struct snapshot {
+	uint64_t generation;
+	uint64_t sweep_time;
+	size_t length;
+	void *buf;
+	unsigned refs;		/* current, plus the clients sending it */
+};
+
+static char *socket_path = IBDIAGD_SOCKET;
+static unsigned interval = DEFAULT_INTERVAL;
+static struct ibnd_config config;
+
+/* current is replaced by the sweeper and read by the client threads */
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct snapshot *current;
+static unsigned nclients;
+
+static volatile sig_atomic_t quit;
+
+static int process_opt(void *context, int ch, char *optarg)
+{
+	switch (ch) {
+	case 1:
+		socket_path = optarg;
+		break;
+	case 2:
+		interval = strtoul(optarg, NULL, 0);
+		if (!interval)
+			IBEXIT("bad interval %s", optarg);
+		break;
+	case 'o':
+		config.max_smps = strtoul(optarg, NULL, 0);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static struct snapshot *get_snapshot(void)
+{
+	struct snapshot *s;
+
+	pthread_mutex_lock(&snap_lock);
+	if ((s = current))
+		s->refs++;
+	pthread_mutex_unlock(&snap_lock);
+	return s;
+}
+
+static void put_snapshot(struct snapshot *s)
+{
+	unsigned refs;
+
+	if (!s)
+		return;
+	pthread_mutex_lock(&snap_lock);
+	refs = --s->refs;
+	pthread_mutex_unlock(&snap_lock);
+	if (!refs) {
+		free(s->buf);
+		free(s);
+	}
+}
+
+static void publish(ibnd_fabric_t * fabric, uint64_t generation)
+{
+	struct snapshot *s, *old;
+
+	if (!(s = calloc(1, sizeof(*s))) ||
+	    ibnd_cache_fabric_buf(fabric, &s->buf, &s->length) < 0) {
+		IBWARN("can't serialize the fabric; keeping the last one");
+		free(s);
+		return;
+	}
+	s->generation = generation;
+	s->sweep_time = time(NULL);
+	s->refs = 1;
+
+	pthread_mutex_lock(&snap_lock);
+	old = current;
+	current = s;
+	pthread_mutex_unlock(&snap_lock);
+	put_snapshot(old);
+}
+
+static unsigned count_changes(ibnd_change_t * c)
+{
+	unsigned n = 0;
+
+	for (; c; c = c->next)
+		n++;
+	return n;
+}
+
+/* rescan against the previous fabric every interval; only the parts which
+ * changed are scanned in full */
+static void *sweeper(void *arg)
+{
+	ibnd_fabric_t *fabric = arg, *next;
+	ibnd_change_t *changes;
+	uint64_t generation = 1;
+	unsigned n;
+
+	for (;;) {
+		sleep(interval);
+
+		if (!(next = ibnd_rediscover_fabric(fabric, ibd_ca,
+						    ibd_ca_port, NULL,
+						    &config, &changes))) {
+			IBWARN("sweep failed; keeping the last fabric");
+			continue;
+		}
+		n = count_changes(changes);
+		ibnd_destroy_fabric(fabric);
+		fabric = next;
+		if (n) {
+			generation++;
+			VERBOSE("%u changes; fabric generation %" PRIu64, n,
+				generation);
+		}
+		publish(fabric, generation);
+	}
+	return NULL;
+}
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		IBEXIT("socket path too long: %s", path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		IBEXIT("socket: %s", strerror(errno));
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* only a socket nobody answers on is left over and may go */
+	if (!lstat(path, &st)) {
+		if (!S_ISSOCK(st.st_mode))
+			IBEXIT("%s exists and is not a socket", path);
+		if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			IBEXIT("an ibdiagd is already serving %s", path);
+		if (errno != ECONNREFUSED)
+			IBEXIT("can't check %s: %s", path, strerror(errno));
+		close(fd);
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			IBEXIT("socket: %s", strerror(errno));
+		unlink(path);
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0)
+		IBEXIT("can't listen on %s: %s", path, strerror(errno));
+	return fd;
+}
+
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* read or write all of buf on the non-blocking fd by deadline */
+static int client_io(int fd, void *buf, size_t length, int writing,
+		     int64_t deadline)
+{
+	struct pollfd pfd = { fd, writing ? POLLOUT : POLLIN };
+	uint8_t *p = buf;
+	int64_t left;
+	ssize_t n;
+
+	while (length) {
+		n = writing ? write(fd, p, length) : read(fd, p, length);
+		if (n > 0) {
+			p += n;
+			length -= n;
+			continue;
+		}
+		if (!n || (errno != EAGAIN && errno != EINTR))
+			return -EIO;
+		if ((left = deadline - now_ms()) <= 0)
+			return -ETIMEDOUT;
+		if (poll(&pfd, 1, left) < 0 && errno != EINTR)
+			return -EIO;
+	}
+	return 0;
+}
+
+/* answer the one request of a connection from the current snapshot */
+static void serve_client(int fd)
+{
+	int64_t deadline = now_ms() + CLIENT_TIMEOUT_MS;
+	struct ibdiagd_reply rep = { IBDIAGD_MAGIC };
+	struct snapshot *s = NULL;
+	struct ibdiagd_req req;
+	int rc;
+
+	if ((rc = client_io(fd, &req, sizeof(req), 0, deadline)) < 0)
+		goto out;
+
+	if (req.magic != IBDIAGD_MAGIC || req.version != IBDIAGD_VERSION ||
+	    req.op != IBDIAGD_OP_FABRIC)
+		rep.status = IBDIAGD_BAD_REQUEST;
+	else if (!(s = get_snapshot()))
+		rep.status = IBDIAGD_NO_FABRIC;
+	else {
+		rep.status = IBDIAGD_OK;
+		rep.generation = s->generation;
+		rep.sweep_time = s->sweep_time;
+		rep.length = s->length;
+	}
+
+	if (!(rc = client_io(fd, &rep, sizeof(rep), 1, deadline)) && s)
+		rc = client_io(fd, s->buf, s->length, 1, deadline);
+	put_snapshot(s);
+out:
+	if (rc == -ETIMEDOUT)
+		DEBUG("client %d too slow; dropped", fd);
+	else if (rc)
+		DEBUG("client %d went away", fd);
+}
+
+static void *client_thread(void *arg)
+{
+	int fd = (int)(intptr_t) arg;
+
+	serve_client(fd);
+	close(fd);
+
+	pthread_mutex_lock(&snap_lock);
+	nclients--;
+	pthread_mutex_unlock(&snap_lock);
+	return NULL;
+}
+
+/* every client gets a thread, so a slow one holds up nobody else */
+static void serve(int lfd)
+{
+	struct pollfd pfd = { lfd, POLLIN };
+	sigset_t set, oldset;
+	pthread_attr_t attr;
+	pthread_t tid;
+	int fd, busy, err;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	/* as for the sweeper, the signals are for this loop to see */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+
+	while (!quit) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			IBEXIT("poll: %s", strerror(errno));
+		}
+		if ((fd = accept(lfd, NULL, NULL)) < 0)
+			continue;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		pthread_mutex_lock(&snap_lock);
+		if (!(busy = nclients >= MAX_CLIENTS))
+			nclients++;
+		pthread_mutex_unlock(&snap_lock);
+		if (busy) {
+			DEBUG("%u clients already; refusing one", MAX_CLIENTS);
+			close(fd);
+			continue;
+		}
+		pthread_sigmask(SIG_BLOCK, &set, &oldset);
+		err = pthread_create(&tid, &attr, client_thread,
+				     (void *)(intptr_t) fd);
+		pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+		if (err) {
+			IBWARN("can't start a client thread");
+			close(fd);
+			pthread_mutex_lock(&snap_lock);
+			nclients--;
+			pthread_mutex_unlock(&snap_lock);
+		}
+	}
+	pthread_attr_destroy(&attr);
+}
+
+int main(int argc, char **argv)
+{
+	const struct ibdiag_opt opts[] = {
+		{"socket", 1, 1, "<path>",
+		 "UNIX socket to serve on, default " IBDIAGD_SOCKET},
+		{"interval", 2, 1, "<sec>",
+		 "seconds between sweeps of the fabric (default 60)"},
+		{"outstanding_smps", 'o', 1, NULL,
+		 "specify the number of outstanding SMP's which should be "
+		 "issued during a sweep"},
+		{0}
+	};
+	const char *usage_examples[] = {
+		"\t\t\t# serve the fabric on " IBDIAGD_SOCKET,
+		"--socket /tmp/ibdiagd --interval 10",
+		NULL
+	};
+	struct sigaction sa = { .sa_handler = on_signal };
+	ibnd_fabric_t *fabric;
+	sigset_t set, oldset;
+	pthread_t tid;
+	int lfd;
+
+	ibdiag_process_opts(argc, argv, &config, "DGKLs", opts, process_opt,
+			    NULL, usage_examples);
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc)
+		ibdiag_show_usage();
+
+	if (ibd_timeout)
+		config.timeout_ms = ibd_timeout;
+	config.flags = ibd_ibnetdisc_flags;
+	config.mkey = ibd_mkey;
+
+	if (!(fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL,
+					    &config)))
+		IBEXIT("discover failed");
+	publish(fabric, 1);
+
+	signal(SIGPIPE, SIG_IGN);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	lfd = listen_on(socket_path);
+
+	/* the signals are for the server loop to see */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	if ((errno = pthread_create(&tid, NULL, sweeper, fabric)))
+		IBEXIT("can't start the sweeper: %s", strerror(errno));
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	serve(lfd);
+
+	close(lfd);
+	unlink(socket_path);
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+ * ibdiagsim: serve a simulated fabric over a UNIX socket so that several
+ * diag processes can share one model (IBDIAG_SIM=unix=PATH).
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_sim.h"
+
+#define MAX_CLIENTS 256
+
+static char *socket_path;
+
+struct client {
+	int fd;
+	int h;
+};
+
+static struct client clients[MAX_CLIENTS];
+static unsigned nclients;
+
+static int process_opt(void *context, int ch, char *optarg)
+{
+	switch (ch) {
+	case 1:
+		socket_path = optarg;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		IBEXIT("socket path too long: %s", path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		IBEXIT("socket: %s", strerror(errno));
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0)
+		IBEXIT("can't listen on %s: %s", path, strerror(errno));
+	return fd;
+}
+
+static void drop_client(struct sim_fabric *f, unsigned i)
+{
+	DEBUG("client %d closed", clients[i].fd);
+	sim_close(f, clients[i].h);
+	close(clients[i].fd);
+	clients[i] = clients[--nclients];
+}
+
+/* handle one frame from client i; returns -1 if it should be dropped */
+static int client_frame(struct sim_fabric *f, unsigned i)
+{
+	umad_port_t port;
+	uint32_t type, length;
+	void *buf;
+	int rc = 0;
+
+	if (sim_read_frame(clients[i].fd, &type, &buf, &length) < 0)
+		return -1;
+	switch (type) {
+	case SIM_FRAME_GETPORT:
+		sim_get_port(f, &port);
+		rc = sim_write_frame(clients[i].fd, SIM_FRAME_GETPORT, &port,
+				     sizeof(port));
+		break;
+	case SIM_FRAME_SEND:
+		if (length < umad_size() + IB_MAD_SIZE ||
+		    sim_send(f, clients[i].h, buf, length - umad_size()) < 0)
+			rc = -1;
+		break;
+	default:
+		IBWARN("unknown frame type %u", type);
+		rc = -1;
+	}
+	free(buf);
+	return rc;
+}
+
+/* send everything which is due; returns the earliest time still pending */
+static uint64_t deliver(struct sim_fabric *f, uint64_t now)
+{
+	uint64_t due, next = UINT64_MAX;
+	unsigned i;
+	void *buf;
+	int length;
+
+	for (i = 0; i < nclients; i++) {
+		while (!sim_next(f, clients[i].h, &due, &length)) {
+			if (due > now) {
+				if (due < next)
+					next = due;
+				break;
+			}
+			if (!(buf = malloc(umad_size() + length)))
+				IBEXIT("out of memory");
+			sim_take(f, clients[i].h, buf);
+			if (sim_write_frame(clients[i].fd, SIM_FRAME_RECV, buf,
+					    umad_size() + length) < 0) {
+				free(buf);
+				drop_client(f, i--);
+				break;
+			}
+			free(buf);
+		}
+	}
+	return next;
+}
+
+static void serve(struct sim_fabric *f, int lfd)
+{
+	struct pollfd pfd[MAX_CLIENTS + 1];
+	struct timespec ts, *tsp;
+	uint64_t next, now;
+	unsigned i, n;
+	int fd, h;
+
+	for (;;) {
+		now = sim_now();
+		next = deliver(f, now);
+		if (next == UINT64_MAX)
+			tsp = NULL;
+		else {
+			now = sim_now();
+			next = next > now ? next - now : 0;
+			ts.tv_sec = next / 1000000000ULL;
+			ts.tv_nsec = next % 1000000000ULL;
+			tsp = &ts;
+		}
+
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < nclients; i++) {
+			pfd[i + 1].fd = clients[i].fd;
+			pfd[i + 1].events = POLLIN;
+		}
+		n = nclients;
+		if (ppoll(pfd, n + 1, tsp, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			IBEXIT("poll: %s", strerror(errno));
+		}
+
+		/* from the end, so that dropping a client doesn't move one
+		 * which is still to be looked at */
+		for (i = n; i > 0; i--)
+			if (pfd[i].revents && client_frame(f, i - 1) < 0)
+				drop_client(f, i - 1);
+
+		if (pfd[0].revents & POLLIN) {
+			if ((fd = accept(lfd, NULL, NULL)) < 0)
+				continue;
+			if (nclients == MAX_CLIENTS ||
+			    (h = sim_open(f)) < 0) {
+				IBWARN("too many clients");
+				close(fd);
+				continue;
+			}
+			clients[nclients].fd = fd;
+			clients[nclients++].h = h;
+			DEBUG("client %d connected", fd);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const struct ibdiag_opt opts[] = {
+		{"socket", 1, 1, "<path>", "UNIX socket to serve on"},
+		{0}
+	};
+	char usage_args[] = "<fabric spec>";
+	const char *usage_examples[] = {
+		"--socket /tmp/sim fattree=4:16:16\t# 256 hosts",
+		"--socket /tmp/sim cache=fabric.cache,latency=50,loss=1",
+		NULL
+	};
+	struct sim_fabric *f;
+	int lfd;
+
+	ibdiag_process_opts(argc, argv, NULL, "CDGKLPesty", opts, process_opt,
+			    usage_args, usage_examples);
+
+	argc -= optind;
+	argv += optind;
+
+	if (!socket_path || argc != 1)
+		ibdiag_show_usage();
+
+	if (!(f = sim_fabric_create(argv[0])))
+		IBEXIT("can't create simulated fabric \"%s\"", argv[0]);
+	signal(SIGPIPE, SIG_IGN);
+	lfd = listen_on(socket_path);
+	serve(f, lfd);
+	return 0;
+}
@@ -64,6 +64,7 @@
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
 static char *load_cache_file = NULL;
+static char *rediscover_file = NULL;
 static char *diff_cache_file = NULL;
 static unsigned diffcheck_flags = DIFF_FLAG_DEFAULT;
 static char *filterdownports_cache_file = NULL;
@@ -104,24 +105,113 @@ int filterdownport_check(ibnd_node_t * node, ibnd_port_t * port)
 	return (fistate == IB_LINK_DOWN) ? 1 : 0;
 }
 
+static struct ibdiag_out out;
+
+static void out_str(const char *str)
+{
+	if (str)
+		ibdiag_out_str(&out, str);
+}
+
+/* "%6d %4d[%2s]": LID, port and external port number */
+static void out_lid_port(int lid, ibnd_port_t * port)
+{
+	ibdiag_out_int(&out, lid, 6);
+	ibdiag_out_char(&out, ' ');
+	ibdiag_out_int(&out, port->portnum, 4);
+	ibdiag_out_char(&out, '[');
+	if (port->ext_portnum)
+		ibdiag_out_int(&out, port->ext_portnum, 2);
+	else
+		out_str("  ");
+	ibdiag_out_char(&out, ']');
+}
+
+static const struct ibdiag_field port_fields[] = {
+	{"node_guid", IBDIAG_FIELD_GUID},
+	{"node_desc", IBDIAG_FIELD_STR},
+	{"node_type", IBDIAG_FIELD_UINT},
+	{"port_guid", IBDIAG_FIELD_GUID},
+	{"lid", IBDIAG_FIELD_UINT},
+	{"port", IBDIAG_FIELD_UINT},
+	{"ext_port", IBDIAG_FIELD_UINT},
+	{"link_width_active", IBDIAG_FIELD_UINT},
+	{"link_speed_active", IBDIAG_FIELD_UINT},
+	{"link_speed_ext_active", IBDIAG_FIELD_UINT},
+	{"fdr10", IBDIAG_FIELD_UINT},
+	{"state", IBDIAG_FIELD_UINT},
+	{"phys_state", IBDIAG_FIELD_UINT},
+	{"remote_node_guid", IBDIAG_FIELD_GUID},
+	{"remote_node_desc", IBDIAG_FIELD_STR},
+	{"remote_port_guid", IBDIAG_FIELD_GUID},
+	{"remote_lid", IBDIAG_FIELD_UINT},
+	{"remote_port", IBDIAG_FIELD_UINT},
+	{"remote_ext_port", IBDIAG_FIELD_UINT},
+	{0}
+};
+
+static struct ibdiag_rec rec;
+
+/* --format: the port as a record with the raw PortInfo values */
+static void print_port_rec(ibnd_node_t * node, ibnd_port_t * port,
+			   struct ib_portinfo_decoded *pi, int iwidth,
+			   int ispeed, int espeed, int fdr10)
+{
+	ibnd_port_t *rport = port->remoteport;
+
+	ibdiag_rec_begin(&rec);
+	ibdiag_rec_uint(&rec, node->guid);
+	ibdiag_rec_str(&rec, ibdiag_remap_node_name(node_name_map, node->guid,
+						    node->nodedesc));
+	ibdiag_rec_uint(&rec, node->type);
+	ibdiag_rec_uint(&rec, port->guid);
+	ibdiag_rec_uint(&rec, node->type == IB_NODE_SWITCH ?
+			node->smalid : port->base_lid);
+	ibdiag_rec_uint(&rec, port->portnum);
+	ibdiag_rec_uint(&rec, port->ext_portnum);
+	ibdiag_rec_uint(&rec, iwidth);
+	ibdiag_rec_uint(&rec, ispeed);
+	ibdiag_rec_uint(&rec, espeed);
+	ibdiag_rec_uint(&rec, !!fdr10);
+	ibdiag_rec_uint(&rec, pi->state);
+	ibdiag_rec_uint(&rec, pi->phys_state);
+	if (rport) {
+		ibdiag_rec_uint(&rec, rport->node->guid);
+		ibdiag_rec_str(&rec,
+			       ibdiag_remap_node_name(node_name_map,
+						      rport->node->guid,
+						      rport->node->nodedesc));
+		ibdiag_rec_uint(&rec, rport->guid);
+		ibdiag_rec_uint(&rec, rport->base_lid ? rport->base_lid :
+				rport->node->smalid);
+		ibdiag_rec_uint(&rec, rport->portnum);
+		ibdiag_rec_uint(&rec, rport->ext_portnum);
+	} else {
+		ibdiag_rec_uint(&rec, 0);
+		ibdiag_rec_str(&rec, "");
+		ibdiag_rec_uint(&rec, 0);
+		ibdiag_rec_uint(&rec, 0);
+		ibdiag_rec_uint(&rec, 0);
+		ibdiag_rec_uint(&rec, 0);
+	}
+	ibdiag_rec_end(&rec);
+}
+
 void print_port(ibnd_node_t * node, ibnd_port_t * port, char *out_prefix)
 {
 	char width[64], speed[64], state[64], physstate[64];
-	char remote_guid_str[256];
-	char remote_str[256];
-	char link_str[256];
 	char width_msg[256];
 	char speed_msg[256];
-	char ext_port_str[256];
 	int iwidth, ispeed, fdr10, espeed, istate, iphystate, cap_mask;
-	int n = 0;
 	uint8_t *info = NULL;
+	struct ib_portinfo_decoded pi;
 
 	if (!port)
 		return;
 
-	iwidth = mad_get_field(port->info, 0, IB_PORT_LINK_WIDTH_ACTIVE_F);
-	ispeed = mad_get_field(port->info, 0, IB_PORT_LINK_SPEED_ACTIVE_F);
+	mad_decode_portinfo(port->info, &pi);
+	iwidth = pi.link_width_active;
+	ispeed = pi.link_speed_active;
 	fdr10 = mad_get_field(port->ext_info, 0,
 			      IB_MLNX_EXT_PORT_LINK_SPEED_ACTIVE_F) & FDR10;
 
@@ -135,8 +225,7 @@ void print_port(ibnd_node_t * node, ibnd_port_t * port, char *out_prefix)
 	if (info) {
 		cap_mask = mad_get_field(info, 0, IB_PORT_CAPMASK_F);
 		if (cap_mask & CL_NTOH32(IB_PORT_CAP_HAS_EXT_SPEEDS))
-			espeed = mad_get_field(port->info, 0,
-					       IB_PORT_LINK_SPEED_EXT_ACTIVE_F);
+			espeed = pi.link_speed_ext_active;
 		else
 			espeed = 0;
 	} else {
@@ -145,23 +234,50 @@ void print_port(ibnd_node_t * node, ibnd_port_t * port, char *out_prefix)
 		espeed = 0;
 	}
 
-	istate = mad_get_field(port->info, 0, IB_PORT_STATE_F);
-	iphystate = mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F);
-
-	remote_guid_str[0] = '\0';
-	remote_str[0] = '\0';
-	link_str[0] = '\0';
-	width_msg[0] = '\0';
-	speed_msg[0] = '\0';
+	istate = pi.state;
+	iphystate = pi.phys_state;
 
 	if (istate == IB_LINK_DOWN
 	    && filterdownports_fabric
 	    && filterdownport_check(node, port))
 		return;
 
+	if (ibd_format != IBDIAG_FORMAT_TEXT) {
+		print_port_rec(node, port, &pi, iwidth, ispeed, espeed, fdr10);
+		return;
+	}
+
+	/* "%s0x%016" PRIx64 " \"%30s\" " in line mode, else "%s      " */
+	out_str(out_prefix);
+	if (line_mode) {
+		out_str("0x");
+		ibdiag_out_hex(&out, port->guid, 16);
+		out_str(" \"");
+		ibdiag_out_pad(&out, ibdiag_remap_node_name(node_name_map,
+							    node->guid,
+							    node->nodedesc),
+			       30);
+		out_str("\" ");
+	} else
+		out_str("      ");
+
+	/* "0x%016" PRIx64 " " for CAs, then "%6d %4d[%2s] ==" */
+	if (port->node->type != IB_NODE_SWITCH) {
+		if (!line_mode) {
+			out_str("0x");
+			ibdiag_out_hex(&out, port->guid, 16);
+			ibdiag_out_char(&out, ' ');
+		}
+		out_lid_port(port->base_lid, port);
+	} else
+		out_lid_port(node->smalid, port);
+	out_str(" ==");
+
 	/* C14-24.2.1 states that a down port allows for invalid data to be
 	 * returned for all PortInfo components except PortState and
 	 * PortPhysicalState */
+	mad_dump_val(IB_PORT_STATE_F, state, 64, &istate);
+	mad_dump_val(IB_PORT_PHYS_STATE_F, physstate, 64, &iphystate);
 	if (istate != IB_LINK_DOWN) {
 		if (!espeed) {
 			if (fdr10)
@@ -173,89 +289,57 @@ void print_port(ibnd_node_t * node, ibnd_port_t * port, char *out_prefix)
 			mad_dump_val(IB_PORT_LINK_SPEED_EXT_ACTIVE_F, speed,
 				     64, &espeed);
 
-		n = snprintf(link_str, 256, "(%3s %18s %6s/%8s)",
-		     mad_dump_val(IB_PORT_LINK_WIDTH_ACTIVE_F, width, 64,
-				  &iwidth),
-		     speed,
-		     mad_dump_val(IB_PORT_STATE_F, state, 64, &istate),
-		     mad_dump_val(IB_PORT_PHYS_STATE_F, physstate, 64,
-				  &iphystate));
-	} else {
-		n = snprintf(link_str, 256, "(              %6s/%8s)",
-		     mad_dump_val(IB_PORT_STATE_F, state, 64, &istate),
-		     mad_dump_val(IB_PORT_PHYS_STATE_F, physstate, 64,
-				  &iphystate));
-	}
+		/* "(%3s %18s %6s/%8s)" */
+		ibdiag_out_char(&out, '(');
+		ibdiag_out_pad(&out, mad_dump_val(IB_PORT_LINK_WIDTH_ACTIVE_F,
+						  width, 64, &iwidth), 3);
+		ibdiag_out_char(&out, ' ');
+		ibdiag_out_pad(&out, speed, 18);
+	} else
+		out_str("(             ");
+	ibdiag_out_char(&out, ' ');
+	ibdiag_out_pad(&out, state, 6);
+	ibdiag_out_char(&out, '/');
+	ibdiag_out_pad(&out, physstate, 8);
+	ibdiag_out_char(&out, ')');
 
 	/* again default values due to C14-24.2.1 */
-	if (add_sw_settings && istate != IB_LINK_DOWN) {
-		snprintf(link_str + n, 256 - n,
-			" (HOQ:%d VL_Stall:%d)",
-			mad_get_field(port->info, 0,
-				IB_PORT_HOQ_LIFE_F),
-			mad_get_field(port->info, 0,
-				IB_PORT_VL_STALL_COUNT_F));
-	}
+	if (add_sw_settings && istate != IB_LINK_DOWN)
+		ibdiag_out_printf(&out, " (HOQ:%d VL_Stall:%d)",
+				  pi.hoq_life, pi.vl_stall_count);
+	out_str("==>  ");
 
 	if (port->remoteport) {
-		char *remap =
-		    remap_node_name(node_name_map, port->remoteport->node->guid,
-				    port->remoteport->node->nodedesc);
-
-		if (port->remoteport->ext_portnum)
-			snprintf(ext_port_str, 256, "%d",
-				 port->remoteport->ext_portnum);
-		else
-			ext_port_str[0] = '\0';
-
+		width_msg[0] = '\0';
+		speed_msg[0] = '\0';
 		get_max_msg(width_msg, speed_msg, 256, port);
 
+		/* "0x%016" PRIx64 " " in line mode, then
+		 * "%6d %4d[%2s] \"%s\" (%s %s)\n" */
 		if (line_mode) {
-			snprintf(remote_guid_str, 256,
-				 "0x%016" PRIx64 " ",
-				 port->remoteport->guid);
+			out_str("0x");
+			ibdiag_out_hex(&out, port->remoteport->guid, 16);
+			ibdiag_out_char(&out, ' ');
 		}
-
-		snprintf(remote_str, 256, "%s%6d %4d[%2s] \"%s\" (%s %s)\n",
-			 remote_guid_str, port->remoteport->base_lid ?
-			 port->remoteport->base_lid :
-			 port->remoteport->node->smalid,
-			 port->remoteport->portnum, ext_port_str, remap,
-			 width_msg, speed_msg);
-		free(remap);
+		out_lid_port(port->remoteport->base_lid ?
+			     port->remoteport->base_lid :
+			     port->remoteport->node->smalid,
+			     port->remoteport);
+		out_str(" \"");
+		out_str(ibdiag_remap_node_name(node_name_map,
+					       port->remoteport->node->guid,
+					       port->remoteport->node->nodedesc));
+		out_str("\" (");
+		out_str(width_msg);
+		ibdiag_out_char(&out, ' ');
+		out_str(speed_msg);
+		out_str(")\n");
 	} else {
 		if (istate == IB_LINK_DOWN)
-			snprintf(remote_str, 256, "           [  ] \"\" ( )\n");
+			out_str("           [  ] \"\" ( )\n");
 		else
-			snprintf(remote_str, 256, "    \"Port not available\"\n");
+			out_str("    \"Port not available\"\n");
 	}
-
-	if (port->ext_portnum)
-		snprintf(ext_port_str, 256, "%d", port->ext_portnum);
-	else
-		ext_port_str[0] = '\0';
-
-	if (line_mode) {
-		char *remap = remap_node_name(node_name_map, node->guid,
-					      node->nodedesc);
-		printf("%s0x%016" PRIx64 " \"%30s\" ",
-		       out_prefix ? out_prefix : "",
-		       port->guid, remap);
-		free(remap);
-	} else
-		printf("%s      ", out_prefix ? out_prefix : "");
-
-	if (port->node->type != IB_NODE_SWITCH) {
-		if (!line_mode)
-			printf("0x%016" PRIx64 " ", port->guid);
-
-		printf("%6d %4d[%2s] ==%s==>  %s",
-			port->base_lid,
-			port->portnum, ext_port_str, link_str, remote_str);
-	} else
-		printf("%6d %4d[%2s] ==%s==>  %s",
-			node->smalid, port->portnum, ext_port_str,
-			link_str, remote_str);
 }
 
 static inline const char *nodetype_str(ibnd_node_t * node)
@@ -275,26 +359,27 @@ void print_node_header(ibnd_node_t *node, int *out_header_flag,
 			char *out_prefix)
 {
 	uint64_t guid = 0;
-	if ((!out_header_flag || !(*out_header_flag)) && !line_mode) {
-		char *remap =
-			remap_node_name(node_name_map, node->guid, node->nodedesc);
+	if ((!out_header_flag || !(*out_header_flag)) && !line_mode &&
+	    ibd_format == IBDIAG_FORMAT_TEXT) {
+		const char *remap = ibdiag_remap_node_name(node_name_map,
+							   node->guid,
+							   node->nodedesc);
 		if (node->type == IB_NODE_SWITCH) {
 			if (node->ports[0])
 				guid = node->ports[0]->guid;
 			else if (node->info)
 				guid = mad_get_field64(node->info, 0, IB_NODE_PORT_GUID_F);
 
-			printf("%s%s: 0x%016" PRIx64 " %s:\n",
+			ibdiag_out_printf(&out, "%s%s: 0x%016" PRIx64 " %s:\n",
 				out_prefix ? out_prefix : "",
 				nodetype_str(node),
 				guid,
 				remap);
 		} else
-			printf("%s%s: %s:\n",
+			ibdiag_out_printf(&out, "%s%s: %s:\n",
 				out_prefix ? out_prefix : "",
 				nodetype_str(node), remap);
 		(*out_header_flag)++;
-		free(remap);
 	}
 }
 
@@ -317,10 +402,32 @@ void print_node(ibnd_node_t * node, void *user_data)
 	}
 }
 
+/* print_node for a whole fabric; view finds the nodes with down ports
+ * without decoding every PortInfo */
+void print_view_node(ibnd_node_t * node, void *user_data)
+{
+	ibnd_fabric_view_t *view = user_data;
+	int n = ibnd_view_find_node(view, node->guid);
+	uint8_t *state;
+	int i;
+
+	if (down_links_only && n >= 0) {
+		state = view->state + view->node_ports[n];
+		for (i = 1; i <= node->numports; i++)
+			if (state[i] == IB_LINK_DOWN)
+				break;
+		if (i > node->numports)
+			return;
+	}
+	print_node(node, NULL);
+}
+
 struct iter_diff_data {
         uint32_t diff_flags;
         ibnd_fabric_t *fabric1;
         ibnd_fabric_t *fabric2;
+        ibnd_fabric_view_t *view1;
+        ibnd_fabric_view_t *view2;
         char *fabric1_prefix;
         char *fabric2_prefix;
 };
@@ -328,29 +435,39 @@ struct iter_diff_data {
 void diff_node_ports(ibnd_node_t * fabric1_node, ibnd_node_t * fabric2_node,
 		       int *head_print, struct iter_diff_data *data)
 {
-	int i = 0;
-
-	for (i = 1; i <= fabric1_node->numports; i++) {
-		ibnd_port_t *fabric1_port, *fabric2_port;
+	ibnd_fabric_view_t *v1 = data->view1, *v2 = data->view2;
+	int i = 0, n1, n2, b1, b2, np1, np2;
+
+	n1 = ibnd_view_find_node(v1, fabric1_node->guid);
+	n2 = ibnd_view_find_node(v2, fabric2_node->guid);
+	b1 = v1->node_ports[n1];
+	b2 = v2->node_ports[n2];
+	np1 = v1->node_numports[n1];
+	np2 = v2->node_numports[n2];
+
+	/* a port only one of the two has was added or removed */
+	for (i = 1; i <= (np1 > np2 ? np1 : np2); i++) {
+		ibnd_port_t *fabric1_port = NULL, *fabric2_port = NULL;
 		int output_diff = 0;
+		int r1 = -1, r2 = -1;	/* the remote ends, -1 if none */
 
-		fabric1_port = fabric1_node->ports[i];
-		fabric2_port = fabric2_node->ports[i];
+		if (i <= np1) {
+			fabric1_port = v1->port[b1 + i];
+			r1 = v1->remote[b1 + i];
+		}
+		if (i <= np2) {
+			fabric2_port = v2->port[b2 + i];
+			r2 = v2->remote[b2 + i];
+		}
 
 		if (!fabric1_port && !fabric2_port)
 			continue;
 
 		if (data->diff_flags & DIFF_FLAG_PORT_CONNECTION) {
-			if ((fabric1_port && !fabric2_port)
-			    || (!fabric1_port && fabric2_port)
-			    || (fabric1_port->remoteport
-				&& !fabric2_port->remoteport)
-			    || (!fabric1_port->remoteport
-				&& fabric2_port->remoteport)
-			    || (fabric1_port->remoteport
-				&& fabric2_port->remoteport
-				&& fabric1_port->remoteport->guid !=
-				fabric2_port->remoteport->guid))
+			if (!fabric1_port || !fabric2_port
+			    || (r1 < 0) != (r2 < 0)
+			    || (r1 >= 0
+				&& v1->port_guid[r1] != v2->port_guid[r2]))
 				output_diff++;
 		}
 
@@ -359,23 +476,15 @@ void diff_node_ports(ibnd_node_t * fabric1_node, ibnd_node_t * fabric2_node,
 		 */
 		if (data->diff_flags & DIFF_FLAG_PORT_STATE
 		    && fabric1_port
-		    && fabric2_port) {
-			int state1, state2;
-
-			state1 = mad_get_field(fabric1_port->info, 0,
-					       IB_PORT_STATE_F);
-			state2 = mad_get_field(fabric2_port->info, 0,
-					       IB_PORT_STATE_F);
-
-			if (state1 != state2)
-				output_diff++;
-		}
+		    && fabric2_port
+		    && v1->state[b1 + i] != v2->state[b2 + i])
+			output_diff++;
 
 		if (data->diff_flags & DIFF_FLAG_PORT_CONNECTION
 		    && data->diff_flags & DIFF_FLAG_LID
 		    && fabric1_port && fabric2_port
-		    && fabric1_port->remoteport && fabric2_port->remoteport
-		    && fabric1_port->remoteport->base_lid != fabric2_port->remoteport->base_lid)
+		    && r1 >= 0 && r2 >= 0
+		    && v1->lid[r1] != v2->lid[r2])
 			output_diff++;
 
 		if (data->diff_flags & DIFF_FLAG_PORT_CONNECTION
@@ -441,11 +550,12 @@ void diff_node_iter(ibnd_node_t * fabric1_node, void *iter_user_data)
 			print_node_header(fabric1_node,
 					    &head_print,
 					    NULL);
-			printf("%snumports = %d\n", data->fabric1_prefix,
-			       fabric1_node->numports);
-			printf("%snumports = %d\n", data->fabric2_prefix,
-			       fabric2_node->numports);
-			return;
+			ibdiag_out_printf(&out, "%snumports = %d\n",
+					  data->fabric1_prefix,
+					  fabric1_node->numports);
+			ibdiag_out_printf(&out, "%snumports = %d\n",
+					  data->fabric2_prefix,
+					  fabric2_node->numports);
 		}
 
 		diff_node_ports(fabric1_node, fabric2_node,
@@ -457,10 +567,14 @@ int diff_node(ibnd_node_t * node, ibnd_fabric_t * orig_fabric,
 		ibnd_fabric_t * new_fabric)
 {
 	struct iter_diff_data iter_diff_data;
+	ibnd_fabric_view_t *view;
 
 	iter_diff_data.diff_flags = diffcheck_flags;
 	iter_diff_data.fabric1 = orig_fabric;
 	iter_diff_data.fabric2 = new_fabric;
+	if (!(iter_diff_data.view1 = ibnd_build_view(orig_fabric)) ||
+	    !(iter_diff_data.view2 = ibnd_build_view(new_fabric)))
+		IBEXIT("failed to build fabric views for diff");
 	iter_diff_data.fabric1_prefix = "< ";
 	iter_diff_data.fabric2_prefix = "> ";
 	if (node)
@@ -488,6 +602,9 @@ int diff_node(ibnd_node_t * node, ibnd_fabric_t * orig_fabric,
 	iter_diff_data.diff_flags &= ~DIFF_FLAG_NODE_DESCRIPTION;
 	iter_diff_data.fabric1 = new_fabric;
 	iter_diff_data.fabric2 = orig_fabric;
+	view = iter_diff_data.view1;
+	iter_diff_data.view1 = iter_diff_data.view2;
+	iter_diff_data.view2 = view;
 	iter_diff_data.fabric1_prefix = "> ";
 	iter_diff_data.fabric2_prefix = "< ";
 	if (node)
@@ -501,6 +618,8 @@ int diff_node(ibnd_node_t * node, ibnd_fabric_t * orig_fabric,
 					&iter_diff_data);
 	}
 
+	ibnd_destroy_view(iter_diff_data.view1);
+	ibnd_destroy_view(iter_diff_data.view2);
 	return 0;
 }
 
@@ -578,6 +697,15 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 'o':
 		cfg->max_smps = strtoul(optarg, NULL, 0);
 		break;
+	case 8:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_ADAPTIVE_SMPS;
+		break;
+	case 9:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_MULTI_PORT;
+		break;
+	case 10:
+		rediscover_file = strdup(optarg);
+		break;
 	default:
 		return -1;
 	}
@@ -626,6 +754,14 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"adaptive_smps", 8, 0, NULL,
+		 "adapt the number of outstanding SMP's to the fabric; "
+		 "-o sets the upper limit"},
+		{"multi_port", 9, 0, NULL,
+		 "scan from every active local port on the subnet in parallel"},
+		{"rediscover", 10, 1, "<file>",
+		 "only scan in full what changed since the fabric cached "
+		 "in <file>"},
 		{"switches-only", 6, 0, NULL,
 		 "Output only switches"},
 		{"cas-only", 7, 0, NULL,
@@ -634,12 +770,17 @@ int main(int argc, char **argv)
 	};
 	char usage_args[] = "";
 
+	ibd_format_supported = 1;
+	ibd_daemon_supported = 1;
 	ibdiag_process_opts(argc, argv, &config, "aDdGgKLlnpRS", opts,
 			    process_opt, usage_args, NULL);
 
 	argc -= optind;
 	argv += optind;
 
+	if (diff_cache_file && ibd_format != IBDIAG_FORMAT_TEXT)
+		IBEXIT("--diff cannot be used with --format\n");
+
 	ibmad_port = mad_rpc_open_port(ibd_ca, ibd_ca_port, mgmt_classes, 3);
 	if (!ibmad_port) {
 		fprintf(stderr, "Failed to open %s port %d\n", ibd_ca,
@@ -658,6 +799,8 @@ int main(int argc, char **argv)
 	config.mkey = ibd_mkey;
 
 	node_name_map = open_node_name_map(node_name_map_file);
+	ibdiag_out_init(&out, stdout);
+	ibdiag_rec_init(&rec, &out, port_fields);
 
 	if (dr_path && load_cache_file) {
 		mad_rpc_close_port(ibmad_port);
@@ -715,7 +858,9 @@ int main(int argc, char **argv)
 		}
 
 		if (!fabric &&
-		    !(fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL, &config))) {
+		    !(fabric = ibdiag_discover_fabric(ibd_ca, ibd_ca_port,
+						      &config,
+						      rediscover_file))) {
 			fprintf(stderr, "discover failed\n");
 			rc = 1;
 			goto close_port;
@@ -751,11 +896,16 @@ int main(int argc, char **argv)
 		if (diff_fabric)
 			diff_node(NULL, diff_fabric, fabric);
 		else {
+			ibnd_fabric_view_t *view = ibnd_build_view(fabric);
+
+			if (!view)
+				IBEXIT("failed to build fabric view");
 			if (only_flag)
-				ibnd_iter_nodes_type(fabric, print_node,
-						     only_type, NULL);
+				ibnd_iter_nodes_type(fabric, print_view_node,
+						     only_type, view);
 			else
-				ibnd_iter_nodes(fabric, print_node, NULL);
+				ibnd_iter_nodes(fabric, print_view_node, view);
+			ibnd_destroy_view(view);
 		}
 	}
 
@@ -764,6 +914,9 @@ int main(int argc, char **argv)
 		ibnd_destroy_fabric(diff_fabric);
 
 close_port:
+	if (ibdiag_out_close(&out))
+		IBEXIT("writing the link info failed\n");
+	ibdiag_free_node_names();
 	close_node_name_map(node_name_map);
 	exit(rc);
 }
@@ -46,6 +46,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <errno.h>
 
 #include <infiniband/umad.h>
 #include <infiniband/mad.h>
@@ -69,12 +70,16 @@
 			   | DIFF_FLAG_PORT_CONNECTION)
 
 static FILE *f;
+static struct ibdiag_out out;
 
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
 static char *cache_file = NULL;
 static char *load_cache_file = NULL;
 static char *diff_cache_file = NULL;
+static char *rediscover_file = NULL;
+static unsigned fts_flags = 0;
+static unsigned cache_flags = 0;
 static unsigned diffcheck_flags = DIFF_FLAG_DEFAULT;
 
 static int report_max_hops = 0;
@@ -151,34 +156,11 @@ static inline const char *ports_nt_str_compat(ibnd_node_t * node)
 	return "??";
 }
 
-char *node_name(ibnd_node_t * node)
-{
-	static char buf[256];
-
-	switch (node->type) {
-	case IB_NODE_SWITCH:
-		sprintf(buf, "\"%s", "S");
-		break;
-	case IB_NODE_CA:
-		sprintf(buf, "\"%s", "H");
-		break;
-	case IB_NODE_ROUTER:
-		sprintf(buf, "\"%s", "R");
-		break;
-	default:
-		sprintf(buf, "\"%s", "?");
-		break;
-	}
-	sprintf(buf + 2, "-%016" PRIx64 "\"", node->guid);
-
-	return buf;
-}
-
 void list_node(ibnd_node_t * node, void *user_data)
 {
 	char *node_type;
-	char *nodename = remap_node_name(node_name_map, node->guid,
-					 node->nodedesc);
+	const char *nodename = ibdiag_remap_node_name(node_name_map, node->guid,
+						      node->nodedesc);
 
 	switch (node->type) {
 	case IB_NODE_SWITCH:
@@ -194,14 +176,12 @@ void list_node(ibnd_node_t * node, void *user_data)
 		node_type = "???";
 		break;
 	}
-	fprintf(f,
+	ibdiag_out_printf(&out,
 		"%s\t : 0x%016" PRIx64
 		" ports %d devid 0x%x vendid 0x%x \"%s\"\n", node_type,
 		node->guid, node->numports, mad_get_field(node->info, 0,
 							  IB_NODE_DEVID_F),
 		mad_get_field(node->info, 0, IB_NODE_VENDORID_F), nodename);
-
-	free(nodename);
 }
 
 void list_nodes(ibnd_fabric_t * fabric, int list)
@@ -214,56 +194,114 @@ void list_nodes(ibnd_fabric_t * fabric, int list)
 		ibnd_iter_nodes_type(fabric, list_node, IB_NODE_ROUTER, NULL);
 }
 
+/* Topology output is written through "out" piece by piece; the printf
+ * format each part corresponds to is given in a comment. */
+static void out_str(const char *str)
+{
+	if (str)
+		ibdiag_out_str(&out, str);
+}
+
+static void out_int(int64_t val)
+{
+	ibdiag_out_int(&out, val, 0);
+}
+
+static void out_hex(uint64_t val, int width)
+{
+	ibdiag_out_hex(&out, val, width);
+}
+
+/* "\"S-%016" PRIx64 "\"", H- for CAs and R- for routers */
+static void out_node_name(ibnd_node_t * node)
+{
+	switch (node->type) {
+	case IB_NODE_SWITCH:
+		out_str("\"S-");
+		break;
+	case IB_NODE_CA:
+		out_str("\"H-");
+		break;
+	case IB_NODE_ROUTER:
+		out_str("\"R-");
+		break;
+	default:
+		out_str("\"?-");
+		break;
+	}
+	out_hex(node->guid, 16);
+	ibdiag_out_char(&out, '"');
+}
+
 void out_ids(ibnd_node_t * node, int group, char *chname, char *out_prefix)
 {
 	uint64_t sysimgguid =
 	    mad_get_field64(node->info, 0, IB_NODE_SYSTEM_GUID_F);
 
-	fprintf(f, "\n%svendid=0x%x\n", out_prefix ? out_prefix : "",
-		mad_get_field(node->info, 0, IB_NODE_VENDORID_F));
-	fprintf(f, "%sdevid=0x%x\n", out_prefix ? out_prefix : "",
-		mad_get_field(node->info, 0, IB_NODE_DEVID_F));
-	if (sysimgguid)
-		fprintf(f, "%ssysimgguid=0x%" PRIx64,
-			out_prefix ? out_prefix : "", sysimgguid);
+	/* "\n%svendid=0x%x\n%sdevid=0x%x\n" */
+	ibdiag_out_char(&out, '\n');
+	out_str(out_prefix);
+	out_str("vendid=0x");
+	out_hex(mad_get_field(node->info, 0, IB_NODE_VENDORID_F), 0);
+	ibdiag_out_char(&out, '\n');
+	out_str(out_prefix);
+	out_str("devid=0x");
+	out_hex(mad_get_field(node->info, 0, IB_NODE_DEVID_F), 0);
+	ibdiag_out_char(&out, '\n');
+	if (sysimgguid) {
+		/* "%ssysimgguid=0x%" PRIx64 */
+		out_str(out_prefix);
+		out_str("sysimgguid=0x");
+		out_hex(sysimgguid, 0);
+	}
 	if (group && node->chassis && node->chassis->chassisnum) {
-		fprintf(f, "\t\t# Chassis %d", node->chassis->chassisnum);
+		ibdiag_out_printf(&out, "\t\t# Chassis %d",
+				  node->chassis->chassisnum);
 		if (chname)
-			fprintf(f, " (%s)", clean_nodedesc(chname));
+			ibdiag_out_printf(&out, " (%s)",
+					  clean_nodedesc(chname));
 		if (ibnd_is_xsigo_tca(node->guid) && node->ports[1] &&
 		    node->ports[1]->remoteport)
-			fprintf(f, " slot %d",
+			ibdiag_out_printf(&out, " slot %d",
 				node->ports[1]->remoteport->portnum);
 	}
 	if (sysimgguid ||
 	    (group && node->chassis && node->chassis->chassisnum))
-		fprintf(f, "\n");
+		ibdiag_out_char(&out, '\n');
 }
 
 uint64_t out_chassis(ibnd_fabric_t * fabric, unsigned char chassisnum)
 {
 	uint64_t guid;
 
-	fprintf(f, "\nChassis %u", chassisnum);
+	ibdiag_out_printf(&out, "\nChassis %u", chassisnum);
 	guid = ibnd_get_chassis_guid(fabric, chassisnum);
 	if (guid)
-		fprintf(f, " (guid 0x%" PRIx64 ")", guid);
-	fprintf(f, "\n");
+		ibdiag_out_printf(&out, " (guid 0x%" PRIx64 ")", guid);
+	ibdiag_out_printf(&out, "\n");
 	return guid;
 }
 
 void out_switch_detail(ibnd_node_t * node, char *sw_prefix)
 {
-	char *nodename = NULL;
-
-	nodename = remap_node_name(node_name_map, node->guid, node->nodedesc);
-
-	fprintf(f, "%sSwitch\t%d %s\t\t# \"%s\" %s port 0 lid %d lmc %d",
-		sw_prefix ? sw_prefix : "", node->numports, node_name(node),
-		nodename, node->smaenhsp0 ? "enhanced" : "base",
-		node->smalid, node->smalmc);
-
-	free(nodename);
+	const char *nodename;
+
+	nodename = ibdiag_remap_node_name(node_name_map, node->guid,
+					  node->nodedesc);
+
+	/* "%sSwitch\t%d %s\t\t# \"%s\" %s port 0 lid %d lmc %d" */
+	out_str(sw_prefix);
+	out_str("Switch\t");
+	out_int(node->numports);
+	ibdiag_out_char(&out, ' ');
+	out_node_name(node);
+	out_str("\t\t# \"");
+	out_str(nodename);
+	out_str(node->smaenhsp0 ? "\" enhanced port 0 lid " :
+		"\" base port 0 lid ");
+	out_int(node->smalid);
+	out_str(" lmc ");
+	out_int(node->smalmc);
 }
 
 void out_switch(ibnd_node_t * node, int group, char *chname, char *id_prefix,
@@ -273,23 +311,26 @@ void out_switch(ibnd_node_t * node, int group, char *chname, char *id_prefix,
 	char str2[256];
 
 	out_ids(node, group, chname, id_prefix);
-	fprintf(f, "%sswitchguid=0x%" PRIx64,
-		id_prefix ? id_prefix : "", node->guid);
-	fprintf(f, "(%" PRIx64 ")",
-		mad_get_field64(node->info, 0, IB_NODE_PORT_GUID_F));
+	/* "%sswitchguid=0x%" PRIx64 "(%" PRIx64 ")" */
+	out_str(id_prefix);
+	out_str("switchguid=0x");
+	out_hex(node->guid, 0);
+	ibdiag_out_char(&out, '(');
+	out_hex(mad_get_field64(node->info, 0, IB_NODE_PORT_GUID_F), 0);
+	ibdiag_out_char(&out, ')');
 	if (group) {
-		fprintf(f, "\t# ");
+		ibdiag_out_printf(&out, "\t# ");
 		str = ibnd_get_chassis_type(node);
 		if (str)
-			fprintf(f, "%s ", str);
+			ibdiag_out_printf(&out, "%s ", str);
 		str = ibnd_get_chassis_slot_str(node, str2, 256);
 		if (str)
-			fprintf(f, "%s", str);
+			ibdiag_out_printf(&out, "%s", str);
 	}
-	fprintf(f, "\n");
+	ibdiag_out_char(&out, '\n');
 
 	out_switch_detail(node, sw_prefix);
-	fprintf(f, "\n");
+	ibdiag_out_char(&out, '\n');
 }
 
 void out_ca_detail(ibnd_node_t * node, char *ca_prefix)
@@ -308,9 +349,16 @@ void out_ca_detail(ibnd_node_t * node, char *ca_prefix)
 		break;
 	}
 
-	fprintf(f, "%s%s\t%d %s\t\t# \"%s\"", ca_prefix ? ca_prefix : "",
-		node_type, node->numports, node_name(node),
-		clean_nodedesc(node->nodedesc));
+	/* "%s%s\t%d %s\t\t# \"%s\"" */
+	out_str(ca_prefix);
+	out_str(node_type);
+	ibdiag_out_char(&out, '\t');
+	out_int(node->numports);
+	ibdiag_out_char(&out, ' ');
+	out_node_name(node);
+	out_str("\t\t# \"");
+	out_str(clean_nodedesc(node->nodedesc));
+	ibdiag_out_char(&out, '"');
 }
 
 void out_ca(ibnd_node_t * node, int group, char *chname, char *id_prefix,
@@ -331,55 +379,79 @@ void out_ca(ibnd_node_t * node, int group, char *chname, char *id_prefix,
 		break;
 	}
 
-	fprintf(f, "%s%sguid=0x%" PRIx64 "\n",
-		id_prefix ? id_prefix : "", node_type, node->guid);
+	/* "%s%sguid=0x%" PRIx64 "\n" */
+	out_str(id_prefix);
+	out_str(node_type);
+	out_str("guid=0x");
+	out_hex(node->guid, 0);
+	ibdiag_out_char(&out, '\n');
 	out_ca_detail(node, ca_prefix);
 	if (group && ibnd_is_xsigo_hca(node->guid))
-		fprintf(f, " (scp)");
-	fprintf(f, "\n");
+		out_str(" (scp)");
+	ibdiag_out_char(&out, '\n');
 }
 
-#define OUT_BUFFER_SIZE 16
-static char *out_ext_port(ibnd_port_t * port, int group)
+/* "[ext %d]" for ports with an external number, when grouping */
+static void out_ext_port(ibnd_port_t * port, int group)
 {
-	static char mapping[OUT_BUFFER_SIZE];
-
 	if (group && port->ext_portnum != 0) {
-		snprintf(mapping, OUT_BUFFER_SIZE,
-			 "[ext %d]", port->ext_portnum);
-		return (mapping);
+		out_str("[ext ");
+		out_int(port->ext_portnum);
+		ibdiag_out_char(&out, ']');
 	}
+}
 
-	return (NULL);
+/* " lid %d %s%s": the remote LID and the link width and speed */
+static void out_link(ibnd_port_t * port, uint32_t iwidth, uint32_t ispeed,
+		     uint32_t espeed, uint32_t fdr10)
+{
+	out_str(" lid ");
+	out_int(port->remoteport->node->type == IB_NODE_SWITCH ?
+		port->remoteport->node->smalid : port->remoteport->base_lid);
+	ibdiag_out_char(&out, ' ');
+	out_str(dump_linkwidth_compat(iwidth));
+	out_str((ispeed != 4 && !espeed) ?
+		dump_linkspeed_compat(ispeed) :
+		dump_linkspeedext_compat(espeed, ispeed, fdr10));
+}
+
+/* " s=%d w=%d v=%d" */
+static void out_full_info(uint32_t ispeed, uint32_t iwidth, uint32_t vlcap)
+{
+	out_str(" s=");
+	out_int(ispeed);
+	out_str(" w=");
+	out_int(iwidth);
+	out_str(" v=");
+	out_int(vlcap);
 }
 
 void out_switch_port(ibnd_port_t * port, int group, char *out_prefix)
 {
-	char *ext_port_str = NULL;
-	char *rem_nodename = NULL;
-	uint32_t iwidth = mad_get_field(port->info, 0,
-					IB_PORT_LINK_WIDTH_ACTIVE_F);
-	uint32_t ispeed = mad_get_field(port->info, 0,
-					IB_PORT_LINK_SPEED_ACTIVE_F);
-	uint32_t vlcap = mad_get_field(port->info, 0,
-				       IB_PORT_VL_CAP_F);
+	const char *rem_nodename;
+	struct ib_portinfo_decoded pi;
+	uint32_t iwidth, ispeed, vlcap;
 	uint32_t fdr10 = mad_get_field(port->ext_info, 0,
 				       IB_MLNX_EXT_PORT_LINK_SPEED_ACTIVE_F);
 	uint32_t cap_mask, espeed;
 
+	mad_decode_portinfo(port->info, &pi);
+	iwidth = pi.link_width_active;
+	ispeed = pi.link_speed_active;
+	vlcap = pi.vl_cap;
+
 	DEBUG("port %p:%d remoteport %p\n", port, port->portnum,
 	      port->remoteport);
-	fprintf(f, "%s[%d]", out_prefix ? out_prefix : "", port->portnum);
-
-	ext_port_str = out_ext_port(port, group);
-	if (ext_port_str)
-		fprintf(f, "%s", ext_port_str);
-
-	rem_nodename = remap_node_name(node_name_map,
-				       port->remoteport->node->guid,
-				       port->remoteport->node->nodedesc);
-
-	ext_port_str = out_ext_port(port->remoteport, group);
+	/* "%s[%d]" */
+	out_str(out_prefix);
+	ibdiag_out_char(&out, '[');
+	out_int(port->portnum);
+	ibdiag_out_char(&out, ']');
+	out_ext_port(port, group);
+
+	rem_nodename = ibdiag_remap_node_name(node_name_map,
+					      port->remoteport->node->guid,
+					      port->remoteport->node->nodedesc);
 
 	if (!port->node->ports[0]) {
 		cap_mask = 0;
@@ -389,89 +461,98 @@ void out_switch_port(ibnd_port_t * port, int group, char *out_prefix)
 		cap_mask = mad_get_field(port->node->ports[0]->info, 0,
 					 IB_PORT_CAPMASK_F);
 		if (cap_mask & CL_NTOH32(IB_PORT_CAP_HAS_EXT_SPEEDS))
-			espeed = mad_get_field(port->info, 0,
-					       IB_PORT_LINK_SPEED_EXT_ACTIVE_F);
+			espeed = pi.link_speed_ext_active;
 		else
 			espeed = 0;
 	}
-	fprintf(f, "\t%s[%d]%s",
-		node_name(port->remoteport->node), port->remoteport->portnum,
-		ext_port_str ? ext_port_str : "");
-	if (port->remoteport->node->type != IB_NODE_SWITCH)
-		fprintf(f, "(%" PRIx64 ") ", port->remoteport->guid);
-	fprintf(f, "\t\t# \"%s\" lid %d %s%s",
-		rem_nodename,
-		port->remoteport->node->type == IB_NODE_SWITCH ?
-		port->remoteport->node->smalid :
-		port->remoteport->base_lid,
-		dump_linkwidth_compat(iwidth),
-		(ispeed != 4 && !espeed) ?
-			dump_linkspeed_compat(ispeed) :
-			dump_linkspeedext_compat(espeed, ispeed, fdr10));
+	/* "\t%s[%d]%s" */
+	ibdiag_out_char(&out, '\t');
+	out_node_name(port->remoteport->node);
+	ibdiag_out_char(&out, '[');
+	out_int(port->remoteport->portnum);
+	ibdiag_out_char(&out, ']');
+	out_ext_port(port->remoteport, group);
+	if (port->remoteport->node->type != IB_NODE_SWITCH) {
+		/* "(%" PRIx64 ") " */
+		ibdiag_out_char(&out, '(');
+		out_hex(port->remoteport->guid, 0);
+		out_str(") ");
+	}
+	/* "\t\t# \"%s\"" */
+	out_str("\t\t# \"");
+	out_str(rem_nodename);
+	ibdiag_out_char(&out, '"');
+	out_link(port, iwidth, ispeed, espeed, fdr10);
 
 	if (full_info)
-		fprintf(f, " s=%d w=%d v=%d", ispeed, iwidth, vlcap);
+		out_full_info(ispeed, iwidth, vlcap);
 
 	if (ibnd_is_xsigo_tca(port->remoteport->guid))
-		fprintf(f, " slot %d", port->portnum);
+		ibdiag_out_printf(&out, " slot %d", port->portnum);
 	else if (ibnd_is_xsigo_hca(port->remoteport->guid))
-		fprintf(f, " (scp)");
-	fprintf(f, "\n");
-
-	free(rem_nodename);
+		out_str(" (scp)");
+	ibdiag_out_char(&out, '\n');
 }
 
 void out_ca_port(ibnd_port_t * port, int group, char *out_prefix)
 {
-	char *str = NULL;
-	char *rem_nodename = NULL;
-	uint32_t iwidth = mad_get_field(port->info, 0,
-					IB_PORT_LINK_WIDTH_ACTIVE_F);
-	uint32_t ispeed = mad_get_field(port->info, 0,
-					IB_PORT_LINK_SPEED_ACTIVE_F);
-	uint32_t vlcap = mad_get_field(port->info, 0,
-				       IB_PORT_VL_CAP_F);
+	const char *rem_nodename;
+	struct ib_portinfo_decoded pi;
 	uint32_t fdr10 = mad_get_field(port->ext_info, 0,
 				       IB_MLNX_EXT_PORT_LINK_SPEED_ACTIVE_F);
-	uint32_t cap_mask, espeed;
+	uint32_t espeed;
+
+	mad_decode_portinfo(port->info, &pi);
+
+	/* "%s[%d]" */
+	out_str(out_prefix);
+	ibdiag_out_char(&out, '[');
+	out_int(port->portnum);
+	ibdiag_out_char(&out, ']');
+	if (port->node->type != IB_NODE_SWITCH) {
+		/* "(%" PRIx64 ") " */
+		ibdiag_out_char(&out, '(');
+		out_hex(port->guid, 0);
+		out_str(") ");
+	}
+	/* "\t%s[%d]" */
+	ibdiag_out_char(&out, '\t');
+	out_node_name(port->remoteport->node);
+	ibdiag_out_char(&out, '[');
+	out_int(port->remoteport->portnum);
+	ibdiag_out_char(&out, ']');
+	out_ext_port(port->remoteport, group);
+	if (port->remoteport->node->type != IB_NODE_SWITCH) {
+		/* " (%" PRIx64 ") " */
+		out_str(" (");
+		out_hex(port->remoteport->guid, 0);
+		out_str(") ");
+	}
 
-	fprintf(f, "%s[%d]", out_prefix ? out_prefix : "", port->portnum);
-	if (port->node->type != IB_NODE_SWITCH)
-		fprintf(f, "(%" PRIx64 ") ", port->guid);
-	fprintf(f, "\t%s[%d]",
-		node_name(port->remoteport->node), port->remoteport->portnum);
-	str = out_ext_port(port->remoteport, group);
-	if (str)
-		fprintf(f, "%s", str);
-	if (port->remoteport->node->type != IB_NODE_SWITCH)
-		fprintf(f, " (%" PRIx64 ") ", port->remoteport->guid);
-
-	rem_nodename = remap_node_name(node_name_map,
-				       port->remoteport->node->guid,
-				       port->remoteport->node->nodedesc);
-
-	cap_mask = mad_get_field(port->info, 0, IB_PORT_CAPMASK_F);
-	if (cap_mask & CL_NTOH32(IB_PORT_CAP_HAS_EXT_SPEEDS))
-		espeed = mad_get_field(port->info, 0,
-				       IB_PORT_LINK_SPEED_EXT_ACTIVE_F);
+	rem_nodename = ibdiag_remap_node_name(node_name_map,
+					      port->remoteport->node->guid,
+					      port->remoteport->node->nodedesc);
+
+	if (pi.capmask & CL_NTOH32(IB_PORT_CAP_HAS_EXT_SPEEDS))
+		espeed = pi.link_speed_ext_active;
 	else
 		espeed = 0;
 
-	fprintf(f, "\t\t# lid %d lmc %d \"%s\" lid %d %s%s",
-		port->base_lid, port->lmc, rem_nodename,
-		port->remoteport->node->type == IB_NODE_SWITCH ?
-		port->remoteport->node->smalid :
-		port->remoteport->base_lid,
-		dump_linkwidth_compat(iwidth),
-		(ispeed != 4 && !espeed) ?
-			dump_linkspeed_compat(ispeed) :
-			dump_linkspeedext_compat(espeed, ispeed, fdr10));
+	/* "\t\t# lid %d lmc %d \"%s\"" */
+	out_str("\t\t# lid ");
+	out_int(port->base_lid);
+	out_str(" lmc ");
+	out_int(port->lmc);
+	out_str(" \"");
+	out_str(rem_nodename);
+	ibdiag_out_char(&out, '"');
+	out_link(port, pi.link_width_active, pi.link_speed_active, espeed,
+		 fdr10);
 
 	if (full_info)
-		fprintf(f, " s=%d w=%d v=%d", ispeed, iwidth, vlcap);
-	fprintf(f, "\n");
-
-	free(rem_nodename);
+		out_full_info(pi.link_speed_active, pi.link_width_active,
+			      pi.vl_cap);
+	ibdiag_out_char(&out, '\n');
 }
 
 struct iter_user_data {
@@ -547,12 +628,12 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 	char *chname = NULL;
 	struct iter_user_data iter_user_data;
 
-	fprintf(f, "#\n# Topology file: generated on %s#\n", ctime(&t));
+	ibdiag_out_printf(&out, "#\n# Topology file: generated on %s#\n", ctime(&t));
 	if (report_max_hops)
-		fprintf(f, "# Reported max hops discovered: %u\n"
+		ibdiag_out_printf(&out, "# Reported max hops discovered: %u\n"
 			"# Total MADs used: %u\n",
 			fabric->maxhops_discovered, fabric->total_mads_used);
-	fprintf(f, "# Initiated from node %016" PRIx64 " port %016" PRIx64 "\n",
+	ibdiag_out_printf(&out, "# Initiated from node %016" PRIx64 " port %016" PRIx64 "\n",
 		fabric->from_node->guid,
 		mad_get_field64(fabric->from_node->info, 0,
 				IB_NODE_PORT_GUID_F));
@@ -574,14 +655,14 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 				     node = node->next_chassis_node) {
 					if (ibnd_is_xsigo_hca(node->guid)) {
 						chname = node->nodedesc;
-						fprintf(f, "Hostname: %s\n",
+						ibdiag_out_printf(&out, "Hostname: %s\n",
 							clean_nodedesc
 							(node->nodedesc));
 					}
 				}
 			}
 
-			fprintf(f, "\n# Spine Nodes");
+			ibdiag_out_printf(&out, "\n# Spine Nodes");
 			for (n = 1; n <= SPINES_MAX_NUM; n++) {
 				if (ch->spinenode[n]) {
 					out_switch(ch->spinenode[n], group,
@@ -598,7 +679,7 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 					}
 				}
 			}
-			fprintf(f, "\n# Line Nodes");
+			ibdiag_out_printf(&out, "\n# Line Nodes");
 			for (n = 1; n <= LINES_MAX_NUM; n++) {
 				if (ch->linenode[n]) {
 					out_switch(ch->linenode[n], group,
@@ -616,7 +697,7 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 				}
 			}
 
-			fprintf(f, "\n# Chassis Switches");
+			ibdiag_out_printf(&out, "\n# Chassis Switches");
 			for (node = ch->nodes; node;
 			     node = node->next_chassis_node) {
 				if (node->type == IB_NODE_SWITCH) {
@@ -633,7 +714,7 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 
 			}
 
-			fprintf(f, "\n# Chassis CAs");
+			ibdiag_out_printf(&out, "\n# Chassis CAs");
 			for (node = ch->nodes; node;
 			     node = node->next_chassis_node) {
 				if (node->type == IB_NODE_CA) {
@@ -661,7 +742,7 @@ int dump_topology(int group, ibnd_fabric_t * fabric)
 		iter_user_data.group = group;
 		iter_user_data.skip_chassis_nodes = 1;
 
-		fprintf(f, "\nNon-Chassis Nodes\n");
+		ibdiag_out_printf(&out, "\nNon-Chassis Nodes\n");
 
 		ibnd_iter_nodes_type(fabric, switch_iter_func, IB_NODE_SWITCH,
 				     &iter_user_data);
@@ -683,8 +764,7 @@ void dump_ports_report(ibnd_node_t * node, void *user_data)
 {
 	int p = 0;
 	ibnd_port_t *port = NULL;
-	char *nodename = NULL;
-	char *rem_nodename = NULL;
+	const char *nodename, *rem_nodename;
 
 	/* for each port */
 	for (p = node->numports, port = node->ports[p]; p > 0;
@@ -717,10 +797,10 @@ void dump_ports_report(ibnd_node_t * node, void *user_data)
 		}
 		fdr10 = mad_get_field(port->ext_info, 0,
 				      IB_MLNX_EXT_PORT_LINK_SPEED_ACTIVE_F);
-		nodename = remap_node_name(node_name_map,
-					   port->node->guid,
-					   port->node->nodedesc);
-		fprintf(stdout, "%2s %5d %2d 0x%016" PRIx64 " %s %s",
+		nodename = ibdiag_remap_node_name(node_name_map,
+						  port->node->guid,
+						  port->node->nodedesc);
+		ibdiag_out_printf(&out, "%2s %5d %2d 0x%016" PRIx64 " %s %s",
 			ports_nt_str_compat(node),
 			node->type ==
 			IB_NODE_SWITCH ? node->smalid : port->base_lid,
@@ -730,10 +810,10 @@ void dump_ports_report(ibnd_node_t * node, void *user_data)
 				dump_linkspeed_compat(ispeed) :
 				dump_linkspeedext_compat(espeed, ispeed, fdr10));
 		if (port->remoteport) {
-			rem_nodename = remap_node_name(node_name_map,
+			rem_nodename = ibdiag_remap_node_name(node_name_map,
 					      port->remoteport->node->guid,
 					      port->remoteport->node->nodedesc);
-			fprintf(stdout,
+			ibdiag_out_printf(&out,
 				" - %2s %5d %2d 0x%016" PRIx64
 				" ( '%s' - '%s' )\n",
 				ports_nt_str_compat(port->remoteport->node),
@@ -742,11 +822,8 @@ void dump_ports_report(ibnd_node_t * node, void *user_data)
 				port->remoteport->base_lid,
 				port->remoteport->portnum,
 				port->remoteport->guid, nodename, rem_nodename);
-			free(rem_nodename);
 		} else
-			fprintf(stdout, "%36s'%s'\n", "", nodename);
-
-		free(nodename);
+			ibdiag_out_printf(&out, "%36s'%s'\n", "", nodename);
 	}
 }
 
@@ -845,13 +922,14 @@ static void diff_ports(ibnd_node_t * fabric1_node, ibnd_node_t * fabric2_node,
 			fabric2_out++;
 		}
 
-		if (fabric1_out) {
+		/* only connected ports can be printed, as in the topology */
+		if (fabric1_out && fabric1_port->remoteport) {
 			diff_iter_out_header(fabric1_node, data,
 					     out_header_flag);
 			(*data->out_port) (fabric1_port, 0,
 					   data->fabric1_prefix);
 		}
-		if (fabric2_out) {
+		if (fabric2_out && fabric2_port->remoteport) {
 			diff_iter_out_header(fabric1_node, data,
 					     out_header_flag);
 			(*data->out_port) (fabric2_port, 0,
@@ -894,16 +972,16 @@ static void diff_iter_func(ibnd_node_t * fabric1_node, void *iter_user_data)
 					     data->fabric1_prefix);
 			(*data->out_header_detail) (fabric2_node,
 						    data->fabric2_prefix);
-			fprintf(f, "\n");
+			ibdiag_out_printf(&out, "\n");
 			out_header_flag++;
 		}
 
 		if (fabric1_node->numports != fabric2_node->numports) {
 			diff_iter_out_header(fabric1_node, data,
 					     &out_header_flag);
-			fprintf(f, "%snumports = %d\n", data->fabric1_prefix,
+			ibdiag_out_printf(&out, "%snumports = %d\n", data->fabric1_prefix,
 				fabric1_node->numports);
-			fprintf(f, "%snumports = %d\n", data->fabric2_prefix,
+			ibdiag_out_printf(&out, "%snumports = %d\n", data->fabric2_prefix,
 				fabric2_node->numports);
 			return;
 		}
@@ -1053,6 +1131,24 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 'o':
 		cfg->max_smps = strtoul(optarg, NULL, 0);
 		break;
+	case 6:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_ADAPTIVE_SMPS;
+		break;
+	case 7:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_MULTI_PORT;
+		break;
+	case 8:
+		rediscover_file = strdup(optarg);
+		break;
+	case 9:
+		fts_flags |= IBND_FTS_UNICAST;
+		break;
+	case 10:
+		fts_flags |= IBND_FTS_UNICAST | IBND_FTS_MULTICAST;
+		break;
+	case 11:
+		cache_flags |= IBND_CACHE_FABRIC_FLAG_V2;
+		break;
 	default:
 		return -1;
 	}
@@ -1089,10 +1185,25 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"adaptive_smps", 6, 0, NULL,
+		 "adapt the number of outstanding SMP's to the fabric; "
+		 "-o sets the upper limit"},
+		{"multi_port", 7, 0, NULL,
+		 "scan from every active local port on the subnet in parallel"},
+		{"rediscover", 8, 1, "<file>",
+		 "only scan in full what changed since the fabric cached "
+		 "in <file>"},
+		{"fts", 9, 0, NULL,
+		 "also read the switches' LFTs, to be stored with --cache"},
+		{"mfts", 10, 0, NULL, "same as --fts, with the MFTs as well"},
+		{"cache-v2", 11, 0, NULL,
+		 "write --cache in the version 2 format, which loads faster "
+		 "but older releases can't read"},
 		{0}
 	};
 	char usage_args[] = "[topology-file]";
 
+	ibd_daemon_supported = 1;
 	ibdiag_process_opts(argc, argv, &config, "DGKLs", opts, process_opt,
 			    usage_args, NULL);
 
@@ -1108,6 +1219,7 @@ int main(int argc, char **argv)
 
 	if (argc && !(f = fopen(argv[0], "w")))
 		IBEXIT("can't open file %s for writing", argv[0]);
+	ibdiag_out_init(&out, f);
 
 	config.mkey = ibd_mkey;
 
@@ -1121,11 +1233,21 @@ int main(int argc, char **argv)
 		if ((fabric = ibnd_load_fabric(load_cache_file, 0)) == NULL)
 			IBEXIT("loading cached fabric failed\n");
 	} else {
-		if ((fabric =
-		     ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL, &config)) == NULL)
+		if ((fabric = ibdiag_discover_fabric(ibd_ca, ibd_ca_port,
+						     &config,
+						     rediscover_file)) == NULL)
 			IBEXIT("discover failed\n");
 	}
 
+	if (fts_flags) {
+		int rc = ibnd_load_fts(fabric, ibd_ca, ibd_ca_port, &config,
+				       fts_flags);
+		if (rc == -EIO)
+			IBWARN("some forwarding table blocks could not be read");
+		else if (rc)
+			IBEXIT("reading forwarding tables failed\n");
+	}
+
 	if (ports_report)
 		ibnd_iter_nodes(fabric, dump_ports_report, NULL);
 	else if (list)
@@ -1134,14 +1256,20 @@ int main(int argc, char **argv)
 		diff(diff_fabric, fabric);
 	else
 		dump_topology(group, fabric);
+	if (ibdiag_out_close(&out))
+		IBEXIT("writing the topology failed\n");
 
 	if (cache_file)
-		if (ibnd_cache_fabric(fabric, cache_file, 0) < 0)
+		/* only the version 2 format holds forwarding tables */
+		if (ibnd_cache_fabric(fabric, cache_file, fts_flags ?
+				      cache_flags | IBND_CACHE_FABRIC_FLAG_V2 :
+				      cache_flags) < 0)
 			IBEXIT("caching ibnetdiscover data failed\n");
 
 	ibnd_destroy_fabric(fabric);
 	if (diff_fabric)
 		ibnd_destroy_fabric(diff_fabric);
+	ibdiag_free_node_names();
 	close_node_name_map(node_name_map);
 	exit(0);
 }
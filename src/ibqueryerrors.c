@@ -56,13 +56,16 @@
 
 #include "ibdiag_common.h"
 #include "ibdiag_sa.h"
+#include "ibdiag_pma.h"
 
 struct ibmad_port *ibmad_port;
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
 static char *load_cache_file = NULL;
+static char *rediscover_file = NULL;
 static uint16_t lid2sl_table[sizeof(uint8_t) * 1024 * 48] = { 0 };
 static int obtain_sl = 1;
+static unsigned pma_window = DEFAULT_PMA_WINDOW;
 
 int data_counters = 0;
 int data_counters_only = 0;
@@ -96,6 +99,7 @@ static char *threshold_file = DEF_THRES_FILE;
 
 /* define a "packet" with threshold values in it */
 uint8_t thresholds[1204] = { 0 };
+static struct ib_perfcounters_decoded thres;
 char * threshold_str = "";
 
 static unsigned valid_gid(ib_gid_t * gid)
@@ -125,6 +129,7 @@ static void set_thres(char *name, uint32_t val)
 			strcpy(threshold_str+n, tmp);
 		}
 	}
+	mad_decode_perfcounters(thresholds, &thres);
 }
 
 static void set_thresholds(char *threshold_file)
@@ -166,11 +171,43 @@ static void set_thresholds(char *threshold_file)
 	fclose(thresf);
 }
 
+/* value of one of the IB_PC_* error counter fields */
+static uint32_t pc_counter(const struct ib_perfcounters_decoded *d, int field)
+{
+	switch (field) {
+	case IB_PC_ERR_SYM_F:
+		return d->symbol_errors;
+	case IB_PC_LINK_RECOVERS_F:
+		return d->link_recovers;
+	case IB_PC_LINK_DOWNED_F:
+		return d->link_downed;
+	case IB_PC_ERR_RCV_F:
+		return d->rcv_errors;
+	case IB_PC_ERR_PHYSRCV_F:
+		return d->rcv_remote_phys_errors;
+	case IB_PC_ERR_SWITCH_REL_F:
+		return d->rcv_switch_relay_errors;
+	case IB_PC_XMT_DISCARDS_F:
+		return d->xmt_discards;
+	case IB_PC_ERR_XMTCONSTR_F:
+		return d->xmt_constraint_errors;
+	case IB_PC_ERR_RCVCONSTR_F:
+		return d->rcv_constraint_errors;
+	case IB_PC_ERR_LOCALINTEG_F:
+		return d->link_integrity_errors;
+	case IB_PC_ERR_EXCESS_OVR_F:
+		return d->excessive_buffer_overrun_errors;
+	case IB_PC_VL15_DROPPED_F:
+		return d->vl15_dropped;
+	case IB_PC_XMT_WAIT_F:
+		return d->xmt_wait;
+	}
+	return 0;
+}
+
 static int exceeds_threshold(int field, unsigned val)
 {
-	uint32_t thres = 0;
-	mad_decode_field(thresholds, field, &thres);
-	return (val > thres);
+	return (val > pc_counter(&thres, field));
 }
 
 static void print_port_config(ibnd_node_t * node, int portnum)
@@ -299,6 +336,10 @@ static void report_suppressed(void)
 
 static int print_summary(void)
 {
+	/* records carry no summary; the exit status still does */
+	if (ibd_format != IBDIAG_FORMAT_TEXT)
+		return (summary.bad_ports);
+
 	printf("\n## Summary: %d nodes checked, %d bad nodes found\n",
 		summary.nodes_checked, summary.bad_nodes);
 	printf("##          %d ports checked, %d ports have errors beyond threshold\n",
@@ -310,26 +351,30 @@ static int print_summary(void)
 	return (summary.bad_ports);
 }
 
-static void insert_lid2sl_table(struct sa_query_result *r)
+static void insert_lid2sl_table(struct sa_cursor *c)
 {
-    unsigned int i;
-    for (i = 0; i < r->result_cnt; i++) {
-	    ib_path_rec_t *p_pr = (ib_path_rec_t *)sa_get_query_rec(r->p_result_madw, i);
+    ib_path_rec_t *p_pr;
+
+    while ((p_pr = sa_cursor_next(c)))
 	    lid2sl_table[cl_ntoh16(p_pr->dlid)] = ib_path_rec_sl(p_pr);
-    }
 }
 
+/* One GetTable for the PathRecords from sgid to dguid, or to every
+ * destination when dguid is 0; the records are read in place from the
+ * handle's receive buffer to fill lid2sl_table. */
 static int path_record_query(ib_gid_t sgid,uint64_t dguid)
 {
      ib_path_rec_t pr;
      ib_net64_t comp_mask = 0;
      uint8_t reversible = 0;
      struct sa_handle * h;
+     struct sa_cursor c;
+     int timeout = ibd_timeout;
+     int ret;
 
      if (!(h = sa_get_handle()))
 	return -1;
 
-     ibd_timeout = DEFAULT_HALF_WORLD_PR_TIMEOUT;
      memset(&pr, 0, sizeof(pr));
 
      CHECK_AND_SET_GID(sgid, pr.sgid, PR, SGID);
@@ -341,46 +386,106 @@ static int path_record_query(ib_gid_t sgid,uint64_t dguid)
      CHECK_AND_SET_VAL(1, 8, -1, pr.num_path, PR, NUMBPATH);/*to get only one PathRecord for each source and destination pair*/
      CHECK_AND_SET_VAL(1, 8, -1, reversible, PR, REVERSIBLE);/*for a reversible path*/
      pr.num_path |= reversible << 7;
-     struct sa_query_result result;
-     int ret = sa_query(h, IB_MAD_METHOD_GET_TABLE,
+
+     /* the SA may take a while to compute paths to the whole subnet */
+     ibd_timeout = DEFAULT_HALF_WORLD_PR_TIMEOUT;
+     ret = sa_query_cursor(h, IB_MAD_METHOD_GET_TABLE,
                         (uint16_t)IB_SA_ATTR_PATHRECORD,0,cl_ntoh64(comp_mask),ibd_sakey,
-                        &pr, sizeof(pr), &result);
+                        &pr, sizeof(pr), &c);
+     ibd_timeout = timeout;
      if (ret) {
              sa_free_handle(h);
              fprintf(stderr, "Query SA failed: %s; sa call path_query failed\n", strerror(ret));
              return ret;
      }
-     if (result.status != IB_SA_MAD_STATUS_SUCCESS) {
-             sa_report_err(result.status);
+     if (c.status != IB_SA_MAD_STATUS_SUCCESS) {
+             sa_report_err(c.status);
              ret = EIO;
              goto Exit;
      }
 
-     insert_lid2sl_table(&result);
+     insert_lid2sl_table(&c);
 Exit:
      sa_free_handle(h);
-     sa_free_result_mad(&result);
      return ret;
 }
 
-static int query_and_dump(char *buf, size_t size, ib_portid_t * portid,
-			  char *node_name, int portnum,
-			  const char *attr_name, uint16_t attr_id,
-			  int start_field, int end_field)
+/* Error sweep state.  Every PMA query is issued through pma_engine; a node
+ * is printed once all of its queries have completed and every node before
+ * it has been printed, so the output is in fabric order as before.
+ */
+struct node_sweep;
+
+struct port_sweep {
+	struct node_sweep *ns;
+	ib_portid_t portid;
+	int portnum;
+	int pending;		/* queries not yet completed */
+	int finished;		/* all counters read */
+	int failed;		/* counters could not be read */
+	int have_pce;
+	int have_xmit_details;
+	int have_rcv_details;
+	uint8_t pc[IB_PC_DATA_SZ];
+	uint8_t pce[IB_PC_DATA_SZ];
+	uint8_t xmit_details[IB_PC_DATA_SZ];
+	uint8_t rcv_details[IB_PC_DATA_SZ];
+};
+
+struct node_sweep {
+	ibnd_node_t *node;
+	char *node_name;
+	ib_portid_t portid;	/* where ClassPortInfo is read */
+	int cpi_port;
+	int startport;
+	uint16_t cap_mask;
+	int all_port_sup;
+	int per_port;		/* port ALL had errors; each port is read */
+	int all_cleared;
+	int pending;
+	int done;
+	struct port_sweep all;	/* PortSelect 0xFF */
+	struct port_sweep *ports;
+};
+
+static struct pma_engine pma_engine;
+static struct node_sweep *sweep = NULL;
+static int sweep_count = 0, sweep_size = 0;
+static int sweep_started = 0, sweep_printed = 0;
+
+static void sweep_query(struct port_sweep *ps, unsigned attr_id,
+			pma_comp_cb_t cb)
 {
-	uint8_t pc[1024];
-	uint32_t val = 0;
-	int i, n;
+	ps->portid.sl = lid2sl_table[ps->portid.lid];
+	if (pma_query_async(&pma_engine, &ps->portid, ps->portnum, attr_id,
+			    cb, ps))
+		IBPANIC("out of memory");
+	ps->pending++;
+	ps->ns->pending++;
+}
 
-	memset(pc, 0, sizeof(pc));
+static void sweep_reset(struct port_sweep *ps, unsigned mask,
+			unsigned attr_id, pma_comp_cb_t cb)
+{
+	if (pma_reset_async(&pma_engine, &ps->portid, ps->portnum, mask,
+			    attr_id, cb, ps))
+		IBPANIC("out of memory");
+	ps->pending++;
+	ps->ns->pending++;
+}
 
-	if (!pma_query_via(pc, portid, portnum, ibd_timeout, attr_id,
-			   ibmad_port)) {
-		IBWARN("%s query failed on %s, %s port %d", attr_name,
-		       node_name, portid2str(portid), portnum);
-		summary.pma_query_failures++;
-		return 0;
-	}
+static void query_failed(struct port_sweep *ps, const char *attr_name)
+{
+	IBWARN("%s query failed on %s, %s port %d", attr_name,
+	       ps->ns->node_name, portid2str(&ps->portid), ps->portnum);
+	summary.pma_query_failures++;
+}
+
+static int dump_details(char *buf, size_t size, uint8_t * pc,
+			int start_field, int end_field)
+{
+	uint32_t val = 0;
+	int i, n;
 
 	for (n = 0, i = start_field; i < end_field; i++) {
 		mad_decode_field(pc, i, (void *)&val);
@@ -392,16 +497,87 @@ static int query_and_dump(char *buf, size_t size, ib_portid_t * portid,
 	return n;
 }
 
+static const struct ibdiag_field port_fields[] = {
+	{"node_guid", IBDIAG_FIELD_GUID},
+	{"node_desc", IBDIAG_FIELD_STR},
+	{"port_guid", IBDIAG_FIELD_GUID},
+	{"lid", IBDIAG_FIELD_UINT},
+	{"port", IBDIAG_FIELD_UINT},
+	{"cap_mask", IBDIAG_FIELD_UINT},
+	{"link_width_active", IBDIAG_FIELD_UINT},
+	{"link_speed_active", IBDIAG_FIELD_UINT},
+	{"link_speed_ext_active", IBDIAG_FIELD_UINT},
+	{"state", IBDIAG_FIELD_UINT},
+	{"phys_state", IBDIAG_FIELD_UINT},
+	IBDIAG_COUNTER_FIELDS,
+	{0}
+};
+
+static struct ibdiag_out out;
+static struct ibdiag_rec rec;
+
+static int has_ext_counters(uint16_t cap_mask)
+{
+	return (cap_mask &
+		(IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP));
+}
+
+/* --format: a port with its link and counters as a record */
+static void print_port_rec(struct port_sweep *ps)
+{
+	ibnd_node_t *node = ps->ns->node;
+	ibnd_port_t *port = node->ports[ps->portnum];
+	struct ib_portinfo_decoded pi;
+	struct ib_perfcounters_decoded d;
+	struct ib_perfcounters_ext_decoded e;
+
+	mad_decode_portinfo(port->info, &pi);
+
+	ibdiag_rec_begin(&rec);
+	ibdiag_rec_uint(&rec, node->guid);
+	ibdiag_rec_str(&rec, ps->ns->node_name);
+	ibdiag_rec_uint(&rec, port->guid);
+	ibdiag_rec_uint(&rec, ps->portid.lid);
+	ibdiag_rec_uint(&rec, ps->portnum);
+	ibdiag_rec_uint(&rec, ntohs(ps->ns->cap_mask));
+	ibdiag_rec_uint(&rec, pi.link_width_active);
+	ibdiag_rec_uint(&rec, pi.link_speed_active);
+	ibdiag_rec_uint(&rec, pi.link_speed_ext_active);
+	ibdiag_rec_uint(&rec, pi.state);
+	ibdiag_rec_uint(&rec, pi.phys_state);
+	if (data_counters_only) {
+		/* pc holds PortCountersExtended if supported */
+		if (has_ext_counters(ps->ns->cap_mask)) {
+			mad_decode_perfcounters_ext(ps->pc, &e);
+			ibdiag_rec_counters(&rec, NULL, &e, 0);
+		} else {
+			mad_decode_perfcounters(ps->pc, &d);
+			ibdiag_rec_counters(&rec, &d, NULL, 0);
+		}
+	} else {
+		mad_decode_perfcounters(ps->pc, &d);
+		if (ps->have_pce)
+			mad_decode_perfcounters_ext(ps->pce, &e);
+		ibdiag_rec_counters(&rec, &d, ps->have_pce ? &e : NULL, 0);
+	}
+	ibdiag_rec_end(&rec);
+}
 
-static int print_results(ib_portid_t * portid, char *node_name,
-			 ibnd_node_t * node, uint8_t * pc, int portnum,
-			 int *header_printed, uint8_t *pce, uint16_t cap_mask)
+static int print_results(struct port_sweep *ps, int *header_printed)
 {
+	ibnd_node_t *node = ps->ns->node;
+	char *node_name = ps->ns->node_name;
+	uint16_t cap_mask = ps->ns->cap_mask;
+	int portnum = ps->portnum;
+	uint8_t *pc = ps->pc;
+	uint8_t *pce = ps->have_pce ? ps->pce : NULL;
+	struct ib_perfcounters_decoded d;
 	char buf[1024];
 	char *str = buf;
 	uint32_t val = 0;
 	int i, n;
 
+	mad_decode_perfcounters(pc, &d);
 	for (n = 0, i = IB_PC_ERR_SYM_F; i <= IB_PC_VL15_DROPPED_F; i++) {
 		if (suppress(i))
 			continue;
@@ -410,40 +586,45 @@ static int print_results(ib_portid_t * portid, char *node_name,
 		if (i == IB_PC_COUNTER_SELECT2_F)
 			continue;
 
-		mad_decode_field(pc, i, (void *)&val);
+		val = pc_counter(&d, i);
 		if (exceeds_threshold(i, val)) {
 			n += snprintf(str + n, 1024 - n, " [%s == %u]",
 				      mad_field_name(i), val);
 
-			/* If there are PortXmitDiscards, get details (if supported) */
-			if (i == IB_PC_XMT_DISCARDS_F && details) {
-				n += query_and_dump(str + n, sizeof(buf) - n, portid,
-						    node_name, portnum,
-						    "PortXmitDiscardDetails",
-						    IB_GSI_PORT_XMIT_DISCARD_DETAILS,
-						    IB_PC_RCV_LOCAL_PHY_ERR_F,
-						    IB_PC_RCV_ERR_LAST_F);
-				/* If there are PortRcvErrors, get details (if supported) */
-			} else if (i == IB_PC_ERR_RCV_F && details) {
-				n += query_and_dump(str + n, sizeof(buf) - n, portid,
-						    node_name, portnum,
-						    "PortRcvErrorDetails",
-						    IB_GSI_PORT_RCV_ERROR_DETAILS,
-						    IB_PC_XMT_INACT_DISC_F,
-						    IB_PC_XMT_DISC_LAST_F);
+			/* If there are PortXmitDiscards, add details (if supported) */
+			if (i == IB_PC_XMT_DISCARDS_F && ps->have_xmit_details) {
+				n += dump_details(str + n, sizeof(buf) - n,
+						  ps->xmit_details,
+						  IB_PC_RCV_LOCAL_PHY_ERR_F,
+						  IB_PC_RCV_ERR_LAST_F);
+				/* If there are PortRcvErrors, add details (if supported) */
+			} else if (i == IB_PC_ERR_RCV_F && ps->have_rcv_details) {
+				n += dump_details(str + n, sizeof(buf) - n,
+						  ps->rcv_details,
+						  IB_PC_XMT_INACT_DISC_F,
+						  IB_PC_XMT_DISC_LAST_F);
 			}
 		}
 	}
 
 	if (!suppress(IB_PC_XMT_WAIT_F)) {
-		mad_decode_field(pc, IB_PC_XMT_WAIT_F, (void *)&val);
+		val = d.xmt_wait;
 		if (exceeds_threshold(IB_PC_XMT_WAIT_F, val))
 			n += snprintf(str + n, 1024 - n, " [%s == %u]",
 				      mad_field_name(IB_PC_XMT_WAIT_F), val);
 	}
 
 	/* if we found errors. */
-	if (n != 0) {
+	if (n != 0 && ibd_format != IBDIAG_FORMAT_TEXT) {
+		if (!*header_printed) {
+			*header_printed = 1;
+			summary.bad_nodes++;
+		}
+		if (portnum != 0xFF) {
+			print_port_rec(ps);
+			summary.bad_ports++;
+		}
+	} else if (n != 0) {
 		if (data_counters) {
 			uint8_t *pkt = pc;
 			int start_field = IB_PC_XMT_BYTES_F;
@@ -506,71 +687,60 @@ static int print_results(ib_portid_t * portid, char *node_name,
 	return (n);
 }
 
-static int query_cap_mask(ib_portid_t * portid, char *node_name, int portnum,
-			  uint16_t * cap_mask)
+/* the part of print_results() which decides whether a port has errors */
+static int port_has_errors(uint8_t * pc)
 {
-	uint8_t pc[1024] = { 0 };
-	uint16_t rc_cap_mask;
-
-	portid->sl = lid2sl_table[portid->lid];
+	struct ib_perfcounters_decoded d;
+	int i;
 
-	/* PerfMgt ClassPortInfo is a required attribute */
-	if (!pma_query_via(pc, portid, portnum, ibd_timeout, CLASS_PORT_INFO,
-			   ibmad_port)) {
-		IBWARN("classportinfo query failed on %s, %s port %d",
-		       node_name, portid2str(portid), portnum);
-		summary.pma_query_failures++;
-		return -1;
+	mad_decode_perfcounters(pc, &d);
+	for (i = IB_PC_ERR_SYM_F; i <= IB_PC_VL15_DROPPED_F; i++) {
+		if (suppress(i) || i == IB_PC_COUNTER_SELECT2_F)
+			continue;
+		if (exceeds_threshold(i, pc_counter(&d, i)))
+			return 1;
 	}
 
-	/* ClassPortInfo should be supported as part of libibmad */
-	memcpy(&rc_cap_mask, pc + 2, sizeof(rc_cap_mask));	/* CapabilityMask */
+	if (suppress(IB_PC_XMT_WAIT_F))
+		return 0;
+	return exceeds_threshold(IB_PC_XMT_WAIT_F, d.xmt_wait);
+}
 
-	*cap_mask = rc_cap_mask;
-	return 0;
+static int wants_details(uint8_t * pc, enum MAD_FIELDS field)
+{
+	struct ib_perfcounters_decoded d;
+
+	if (!details || suppress(field))
+		return 0;
+	mad_decode_perfcounters(pc, &d);
+	return exceeds_threshold(field, pc_counter(&d, field));
 }
 
-static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
-			   char *node_name, ibnd_node_t * node, int portnum,
-			   int *header_printed)
+static void print_data_cnts(struct port_sweep *ps, int *header_printed)
 {
-	uint8_t pc[1024];
+	ibnd_node_t *node = ps->ns->node;
+	int portnum = ps->portnum;
 	int i;
 	int start_field = IB_PC_XMT_BYTES_F;
 	int end_field = IB_PC_RCV_PKTS_F;
 
-	memset(pc, 0, 1024);
-
-	portid->sl = lid2sl_table[portid->lid];
-
-	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			summary.pma_query_failures++;
-			return (1);
-		}
+	if (has_ext_counters(ps->ns->cap_mask)) {
 		start_field = IB_PC_EXT_XMT_BYTES_F;
-		if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED)
+		if (ps->ns->cap_mask & IB_PM_EXT_WIDTH_SUPPORTED)
 			end_field = IB_PC_EXT_RCV_MPKTS_F;
 		else
 			end_field = IB_PC_EXT_RCV_PKTS_F;
-	} else {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			summary.pma_query_failures++;
-			return (1);
-		}
-		start_field = IB_PC_XMT_BYTES_F;
-		end_field = IB_PC_RCV_PKTS_F;
+	}
+
+	if (ibd_format != IBDIAG_FORMAT_TEXT) {
+		if (portnum != 0xFF)
+			print_port_rec(ps);
+		return;
 	}
 
 	if (!*header_printed) {
 		printf("Data Counters for 0x%" PRIx64 " \"%s\"\n", node->guid,
-		       node_name);
+		       ps->ns->node_name);
 		*header_printed = 1;
 	}
 
@@ -585,7 +755,7 @@ static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
 		float val = 0;
 		char *unit = "";
 		int data = 0;
-		mad_decode_field(pc, i, (void *)&val64);
+		mad_decode_field(ps->pc, i, (void *)&val64);
 		if (i == IB_PC_EXT_XMT_BYTES_F || i == IB_PC_EXT_RCV_BYTES_F ||
 		    i == IB_PC_XMT_BYTES_F || i == IB_PC_RCV_BYTES_F)
 			data = 1;
@@ -597,98 +767,118 @@ static int print_data_cnts(ib_portid_t * portid, uint16_t cap_mask,
 
 	if (portnum != 0xFF && port_config)
 		print_port_config(node, portnum);
-
-	return (0);
 }
 
-static int print_errors(ib_portid_t * portid, uint16_t cap_mask,
-			char *node_name, ibnd_node_t * node, int portnum,
-			int *header_printed)
+static void print_sweep_node(struct node_sweep *ns)
 {
-	uint8_t pc[1024];
-	uint8_t pce[1024];
-	uint8_t *pc_ext = NULL;
+	ibnd_node_t *node = ns->node;
+	int header_printed = 0;
+	int p;
 
-	memset(pc, 0, 1024);
-	memset(pce, 0, 1024);
+	if (data_counters_only) {
+		for (p = ns->startport; p <= node->numports; p++) {
+			if (!node->ports[p])
+				continue;
+			if (!ns->ports[p].failed)
+				print_data_cnts(&ns->ports[p], &header_printed);
+			summary.ports_checked++;
+		}
+	} else if (ns->all_port_sup && !ns->per_port) {
+		summary.ports_checked += node->numports;
+	} else {
+		if (ns->all_port_sup)
+			print_results(&ns->all, &header_printed);
+
+		for (p = ns->startport; p <= node->numports; p++) {
+			if (!node->ports[p])
+				continue;
+			if (!ns->ports[p].failed)
+				print_results(&ns->ports[p], &header_printed);
+			summary.ports_checked++;
+		}
+	}
 
-	portid->sl = lid2sl_table[portid->lid];
+	summary.nodes_checked++;
+}
 
-	if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-			   IB_GSI_PORT_COUNTERS, ibmad_port)) {
-		IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
-		       node_name, portid2str(portid), portnum);
-		summary.pma_query_failures++;
-		return (0);
-	}
+static void start_nodes(void);
 
-	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
-		if (!pma_query_via(pce, portid, portnum, ibd_timeout,
-		    IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			summary.pma_query_failures++;
-			return (0);
-		}
-		pc_ext = pce;
-	}
+static void print_ready(void)
+{
+	struct node_sweep *ns;
 
-	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
-		/* if PortCounters:PortXmitWait not supported clear this counter */
-		uint32_t foo = 0;
-		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &foo);
+	while (sweep_printed < sweep_started && sweep[sweep_printed].done) {
+		ns = &sweep[sweep_printed++];
+		print_sweep_node(ns);
+		free(ns->ports);
+		free(ns->node_name);
 	}
-	return (print_results(portid, node_name, node, pc, portnum,
-			      header_printed, pc_ext, cap_mask));
+	start_nodes();
 }
 
-uint8_t *reset_pc_ext(void *rcvbuf, ib_portid_t * dest,
-		      int port, unsigned mask, unsigned timeout,
-		      const struct ibmad_port * srcport)
-{
-	ib_rpc_t rpc = { 0 };
-	int lid = dest->lid;
+static void clear_port(struct port_sweep *ps);
 
-	DEBUG("lid %u port %d mask 0x%x", lid, port, mask);
+static void node_done(struct node_sweep *ns)
+{
+	if (--ns->pending)
+		return;
 
-	if (lid == -1) {
-		IBWARN("only lid routed is supported");
-		return NULL;
+	if (ns->all_port_sup && !ns->all_cleared) {
+		ns->all_cleared = 1;
+		clear_port(&ns->all);
+		if (ns->pending)
+			return;
 	}
 
-	if (!mask)
-		mask = ~0;
+	ns->done = 1;
+	print_ready();
+}
 
-	rpc.mgtclass = IB_PERFORMANCE_CLASS;
-	rpc.method = IB_MAD_METHOD_SET;
-	rpc.attr.id = IB_GSI_PORT_COUNTERS_EXT;
+static void start_port_reads(struct node_sweep *ns);
 
-	memset(rcvbuf, 0, IB_MAD_SIZE);
+/* one query for ps completed; move on to whatever it enables */
+static void port_done(struct port_sweep *ps)
+{
+	struct node_sweep *ns = ps->ns;
+
+	if (--ps->pending == 0 && !ps->finished) {
+		ps->finished = 1;
+		if (ps == &ns->all) {
+			if (!ps->failed && port_has_errors(ps->pc)) {
+				ns->per_port = 1;
+				start_port_reads(ns);
+			}
+		} else if (!ns->all_port_sup)
+			clear_port(ps);
+	}
 
-	/* Same for attribute IDs */
-	mad_set_field(rcvbuf, 0, IB_PC_EXT_PORT_SELECT_F, port);
-	mad_set_field(rcvbuf, 0, IB_PC_EXT_COUNTER_SELECT_F, mask);
-	rpc.attr.mod = 0;
-	rpc.timeout = timeout;
-	rpc.datasz = IB_PC_DATA_SZ;
-	rpc.dataoffs = IB_PC_DATA_OFFS;
-	if (!dest->qp)
-		dest->qp = 1;
-	if (!dest->qkey)
-		dest->qkey = IB_DEFAULT_QP1_QKEY;
+	node_done(ns);
+}
 
-	return mad_rpc(srcport, &rpc, dest, rcvbuf, rcvbuf);
+static void clear_cb(struct pma_query *q, uint8_t * data, int status)
+{
+	struct port_sweep *ps = q->cb_data;
+
+	if (status && q->rpc.attr.id == IB_GSI_PORT_COUNTERS)
+		fprintf(stderr, "Failed to reset errors %s port %d\n",
+			ps->ns->node_name, ps->portnum);
+	else if (status && q->rpc.attr.id == IB_GSI_PORT_COUNTERS_EXT)
+		fprintf(stderr, "Failed to reset extended data counters %s, "
+			"%s port %d\n", ps->ns->node_name,
+			portid2str(&ps->portid), ps->portnum);
+	port_done(ps);
 }
 
-static void clear_port(ib_portid_t * portid, uint16_t cap_mask,
-		       char *node_name, int port)
+static void clear_port(struct port_sweep *ps)
 {
-	uint8_t pc[1024] = { 0 };
+	uint16_t cap_mask = ps->ns->cap_mask;
 	/* bits defined in Table 228 PortCounters CounterSelect and
 	 * CounterSelect2
 	 */
 	uint32_t mask = 0;
 
+	ps->finished = 1;
+
 	if (clear_errors) {
 		mask |= 0xFFF;
 		if (cap_mask & IB_PM_PC_XMIT_WAIT_SUP)
@@ -698,134 +888,255 @@ static void clear_port(ib_portid_t * portid, uint16_t cap_mask,
 		mask |= 0xF000;
 
 	if (mask)
-		if (!performance_reset_via(pc, portid, port, mask, ibd_timeout,
-					   IB_GSI_PORT_COUNTERS, ibmad_port))
-			fprintf(stderr, "Failed to reset errors %s port %d\n", node_name,
-				port);
+		sweep_reset(ps, mask, IB_GSI_PORT_COUNTERS, clear_cb);
 
 	if (clear_errors && details) {
-		memset(pc, 0, 1024);
-		performance_reset_via(pc, portid, port, 0xf, ibd_timeout,
-				      IB_GSI_PORT_XMIT_DISCARD_DETAILS,
-				      ibmad_port);
-		memset(pc, 0, 1024);
-		performance_reset_via(pc, portid, port, 0x3f, ibd_timeout,
-				      IB_GSI_PORT_RCV_ERROR_DETAILS,
-				      ibmad_port);
+		sweep_reset(ps, 0xf, IB_GSI_PORT_XMIT_DISCARD_DETAILS,
+			    clear_cb);
+		sweep_reset(ps, 0x3f, IB_GSI_PORT_RCV_ERROR_DETAILS,
+			    clear_cb);
 	}
 
-	if (clear_counts &&
-	    (cap_mask &
-	     (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP))) {
+	if (clear_counts && has_ext_counters(cap_mask)) {
 		if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED)
 			mask = 0xFF;
 		else
 			mask = 0x0F;
 
-		if (!reset_pc_ext(pc, portid, port, mask, ibd_timeout,
-		    ibmad_port))
-			fprintf(stderr, "Failed to reset extended data counters %s, "
-				"%s port %d\n", node_name, portid2str(portid),
-				port);
+		sweep_reset(ps, mask, IB_GSI_PORT_COUNTERS_EXT, clear_cb);
 	}
 }
 
-void print_node(ibnd_node_t * node, void *user_data)
+static void details_cb(struct pma_query *q, uint8_t * data, int status)
 {
-	int header_printed = 0;
-	int p = 0;
-	int startport = 1;
-	int type = 0;
-	int all_port_sup = 0;
-	ib_portid_t portid = { 0 };
-	uint16_t cap_mask = 0;
-	char *node_name = NULL;
+	struct port_sweep *ps = q->cb_data;
+	int xmit = (q->rpc.attr.id == IB_GSI_PORT_XMIT_DISCARD_DETAILS);
+
+	if (status)
+		query_failed(ps, xmit ? "PortXmitDiscardDetails" :
+			     "PortRcvErrorDetails");
+	else if (xmit) {
+		memcpy(ps->xmit_details, data, IB_PC_DATA_SZ);
+		ps->have_xmit_details = 1;
+	} else {
+		memcpy(ps->rcv_details, data, IB_PC_DATA_SZ);
+		ps->have_rcv_details = 1;
+	}
+	port_done(ps);
+}
 
-	switch (node->type) {
-	case IB_NODE_SWITCH:
-		type = PRINT_SWITCH;
-		break;
-	case IB_NODE_CA:
-		type = PRINT_CA;
-		break;
-	case IB_NODE_ROUTER:
-		type = PRINT_ROUTER;
-		break;
+static void pce_cb(struct pma_query *q, uint8_t * data, int status)
+{
+	struct port_sweep *ps = q->cb_data;
+
+	if (status) {
+		query_failed(ps, "IB_GSI_PORT_COUNTERS_EXT");
+		ps->failed = 1;
+	} else {
+		memcpy(ps->pce, data, IB_PC_DATA_SZ);
+		ps->have_pce = 1;
 	}
+	port_done(ps);
+}
 
-	if ((type & node_type_to_print) == 0)
-		return;
+static void pc_cb(struct pma_query *q, uint8_t * data, int status)
+{
+	struct port_sweep *ps = q->cb_data;
+
+	if (status) {
+		query_failed(ps, "IB_GSI_PORT_COUNTERS");
+		ps->failed = 1;
+		goto done;
+	}
+
+	memcpy(ps->pc, data, IB_PC_DATA_SZ);
+	if (!(ps->ns->cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
+		/* if PortCounters:PortXmitWait not supported clear this counter */
+		uint32_t foo = 0;
+		mad_encode_field(ps->pc, IB_PC_XMT_WAIT_F, &foo);
+	}
+
+	if (has_ext_counters(ps->ns->cap_mask))
+		sweep_query(ps, IB_GSI_PORT_COUNTERS_EXT, pce_cb);
+
+	/* If there are PortXmitDiscards or PortRcvErrors, get details
+	 * (if supported) */
+	if (wants_details(ps->pc, IB_PC_XMT_DISCARDS_F))
+		sweep_query(ps, IB_GSI_PORT_XMIT_DISCARD_DETAILS, details_cb);
+	if (wants_details(ps->pc, IB_PC_ERR_RCV_F))
+		sweep_query(ps, IB_GSI_PORT_RCV_ERROR_DETAILS, details_cb);
+
+done:
+	port_done(ps);
+}
+
+/* --counters: PortCountersExtended if supported, PortCounters otherwise */
+static void data_cnts_cb(struct pma_query *q, uint8_t * data, int status)
+{
+	struct port_sweep *ps = q->cb_data;
+
+	if (status) {
+		query_failed(ps, q->rpc.attr.id == IB_GSI_PORT_COUNTERS_EXT ?
+			     "IB_GSI_PORT_COUNTERS_EXT" :
+			     "IB_GSI_PORT_COUNTERS");
+		ps->failed = 1;
+	} else
+		memcpy(ps->pc, data, IB_PC_DATA_SZ);
+	port_done(ps);
+}
+
+static void start_port_reads(struct node_sweep *ns)
+{
+	ibnd_node_t *node = ns->node;
+	struct port_sweep *ps;
+	int p;
+
+	for (p = ns->startport; p <= node->numports; p++) {
+		if (!node->ports[p])
+			continue;
+
+		ps = &ns->ports[p];
+		ps->ns = ns;
+		ps->portnum = p;
+		if (node->type == IB_NODE_SWITCH)
+			ib_portid_set(&ps->portid, node->smalid, 0, 0);
+		else
+			ib_portid_set(&ps->portid, node->ports[p]->base_lid,
+				      0, 0);
+
+		if (data_counters_only)
+			sweep_query(ps, has_ext_counters(ns->cap_mask) ?
+				    IB_GSI_PORT_COUNTERS_EXT :
+				    IB_GSI_PORT_COUNTERS, data_cnts_cb);
+		else
+			sweep_query(ps, IB_GSI_PORT_COUNTERS, pc_cb);
+	}
+}
+
+static void cpi_cb(struct pma_query *q, uint8_t * data, int status)
+{
+	struct node_sweep *ns = q->cb_data;
+	uint16_t rc_cap_mask;
+
+	if (status) {
+		IBWARN("classportinfo query failed on %s, %s port %d",
+		       ns->node_name, portid2str(&ns->portid), ns->cpi_port);
+		summary.pma_query_failures++;
+	} else {
+		/* ClassPortInfo should be supported as part of libibmad */
+		memcpy(&rc_cap_mask, data + 2, sizeof(rc_cap_mask));	/* CapabilityMask */
+		ns->cap_mask = rc_cap_mask;
+		if (ns->cap_mask & IB_PM_ALL_PORT_SELECT)
+			ns->all_port_sup = 1;
+	}
+
+	ns->all.ns = ns;
+	ns->all.portid = ns->portid;
+	ns->all.portnum = 0xFF;
+
+	if (ns->all_port_sup && !data_counters_only)
+		sweep_query(&ns->all, IB_GSI_PORT_COUNTERS, pc_cb);
+	else
+		start_port_reads(ns);
+
+	node_done(ns);
+}
+
+static void start_node(struct node_sweep *ns)
+{
+	ibnd_node_t *node = ns->node;
+	int p = 0;
 
 	if (node->type == IB_NODE_SWITCH && node->smaenhsp0)
-		startport = 0;
+		ns->startport = 0;
+	else
+		ns->startport = 1;
 
-	node_name = remap_node_name(node_name_map, node->guid, node->nodedesc);
+	ns->node_name = remap_node_name(node_name_map, node->guid,
+					node->nodedesc);
+	ns->ports = calloc(node->numports + 1, sizeof(*ns->ports));
+	if (!ns->ports)
+		IBPANIC("out of memory");
 
 	if (node->type == IB_NODE_SWITCH) {
-		ib_portid_set(&portid, node->smalid, 0, 0);
+		ib_portid_set(&ns->portid, node->smalid, 0, 0);
 		p = 0;
 	} else {
 		for (p = 1; p <= node->numports; p++) {
 			if (node->ports[p]) {
-				ib_portid_set(&portid,
+				ib_portid_set(&ns->portid,
 					      node->ports[p]->base_lid,
 					      0, 0);
 				break;
 			}
 		}
 	}
+	ns->cpi_port = p;
+	ns->portid.sl = lid2sl_table[ns->portid.lid];
 
-	if ((query_cap_mask(&portid, node_name, p, &cap_mask) == 0) &&
-	    (cap_mask & IB_PM_ALL_PORT_SELECT))
-		all_port_sup = 1;
+	/* PerfMgt ClassPortInfo is a required attribute */
+	if (pma_query_async(&pma_engine, &ns->portid, p, CLASS_PORT_INFO,
+			    cpi_cb, ns))
+		IBPANIC("out of memory");
+	ns->pending++;
+}
 
-	if (data_counters_only) {
-		for (p = startport; p <= node->numports; p++) {
-			if (node->ports[p]) {
-				if (node->type == IB_NODE_SWITCH)
-					ib_portid_set(&portid, node->smalid, 0, 0);
-				else
-					ib_portid_set(&portid, node->ports[p]->base_lid,
-						      0, 0);
-
-				print_data_cnts(&portid, cap_mask, node_name, node, p,
-						&header_printed);
-				summary.ports_checked++;
-				if (!all_port_sup)
-					clear_port(&portid, cap_mask, node_name, p);
-			}
-		}
-	} else {
-		if (all_port_sup)
-			if (!print_errors(&portid, cap_mask, node_name, node,
-					  0xFF, &header_printed)) {
-				summary.ports_checked += node->numports;
-				goto clear;
-			}
+/* keep a bounded number of nodes between started and printed */
+static void start_nodes(void)
+{
+	while (sweep_started < sweep_count &&
+	       sweep_started - sweep_printed < (int)pma_window * 2)
+		start_node(&sweep[sweep_started++]);
+}
 
-		for (p = startport; p <= node->numports; p++) {
-			if (node->ports[p]) {
-				if (node->type == IB_NODE_SWITCH)
-					ib_portid_set(&portid, node->smalid, 0, 0);
-				else
-					ib_portid_set(&portid, node->ports[p]->base_lid,
-						      0, 0);
-
-				print_errors(&portid, cap_mask, node_name, node, p,
-					     &header_printed);
-				summary.ports_checked++;
-				if (!all_port_sup)
-					clear_port(&portid, cap_mask, node_name, p);
-			}
-		}
+void queue_node(ibnd_node_t * node, void *user_data)
+{
+	int type = 0;
+
+	switch (node->type) {
+	case IB_NODE_SWITCH:
+		type = PRINT_SWITCH;
+		break;
+	case IB_NODE_CA:
+		type = PRINT_CA;
+		break;
+	case IB_NODE_ROUTER:
+		type = PRINT_ROUTER;
+		break;
 	}
 
-clear:
-	summary.nodes_checked++;
-	if (all_port_sup)
-		clear_port(&portid, cap_mask, node_name, 0xFF);
+	if ((type & node_type_to_print) == 0)
+		return;
 
-	free(node_name);
+	if (sweep_count == sweep_size) {
+		sweep_size = sweep_size ? sweep_size * 2 : 256;
+		sweep = realloc(sweep, sweep_size * sizeof(*sweep));
+		if (!sweep)
+			IBPANIC("out of memory");
+	}
+	memset(&sweep[sweep_count], 0, sizeof(*sweep));
+	sweep[sweep_count++].node = node;
+}
+
+static int sweep_nodes(void)
+{
+	int rc = 0;
+
+	if (!sweep_count)
+		return 0;
+
+	if ((rc = pma_engine_open(&pma_engine, ibd_ca, ibd_ca_port,
+				  pma_window, DEFAULT_PMAS_PER_LID,
+				  ibd_timeout)) == 0) {
+		start_nodes();
+		rc = pma_engine_run(&pma_engine);
+		pma_engine_close(&pma_engine);
+	}
+
+	free(sweep);
+	sweep = NULL;
+	sweep_count = sweep_size = sweep_started = sweep_printed = 0;
+	return rc;
 }
 
 static void add_suppressed(enum MAD_FIELDS field)
@@ -918,6 +1229,18 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 'o':
 		cfg->max_smps = strtoul(optarg, NULL, 0);
 		break;
+	case 11:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_ADAPTIVE_SMPS;
+		break;
+	case 12:
+		ibd_ibnetdisc_flags |= IBND_CONFIG_MULTI_PORT;
+		break;
+	case 13:
+		rediscover_file = strdup(optarg);
+		break;
+	case 14:
+		pma_window = strtoul(optarg, NULL, 0);
+		break;
 	default:
 		return -1;
 	}
@@ -974,11 +1297,24 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"adaptive_smps", 11, 0, NULL,
+		 "adapt the number of outstanding SMP's to the fabric; "
+		 "-o sets the upper limit"},
+		{"multi_port", 12, 0, NULL,
+		 "scan from every active local port on the subnet in parallel"},
+		{"rediscover", 13, 1, "<file>",
+		 "only scan in full what changed since the fabric cached "
+		 "in <file>"},
+		{"outstanding_pmas", 14, 1, NULL,
+		 "specify the number of outstanding PerfMgt queries which "
+		 "should be issued during the error sweep"},
 		{0}
 	};
 	char usage_args[] = "";
 
 	memset(suppressed_fields, 0, sizeof suppressed_fields);
+	ibd_format_supported = 1;
+	ibd_daemon_supported = 1;
 	ibdiag_process_opts(argc, argv, &config, "cDGKLnRrSs", opts, process_opt,
 			    usage_args, NULL);
 
@@ -988,6 +1324,9 @@ int main(int argc, char **argv)
 	if (!node_type_to_print)
 		node_type_to_print = PRINT_ALL;
 
+	ibdiag_out_init(&out, stdout);
+	ibdiag_rec_init(&rec, &out, port_fields);
+
 	ibmad_port = mad_rpc_open_port(ibd_ca, ibd_ca_port, mgmt_classes, 4);
 	if (!ibmad_port)
 		IBEXIT("Failed to open port; %s:%d\n", ibd_ca, ibd_ca_port);
@@ -1051,10 +1390,10 @@ int main(int argc, char **argv)
 				       " attempting full scan");
 		}
 
-		if (!fabric && !(fabric = ibnd_discover_fabric(ibd_ca,
-							       ibd_ca_port,
-							       NULL,
-							       &config))) {
+		if (!fabric && !(fabric = ibdiag_discover_fabric(ibd_ca,
+								 ibd_ca_port,
+								 &config,
+								 rediscover_file))) {
 			fprintf(stderr, "discover failed\n");
 			rc = -1;
 			goto close_name_map;
@@ -1081,7 +1420,7 @@ int main(int argc, char **argv)
 	if (port_guid_str) {
 		ibnd_port_t *port = ibnd_find_port_guid(fabric, port_guid);
 		if (port)
-			print_node(port->node, NULL);
+			queue_node(port->node, NULL);
 		else
 			fprintf(stderr, "Failed to find node: %s\n",
 				port_guid_str);
@@ -1101,7 +1440,7 @@ int main(int argc, char **argv)
 			if(obtain_sl)
 				if(path_record_query(self_gid,port->guid))
 					goto close_port;
-			print_node(port->node, NULL);
+			queue_node(port->node, NULL);
 		} else
 			fprintf(stderr, "Failed to find node: %s\n", dr_path);
 	} else {
@@ -1109,7 +1448,13 @@ int main(int argc, char **argv)
 			if(path_record_query(self_gid,0))
 				goto close_port;
 
-		ibnd_iter_nodes(fabric, print_node, NULL);
+		ibnd_iter_nodes(fabric, queue_node, NULL);
+	}
+
+	if (sweep_nodes() < 0) {
+		fprintf(stderr, "PerfMgt sweep failed\n");
+		rc = -1;
+		goto close_port;
 	}
 
 	rc = print_summary();
@@ -1121,6 +1466,8 @@ close_port:
 	ibnd_destroy_fabric(fabric);
 
 close_name_map:
+	if (ibdiag_out_close(&out))
+		IBEXIT("writing the port records failed\n");
 	close_node_name_map(node_name_map);
 	exit(rc);
 }
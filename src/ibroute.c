@@ -49,10 +49,11 @@
 #include <complib/cl_nodenamemap.h>
 
 #include "ibdiag_common.h"
+#include "ibdiag_sa.h"
 
 struct ibmad_port *srcport;
 
-static int brief, dump_all, multicast;
+static int brief, dump_all, multicast, via_sa;
 
 static char *node_name_map_file = NULL;
 static nn_map_t *node_name_map = NULL;
@@ -88,7 +89,97 @@ char *check_switch(ib_portid_t * portid, unsigned int *nports, uint64_t * guid,
 	return 0;
 }
 
-#define IB_MLIDS_IN_BLOCK	(IB_SMP_DATA_SIZE/2)
+/* With --via-sa the blocks of the table, each of "chunks" port masks for
+ * multicast, are those of the SM's copy, fetched in one GetTable. */
+static uint8_t *sa_tbl;
+static unsigned sa_startblock, sa_nblocks, sa_chunks;
+
+static uint8_t *sa_block(unsigned block, unsigned chunk)
+{
+	return sa_tbl + ((block - sa_startblock) * sa_chunks + chunk) *
+	    IB_SMP_DATA_SIZE;
+}
+
+static void sa_store_record(void *rec)
+{
+	void *data;
+	int idx;
+
+	idx = sa_ft_record_index(rec, multicast, sa_startblock, sa_nblocks,
+				 sa_chunks, &data);
+	if (idx >= 0)
+		memcpy(sa_tbl + idx * IB_SMP_DATA_SIZE, data,
+		       IB_SMP_DATA_SIZE);
+}
+
+char *read_tables_via_sa(ib_portid_t * portid, unsigned startblock,
+			 unsigned nblocks, unsigned chunks)
+{
+	uint8_t pi[IB_SMP_DATA_SIZE] = { 0 };
+	ib_lft_record_t lftr;
+	ib_mft_record_t mftr;
+	ib_net64_t comp_mask = 0;
+	struct sa_handle *h;
+	struct sa_cursor c;
+	void *rec;
+	int lid = portid->lid, ret;
+
+	/* the SA knows the switch by the LID of port 0 */
+	if (!lid) {
+		if (!smp_query_via(pi, portid, IB_ATTR_PORT_INFO, 0, 0,
+				   srcport))
+			return "port info failed";
+		mad_decode_field(pi, IB_PORT_LID_F, &lid);
+	}
+
+	sa_startblock = startblock;
+	sa_nblocks = nblocks;
+	sa_chunks = chunks;
+	if (!(sa_tbl = calloc(nblocks * chunks, IB_SMP_DATA_SIZE)))
+		return "out of memory";
+
+	if (!(h = sa_get_handle())) {
+		free(sa_tbl);
+		sa_tbl = NULL;
+		return "SA not found";
+	}
+
+	memset(&lftr, 0, sizeof(lftr));
+	memset(&mftr, 0, sizeof(mftr));
+	if (multicast) {
+		CHECK_AND_SET_VAL(lid, 16, 0, mftr.lid, MFTR, LID);
+		ret = sa_query_cursor(h, IB_MAD_METHOD_GET_TABLE,
+				      IB_SA_ATTR_MFTRECORD, 0,
+				      cl_ntoh64(comp_mask), ibd_sakey, &mftr,
+				      sizeof(mftr), &c);
+	} else {
+		CHECK_AND_SET_VAL(lid, 16, 0, lftr.lid, LFTR, LID);
+		ret = sa_query_cursor(h, IB_MAD_METHOD_GET_TABLE,
+				      IB_SA_ATTR_LFTRECORD, 0,
+				      cl_ntoh64(comp_mask), ibd_sakey, &lftr,
+				      sizeof(lftr), &c);
+	}
+	if (ret) {
+		fprintf(stderr, "Query SA failed: %s\n", strerror(ret));
+		goto err;
+	}
+	if (c.status != IB_SA_MAD_STATUS_SUCCESS) {
+		sa_report_err(c.status);
+		goto err;
+	}
+
+	while ((rec = sa_cursor_next(&c)))
+		sa_store_record(rec);
+
+	sa_free_handle(h);
+	return 0;
+
+err:
+	sa_free_handle(h);
+	free(sa_tbl);
+	sa_tbl = NULL;
+	return "SA query failed";
+}
 
 int dump_mlid(char *str, int strlen, unsigned mlid, unsigned nports,
 	      uint16_t mft[16][IB_MLIDS_IN_BLOCK])
@@ -208,12 +299,21 @@ char *dump_multicast_tables(ib_portid_t * portid, unsigned startlid,
 
 	startblock = startlid / IB_MLIDS_IN_BLOCK;
 	lastblock = endlid / IB_MLIDS_IN_BLOCK;
+	if (via_sa && startblock <= lastblock &&
+	    (s = read_tables_via_sa(portid, startblock,
+				    lastblock - startblock + 1, chunks)))
+		return s;
 	for (block = startblock; block <= lastblock; block++) {
 		for (j = 0; j < chunks; j++) {
 			int status;
 			mod = (block - IB_MIN_MCAST_LID / IB_MLIDS_IN_BLOCK)
 			    | (j << 28);
 
+			if (via_sa) {
+				memcpy(mft + j, sa_block(block, j),
+				       IB_SMP_DATA_SIZE);
+				continue;
+			}
 			DEBUG("reading block %x chunk %d mod %x", block, j,
 			      mod);
 			if (!smp_query_status_via
@@ -244,6 +344,7 @@ char *dump_multicast_tables(ib_portid_t * portid, unsigned startlid,
 	printf("%d %smlids dumped \n", n, dump_all ? "" : "valid ");
 
 	free(mapnd);
+	free(sa_tbl);
 	return 0;
 }
 
@@ -360,10 +461,16 @@ char *dump_unicast_tables(ib_portid_t * portid, int startlid, int endlid)
 	printf("       Port     Info \n");
 	startblock = startlid / IB_SMP_DATA_SIZE;
 	endblock = ALIGN(endlid, IB_SMP_DATA_SIZE) / IB_SMP_DATA_SIZE;
+	if (via_sa && startblock < endblock &&
+	    (s = read_tables_via_sa(portid, startblock, endblock - startblock,
+				    1)))
+		return s;
 	for (block = startblock; block < endblock; block++) {
 		int status;
 		DEBUG("reading block %d", block);
-		if (!smp_query_status_via(lft, portid, IB_ATTR_LINEARFORWTBL, block,
+		if (via_sa)
+			memcpy(lft, sa_block(block, 0), IB_SMP_DATA_SIZE);
+		else if (!smp_query_status_via(lft, portid, IB_ATTR_LINEARFORWTBL, block,
 				   0, &status, srcport)) {
 			fprintf(stderr, "SubnGet() failed"
 					"; MAD status 0x%x AM 0x%x\n",
@@ -391,6 +498,7 @@ char *dump_unicast_tables(ib_portid_t * portid, int startlid, int endlid)
 
 	printf("%d %slids dumped \n", n, dump_all ? "" : "valid ");
 	free(mapnd);
+	free(sa_tbl);
 	return 0;
 }
 
@@ -409,6 +517,9 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 1:
 		node_name_map_file = strdup(optarg);
 		break;
+	case 2:
+		via_sa++;
+		break;
 	default:
 		return -1;
 	}
@@ -429,6 +540,8 @@ int main(int argc, char **argv)
 		 "do not try to resolve destinations"},
 		{"Multicast", 'M', 0, NULL, "show multicast forwarding tables"},
 		{"node-name-map", 1, 1, "<file>", "node name map file"},
+		{"via-sa", 2, 0, NULL,
+		 "read the table from the SA instead of the switch"},
 		{0}
 	};
 	char usage_args[] = "[<dest dr_path|lid|guid> [<startlid> [<endlid>]]]";
@@ -445,6 +558,7 @@ int main(int argc, char **argv)
 		"-M 4\t# dump all non empty mlids of switch with lid 4",
 		"-M 4 0xc010 0xc020\t# same, but with range",
 		"-M -n 4\t# simple dump format",
+		"--via-sa 4\t# dump the SM's copy of the table",
 		NULL,
 	};
 
@@ -0,0 +1,743 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <complib/cl_nodenamemap.h>
+#include <complib/cl_qmap.h>
+
+#include <infiniband/ibnetdisc.h>
+
+#include "ibdiag_common.h"
+
+#define MAX_HOPS	64
+#define WORK_CHUNK	64
+#define HIST_BUCKETS	20
+#define HIST_WIDTH	50
+
+/* what the far end of a switch port is */
+enum {
+	LINK_NONE,
+	LINK_HOST,
+	LINK_UP,
+	LINK_DOWN,
+	LINK_ACROSS,
+};
+
+static const char *link_str[] = { "-", "host", "up", "down", "across" };
+
+struct rb_switch {
+	cl_map_item_t map_item;	/* by node guid */
+	ibnd_node_t *node;
+	char *name;
+	unsigned base;		/* of this switch's ports in the count arrays */
+	int *peer;		/* switch index by port, -1 for hosts and none */
+	uint8_t *link;		/* LINK_* by port */
+	int rank;		/* hops from the nearest host, -1 if none */
+	unsigned weight;	/* host ports attached (path sources) */
+	int uplinks;
+	uint64_t min, max;
+	int unbalanced;
+};
+
+struct rb_dest {
+	uint16_t lid;
+	int sw;			/* switch the destination port hangs off */
+};
+
+struct rb_fabric {
+	struct rb_switch *sw;
+	int nsw;
+	unsigned nports;
+	struct rb_dest *dest;
+	int ndest, dest_size;
+	int *srcs;		/* switches with hosts attached */
+	int nsrcs;
+	uint64_t *count;	/* routes by switch port */
+	uint64_t lost;		/* unrouted destinations or paths */
+};
+
+struct rb_thread {
+	pthread_t thread;
+	struct rb_fabric *rf;
+	uint64_t *count;
+	uint64_t lost;
+};
+
+static char *node_name_map_file = NULL;
+static nn_map_t *node_name_map = NULL;
+static char *load_cache_file = NULL;
+static int cached_fts = 0;
+static int paths = 0;
+static int csv = 0;
+static int histogram = 0;
+static int nthreads = 0;
+static long slack = -1;
+
+static unsigned next_item;
+
+static unsigned claim_work(unsigned total, unsigned *end)
+{
+	unsigned start = __sync_fetch_and_add(&next_item, WORK_CHUNK);
+
+	if (start >= total) {
+		*end = total;
+		return total;
+	}
+	*end = start + WORK_CHUNK < total ? start + WORK_CHUNK : total;
+	return start;
+}
+
+/* destinations mode: each switch counts the host LIDs behind each port */
+static void *count_dests(void *arg)
+{
+	struct rb_thread *t = arg;
+	struct rb_fabric *rf = t->rf;
+	unsigned i, end, d;
+
+	while ((i = claim_work(rf->nsw, &end)) < (unsigned)rf->nsw)
+		for (; i < end; i++) {
+			struct rb_switch *sw = &rf->sw[i];
+			ibnd_node_t *node = sw->node;
+			uint64_t *count = rf->count + sw->base;
+
+			for (d = 0; d < (unsigned)rf->ndest; d++) {
+				uint16_t lid = rf->dest[d].lid;
+				uint8_t p;
+
+				if (lid >= node->lft_size ||
+				    (p = node->lft[lid]) > node->numports ||
+				    sw->link[p] == LINK_NONE) {
+					t->lost++;
+					continue;
+				}
+				count[p]++;
+			}
+		}
+	return NULL;
+}
+
+/* follow the LFTs from switch s to lid, adding weight to every port used */
+static int walk(struct rb_fabric *rf, int s, uint16_t lid, unsigned weight,
+		uint64_t *count)
+{
+	int hops;
+
+	for (hops = 0; hops < MAX_HOPS; hops++) {
+		struct rb_switch *sw = &rf->sw[s];
+		ibnd_node_t *node = sw->node;
+		uint8_t p;
+
+		if (lid >= node->lft_size ||
+		    (p = node->lft[lid]) > node->numports ||
+		    sw->link[p] == LINK_NONE)
+			return -1;
+		count[sw->base + p] += weight;
+		if (sw->link[p] == LINK_HOST)
+			return 0;
+		s = sw->peer[p];
+	}
+	return -1;
+}
+
+/* paths mode: every host port sends to every host LID */
+static void *count_paths(void *arg)
+{
+	struct rb_thread *t = arg;
+	struct rb_fabric *rf = t->rf;
+	unsigned i, end;
+	int j;
+
+	while ((i = claim_work(rf->ndest, &end)) < (unsigned)rf->ndest)
+		for (; i < end; i++) {
+			struct rb_dest *dest = &rf->dest[i];
+
+			for (j = 0; j < rf->nsrcs; j++) {
+				int s = rf->srcs[j];
+				unsigned w = rf->sw[s].weight;
+
+				/* not from the destination port to itself */
+				if (s == dest->sw)
+					w--;
+				if (w && walk(rf, s, dest->lid, w, t->count))
+					t->lost += w;
+			}
+		}
+	return NULL;
+}
+
+static int count_routes(struct rb_fabric *rf)
+{
+	struct rb_thread *threads;
+	unsigned items = paths ? rf->ndest : rf->nsw;
+	unsigned n = nthreads, i, p;
+	int started, rc = 0;
+
+	if (!n)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > (items + WORK_CHUNK - 1) / WORK_CHUNK)
+		n = (items + WORK_CHUNK - 1) / WORK_CHUNK;
+	if (!n)
+		n = 1;
+
+	if (!(threads = calloc(n, sizeof(*threads))))
+		return -ENOMEM;
+	for (i = 0; i < n; i++) {
+		threads[i].rf = rf;
+		/* switches are counted in place, paths from any destination
+		 * can cross any port */
+		if (!paths)
+			threads[i].count = rf->count;
+		else if (!(threads[i].count = calloc(rf->nports,
+						     sizeof(uint64_t)))) {
+			rc = -ENOMEM;
+			goto out;
+		}
+	}
+
+	next_item = 0;
+	for (started = 0; started < (int)n; started++)
+		if (pthread_create(&threads[started].thread, NULL,
+				   paths ? count_paths : count_dests,
+				   &threads[started])) {
+			IBWARN("failed to start counting thread %d", started);
+			break;
+		}
+	/* a thread that never started leaves its share to the others */
+	if (!started)
+		(paths ? count_paths : count_dests)(&threads[0]);
+	for (i = 0; i < (unsigned)started; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	for (i = 0; i < n; i++) {
+		rf->lost += threads[i].lost;
+		if (paths)
+			for (p = 0; p < rf->nports; p++)
+				rf->count[p] += threads[i].count[p];
+	}
+out:
+	if (paths)
+		for (i = 0; i < n; i++)
+			free(threads[i].count);
+	free(threads);
+	return rc;
+}
+
+static struct rb_switch *find_switch(cl_qmap_t *map, ibnd_node_t *node)
+{
+	cl_map_item_t *item = cl_qmap_get(map, node->guid);
+
+	if (item == cl_qmap_end(map))
+		return NULL;
+	return (struct rb_switch *)item;
+}
+
+static void rank_switches(struct rb_fabric *rf)
+{
+	int *queue, head = 0, tail = 0, i, p;
+
+	if (!(queue = calloc(rf->nsw, sizeof(*queue))))
+		IBEXIT("out of memory");
+
+	for (i = 0; i < rf->nsw; i++) {
+		rf->sw[i].rank = rf->sw[i].weight ? 0 : -1;
+		if (!rf->sw[i].rank)
+			queue[tail++] = i;
+	}
+	while (head < tail) {
+		struct rb_switch *sw = &rf->sw[queue[head++]];
+
+		for (p = 1; p <= sw->node->numports; p++) {
+			struct rb_switch *peer;
+
+			if (sw->peer[p] < 0)
+				continue;
+			peer = &rf->sw[sw->peer[p]];
+			if (peer->rank < 0) {
+				peer->rank = sw->rank + 1;
+				queue[tail++] = sw->peer[p];
+			}
+		}
+	}
+	free(queue);
+
+	for (i = 0; i < rf->nsw; i++) {
+		struct rb_switch *sw = &rf->sw[i];
+
+		for (p = 1; p <= sw->node->numports; p++) {
+			struct rb_switch *peer;
+
+			if (sw->peer[p] < 0)
+				continue;
+			peer = &rf->sw[sw->peer[p]];
+			if (sw->rank < 0 || peer->rank == sw->rank)
+				sw->link[p] = LINK_ACROSS;
+			else if (peer->rank > sw->rank)
+				sw->link[p] = LINK_UP;
+			else
+				sw->link[p] = LINK_DOWN;
+		}
+	}
+}
+
+static void setup(struct rb_fabric *rf, ibnd_fabric_t *fabric)
+{
+	cl_qmap_t map;
+	ibnd_node_t *node;
+	int i, p, missing = 0;
+	unsigned l;
+
+	memset(rf, 0, sizeof(*rf));
+	for (node = fabric->switches; node; node = node->type_next)
+		rf->nsw++;
+	if (!rf->nsw)
+		IBEXIT("no switches found");
+	if (!(rf->sw = calloc(rf->nsw, sizeof(*rf->sw))) ||
+	    !(rf->srcs = calloc(rf->nsw, sizeof(*rf->srcs))))
+		IBEXIT("out of memory");
+
+	cl_qmap_init(&map);
+	for (i = 0, node = fabric->switches; node; node = node->type_next) {
+		struct rb_switch *sw = &rf->sw[i++];
+
+		sw->node = node;
+		sw->name = remap_node_name(node_name_map, node->guid,
+					   node->nodedesc);
+		sw->base = rf->nports;
+		rf->nports += node->numports + 1;
+		if (!(sw->peer = calloc(node->numports + 1, sizeof(int))) ||
+		    !(sw->link = calloc(node->numports + 1, 1)))
+			IBEXIT("out of memory");
+		/* nothing routes through it; counted as lost */
+		if (!node->lft)
+			missing++;
+		cl_qmap_insert(&map, node->guid, &sw->map_item);
+	}
+	if (missing == rf->nsw)
+		IBEXIT("no forwarding tables");
+	if (missing)
+		IBWARN("%d switches have no LFT", missing);
+
+	for (i = 0; i < rf->nsw; i++) {
+		struct rb_switch *sw = &rf->sw[i];
+
+		for (p = 0; p <= sw->node->numports; p++) {
+			ibnd_port_t *port = sw->node->ports[p];
+			struct rb_switch *peer;
+
+			sw->peer[p] = -1;
+			if (!p || !port || !port->remoteport)
+				continue;
+			if (port->remoteport->node->type != IB_NODE_SWITCH) {
+				sw->link[p] = LINK_HOST;
+				continue;
+			}
+			if (!(peer = find_switch(&map, port->remoteport->node)))
+				continue;
+			sw->peer[p] = peer - rf->sw;
+			/* until ranked */
+			sw->link[p] = LINK_ACROSS;
+		}
+	}
+
+	/* destinations: every LID of the switch attached host ports */
+	for (node = fabric->nodes; node; node = node->next) {
+		if (node->type == IB_NODE_SWITCH)
+			continue;
+		for (p = 1; p <= node->numports; p++) {
+			ibnd_port_t *port = node->ports[p];
+			struct rb_switch *sw;
+
+			if (!port || !port->base_lid || !port->remoteport ||
+			    !(sw = find_switch(&map, port->remoteport->node)))
+				continue;
+			if (!sw->weight++)
+				rf->srcs[rf->nsrcs++] = sw - rf->sw;
+			while (rf->ndest + (1 << port->lmc) > rf->dest_size) {
+				rf->dest_size = rf->dest_size ?
+						2 * rf->dest_size : 1024;
+				rf->dest = realloc(rf->dest, rf->dest_size *
+						   sizeof(*rf->dest));
+				if (!rf->dest)
+					IBEXIT("out of memory");
+			}
+			for (l = 0; l < (1u << port->lmc); l++) {
+				rf->dest[rf->ndest].lid = port->base_lid + l;
+				rf->dest[rf->ndest++].sw = sw - rf->sw;
+			}
+		}
+	}
+	if (!rf->ndest)
+		IBEXIT("no hosts found");
+
+	if (!(rf->count = calloc(rf->nports, sizeof(uint64_t))))
+		IBEXIT("out of memory");
+
+	rank_switches(rf);
+}
+
+static void check_balance(struct rb_fabric *rf)
+{
+	int i, p;
+
+	for (i = 0; i < rf->nsw; i++) {
+		struct rb_switch *sw = &rf->sw[i];
+		uint64_t *count = rf->count + sw->base, allowed;
+
+		sw->min = UINT64_MAX;
+		sw->max = 0;
+		for (p = 1; p <= sw->node->numports; p++) {
+			if (sw->link[p] != LINK_UP)
+				continue;
+			sw->uplinks++;
+			if (count[p] < sw->min)
+				sw->min = count[p];
+			if (count[p] > sw->max)
+				sw->max = count[p];
+		}
+		if (sw->uplinks < 2)
+			continue;
+		if (slack >= 0)
+			allowed = slack;
+		else if (paths)
+			allowed = sw->max / 10;
+		else
+			allowed = 1;
+		sw->unbalanced = sw->max - sw->min > allowed;
+	}
+}
+
+static char *remote_name(ibnd_port_t *port)
+{
+	ibnd_node_t *node = port->remoteport->node;
+
+	return remap_node_name(node_name_map, node->guid, node->nodedesc);
+}
+
+static void print_switch(struct rb_fabric *rf, struct rb_switch *sw)
+{
+	uint64_t *count = rf->count + sw->base;
+	const char *what = paths ? "paths" : "destinations";
+	int p;
+
+	printf("%s 0x%016" PRIx64 " \"%s\" lid %d: ",
+	       sw->unbalanced ? "Unbalanced switch" : "Switch",
+	       sw->node->guid, sw->name, sw->node->smalid);
+	if (sw->uplinks)
+		printf("up-links carry %" PRIu64 " to %" PRIu64 " %s\n",
+		       sw->min, sw->max, what);
+	else
+		printf("no up-links\n");
+
+	for (p = 1; p <= sw->node->numports; p++) {
+		ibnd_port_t *port = sw->node->ports[p];
+		char *rname;
+
+		if (sw->link[p] == LINK_NONE)
+			continue;
+		rname = remote_name(port);
+		printf("   port %3d %-6s -> 0x%016" PRIx64 " port %3d \"%s\": "
+		       "%" PRIu64 "\n", p, link_str[sw->link[p]],
+		       port->remoteport->node->guid,
+		       port->remoteport->portnum, rname, count[p]);
+		free(rname);
+	}
+}
+
+static void csv_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"')
+			putchar('"');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+static void print_csv(struct rb_fabric *rf)
+{
+	int i, p;
+
+	printf("switch_guid,switch_name,switch_lid,port,link,%s,"
+	       "remote_guid,remote_port,remote_name,unbalanced\n",
+	       paths ? "paths" : "destinations");
+	for (i = 0; i < rf->nsw; i++) {
+		struct rb_switch *sw = &rf->sw[i];
+
+		for (p = 1; p <= sw->node->numports; p++) {
+			ibnd_port_t *port = sw->node->ports[p];
+			char *rname;
+
+			if (sw->link[p] == LINK_NONE)
+				continue;
+			rname = remote_name(port);
+			printf("0x%016" PRIx64 ",", sw->node->guid);
+			csv_string(sw->name);
+			printf(",%d,%d,%s,%" PRIu64 ",0x%016" PRIx64 ",%d,",
+			       sw->node->smalid, p, link_str[sw->link[p]],
+			       rf->count[sw->base + p],
+			       port->remoteport->node->guid,
+			       port->remoteport->portnum);
+			csv_string(rname);
+			printf(",%d\n", sw->unbalanced);
+			free(rname);
+		}
+	}
+}
+
+/* how the up-link loads spread over the fabric */
+static void print_histogram(struct rb_fabric *rf)
+{
+	uint64_t lo = UINT64_MAX, hi = 0, width, c;
+	unsigned hist[HIST_BUCKETS] = { 0 }, top = 0;
+	int i, p, b, nb;
+
+	for (i = 0; i < rf->nsw; i++)
+		for (p = 1; p <= rf->sw[i].node->numports; p++) {
+			if (rf->sw[i].link[p] != LINK_UP)
+				continue;
+			c = rf->count[rf->sw[i].base + p];
+			if (c < lo)
+				lo = c;
+			if (c > hi)
+				hi = c;
+		}
+	if (lo > hi) {
+		printf("No up-links\n");
+		return;
+	}
+
+	nb = hi - lo + 1 < HIST_BUCKETS ? hi - lo + 1 : HIST_BUCKETS;
+	width = (hi - lo + nb) / nb;
+	for (i = 0; i < rf->nsw; i++)
+		for (p = 1; p <= rf->sw[i].node->numports; p++) {
+			if (rf->sw[i].link[p] != LINK_UP)
+				continue;
+			b = (rf->count[rf->sw[i].base + p] - lo) / width;
+			if (++hist[b] > top)
+				top = hist[b];
+		}
+
+	printf("Up-links by %s routed:\n", paths ? "paths" : "destinations");
+	for (b = 0; b < nb; b++) {
+		int bar = (uint64_t)hist[b] * HIST_WIDTH / top;
+
+		if (width == 1)
+			printf("  %12" PRIu64 "              ", lo + b * width);
+		else
+			printf("  %12" PRIu64 " - %12" PRIu64 " ", lo + b * width,
+			       lo + (b + 1) * width - 1);
+		printf("%8u %.*s\n", hist[b], bar ? bar : !!hist[b],
+		       "##################################################");
+	}
+}
+
+static void print_summary(struct rb_fabric *rf)
+{
+	int i, with_uplinks = 0, unbalanced = 0;
+
+	for (i = 0; i < rf->nsw; i++) {
+		with_uplinks += rf->sw[i].uplinks > 1;
+		unbalanced += rf->sw[i].unbalanced;
+	}
+	printf("%d switches, %d host LIDs: %d switches with up-links, "
+	       "%d unbalanced\n", rf->nsw, rf->ndest, with_uplinks,
+	       unbalanced);
+	if (rf->lost)
+		printf("%" PRIu64 " %s not routed to a host\n", rf->lost,
+		       paths ? "paths" : "switch LFT entries");
+}
+
+static void free_rb_fabric(struct rb_fabric *rf)
+{
+	int i;
+
+	for (i = 0; i < rf->nsw; i++) {
+		free(rf->sw[i].name);
+		free(rf->sw[i].peer);
+		free(rf->sw[i].link);
+	}
+	free(rf->sw);
+	free(rf->srcs);
+	free(rf->dest);
+	free(rf->count);
+}
+
+static int process_opt(void *context, int ch, char *optarg)
+{
+	struct ibnd_config *cfg = context;
+	char *end;
+
+	switch (ch) {
+	case 1:
+		node_name_map_file = strdup(optarg);
+		break;
+	case 2:
+		load_cache_file = strdup(optarg);
+		break;
+	case 3:
+		cached_fts = 1;
+		break;
+	case 4:
+		nthreads = strtoul(optarg, NULL, 0);
+		break;
+	case 5:
+		slack = strtol(optarg, &end, 0);
+		if (*end || slack < 0)
+			IBEXIT("invalid slack %s", optarg);
+		break;
+	case 6:
+		csv = 1;
+		break;
+	case 7:
+		histogram = 1;
+		break;
+	case 'p':
+		paths = 1;
+		break;
+	case 'o':
+		cfg->max_smps = strtoul(optarg, NULL, 0);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct ibnd_config config = { 0 };
+	ibnd_fabric_t *fabric = NULL;
+	struct rb_fabric rf;
+	int i, rc;
+
+	const struct ibdiag_opt opts[] = {
+		{"node-name-map", 1, 1, "<file>", "node name map file"},
+		{"load-cache", 2, 1, "<file>",
+		 "filename of ibnetdiscover cache to load"},
+		{"cached-fts", 3, 0, NULL,
+		 "use the forwarding tables stored in the cache instead of "
+		 "reading them"},
+		{"paths", 'p', 0, NULL,
+		 "count the paths between all host ports, not destinations"},
+		{"threads", 4, 1, "<n>",
+		 "number of threads counting routes (default: one per CPU)"},
+		{"slack", 5, 1, "<n>",
+		 "allowed difference between the busiest and least used "
+		 "up-link of a switch"},
+		{"csv", 6, 0, NULL, "print the count of every port as CSV"},
+		{"histogram", 7, 0, NULL,
+		 "print a histogram of the up-link counts"},
+		{"outstanding_smps", 'o', 1, NULL,
+		 "specify the number of outstanding SMP's which should be "
+		 "issued during the scan"},
+		{0}
+	};
+	char usage_args[] = "";
+	const char *usage_examples[] = {
+		"\t\t\t# unbalanced switches after reading the LFTs",
+		"-v --load-cache fabric.cache\t# all switches, LFTs read over LIDs",
+		"--paths --histogram\t# spread of all-pairs paths over up-links",
+		NULL,
+	};
+
+	ibd_daemon_supported = 1;
+	ibdiag_process_opts(argc, argv, &config, "DGKLs", opts, process_opt,
+			    usage_args, usage_examples);
+
+	argc -= optind;
+	argv += optind;
+
+	if (cached_fts && !load_cache_file)
+		IBEXIT("--cached-fts requires --load-cache");
+
+	node_name_map = open_node_name_map(node_name_map_file);
+
+	if (ibd_timeout)
+		config.timeout_ms = ibd_timeout;
+	config.flags = ibd_ibnetdisc_flags;
+	config.mkey = ibd_mkey;
+
+	if (load_cache_file) {
+		if (!(fabric = ibnd_load_fabric(load_cache_file, 0)))
+			IBEXIT("loading cached fabric failed");
+	} else if (!(fabric = ibdiag_discover_fabric(ibd_ca, ibd_ca_port,
+						     &config, NULL)))
+		IBEXIT("discover failed");
+
+	if (!cached_fts) {
+		rc = ibnd_load_fts(fabric, ibd_ca, ibd_ca_port, &config,
+				   IBND_FTS_UNICAST);
+		if (rc == -EIO)
+			IBWARN("some forwarding table blocks could not be read");
+		else if (rc)
+			IBEXIT("reading forwarding tables failed");
+	}
+
+	setup(&rf, fabric);
+	if (count_routes(&rf))
+		IBEXIT("out of memory");
+	check_balance(&rf);
+
+	if (csv)
+		print_csv(&rf);
+	else {
+		if (histogram)
+			print_histogram(&rf);
+		else
+			for (i = 0; i < rf.nsw; i++)
+				if (ibverbose || rf.sw[i].unbalanced)
+					print_switch(&rf, &rf.sw[i]);
+		print_summary(&rf);
+	}
+
+	free_rb_fabric(&rf);
+	ibnd_destroy_fabric(fabric);
+	close_node_name_map(node_name_map);
+	exit(0);
+}
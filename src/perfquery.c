@@ -40,6 +40,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <netinet/in.h>
@@ -108,9 +111,47 @@ static uint8_t pc[1024];
 struct perf_count perf_count = {0};
 struct perf_count_ext perf_count_ext = {0};
 
+static const struct ibdiag_field counter_fields[] = {
+	{"lid", IBDIAG_FIELD_UINT},
+	{"port", IBDIAG_FIELD_UINT},
+	{"cap_mask", IBDIAG_FIELD_UINT},
+	{"cap_mask2", IBDIAG_FIELD_UINT},
+	{"extended", IBDIAG_FIELD_UINT},
+	IBDIAG_COUNTER_FIELDS,
+	{0}
+};
+
+static struct ibdiag_out out;
+static struct ibdiag_rec rec;
+
 #define ALL_PORTS 0xFF
 #define MAX_PORTS 255
 
+/* --format: the counters in pc as a record */
+static void output_counters_rec(int extended, uint16_t cap_mask,
+				uint32_t cap_mask2, ib_portid_t * portid,
+				int port)
+{
+	struct ib_perfcounters_decoded d;
+	struct ib_perfcounters_ext_decoded e;
+
+	ibdiag_rec_begin(&rec);
+	ibdiag_rec_uint(&rec, portid->lid);
+	ibdiag_rec_uint(&rec, port);
+	ibdiag_rec_uint(&rec, ntohs(cap_mask));
+	ibdiag_rec_uint(&rec, cap_mask2);
+	ibdiag_rec_uint(&rec, extended);
+	if (extended) {
+		mad_decode_perfcounters_ext(pc, &e);
+		ibdiag_rec_counters(&rec, NULL, &e, htonl(cap_mask2) &
+				    IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP);
+	} else {
+		mad_decode_perfcounters(pc, &d);
+		ibdiag_rec_counters(&rec, &d, NULL, 0);
+	}
+	ibdiag_rec_end(&rec);
+}
+
 /* Notes: IB semantics is to cap counters if count has exceeded limits.
  * Therefore we must check for overflows and cap the counters if necessary.
  *
@@ -162,46 +203,34 @@ static void aggregate_64bit(uint64_t * dest, uint64_t val)
 
 static void aggregate_perfcounters(void)
 {
-	uint32_t val;
-
-	mad_decode_field(pc, IB_PC_PORT_SELECT_F, &val);
-	perf_count.portselect = val;
-	mad_decode_field(pc, IB_PC_COUNTER_SELECT_F, &val);
-	perf_count.counterselect = val;
-	mad_decode_field(pc, IB_PC_ERR_SYM_F, &val);
-	aggregate_16bit(&perf_count.symbolerrors, val);
-	mad_decode_field(pc, IB_PC_LINK_RECOVERS_F, &val);
-	aggregate_8bit(&perf_count.linkrecovers, val);
-	mad_decode_field(pc, IB_PC_LINK_DOWNED_F, &val);
-	aggregate_8bit(&perf_count.linkdowned, val);
-	mad_decode_field(pc, IB_PC_ERR_RCV_F, &val);
-	aggregate_16bit(&perf_count.rcverrors, val);
-	mad_decode_field(pc, IB_PC_ERR_PHYSRCV_F, &val);
-	aggregate_16bit(&perf_count.rcvremotephyerrors, val);
-	mad_decode_field(pc, IB_PC_ERR_SWITCH_REL_F, &val);
-	aggregate_16bit(&perf_count.rcvswrelayerrors, val);
-	mad_decode_field(pc, IB_PC_XMT_DISCARDS_F, &val);
-	aggregate_16bit(&perf_count.xmtdiscards, val);
-	mad_decode_field(pc, IB_PC_ERR_XMTCONSTR_F, &val);
-	aggregate_8bit(&perf_count.xmtconstrainterrors, val);
-	mad_decode_field(pc, IB_PC_ERR_RCVCONSTR_F, &val);
-	aggregate_8bit(&perf_count.rcvconstrainterrors, val);
-	mad_decode_field(pc, IB_PC_ERR_LOCALINTEG_F, &val);
-	aggregate_4bit(&perf_count.linkintegrityerrors, val);
-	mad_decode_field(pc, IB_PC_ERR_EXCESS_OVR_F, &val);
-	aggregate_4bit(&perf_count.excbufoverrunerrors, val);
-	mad_decode_field(pc, IB_PC_VL15_DROPPED_F, &val);
-	aggregate_16bit(&perf_count.vl15dropped, val);
-	mad_decode_field(pc, IB_PC_XMT_BYTES_F, &val);
-	aggregate_32bit(&perf_count.xmtdata, val);
-	mad_decode_field(pc, IB_PC_RCV_BYTES_F, &val);
-	aggregate_32bit(&perf_count.rcvdata, val);
-	mad_decode_field(pc, IB_PC_XMT_PKTS_F, &val);
-	aggregate_32bit(&perf_count.xmtpkts, val);
-	mad_decode_field(pc, IB_PC_RCV_PKTS_F, &val);
-	aggregate_32bit(&perf_count.rcvpkts, val);
-	mad_decode_field(pc, IB_PC_XMT_WAIT_F, &val);
-	aggregate_32bit(&perf_count.xmtwait, val);
+	struct ib_perfcounters_decoded d;
+
+	mad_decode_perfcounters(pc, &d);
+	perf_count.portselect = d.port_select;
+	perf_count.counterselect = d.counter_select;
+	aggregate_16bit(&perf_count.symbolerrors, d.symbol_errors);
+	aggregate_8bit(&perf_count.linkrecovers, d.link_recovers);
+	aggregate_8bit(&perf_count.linkdowned, d.link_downed);
+	aggregate_16bit(&perf_count.rcverrors, d.rcv_errors);
+	aggregate_16bit(&perf_count.rcvremotephyerrors,
+			d.rcv_remote_phys_errors);
+	aggregate_16bit(&perf_count.rcvswrelayerrors,
+			d.rcv_switch_relay_errors);
+	aggregate_16bit(&perf_count.xmtdiscards, d.xmt_discards);
+	aggregate_8bit(&perf_count.xmtconstrainterrors,
+		       d.xmt_constraint_errors);
+	aggregate_8bit(&perf_count.rcvconstrainterrors,
+		       d.rcv_constraint_errors);
+	aggregate_4bit(&perf_count.linkintegrityerrors,
+		       d.link_integrity_errors);
+	aggregate_4bit(&perf_count.excbufoverrunerrors,
+		       d.excessive_buffer_overrun_errors);
+	aggregate_16bit(&perf_count.vl15dropped, d.vl15_dropped);
+	aggregate_32bit(&perf_count.xmtdata, d.xmt_data);
+	aggregate_32bit(&perf_count.rcvdata, d.rcv_data);
+	aggregate_32bit(&perf_count.xmtpkts, d.xmt_pkts);
+	aggregate_32bit(&perf_count.rcvpkts, d.rcv_pkts);
+	aggregate_32bit(&perf_count.xmtwait, d.xmt_wait);
 }
 
 static void output_aggregate_perfcounters(ib_portid_t * portid,
@@ -237,6 +266,11 @@ static void output_aggregate_perfcounters(ib_portid_t * portid,
 	mad_encode_field(pc, IB_PC_RCV_PKTS_F, &perf_count.rcvpkts);
 	mad_encode_field(pc, IB_PC_XMT_WAIT_F, &perf_count.xmtwait);
 
+	if (ibd_format != IBDIAG_FORMAT_TEXT) {
+		output_counters_rec(0, cap_mask, 0, portid, ALL_PORTS);
+		return;
+	}
+
 	mad_dump_perfcounters(buf, sizeof buf, pc, sizeof pc);
 
 	printf("# Port counters: %s port %d (CapMask: 0x%02X)\n%s",
@@ -245,64 +279,53 @@ static void output_aggregate_perfcounters(ib_portid_t * portid,
 
 static void aggregate_perfcounters_ext(uint16_t cap_mask, uint32_t cap_mask2)
 {
-	uint32_t val;
-	uint64_t val64;
-
-	mad_decode_field(pc, IB_PC_EXT_PORT_SELECT_F, &val);
-	perf_count_ext.portselect = val;
-	mad_decode_field(pc, IB_PC_EXT_COUNTER_SELECT_F, &val);
-	perf_count_ext.counterselect = val;
-	mad_decode_field(pc, IB_PC_EXT_XMT_BYTES_F, &val64);
-	aggregate_64bit(&perf_count_ext.portxmitdata, val64);
-	mad_decode_field(pc, IB_PC_EXT_RCV_BYTES_F, &val64);
-	aggregate_64bit(&perf_count_ext.portrcvdata, val64);
-	mad_decode_field(pc, IB_PC_EXT_XMT_PKTS_F, &val64);
-	aggregate_64bit(&perf_count_ext.portxmitpkts, val64);
-	mad_decode_field(pc, IB_PC_EXT_RCV_PKTS_F, &val64);
-	aggregate_64bit(&perf_count_ext.portrcvpkts, val64);
+	struct ib_perfcounters_ext_decoded d;
+
+	mad_decode_perfcounters_ext(pc, &d);
+	perf_count_ext.portselect = d.port_select;
+	perf_count_ext.counterselect = d.counter_select;
+	aggregate_64bit(&perf_count_ext.portxmitdata, d.xmt_data);
+	aggregate_64bit(&perf_count_ext.portrcvdata, d.rcv_data);
+	aggregate_64bit(&perf_count_ext.portxmitpkts, d.xmt_pkts);
+	aggregate_64bit(&perf_count_ext.portrcvpkts, d.rcv_pkts);
 
 	if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED) {
-		mad_decode_field(pc, IB_PC_EXT_XMT_UPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portunicastxmitpkts, val64);
-		mad_decode_field(pc, IB_PC_EXT_RCV_UPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portunicastrcvpkts, val64);
-		mad_decode_field(pc, IB_PC_EXT_XMT_MPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portmulticastxmitpkits, val64);
-		mad_decode_field(pc, IB_PC_EXT_RCV_MPKTS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portmulticastrcvpkts, val64);
+		aggregate_64bit(&perf_count_ext.portunicastxmitpkts,
+				d.xmt_upkts);
+		aggregate_64bit(&perf_count_ext.portunicastrcvpkts,
+				d.rcv_upkts);
+		aggregate_64bit(&perf_count_ext.portmulticastxmitpkits,
+				d.xmt_mpkts);
+		aggregate_64bit(&perf_count_ext.portmulticastrcvpkts,
+				d.rcv_mpkts);
 	}
 
 	if (htonl(cap_mask2) & IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP) {
-		mad_decode_field(pc, IB_PC_EXT_COUNTER_SELECT2_F, &val);
-		perf_count_ext.counterSelect2 = val;
-		mad_decode_field(pc, IB_PC_EXT_ERR_SYM_F, &val64);
-		aggregate_64bit(&perf_count_ext.symbolErrorCounter, val64);
-		mad_decode_field(pc, IB_PC_EXT_LINK_RECOVERS_F, &val64);
-		aggregate_64bit(&perf_count_ext.linkErrorRecoveryCounter, val64);
-		mad_decode_field(pc, IB_PC_EXT_LINK_DOWNED_F, &val64);
-		aggregate_64bit(&perf_count_ext.linkDownedCounter, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_RCV_F, &val64);
-		aggregate_64bit(&perf_count_ext.portRcvErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_PHYSRCV_F, &val64);
-		aggregate_64bit(&perf_count_ext.portRcvRemotePhysicalErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_SWITCH_REL_F, &val64);
-		aggregate_64bit(&perf_count_ext.portRcvSwitchRelayErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_XMT_DISCARDS_F, &val64);
-		aggregate_64bit(&perf_count_ext.portXmitDiscards, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_XMTCONSTR_F, &val64);
-		aggregate_64bit(&perf_count_ext.portXmitConstraintErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_RCVCONSTR_F, &val64);
-		aggregate_64bit(&perf_count_ext.portRcvConstraintErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_LOCALINTEG_F, &val64);
-		aggregate_64bit(&perf_count_ext.localLinkIntegrityErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_ERR_EXCESS_OVR_F, &val64);
-		aggregate_64bit(&perf_count_ext.excessiveBufferOverrunErrors, val64);
-		mad_decode_field(pc, IB_PC_EXT_VL15_DROPPED_F, &val64);
-		aggregate_64bit(&perf_count_ext.VL15Dropped, val64);
-		mad_decode_field(pc, IB_PC_EXT_XMT_WAIT_F, &val64);
-		aggregate_64bit(&perf_count_ext.portXmitWait, val64);
-		mad_decode_field(pc, IB_PC_EXT_QP1_DROP_F, &val64);
-		aggregate_64bit(&perf_count_ext.QP1Dropped, val64);
+		perf_count_ext.counterSelect2 = d.counter_select2;
+		aggregate_64bit(&perf_count_ext.symbolErrorCounter,
+				d.symbol_errors);
+		aggregate_64bit(&perf_count_ext.linkErrorRecoveryCounter,
+				d.link_recovers);
+		aggregate_64bit(&perf_count_ext.linkDownedCounter,
+				d.link_downed);
+		aggregate_64bit(&perf_count_ext.portRcvErrors, d.rcv_errors);
+		aggregate_64bit(&perf_count_ext.portRcvRemotePhysicalErrors,
+				d.rcv_remote_phys_errors);
+		aggregate_64bit(&perf_count_ext.portRcvSwitchRelayErrors,
+				d.rcv_switch_relay_errors);
+		aggregate_64bit(&perf_count_ext.portXmitDiscards,
+				d.xmt_discards);
+		aggregate_64bit(&perf_count_ext.portXmitConstraintErrors,
+				d.xmt_constraint_errors);
+		aggregate_64bit(&perf_count_ext.portRcvConstraintErrors,
+				d.rcv_constraint_errors);
+		aggregate_64bit(&perf_count_ext.localLinkIntegrityErrors,
+				d.link_integrity_errors);
+		aggregate_64bit(&perf_count_ext.excessiveBufferOverrunErrors,
+				d.excessive_buffer_overrun_errors);
+		aggregate_64bit(&perf_count_ext.VL15Dropped, d.vl15_dropped);
+		aggregate_64bit(&perf_count_ext.portXmitWait, d.xmt_wait);
+		aggregate_64bit(&perf_count_ext.QP1Dropped, d.qp1_dropped);
 	}
 }
 
@@ -370,6 +393,11 @@ static void output_aggregate_perfcounters_ext(ib_portid_t * portid,
 				 &perf_count_ext.QP1Dropped);
 	}
 
+	if (ibd_format != IBDIAG_FORMAT_TEXT) {
+		output_counters_rec(1, cap_mask, cap_mask2, portid, ALL_PORTS);
+		return;
+	}
+
 	mad_dump_perfcounters_ext(buf, sizeof buf, pc, sizeof pc);
 
 	printf("# Port extended counters: %s port %d (CapMask: 0x%02X CapMask2: 0x%07X)\n%s",
@@ -397,6 +425,9 @@ static void dump_perfcounters(int extended, int timeout, uint16_t cap_mask,
 		}
 		if (aggregate)
 			aggregate_perfcounters();
+		else if (ibd_format != IBDIAG_FORMAT_TEXT)
+			output_counters_rec(0, cap_mask, cap_mask2, portid,
+					    port);
 		else
 			mad_dump_fields(buf, sizeof buf, pc, sizeof pc,
 							IB_PC_FIRST_F,
@@ -418,12 +449,15 @@ static void dump_perfcounters(int extended, int timeout, uint16_t cap_mask,
 			IBEXIT("perfextquery");
 		if (aggregate)
 			aggregate_perfcounters_ext(cap_mask, cap_mask2);
+		else if (ibd_format != IBDIAG_FORMAT_TEXT)
+			output_counters_rec(1, cap_mask, cap_mask2, portid,
+					    port);
 		else
 			mad_dump_perfcounters_ext(buf, sizeof buf, pc,
 						  sizeof pc);
 	}
 
-	if (!aggregate) {
+	if (!aggregate && ibd_format == IBDIAG_FORMAT_TEXT) {
 		if (extended)
 			printf("# Port extended counters: %s port %d "
 			       "(CapMask: 0x%02X CapMask2: 0x%07X)\n%s",
@@ -457,6 +491,7 @@ static int reset, reset_only, all_ports, loop_ports, port, extended, xmt_sl,
     rcvcc, slrcvfecn, slrcvbecn, xmitcc, vlxmittimecc;
 static int ports[MAX_PORTS];
 static int ports_count;
+static double watch_interval;
 
 static void common_func(ib_portid_t * portid, int port_num, int mask,
 			unsigned query, unsigned reset,
@@ -697,8 +732,192 @@ void dump_portsamples_control(ib_portid_t * portid, int port)
 	       port, buf);
 }
 
+/* Watch mode: sample counters every watch_interval seconds, without
+ * resetting them, and print the per interval rates.
+ */
+#define WATCH_NUM_ERRS 12
+
+static const enum MAD_FIELDS watch_err_fields[WATCH_NUM_ERRS] = {
+	IB_PC_ERR_SYM_F, IB_PC_LINK_RECOVERS_F, IB_PC_LINK_DOWNED_F,
+	IB_PC_ERR_RCV_F, IB_PC_ERR_PHYSRCV_F, IB_PC_ERR_SWITCH_REL_F,
+	IB_PC_XMT_DISCARDS_F, IB_PC_ERR_XMTCONSTR_F, IB_PC_ERR_RCVCONSTR_F,
+	IB_PC_ERR_LOCALINTEG_F, IB_PC_ERR_EXCESS_OVR_F, IB_PC_VL15_DROPPED_F
+};
+
+static const enum MAD_FIELDS watch_ext_err_fields[WATCH_NUM_ERRS] = {
+	IB_PC_EXT_ERR_SYM_F, IB_PC_EXT_LINK_RECOVERS_F,
+	IB_PC_EXT_LINK_DOWNED_F, IB_PC_EXT_ERR_RCV_F, IB_PC_EXT_ERR_PHYSRCV_F,
+	IB_PC_EXT_ERR_SWITCH_REL_F, IB_PC_EXT_XMT_DISCARDS_F,
+	IB_PC_EXT_ERR_XMTCONSTR_F, IB_PC_EXT_ERR_RCVCONSTR_F,
+	IB_PC_EXT_ERR_LOCALINTEG_F, IB_PC_EXT_ERR_EXCESS_OVR_F,
+	IB_PC_EXT_VL15_DROPPED_F
+};
+
+struct watch_sample {
+	int valid;
+	struct timespec time;
+	uint64_t xmtdata;
+	uint64_t rcvdata;
+	uint64_t xmtpkts;
+	uint64_t rcvpkts;
+	uint64_t errs[WATCH_NUM_ERRS];
+};
+
+static int watch_read(ib_portid_t * portid, int port_num, int ext,
+		      int ext_errs, struct watch_sample *s)
+{
+	uint32_t val;
+	int i;
+
+	if (ext) {
+		memset(pc, 0, sizeof(pc));
+		if (!pma_query_via(pc, portid, port_num, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS_EXT, srcport))
+			return -1;
+		mad_decode_field(pc, IB_PC_EXT_XMT_BYTES_F, &s->xmtdata);
+		mad_decode_field(pc, IB_PC_EXT_RCV_BYTES_F, &s->rcvdata);
+		mad_decode_field(pc, IB_PC_EXT_XMT_PKTS_F, &s->xmtpkts);
+		mad_decode_field(pc, IB_PC_EXT_RCV_PKTS_F, &s->rcvpkts);
+		for (i = 0; ext_errs && i < WATCH_NUM_ERRS; i++)
+			mad_decode_field(pc, watch_ext_err_fields[i],
+					 &s->errs[i]);
+	}
+
+	if (!ext || !ext_errs) {
+		memset(pc, 0, sizeof(pc));
+		if (!pma_query_via(pc, portid, port_num, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS, srcport))
+			return -1;
+		if (!ext) {
+			mad_decode_field(pc, IB_PC_XMT_BYTES_F, &val);
+			s->xmtdata = val;
+			mad_decode_field(pc, IB_PC_RCV_BYTES_F, &val);
+			s->rcvdata = val;
+			mad_decode_field(pc, IB_PC_XMT_PKTS_F, &val);
+			s->xmtpkts = val;
+			mad_decode_field(pc, IB_PC_RCV_PKTS_F, &val);
+			s->rcvpkts = val;
+		}
+		for (i = 0; i < WATCH_NUM_ERRS; i++) {
+			mad_decode_field(pc, watch_err_fields[i], &val);
+			s->errs[i] = val;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &s->time);
+	s->valid = 1;
+	return 0;
+}
+
+/* PortCounters saturate rather than wrap (the 32 bit data and packet
+ * counters stop at 2^32-1, which then reads as no traffic), and the 64
+ * bit PortCountersExtended ones do not wrap in practice; a counter which
+ * went backwards was cleared by someone else since the previous sample.
+ */
+static uint64_t watch_delta(uint64_t prev, uint64_t cur)
+{
+	return cur >= prev ? cur - prev : cur;
+}
+
+static void watch_print(int port_num, int ext, struct watch_sample *prev,
+			struct watch_sample *cur, struct timespec *start)
+{
+	double secs, elapsed;
+	uint64_t errs = 0;
+	int i;
+
+	secs = (cur->time.tv_sec - prev->time.tv_sec) +
+	    (cur->time.tv_nsec - prev->time.tv_nsec) / 1e9;
+	elapsed = (cur->time.tv_sec - start->tv_sec) +
+	    (cur->time.tv_nsec - start->tv_nsec) / 1e9;
+	if (secs <= 0)
+		return;
+
+	for (i = 0; i < WATCH_NUM_ERRS; i++)
+		errs += watch_delta(prev->errs[i], cur->errs[i]);
+
+	/* data counters are in units of 4 octets */
+	printf("%12.3f %4d %14.0f %14.0f %12.0f %12.0f %10.1f\n",
+	       elapsed, port_num,
+	       4.0 * watch_delta(prev->xmtdata, cur->xmtdata) / secs,
+	       4.0 * watch_delta(prev->rcvdata, cur->rcvdata) / secs,
+	       watch_delta(prev->xmtpkts, cur->xmtpkts) / secs,
+	       watch_delta(prev->rcvpkts, cur->rcvpkts) / secs,
+	       errs / secs);
+}
+
+static void watch_counters(ib_portid_t * portid, int *port_list, int nports,
+			   uint16_t cap_mask, uint32_t cap_mask2)
+{
+	struct watch_sample *prev, cur;
+	struct timespec start, next;
+	long step_ns = (long)(watch_interval * 1e9);
+	int ext, ext_errs, saturated = 0;
+	int i;
+
+	ext = (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED) ||
+	    (cap_mask & IB_PM_EXT_WIDTH_NOIETF_SUP);
+	ext_errs = ext && (htonl(cap_mask2) & IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP);
+
+	prev = calloc(nports, sizeof(*prev));
+	if (!prev)
+		IBEXIT("out of memory");
+
+	printf("# Watching %s every %g seconds (%s)\n", portid2str(portid),
+	       watch_interval, ext ? "PortCountersExtended" : "PortCounters");
+	printf("%12s %4s %14s %14s %12s %12s %10s\n", "# time", "port",
+	       "xmit_bytes/s", "rcv_bytes/s", "xmit_pkts/s", "rcv_pkts/s",
+	       "errors/s");
+	fflush(stdout);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+	for (;;) {
+		for (i = 0; i < nports; i++) {
+			memset(&cur, 0, sizeof(cur));
+			if (watch_read(portid, port_list[i], ext, ext_errs,
+				       &cur) < 0) {
+				IBWARN("PerfMgt query of %s port %d failed",
+				       portid2str(portid), port_list[i]);
+				prev[i].valid = 0;
+				continue;
+			}
+			if (!ext && !saturated &&
+			    (cur.xmtdata == 0xffffffff ||
+			     cur.rcvdata == 0xffffffff)) {
+				IBWARN("PortCounters data counters of port %d"
+				       " are saturated; rates will read 0 until"
+				       " they are reset", port_list[i]);
+				saturated = 1;
+			}
+			if (prev[i].valid)
+				watch_print(port_list[i], ext, &prev[i], &cur,
+					    &start);
+			prev[i] = cur;
+		}
+		fflush(stdout);
+
+		/* keep a fixed cadence; skip ticks the queries overran */
+		do {
+			next.tv_nsec += step_ns % 1000000000L;
+			next.tv_sec += step_ns / 1000000000L +
+			    next.tv_nsec / 1000000000L;
+			next.tv_nsec %= 1000000000L;
+			clock_gettime(CLOCK_MONOTONIC, &cur.time);
+		} while (cur.time.tv_sec > next.tv_sec ||
+			 (cur.time.tv_sec == next.tv_sec &&
+			  cur.time.tv_nsec >= next.tv_nsec));
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				       NULL) == EINTR)
+			;
+	}
+}
+
 static int process_opt(void *context, int ch, char *optarg)
 {
+	char *endp;
+
 	switch (ch) {
 	case 'x':
 		extended = 1;
@@ -757,6 +976,13 @@ static int process_opt(void *context, int ch, char *optarg)
 	case 12:
 		vlxmittimecc = 1;
 		break;
+	case 13:
+		watch_interval = strtod(optarg, &endp);
+		if (*endp || watch_interval <= 0) {
+			fprintf(stderr, "invalid watch interval: %s\n", optarg);
+			return -1;
+		}
+		break;
 	case 'a':
 		all_ports++;
 		port = ALL_PORTS;
@@ -816,6 +1042,8 @@ int main(int argc, char **argv)
 		{"loop_ports", 'l', 0, NULL, "iterate through each port"},
 		{"reset_after_read", 'r', 0, NULL, "reset counters after read"},
 		{"Reset_only", 'R', 0, NULL, "only reset counters"},
+		{"watch", 13, 1, "<seconds>",
+		 "print counter rates every <seconds> until interrupted"},
 		{0}
 	};
 	char usage_args[] = " [<lid|guid> [[port(s)] [reset_mask]]]";
@@ -835,15 +1063,31 @@ int main(int argc, char **argv)
 		"-l 32 1-10\t# read performance counters from lid 32, port 1-10, output each port",
 		"-a 32 1,4,8\t# read performance counters from lid 32, port 1, 4, and 8, aggregate output",
 		"-l 32 1,4,8\t# read performance counters from lid 32, port 1, 4, and 8, output each port",
+		"--watch 5 32 1\t# print counter rates of lid 32, port 1 every 5 seconds",
 		NULL,
 	};
 
+	ibd_format_supported = 1;
 	ibdiag_process_opts(argc, argv, NULL, "DK", opts, process_opt,
 			    usage_args, usage_examples);
 
 	argc -= optind;
 	argv += optind;
 
+	if (ibd_format != IBDIAG_FORMAT_TEXT &&
+	    (xmt_sl || rcv_sl || xmt_disc || rcv_err || extended_speeds ||
+	     oprcvcounters || flowctlcounters || vloppackets || vlopdata ||
+	     vlxmitflowctlerrors || vlxmitcounters || swportvlcong || rcvcc ||
+	     slrcvfecn || slrcvbecn || xmitcc || vlxmittimecc || smpl_ctl ||
+	     watch_interval > 0))
+		IBEXIT("--format is only available for PortCounters and "
+		       "PortCountersExtended");
+	ibdiag_out_init(&out, stdout);
+	ibdiag_rec_init(&rec, &out, counter_fields);
+
+	if (watch_interval > 0 && (reset || reset_only))
+		IBEXIT("--watch can not be combined with counter resets");
+
 	if (argc > 1) {
 		if (strchr(argv[1], ',')) {
 			tmpstr = strtok(argv[1], ",");
@@ -1024,6 +1268,24 @@ int main(int argc, char **argv)
 			    ("Emulating AllPortSelect by iterating through all ports");
 	}
 
+	if (watch_interval > 0) {
+		int watch_ports[MAX_PORTS + 1];
+		int nwatch = 0;
+
+		if (all_ports_loop ||
+		    (loop_ports && (all_ports || port == ALL_PORTS))) {
+			for (i = start_port; i <= num_ports; i++)
+				watch_ports[nwatch++] = i;
+		} else if (ports_count > 1) {
+			for (i = 0; i < ports_count; i++)
+				watch_ports[nwatch++] = ports[i];
+		} else
+			watch_ports[nwatch++] = port;
+
+		watch_counters(&portid, watch_ports, nwatch, cap_mask,
+			       cap_mask2);
+	}
+
 	if (reset_only)
 		goto do_reset;
 
@@ -1084,5 +1346,7 @@ do_reset:
 
 done:
 	mad_rpc_close_port(srcport);
+	if (ibdiag_out_close(&out))
+		IBEXIT("writing the counters failed");
 	exit(0);
 }
@@ -782,15 +782,14 @@ static void dump_one_mft_record(void *data, struct query_params *p)
 	printf("\n");
 }
 
-static void dump_results(struct sa_query_result *r,
+static void dump_results(struct sa_cursor *c,
 			 void (*dump_func) (void *, struct query_params *),
 			 struct query_params *p)
 {
-	unsigned i;
-	for (i = 0; i < r->result_cnt; i++) {
-		void *data = sa_get_query_rec(r->p_result_madw, i);
+	void *data;
+
+	while ((data = sa_cursor_next(c)))
 		dump_func(data, p);
-	}
 }
 
 /**
@@ -817,6 +816,30 @@ static int get_any_records(struct sa_handle * h,
 	return ret;
 }
 
+/**
+ * Same as get_any_records, with the records left in the handle's buffer
+ */
+static int get_any_records_cursor(struct sa_handle * h,
+				  uint16_t attr_id, uint32_t attr_mod,
+				  ib_net64_t comp_mask, void *attr,
+				  size_t attr_size, struct sa_cursor *c)
+{
+	int ret = sa_query_cursor(h, IB_MAD_METHOD_GET_TABLE, attr_id,
+				  attr_mod, cl_ntoh64(comp_mask), ibd_sakey,
+				  attr, attr_size, c);
+	if (ret) {
+		fprintf(stderr, "Query SA failed: %s\n", strerror(ret));
+		return ret;
+	}
+
+	if (c->status != IB_SA_MAD_STATUS_SUCCESS) {
+		sa_report_err(c->status);
+		return EIO;
+	}
+
+	return ret;
+}
+
 static int get_and_dump_any_records(struct sa_handle * h, uint16_t attr_id,
 				    uint32_t attr_mod, ib_net64_t comp_mask,
 				    void *attr,
@@ -825,14 +848,13 @@ static int get_and_dump_any_records(struct sa_handle * h, uint16_t attr_id,
 				    		       struct query_params *),
 				    struct query_params *p)
 {
-	struct sa_query_result result;
-	int ret = get_any_records(h, attr_id, attr_mod, comp_mask, attr,
-				  attr_size, &result);
+	struct sa_cursor c;
+	int ret = get_any_records_cursor(h, attr_id, attr_mod, comp_mask,
+					 attr, attr_size, &c);
 	if (ret)
 		return ret;
 
-	dump_results(&result, dump_func, p);
-	sa_free_result_mad(&result);
+	dump_results(&c, dump_func, p);
 	return 0;
 }
 
@@ -850,13 +872,12 @@ static int get_and_dump_all_records(struct sa_handle * h, uint16_t attr_id,
 						       struct query_params *p),
 				    struct query_params *p)
 {
-	struct sa_query_result result;
-	int ret = get_all_records(h, attr_id, &result);
+	struct sa_cursor c;
+	int ret = get_any_records_cursor(h, attr_id, 0, 0, NULL, 0, &c);
 	if (ret)
 		return ret;
 
-	dump_results(&result, dump_func, p);
-	sa_free_result_mad(&result);
+	dump_results(&c, dump_func, p);
 	return ret;
 }
 
@@ -971,15 +992,16 @@ static int parse_lid_and_ports(struct sa_handle * h,
  * Get the portinfo records available with IsSM or IsSMdisabled CapabilityMask bit on.
  */
 static int get_issm_records(struct sa_handle * h, ib_net32_t capability_mask,
-			    struct sa_query_result *result)
+			    struct sa_cursor *c)
 {
 	ib_portinfo_record_t attr;
 
 	memset(&attr, 0, sizeof(attr));
 	attr.port_info.capability_mask = capability_mask;
 
-	return get_any_records(h, IB_SA_ATTR_PORTINFORECORD, 1 << 31,
-			       IB_PIR_COMPMASK_CAPMASK, &attr, sizeof(attr), result);
+	return get_any_records_cursor(h, IB_SA_ATTR_PORTINFORECORD, 1 << 31,
+				      IB_PIR_COMPMASK_CAPMASK, &attr,
+				      sizeof(attr), c);
 }
 
 static int print_node_records(struct sa_handle * h, struct query_params *p)
@@ -1079,26 +1101,24 @@ static int query_path_records(const struct query_cmd *q, struct sa_handle * h,
 
 static int print_issm_records(struct sa_handle * h, struct query_params *p)
 {
-	struct sa_query_result result;
+	struct sa_cursor c;
 	int ret = 0;
 
 	/* First, get IsSM records */
-	ret = get_issm_records(h, IB_PORT_CAP_IS_SM, &result);
+	ret = get_issm_records(h, IB_PORT_CAP_IS_SM, &c);
 	if (ret != 0)
 		return (ret);
 
 	printf("IsSM ports\n");
-	dump_results(&result, dump_portinfo_record, p);
-	sa_free_result_mad(&result);
+	dump_results(&c, dump_portinfo_record, p);
 
 	/* Now, get IsSMdisabled records */
-	ret = get_issm_records(h, IB_PORT_CAP_SM_DISAB, &result);
+	ret = get_issm_records(h, IB_PORT_CAP_SM_DISAB, &c);
 	if (ret != 0)
 		return (ret);
 
 	printf("\nIsSMdisabled ports\n");
-	dump_results(&result, dump_portinfo_record, p);
-	sa_free_result_mad(&result);
+	dump_results(&c, dump_portinfo_record, p);
 
 	return (ret);
 }
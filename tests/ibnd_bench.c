@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+ * ibnd_bench: time libibnetdisc against simulated fabrics.
+ *
+ * Every scenario runs in its own process against the in-process fabric of
+ * src/ibdiag_sim.c and prints one JSON object per line, so that results
+ * can be collected and compared between builds.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <infiniband/mad.h>
+#include <infiniband/ibnetdisc.h>
+
+#include "ibdiag_sim.h"
+
+struct scenario {
+	const char *name;
+	unsigned nodes;		/* approximate, for --max-nodes */
+	const char *spec;
+};
+
+/* roughly 1k, 10k and 50k nodes of each shape; 50k is bounded by the
+ * unicast LID space */
+static const struct scenario scenarios[] = {
+	{"fattree-1k", 1344, "fattree=16"},
+	{"dragonfly-1k", 1024, "dragonfly=16:8:7"},
+	{"torus-1k", 1000, "torus=5:5:5:7"},
+	{"fattree-10k", 11271, "fattree=34"},
+	{"dragonfly-10k", 10240, "dragonfly=40:16:15"},
+	{"torus-10k", 10000, "torus=10:10:10:9"},
+	{"fattree-50k", 47824, "fattree=56"},
+	{"dragonfly-50k", 48960, "dragonfly=90:32:16"},
+	{"torus-50k", 45056, "torus=16:16:16:10"},
+	{NULL}
+};
+
+static char *argv0;
+static const char *extra = "";
+static unsigned max_nodes = ~0u;
+static unsigned iters = 1;
+static struct ibnd_config config;
+
+/* Count allocations made while discovering by interposing on the glibc
+ * allocator; elsewhere allocs are reported as -1. */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int counting;
+static unsigned long nallocs;
+
+void *malloc(size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_realloc(ptr, size);
+}
+#define COUNT_ALLOCS(on) (counting = (on))
+#define NALLOCS() ((long)nallocs)
+#else
+#define COUNT_ALLOCS(on)
+#define NALLOCS() (-1L)
+#endif
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct lookups {
+	unsigned n;
+	uint64_t *node_guids;
+	uint64_t *port_guids;
+	uint16_t *lids;
+	char **dr;
+};
+
+static void collect(ibnd_fabric_t *fabric, struct lookups *l,
+		    unsigned *nswitches, unsigned *nports)
+{
+	ibnd_node_t *node;
+	char buf[256];
+	unsigned n = 0;
+	int p;
+
+	*nswitches = *nports = 0;
+	for (node = fabric->nodes; node; node = node->next)
+		n++;
+	l->node_guids = calloc(n, sizeof(*l->node_guids));
+	l->port_guids = calloc(n, sizeof(*l->port_guids));
+	l->lids = calloc(n, sizeof(*l->lids));
+	l->dr = calloc(n, sizeof(*l->dr));
+	if (!l->node_guids || !l->port_guids || !l->lids || !l->dr) {
+		fprintf(stderr, "%s: out of memory\n", argv0);
+		exit(1);
+	}
+
+	for (n = 0, node = fabric->nodes; node; node = node->next, n++) {
+		if (node->type == IB_NODE_SWITCH)
+			(*nswitches)++;
+		for (p = 0; p <= node->numports; p++)
+			if (node->ports[p])
+				(*nports)++;
+		l->node_guids[n] = node->guid;
+		p = node->type == IB_NODE_SWITCH ? 0 : 1;
+		if (node->ports[p]) {
+			l->port_guids[n] = node->ports[p]->guid;
+			l->lids[n] = node->ports[p]->base_lid;
+		}
+		l->dr[n] = strdup(drpath2str(&node->path_portid.drpath, buf,
+					     sizeof(buf)));
+	}
+	l->n = n;
+}
+
+static void free_lookups(struct lookups *l)
+{
+	unsigned i;
+
+	for (i = 0; i < l->n; i++)
+		free(l->dr[i]);
+	free(l->dr);
+	free(l->node_guids);
+	free(l->port_guids);
+	free(l->lids);
+}
+
+/* ns per lookup; misses are counted in *failed */
+static double time_lookups(ibnd_fabric_t *fabric, struct lookups *l,
+			   int kind, unsigned *failed)
+{
+	double t = now_s();
+	unsigned i;
+	void *r = NULL;
+
+	for (i = 0; i < l->n; i++) {
+		switch (kind) {
+		case 0:
+			r = ibnd_find_node_guid(fabric, l->node_guids[i]);
+			break;
+		case 1:
+			r = ibnd_find_port_guid(fabric, l->port_guids[i]);
+			break;
+		case 2:
+			if (!l->lids[i])
+				continue;
+			r = ibnd_find_port_lid(fabric, l->lids[i]);
+			break;
+		case 3:
+			r = ibnd_find_node_dr(fabric, l->dr[i]);
+			break;
+		}
+		if (!r)
+			(*failed)++;
+	}
+	return l->n ? (now_s() - t) * 1e9 / l->n : 0;
+}
+
+static int run(const struct scenario *sc)
+{
+	struct ibmad_transport *tp;
+	ibnd_fabric_t *fabric, *loaded;
+	struct lookups l = { 0 };
+	struct rusage ru;
+	struct stat st;
+	unsigned nswitches, nports, failed = 0, i;
+	double t, discover = 0, cache, load, destroy, lookup[4];
+	unsigned mads = 0;
+	long allocs = 0;
+	char spec[512], file[64];
+
+	snprintf(spec, sizeof(spec), "%s%s", sc->spec, extra);
+	if (!(tp = sim_transport_create(spec))) {
+		fprintf(stderr, "%s: bad fabric spec %s\n", argv0, spec);
+		return -1;
+	}
+	mad_set_transport(tp);
+
+	/* best of iters; the last fabric is kept */
+	fabric = NULL;
+	for (i = 0; i < iters; i++) {
+		if (fabric)
+			ibnd_destroy_fabric(fabric);
+		t = now_s();
+		COUNT_ALLOCS(1);
+		fabric = ibnd_discover_fabric(NULL, 0, NULL, &config);
+		COUNT_ALLOCS(0);
+		t = now_s() - t;
+		if (!fabric) {
+			fprintf(stderr, "%s: %s: discover failed\n", argv0,
+				sc->name);
+			return -1;
+		}
+		if (!i || t < discover)
+			discover = t;
+		if (!i) {
+			allocs = NALLOCS();
+			mads = fabric->total_mads_used;
+		}
+	}
+	collect(fabric, &l, &nswitches, &nports);
+
+	snprintf(file, sizeof(file), "/tmp/ibnd_bench.%d.cache", (int)getpid());
+	t = now_s();
+	if (ibnd_cache_fabric(fabric, file, IBND_CACHE_FABRIC_FLAG_V2)) {
+		fprintf(stderr, "%s: %s: cache failed\n", argv0, sc->name);
+		return -1;
+	}
+	cache = now_s() - t;
+	if (stat(file, &st))
+		st.st_size = 0;
+
+	t = now_s();
+	loaded = ibnd_load_fabric(file, 0);
+	load = now_s() - t;
+	unlink(file);
+	if (!loaded) {
+		fprintf(stderr, "%s: %s: load failed\n", argv0, sc->name);
+		return -1;
+	}
+	ibnd_destroy_fabric(loaded);
+
+	for (i = 0; i < 4; i++)
+		lookup[i] = time_lookups(fabric, &l, i, &failed);
+
+	t = now_s();
+	ibnd_destroy_fabric(fabric);
+	destroy = now_s() - t;
+
+	getrusage(RUSAGE_SELF, &ru);
+	printf("{\"scenario\":\"%s\",\"spec\":\"%s\",\"nodes\":%u,"
+	       "\"switches\":%u,\"ports\":%u,\"discover_s\":%.6f,"
+	       "\"mads\":%u,\"mads_per_node\":%.2f,\"allocs\":%ld,"
+	       "\"allocs_per_node\":%.2f,\"cache_s\":%.6f,"
+	       "\"cache_bytes\":%lld,\"load_s\":%.6f,"
+	       "\"find_node_guid_ns\":%.1f,\"find_port_guid_ns\":%.1f,"
+	       "\"find_port_lid_ns\":%.1f,\"find_node_dr_ns\":%.1f,"
+	       "\"lookup_misses\":%u,\"destroy_s\":%.6f,"
+	       "\"peak_rss_kb\":%ld}\n",
+	       sc->name, spec, l.n, nswitches, nports, discover, mads,
+	       l.n ? (double)mads / l.n : 0, allocs,
+	       allocs >= 0 && l.n ? (double)allocs / l.n : -1, cache,
+	       (long long)st.st_size, load, lookup[0], lookup[1], lookup[2],
+	       lookup[3], failed, destroy, ru.ru_maxrss);
+	fflush(stdout);
+	free_lookups(&l);
+	return 0;
+}
+
+/* each scenario in a child, so that peak RSS is its own */
+static int run_forked(const struct scenario *sc)
+{
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	if ((pid = fork()) < 0) {
+		fprintf(stderr, "%s: fork: %s\n", argv0, strerror(errno));
+		return -1;
+	}
+	if (!pid)
+		_exit(run(sc) ? 1 : 0);
+	if (waitpid(pid, &status, 0) < 0)
+		return -1;
+	if (WIFSIGNALED(status)) {
+		fprintf(stderr, "%s: %s killed by signal %d\n", argv0,
+			sc->name, WTERMSIG(status));
+		return -1;
+	}
+	if (WEXITSTATUS(status)) {
+		fprintf(stderr, "%s: %s failed\n", argv0, sc->name);
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	const struct scenario *sc;
+
+	fprintf(stderr,
+		"Usage: %s [-h -i <iters> -m <max nodes> -o <outstanding> "
+		"-e <spec params>] [<name>=<spec> ...]\n"
+		"   Time discovery, caching and lookups on simulated fabrics\n"
+		"   -i <iters> discovery runs per scenario, best is reported\n"
+		"   -m <nodes> skip scenarios larger than this\n"
+		"   -o <outstanding> max SMPs on the wire\n"
+		"   -e <params> appended to every spec, e.g. \",latency=5\"\n"
+		"   Default scenarios:\n", argv0);
+	for (sc = scenarios; sc->name; sc++)
+		fprintf(stderr, "      %-14s %s\n", sc->name, sc->spec);
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	const struct scenario *sc;
+	struct scenario custom;
+	char *eq;
+	int ch, i, rc = 0;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "hi:m:o:e:")) != -1) {
+		switch (ch) {
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			if (!iters)
+				iters = 1;
+			break;
+		case 'm':
+			max_nodes = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			config.max_smps = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			extra = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc) {
+		for (i = 0; i < argc; i++) {
+			if (!(eq = strchr(argv[i], '=')))
+				usage();
+			*eq = '\0';
+			custom.name = argv[i];
+			custom.spec = eq + 1;
+			if (run_forked(&custom))
+				rc = 1;
+		}
+		return rc;
+	}
+
+	for (sc = scenarios; sc->name; sc++)
+		if (sc->nodes <= max_nodes && run_forked(sc))
+			rc = 1;
+	return rc;
+}
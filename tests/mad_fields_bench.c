@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2026 The infiniband-diags authors.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+/*
+ * mad_fields_bench: time the libibmad field accessors.
+ *
+ * Decodes a few PortInfo fields out of an array of records, as the tools
+ * do for every port of a fabric, through mad_get_field() and through the
+ * inline accessors of mad_fields.h, and prints one JSON object per line.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <infiniband/mad.h>
+#include <infiniband/mad_fields.h>
+
+#define NRECS	4096
+#define ROUNDS	200
+
+static const enum MAD_FIELDS fields[] = {
+	IB_PORT_LID_F,
+	IB_PORT_STATE_F,
+	IB_PORT_PHYS_STATE_F,
+	IB_PORT_LINK_WIDTH_ACTIVE_F,
+	IB_PORT_LINK_SPEED_ACTIVE_F,
+	IB_PORT_NEIGHBOR_MTU_F,
+	IB_PORT_LMC_F,
+	IB_PORT_SMSL_F,
+};
+#define NFIELDS	(sizeof(fields) / sizeof(fields[0]))
+
+static uint8_t recs[NRECS][IB_SMP_DATA_SIZE];
+static volatile uint32_t sink;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double t, uint32_t sum)
+{
+	printf("{\"accessor\":\"%s\",\"ns_per_field\":%.2f,\"sum\":%" PRIu32
+	       "}\n", name, t * 1e9 / ((double)NRECS * ROUNDS * NFIELDS), sum);
+}
+
+static void bench_library(void)
+{
+	double t = now_s();
+	uint32_t sum = 0;
+	unsigned r, i, f;
+
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NRECS; i++)
+			for (f = 0; f < NFIELDS; f++)
+				sum += mad_get_field(recs[i], 0, fields[f]);
+	report("mad_get_field", now_s() - t, sum);
+	sink = sum;
+}
+
+static void bench_fast(void)
+{
+	double t = now_s();
+	uint32_t sum = 0;
+	unsigned r, i, f;
+
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NRECS; i++)
+			for (f = 0; f < NFIELDS; f++)
+				sum += mad_get_field_fast(recs[i], 0,
+							  fields[f]);
+	report("mad_get_field_fast", now_s() - t, sum);
+	sink = sum;
+}
+
+/* the fields spelled out, as in the tools */
+static void bench_fast_const(void)
+{
+	double t = now_s();
+	uint32_t sum = 0;
+	unsigned r, i;
+
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NRECS; i++) {
+			uint8_t *p = recs[i];
+
+			sum += mad_get_field_fast(p, 0, IB_PORT_LID_F);
+			sum += mad_get_field_fast(p, 0, IB_PORT_STATE_F);
+			sum += mad_get_field_fast(p, 0, IB_PORT_PHYS_STATE_F);
+			sum += mad_get_field_fast(p, 0,
+						  IB_PORT_LINK_WIDTH_ACTIVE_F);
+			sum += mad_get_field_fast(p, 0,
+						  IB_PORT_LINK_SPEED_ACTIVE_F);
+			sum += mad_get_field_fast(p, 0, IB_PORT_NEIGHBOR_MTU_F);
+			sum += mad_get_field_fast(p, 0, IB_PORT_LMC_F);
+			sum += mad_get_field_fast(p, 0, IB_PORT_SMSL_F);
+		}
+	report("mad_get_field_fast/const", now_s() - t, sum);
+	sink = sum;
+}
+
+int main(void)
+{
+	unsigned i, j;
+
+	srand(1);
+	for (i = 0; i < NRECS; i++)
+		for (j = 0; j < IB_SMP_DATA_SIZE; j++)
+			recs[i][j] = rand();
+
+	bench_library();
+	bench_fast();
+	bench_fast_const();
+	return 0;
+}